@@ -0,0 +1,521 @@
+/******************************************************************************
+ *   @file AeadChannel.cpp                                                    *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "AeadChannel.h"
+#include "AeadCiphers.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+    const std::string ERR_MSG_NULL_KEY            = "The key must not be NULL." ;
+    const std::string ERR_MSG_EQUAL_IDENTIFIERS   = "Both ends of a channel must have different identifiers." ;
+    const std::string ERR_MSG_AES_GCM_UNSUPPORTED = "AES-GCM is not supported by this processor." ;
+    const std::string ERR_MSG_COUNTER_EXHAUSTED   = "The frame counter is exhausted. Replace the key." ;
+    const std::string ERR_MSG_NO_RANDOM_SALT      = "Cannot read a random salt from /dev/urandom." ;
+    const std::string ERR_MSG_NULL_SALT           = "The salt must not be NULL." ;
+    const std::string ERR_MSG_REMOTE_SALT_SET     = "The salt of the other end has already been set." ;
+    const std::string ERR_MSG_NO_REMOTE_SALT      = "The salt of the other end has not been set." ;
+
+    const uint64_t MAX_FRAME_COUNTER = ~static_cast<uint64_t>( 0 ) ;
+
+    /*
+     * Builds the nonce: the identifier of the sender followed by the
+     * frame counter, both big-endian.
+     */
+    inline
+    void
+    MakeNonce( unsigned char* nonce,
+               const uint32_t identifier,
+               const uint64_t counter )
+    {
+        for( int i=0; i<4; ++i )
+        {
+            nonce[i] = identifier >> ( 24 - 8 * i ) ;
+        }
+        for( int i=0; i<8; ++i )
+        {
+            nonce[ 4 + i ] = counter >> ( 56 - 8 * i ) ;
+        }
+    }
+
+    /*
+     * Fills buffer with random bytes from the kernel.
+     */
+    bool
+    ReadRandomBytes( unsigned char*     buffer,
+                     const unsigned int bufferSize )
+    {
+        const int fd = open( "/dev/urandom",
+                             O_RDONLY | O_CLOEXEC ) ;
+        if ( fd < 0 )
+        {
+            return false ;
+        }
+        unsigned int num_of_bytes = 0 ;
+        while( num_of_bytes < bufferSize )
+        {
+            const ssize_t result = read( fd,
+                                         buffer + num_of_bytes,
+                                         bufferSize - num_of_bytes ) ;
+            if ( result > 0 )
+            {
+                num_of_bytes += result ;
+            }
+            else if ( ( result < 0 ) && ( EINTR == errno ) )
+            {
+                continue ;
+            }
+            else
+            {
+                break ;
+            }
+        }
+        close( fd ) ;
+        return ( bufferSize == num_of_bytes ) ;
+    }
+}
+
+namespace LibSerial
+{
+    class AeadChannel::Implementation
+    {
+    public:
+        /*
+         * The expanded key of the selected algorithm.
+         */
+        struct CipherKey
+        {
+            Aead::AesGcmKey mAesGcmKey ;
+            uint32_t        mChaCha20Key[8] ;
+        } ;
+
+        Implementation( const uint32_t  localIdentifier,
+                        const uint32_t  remoteIdentifier,
+                        const Algorithm algorithm ) ;
+
+        /*
+         * Expands a key for the selected algorithm.
+         */
+        void
+        ExpandKey( const unsigned char* key,
+                   CipherKey&           cipherKey ) const ;
+
+        /*
+         * Derives a key from a parent key and a salt. The parent key
+         * encrypts KEY_SIZE zero bytes with the salt as the nonce, and
+         * the resulting key stream is the derived key.
+         */
+        void
+        DeriveKey( const CipherKey&     parentKey,
+                   const unsigned char* salt,
+                   CipherKey&           derivedKey ) const ;
+
+        /*
+         * Derives the key of one direction from the shared key, the salt
+         * of the sending end and then the salt of the receiving end. The
+         * shared key and the intermediate key are used for nothing else,
+         * so their nonces are only ever salts.
+         */
+        void
+        DeriveSessionKey( const unsigned char* senderSalt,
+                          const unsigned char* receiverSalt,
+                          CipherKey&           sessionKey ) const ;
+
+        /*
+         * Runs the selected algorithm on data in place.
+         */
+        void
+        Seal( const CipherKey&     cipherKey,
+              const unsigned char* nonce,
+              const unsigned char* additionalData,
+              unsigned char*       data,
+              const unsigned int   dataSize,
+              unsigned char*       tag ) const ;
+
+        bool
+        Open( const CipherKey&     cipherKey,
+              const unsigned char* nonce,
+              const unsigned char* additionalData,
+              unsigned char*       data,
+              const unsigned int   dataSize,
+              const unsigned char* tag ) const ;
+
+        const Algorithm mAlgorithm ;
+        const uint32_t  mLocalIdentifier ;
+        const uint32_t  mRemoteIdentifier ;
+
+        CipherKey mSharedKey ;
+
+        /*
+         * Sender state.
+         */
+        unsigned char mLocalSalt[ SALT_SIZE ] ;
+        CipherKey     mSendKey ;
+        uint64_t      mNextSendCounter ;
+
+        /*
+         * Receiver state.
+         */
+        CipherKey                  mReceiveKey ;
+        bool                       mHasRemoteSalt ;
+        uint64_t                   mLastReceiveCounter ;
+        bool                       mHasReceivedFrame ;
+        std::atomic<unsigned long> mNumOfRejectedFrames ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    AeadChannel::AeadChannel( const unsigned char* key,
+                              const unsigned int   localIdentifier,
+                              const unsigned int   remoteIdentifier,
+                              const Algorithm      algorithm )
+        throw( std::invalid_argument,
+               std::runtime_error ) :
+        mImpl( NULL )
+    {
+        if ( NULL == key )
+        {
+            throw std::invalid_argument( ERR_MSG_NULL_KEY ) ;
+        }
+        if ( localIdentifier == remoteIdentifier )
+        {
+            throw std::invalid_argument( ERR_MSG_EQUAL_IDENTIFIERS ) ;
+        }
+        Algorithm selected_algorithm = algorithm ;
+        if ( AUTOMATIC == algorithm )
+        {
+            selected_algorithm = IsAesGcmAccelerated() ?
+                                 AES_256_GCM :
+                                 CHACHA20_POLY1305 ;
+        }
+        else if ( ( AES_256_GCM == algorithm ) &&
+                  ( ! IsAesGcmAccelerated() ) )
+        {
+            throw std::runtime_error( ERR_MSG_AES_GCM_UNSUPPORTED ) ;
+        }
+        mImpl = new Implementation( localIdentifier,
+                                    remoteIdentifier,
+                                    selected_algorithm ) ;
+        if ( ! ReadRandomBytes( mImpl->mLocalSalt,
+                                SALT_SIZE ) )
+        {
+            delete mImpl ;
+            throw std::runtime_error( ERR_MSG_NO_RANDOM_SALT ) ;
+        }
+        mImpl->ExpandKey( key,
+                          mImpl->mSharedKey ) ;
+    }
+
+    AeadChannel::~AeadChannel()
+    {
+        Aead::SecureZero( &mImpl->mSharedKey,
+                          sizeof( mImpl->mSharedKey ) ) ;
+        Aead::SecureZero( &mImpl->mSendKey,
+                          sizeof( mImpl->mSendKey ) ) ;
+        Aead::SecureZero( &mImpl->mReceiveKey,
+                          sizeof( mImpl->mReceiveKey ) ) ;
+        delete mImpl ;
+    }
+
+    AeadChannel::Algorithm
+    AeadChannel::GetAlgorithm() const
+    {
+        return mImpl->mAlgorithm ;
+    }
+
+    bool
+    AeadChannel::IsAesGcmAccelerated()
+    {
+        return Aead::IsAesGcmSupported() ;
+    }
+
+    void
+    AeadChannel::GetLocalSalt( unsigned char* salt ) const
+    {
+        memcpy( salt,
+                mImpl->mLocalSalt,
+                SALT_SIZE ) ;
+    }
+
+    void
+    AeadChannel::SetRemoteSalt( const unsigned char* salt )
+        throw( std::invalid_argument,
+               std::logic_error )
+    {
+        if ( NULL == salt )
+        {
+            throw std::invalid_argument( ERR_MSG_NULL_SALT ) ;
+        }
+        if ( mImpl->mHasRemoteSalt )
+        {
+            throw std::logic_error( ERR_MSG_REMOTE_SALT_SET ) ;
+        }
+        mImpl->DeriveSessionKey( mImpl->mLocalSalt,
+                                 salt,
+                                 mImpl->mSendKey ) ;
+        mImpl->DeriveSessionKey( salt,
+                                 mImpl->mLocalSalt,
+                                 mImpl->mReceiveKey ) ;
+        mImpl->mHasRemoteSalt = true ;
+    }
+
+    unsigned int
+    AeadChannel::Seal( unsigned char*     frame,
+                       const unsigned int payloadSize )
+        throw( std::overflow_error,
+               std::logic_error )
+    {
+        if ( ! mImpl->mHasRemoteSalt )
+        {
+            throw std::logic_error( ERR_MSG_NO_REMOTE_SALT ) ;
+        }
+        if ( MAX_FRAME_COUNTER == mImpl->mNextSendCounter )
+        {
+            throw std::overflow_error( ERR_MSG_COUNTER_EXHAUSTED ) ;
+        }
+        const uint64_t counter = mImpl->mNextSendCounter++ ;
+        //
+        // The header carries the low 32 bits of the counter and is
+        // authenticated as additional data.
+        //
+        for( unsigned int i=0; i<HEADER_SIZE; ++i )
+        {
+            frame[i] = counter >> ( 24 - 8 * i ) ;
+        }
+        unsigned char nonce[ Aead::NONCE_SIZE ] ;
+        MakeNonce( nonce,
+                   mImpl->mLocalIdentifier,
+                   counter ) ;
+        mImpl->Seal( mImpl->mSendKey,
+                     nonce,
+                     frame,
+                     frame + HEADER_SIZE,
+                     payloadSize,
+                     frame + HEADER_SIZE + payloadSize ) ;
+        return payloadSize + OVERHEAD ;
+    }
+
+    int
+    AeadChannel::Open( unsigned char*     frame,
+                       const unsigned int frameSize )
+    {
+        if ( ( frameSize < OVERHEAD ) ||
+             ( ! mImpl->mHasRemoteSalt ) )
+        {
+            ++mImpl->mNumOfRejectedFrames ;
+            return -1 ;
+        }
+        //
+        // Reconstruct the full counter as the smallest value greater
+        // than the last accepted counter whose low 32 bits match the
+        // header. A replayed frame maps to a counter it was not sealed
+        // with and fails authentication.
+        //
+        uint32_t sequence_number = 0 ;
+        for( unsigned int i=0; i<HEADER_SIZE; ++i )
+        {
+            sequence_number = ( sequence_number << 8 ) | frame[i] ;
+        }
+        uint64_t counter = sequence_number ;
+        if ( mImpl->mHasReceivedFrame )
+        {
+            const uint64_t last_counter = mImpl->mLastReceiveCounter ;
+            counter |= last_counter & ~static_cast<uint64_t>( 0xFFFFFFFF ) ;
+            if ( counter <= last_counter )
+            {
+                counter += static_cast<uint64_t>( 1 ) << 32 ;
+            }
+        }
+        unsigned char nonce[ Aead::NONCE_SIZE ] ;
+        MakeNonce( nonce,
+                   mImpl->mRemoteIdentifier,
+                   counter ) ;
+        const unsigned int payload_size = frameSize - OVERHEAD ;
+        if ( ! mImpl->Open( mImpl->mReceiveKey,
+                            nonce,
+                            frame,
+                            frame + HEADER_SIZE,
+                            payload_size,
+                            frame + HEADER_SIZE + payload_size ) )
+        {
+            ++mImpl->mNumOfRejectedFrames ;
+            return -1 ;
+        }
+        mImpl->mLastReceiveCounter = counter ;
+        mImpl->mHasReceivedFrame = true ;
+        return payload_size ;
+    }
+
+    unsigned long
+    AeadChannel::GetNumOfRejectedFrames() const
+    {
+        return mImpl->mNumOfRejectedFrames ;
+    }
+
+    /* ------------------------------------------------------------ */
+    AeadChannel::Implementation::Implementation( const uint32_t  localIdentifier,
+                                                 const uint32_t  remoteIdentifier,
+                                                 const Algorithm algorithm ) :
+        mAlgorithm(algorithm),
+        mLocalIdentifier(localIdentifier),
+        mRemoteIdentifier(remoteIdentifier),
+        mSharedKey(),
+        mLocalSalt(),
+        mSendKey(),
+        mNextSendCounter(0),
+        mReceiveKey(),
+        mHasRemoteSalt(false),
+        mLastReceiveCounter(0),
+        mHasReceivedFrame(false),
+        mNumOfRejectedFrames(0)
+    {
+        /* empty */
+    }
+
+    void
+    AeadChannel::Implementation::ExpandKey( const unsigned char* key,
+                                            CipherKey&           cipherKey ) const
+    {
+        if ( AES_256_GCM == mAlgorithm )
+        {
+            Aead::AesGcmInit( cipherKey.mAesGcmKey,
+                              key ) ;
+        }
+        else
+        {
+            Aead::ChaCha20KeyWords( cipherKey.mChaCha20Key,
+                                    key ) ;
+        }
+    }
+
+    void
+    AeadChannel::Implementation::DeriveKey( const CipherKey&     parentKey,
+                                            const unsigned char* salt,
+                                            CipherKey&           derivedKey ) const
+    {
+        unsigned char key[ KEY_SIZE ] = { 0 } ;
+        unsigned char tag[ TAG_SIZE ] ;
+        if ( AES_256_GCM == mAlgorithm )
+        {
+            Aead::AesGcmSeal( parentKey.mAesGcmKey,
+                              salt,
+                              NULL,
+                              0,
+                              key,
+                              KEY_SIZE,
+                              tag ) ;
+        }
+        else
+        {
+            Aead::ChaCha20Poly1305Seal( parentKey.mChaCha20Key,
+                                        salt,
+                                        NULL,
+                                        0,
+                                        key,
+                                        KEY_SIZE,
+                                        tag ) ;
+        }
+        ExpandKey( key,
+                   derivedKey ) ;
+        Aead::SecureZero( key,
+                          KEY_SIZE ) ;
+    }
+
+    void
+    AeadChannel::Implementation::DeriveSessionKey( const unsigned char* senderSalt,
+                                                   const unsigned char* receiverSalt,
+                                                   CipherKey&           sessionKey ) const
+    {
+        CipherKey sender_key ;
+        DeriveKey( mSharedKey,
+                   senderSalt,
+                   sender_key ) ;
+        DeriveKey( sender_key,
+                   receiverSalt,
+                   sessionKey ) ;
+        Aead::SecureZero( &sender_key,
+                          sizeof( sender_key ) ) ;
+    }
+
+    void
+    AeadChannel::Implementation::Seal( const CipherKey&     cipherKey,
+                                       const unsigned char* nonce,
+                                       const unsigned char* additionalData,
+                                       unsigned char*       data,
+                                       const unsigned int   dataSize,
+                                       unsigned char*       tag ) const
+    {
+        if ( AES_256_GCM == mAlgorithm )
+        {
+            Aead::AesGcmSeal( cipherKey.mAesGcmKey,
+                              nonce,
+                              additionalData,
+                              HEADER_SIZE,
+                              data,
+                              dataSize,
+                              tag ) ;
+        }
+        else
+        {
+            Aead::ChaCha20Poly1305Seal( cipherKey.mChaCha20Key,
+                                        nonce,
+                                        additionalData,
+                                        HEADER_SIZE,
+                                        data,
+                                        dataSize,
+                                        tag ) ;
+        }
+    }
+
+    bool
+    AeadChannel::Implementation::Open( const CipherKey&     cipherKey,
+                                       const unsigned char* nonce,
+                                       const unsigned char* additionalData,
+                                       unsigned char*       data,
+                                       const unsigned int   dataSize,
+                                       const unsigned char* tag ) const
+    {
+        if ( AES_256_GCM == mAlgorithm )
+        {
+            return Aead::AesGcmOpen( cipherKey.mAesGcmKey,
+                                     nonce,
+                                     additionalData,
+                                     HEADER_SIZE,
+                                     data,
+                                     dataSize,
+                                     tag ) ;
+        }
+        return Aead::ChaCha20Poly1305Open( cipherKey.mChaCha20Key,
+                                           nonce,
+                                           additionalData,
+                                           HEADER_SIZE,
+                                           data,
+                                           dataSize,
+                                           tag ) ;
+    }
+}
@@ -0,0 +1,241 @@
+/******************************************************************************
+ *   @file AeadChannel.h                                                      *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _AeadChannel_h_
+#define _AeadChannel_h_
+
+#include <stdexcept>
+
+namespace LibSerial
+{
+    /**
+     * @brief Authenticated encryption of the frames exchanged over a
+     *        serial link. The channel sits between the framing layer and
+     *        SerialPort: the framing layer seals each outgoing frame
+     *        before writing it and opens each incoming frame after
+     *        delimiting it.
+     *
+     *        A sealed frame consists of a 4-byte sequence number, the
+     *        encrypted payload and a 16-byte tag:
+     *
+     *        @code
+     *        | sequence number | payload ... | tag |
+     *        @endcode
+     *
+     *        Frames are encrypted in place and no memory is allocated
+     *        after construction. The 96-bit nonce is made of the
+     *        identifier of the sending end and a 64-bit frame counter.
+     *        Only the low 32 bits of the counter are sent; the receiver
+     *        reconstructs the rest and rejects any frame whose counter is
+     *        not greater than that of the last accepted frame, which
+     *        makes replayed frames fail.
+     *
+     *        The shared key is never used on frames directly. Each
+     *        channel draws a random salt when it is constructed. The key
+     *        of each direction is derived from the shared key, the salt
+     *        of the sending end and the salt of the receiving end, so the
+     *        frame counter can start at zero in every session without
+     *        ever repeating a nonce under the same key, and frames
+     *        recorded in an earlier session never open in a later one,
+     *        even if its salt is replayed. The salts are not secret: when
+     *        the link comes up, each end sends the value of
+     *        GetLocalSalt() to the other, which passes it to
+     *        SetRemoteSalt() before sealing or opening frames. A channel
+     *        serves a single session. When either end restarts, both
+     *        ends construct new channels and exchange salts again.
+     *
+     *        Both ends of a link must use the same algorithm, so the
+     *        algorithm is always chosen by the caller. AES-256-GCM
+     *        requires the AES-NI and PCLMULQDQ instructions;
+     *        ChaCha20-Poly1305 runs on any processor. AUTOMATIC picks
+     *        one from the local processor and is only suitable if both
+     *        ends are known to make the same choice.
+     *
+     *        Seal() and Open() use separate state: one thread may send
+     *        while another receives, but neither method may be called
+     *        concurrently with itself.
+     */
+    class AeadChannel
+    {
+    public:
+        /**
+         * @brief The authenticated encryption algorithms.
+         */
+        enum Algorithm {
+            AUTOMATIC,          //!< AES-256-GCM if accelerated locally, ChaCha20-Poly1305 otherwise.
+            AES_256_GCM,
+            CHACHA20_POLY1305
+        } ;
+
+        /**
+         * @brief Size of the shared key in bytes.
+         */
+        static const unsigned int KEY_SIZE = 32 ;
+
+        /**
+         * @brief Number of bytes before the payload in a sealed frame.
+         */
+        static const unsigned int HEADER_SIZE = 4 ;
+
+        /**
+         * @brief Number of bytes after the payload in a sealed frame.
+         */
+        static const unsigned int TAG_SIZE = 16 ;
+
+        /**
+         * @brief Total number of bytes added to every frame.
+         */
+        static const unsigned int OVERHEAD = HEADER_SIZE + TAG_SIZE ;
+
+        /**
+         * @brief Size of the session salt in bytes.
+         */
+        static const unsigned int SALT_SIZE = 12 ;
+
+        /**
+         * @brief Constructs one end of a link.
+         * @param key The KEY_SIZE byte key shared by both ends.
+         * @param localIdentifier Identifies frames sent by this end.
+         * @param remoteIdentifier The local identifier of the other end.
+         * @param algorithm The algorithm to use, which must be the same
+         *        at both ends.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        key is NULL or if both identifiers are equal, which would
+         *        make the two directions of the link share nonces.
+         * @throw std::runtime_error This exception is thrown if
+         *        AES_256_GCM is requested but the processor does not
+         *        support it, or if no random salt can be obtained.
+         */
+        AeadChannel( const unsigned char* key,
+                     const unsigned int   localIdentifier,
+                     const unsigned int   remoteIdentifier,
+                     const Algorithm      algorithm )
+            throw( std::invalid_argument,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Destructor. Erases the key material.
+         */
+        ~AeadChannel() ;
+
+        /**
+         * @brief Gets the algorithm used by the channel. Never returns
+         *        AUTOMATIC.
+         */
+        Algorithm
+        GetAlgorithm() const ;
+
+        /**
+         * @brief Determines if AES-256-GCM can use the AES-NI and
+         *        PCLMULQDQ instructions of this processor.
+         */
+        static
+        bool
+        IsAesGcmAccelerated() ;
+
+        /**
+         * @brief Gets the salt of this end, which must be passed to
+         *        SetRemoteSalt() at the other end.
+         * @param salt Receives SALT_SIZE bytes.
+         */
+        void
+        GetLocalSalt( unsigned char* salt ) const ;
+
+        /**
+         * @brief Sets the salt of the other end and derives the keys of
+         *        both directions from it. Frames can only be sealed and
+         *        opened after this has been called. Must not be called
+         *        concurrently with Seal() or Open().
+         * @param salt The SALT_SIZE bytes returned by GetLocalSalt() at
+         *        the other end.
+         * @throw std::invalid_argument This exception is thrown if salt is
+         *        NULL.
+         * @throw std::logic_error This exception is thrown if the salt of
+         *        the other end has already been set. The salt is not
+         *        authenticated, so accepting a new one could not tell a
+         *        restarted peer from a replayed handshake.
+         */
+        void
+        SetRemoteSalt( const unsigned char* salt )
+            throw( std::invalid_argument,
+                   std::logic_error ) ;
+
+        /**
+         * @brief Seals a frame in place. The payload must be stored at
+         *        frame + HEADER_SIZE and the buffer must have room for
+         *        payloadSize + OVERHEAD bytes.
+         * @return Returns the size of the sealed frame.
+         * @throw std::overflow_error This exception is thrown if the frame
+         *        counter is exhausted and the key must be replaced.
+         * @throw std::logic_error This exception is thrown if the salt of
+         *        the other end has not been set.
+         */
+        unsigned int
+        Seal( unsigned char*     frame,
+              const unsigned int payloadSize )
+            throw( std::overflow_error,
+                   std::logic_error ) ;
+
+        /**
+         * @brief Authenticates and decrypts a sealed frame in place. On
+         *        success the payload is at frame + HEADER_SIZE. A frame
+         *        that is not authentic leaves the buffer unmodified.
+         * @return Returns the size of the payload, or -1 if the frame is
+         *         too short, not authentic or replayed, or if the salt of
+         *         the other end has not been set.
+         */
+        int
+        Open( unsigned char*     frame,
+              const unsigned int frameSize ) ;
+
+        /**
+         * @brief Gets the number of frames rejected by Open().
+         */
+        unsigned long
+        GetNumOfRejectedFrames() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        AeadChannel( const AeadChannel& otherChannel ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        AeadChannel& operator=( const AeadChannel& otherChannel ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _AeadChannel_h_
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *   @file AeadCiphers.h                                                      *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _AeadCiphers_h_
+#define _AeadCiphers_h_
+
+#include <stdint.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief The authenticated encryption primitives behind AeadChannel.
+     *        All functions work in place on caller-provided buffers and
+     *        never allocate memory.
+     */
+    namespace Aead
+    {
+        const unsigned int KEY_SIZE   = 32 ;
+        const unsigned int NONCE_SIZE = 12 ;
+        const unsigned int TAG_SIZE   = 16 ;
+
+        /**
+         * @brief Expanded AES-256-GCM key: the AES round keys followed by
+         *        the first four powers of the hash key, in the byte order
+         *        used by the PCLMULQDQ GHASH implementation.
+         */
+        struct AesGcmKey
+        {
+            unsigned char mRoundKeys[15][16] ;
+            unsigned char mHashKeyPowers[4][16] ;
+        } ;
+
+        /**
+         * @brief Determines if the processor has the AES-NI and PCLMULQDQ
+         *        instructions required by the AES-GCM functions.
+         */
+        bool
+        IsAesGcmSupported() ;
+
+        /**
+         * @brief Expands a 256-bit key. Must only be called if
+         *        IsAesGcmSupported() returns true.
+         */
+        void
+        AesGcmInit( AesGcmKey&           expandedKey,
+                    const unsigned char* key ) ;
+
+        /**
+         * @brief Encrypts data in place and computes the tag over the
+         *        additional data and the ciphertext.
+         */
+        void
+        AesGcmSeal( const AesGcmKey&     expandedKey,
+                    const unsigned char* nonce,
+                    const unsigned char* additionalData,
+                    const unsigned int   additionalDataSize,
+                    unsigned char*       data,
+                    const unsigned int   dataSize,
+                    unsigned char*       tag ) ;
+
+        /**
+         * @brief Verifies the tag and, only if it is valid, decrypts data
+         *        in place.
+         * @return Returns true if the tag is valid.
+         */
+        bool
+        AesGcmOpen( const AesGcmKey&     expandedKey,
+                    const unsigned char* nonce,
+                    const unsigned char* additionalData,
+                    const unsigned int   additionalDataSize,
+                    unsigned char*       data,
+                    const unsigned int   dataSize,
+                    const unsigned char* tag ) ;
+
+        /**
+         * @brief ChaCha20-Poly1305 as specified in RFC 8439. Portable and
+         *        constant time on every processor.
+         */
+        void
+        ChaCha20Poly1305Seal( const uint32_t*      key,
+                              const unsigned char* nonce,
+                              const unsigned char* additionalData,
+                              const unsigned int   additionalDataSize,
+                              unsigned char*       data,
+                              const unsigned int   dataSize,
+                              unsigned char*       tag ) ;
+
+        bool
+        ChaCha20Poly1305Open( const uint32_t*      key,
+                              const unsigned char* nonce,
+                              const unsigned char* additionalData,
+                              const unsigned int   additionalDataSize,
+                              unsigned char*       data,
+                              const unsigned int   dataSize,
+                              const unsigned char* tag ) ;
+
+        /**
+         * @brief Converts a 256-bit key to the eight little-endian words
+         *        used by ChaCha20.
+         */
+        void
+        ChaCha20KeyWords( uint32_t*            keyWords,
+                          const unsigned char* key ) ;
+
+        /**
+         * @brief Compares two tags in constant time.
+         */
+        bool
+        IsTagEqual( const unsigned char* tag1,
+                    const unsigned char* tag2 ) ;
+
+        /**
+         * @brief Overwrites memory with zeros in a way the compiler cannot
+         *        optimise away.
+         */
+        void
+        SecureZero( void*              buffer,
+                    const unsigned int bufferSize ) ;
+
+    } // namespace Aead
+
+} // namespace LibSerial
+
+#endif // #ifndef _AeadCiphers_h_
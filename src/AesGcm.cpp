@@ -0,0 +1,534 @@
+/******************************************************************************
+ *   @file AesGcm.cpp                                                         *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "AeadCiphers.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+//
+// The library is built for the baseline instruction set. Only the
+// functions below use AES-NI and PCLMULQDQ, and they are only called
+// after IsAesGcmSupported() checked the processor at run time.
+//
+#define AESNI_TARGET __attribute__(( target( "aes,pclmul,ssse3,sse4.1" ) ))
+
+namespace
+{
+    using LibSerial::Aead::AesGcmKey ;
+
+    const unsigned int BLOCK_SIZE = 16 ;
+
+    AESNI_TARGET inline
+    __m128i
+    ByteSwap( const __m128i block )
+    {
+        return _mm_shuffle_epi8( block,
+                                 _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7,
+                                               8, 9, 10, 11, 12, 13, 14, 15 ) ) ;
+    }
+
+    //
+    // AES-256 key expansion, following the Intel AES-NI white paper.
+    //
+    AESNI_TARGET inline
+    __m128i
+    ExpandEvenRoundKey( __m128i previousKey,
+                        __m128i assist )
+    {
+        assist = _mm_shuffle_epi32( assist, 0xFF ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        return _mm_xor_si128( previousKey, assist ) ;
+    }
+
+    AESNI_TARGET inline
+    __m128i
+    ExpandOddRoundKey( const __m128i evenKey,
+                       __m128i       previousKey )
+    {
+        const __m128i assist = _mm_shuffle_epi32( _mm_aeskeygenassist_si128( evenKey, 0x00 ),
+                                                  0xAA ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        previousKey = _mm_xor_si128( previousKey, _mm_slli_si128( previousKey, 4 ) ) ;
+        return _mm_xor_si128( previousKey, assist ) ;
+    }
+
+    /*
+     * The round keys and hash key powers of an expanded key, loaded into
+     * registers once per frame.
+     */
+    struct LoadedKey
+    {
+        __m128i mRoundKeys[15] ;
+        __m128i mHashKeyPowers[4] ;
+    } ;
+
+    AESNI_TARGET inline
+    void
+    LoadKey( LoadedKey&       loadedKey,
+             const AesGcmKey& expandedKey )
+    {
+        for( int i=0; i<15; ++i )
+        {
+            loadedKey.mRoundKeys[i] =
+                _mm_loadu_si128( reinterpret_cast<const __m128i*>( expandedKey.mRoundKeys[i] ) ) ;
+        }
+        for( int i=0; i<4; ++i )
+        {
+            loadedKey.mHashKeyPowers[i] =
+                _mm_loadu_si128( reinterpret_cast<const __m128i*>( expandedKey.mHashKeyPowers[i] ) ) ;
+        }
+    }
+
+    AESNI_TARGET inline
+    __m128i
+    EncryptBlock( const __m128i* roundKeys,
+                  __m128i        block )
+    {
+        block = _mm_xor_si128( block, roundKeys[0] ) ;
+        for( int i=1; i<14; ++i )
+        {
+            block = _mm_aesenc_si128( block, roundKeys[i] ) ;
+        }
+        return _mm_aesenclast_si128( block, roundKeys[14] ) ;
+    }
+
+    /*
+     * Encrypts four independent blocks so that the AES rounds of the
+     * blocks overlap in the pipeline.
+     */
+    AESNI_TARGET inline
+    void
+    EncryptFourBlocks( const __m128i* roundKeys,
+                       __m128i*       blocks )
+    {
+        for( int j=0; j<4; ++j )
+        {
+            blocks[j] = _mm_xor_si128( blocks[j], roundKeys[0] ) ;
+        }
+        for( int i=1; i<14; ++i )
+        {
+            for( int j=0; j<4; ++j )
+            {
+                blocks[j] = _mm_aesenc_si128( blocks[j], roundKeys[i] ) ;
+            }
+        }
+        for( int j=0; j<4; ++j )
+        {
+            blocks[j] = _mm_aesenclast_si128( blocks[j], roundKeys[14] ) ;
+        }
+    }
+
+    /*
+     * Carry-less multiplication of two byte-swapped field elements. The
+     * unreduced 256-bit product is accumulated into low and high so that
+     * several products can share a single reduction.
+     */
+    AESNI_TARGET inline
+    void
+    AccumulateProduct( const __m128i a,
+                       const __m128i b,
+                       __m128i&      low,
+                       __m128i&      high )
+    {
+        __m128i middle = _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x10 ),
+                                        _mm_clmulepi64_si128( a, b, 0x01 ) ) ;
+        low  = _mm_xor_si128( low,
+                              _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x00 ),
+                                             _mm_slli_si128( middle, 8 ) ) ) ;
+        high = _mm_xor_si128( high,
+                              _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x11 ),
+                                             _mm_srli_si128( middle, 8 ) ) ) ;
+    }
+
+    /*
+     * Reduces a 256-bit product modulo the GCM polynomial. The product of
+     * two bit-reflected operands is one bit short, so it is shifted left
+     * by one first.
+     */
+    AESNI_TARGET inline
+    __m128i
+    Reduce( __m128i low,
+            __m128i high )
+    {
+        __m128i low_carry  = _mm_srli_epi32( low, 31 ) ;
+        __m128i high_carry = _mm_srli_epi32( high, 31 ) ;
+        const __m128i cross_carry = _mm_srli_si128( low_carry, 12 ) ;
+        high_carry = _mm_slli_si128( high_carry, 4 ) ;
+        low_carry  = _mm_slli_si128( low_carry, 4 ) ;
+        low  = _mm_or_si128( _mm_slli_epi32( low, 1 ), low_carry ) ;
+        high = _mm_or_si128( _mm_or_si128( _mm_slli_epi32( high, 1 ), high_carry ),
+                             cross_carry ) ;
+        //
+        // First phase of the reduction.
+        //
+        __m128i t = _mm_xor_si128( _mm_xor_si128( _mm_slli_epi32( low, 31 ),
+                                                  _mm_slli_epi32( low, 30 ) ),
+                                   _mm_slli_epi32( low, 25 ) ) ;
+        const __m128i t_high = _mm_srli_si128( t, 4 ) ;
+        low = _mm_xor_si128( low, _mm_slli_si128( t, 12 ) ) ;
+        //
+        // Second phase of the reduction.
+        //
+        t = _mm_xor_si128( _mm_xor_si128( _mm_srli_epi32( low, 1 ),
+                                          _mm_srli_epi32( low, 2 ) ),
+                           _mm_xor_si128( _mm_srli_epi32( low, 7 ),
+                                          t_high ) ) ;
+        return _mm_xor_si128( high, _mm_xor_si128( low, t ) ) ;
+    }
+
+    AESNI_TARGET inline
+    __m128i
+    Multiply( const __m128i a,
+              const __m128i b )
+    {
+        __m128i low  = _mm_setzero_si128() ;
+        __m128i high = _mm_setzero_si128() ;
+        AccumulateProduct( a, b, low, high ) ;
+        return Reduce( low, high ) ;
+    }
+
+    /*
+     * Absorbs data into the GHASH state. A final partial block is padded
+     * with zeros.
+     */
+    AESNI_TARGET inline
+    __m128i
+    GhashUpdate( const LoadedKey&     key,
+                 __m128i              state,
+                 const unsigned char* data,
+                 const unsigned int   dataSize )
+    {
+        const __m128i* h = key.mHashKeyPowers ;
+        unsigned int offset = 0 ;
+        //
+        // Four blocks per reduction:
+        // X' = (X + B0).H^4 + B1.H^3 + B2.H^2 + B3.H
+        //
+        while( dataSize - offset >= 4 * BLOCK_SIZE )
+        {
+            const __m128i* blocks = reinterpret_cast<const __m128i*>( data + offset ) ;
+            __m128i low  = _mm_setzero_si128() ;
+            __m128i high = _mm_setzero_si128() ;
+            AccumulateProduct( _mm_xor_si128( state,
+                                              ByteSwap( _mm_loadu_si128( blocks ) ) ),
+                               h[3], low, high ) ;
+            AccumulateProduct( ByteSwap( _mm_loadu_si128( blocks + 1 ) ), h[2], low, high ) ;
+            AccumulateProduct( ByteSwap( _mm_loadu_si128( blocks + 2 ) ), h[1], low, high ) ;
+            AccumulateProduct( ByteSwap( _mm_loadu_si128( blocks + 3 ) ), h[0], low, high ) ;
+            state = Reduce( low, high ) ;
+            offset += 4 * BLOCK_SIZE ;
+        }
+        while( dataSize - offset >= BLOCK_SIZE )
+        {
+            const __m128i block =
+                ByteSwap( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + offset ) ) ) ;
+            state = Multiply( _mm_xor_si128( state, block ), h[0] ) ;
+            offset += BLOCK_SIZE ;
+        }
+        if ( offset < dataSize )
+        {
+            unsigned char last_block[ BLOCK_SIZE ] = { 0 } ;
+            memcpy( last_block,
+                    data + offset,
+                    dataSize - offset ) ;
+            const __m128i block =
+                ByteSwap( _mm_loadu_si128( reinterpret_cast<const __m128i*>( last_block ) ) ) ;
+            state = Multiply( _mm_xor_si128( state, block ), h[0] ) ;
+        }
+        return state ;
+    }
+
+    AESNI_TARGET inline
+    __m128i
+    CounterBlock( const __m128i nonceBlock,
+                  const uint32_t counter )
+    {
+        return _mm_insert_epi32( nonceBlock,
+                                 static_cast<int>( __builtin_bswap32( counter ) ),
+                                 3 ) ;
+    }
+
+    /*
+     * XORs data with the CTR key stream starting at counter 2. Counter
+     * 1 is reserved for the tag.
+     */
+    AESNI_TARGET inline
+    void
+    CtrXor( const LoadedKey&   key,
+            const __m128i      nonceBlock,
+            unsigned char*     data,
+            const unsigned int dataSize )
+    {
+        uint32_t counter = 2 ;
+        unsigned int offset = 0 ;
+        while( dataSize - offset >= 4 * BLOCK_SIZE )
+        {
+            __m128i key_stream[4] ;
+            for( int j=0; j<4; ++j )
+            {
+                key_stream[j] = CounterBlock( nonceBlock, counter++ ) ;
+            }
+            EncryptFourBlocks( key.mRoundKeys, key_stream ) ;
+            __m128i* blocks = reinterpret_cast<__m128i*>( data + offset ) ;
+            for( int j=0; j<4; ++j )
+            {
+                _mm_storeu_si128( blocks + j,
+                                  _mm_xor_si128( _mm_loadu_si128( blocks + j ),
+                                                 key_stream[j] ) ) ;
+            }
+            offset += 4 * BLOCK_SIZE ;
+        }
+        while( dataSize - offset >= BLOCK_SIZE )
+        {
+            const __m128i key_stream = EncryptBlock( key.mRoundKeys,
+                                                     CounterBlock( nonceBlock, counter++ ) ) ;
+            __m128i* block = reinterpret_cast<__m128i*>( data + offset ) ;
+            _mm_storeu_si128( block,
+                              _mm_xor_si128( _mm_loadu_si128( block ), key_stream ) ) ;
+            offset += BLOCK_SIZE ;
+        }
+        if ( offset < dataSize )
+        {
+            unsigned char key_stream[ BLOCK_SIZE ] ;
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( key_stream ),
+                              EncryptBlock( key.mRoundKeys,
+                                            CounterBlock( nonceBlock, counter ) ) ) ;
+            for( unsigned int i=0; offset + i < dataSize; ++i )
+            {
+                data[ offset + i ] ^= key_stream[i] ;
+            }
+        }
+    }
+
+    AESNI_TARGET inline
+    __m128i
+    LoadNonceBlock( const unsigned char* nonce )
+    {
+        unsigned char nonce_block[ BLOCK_SIZE ] = { 0 } ;
+        memcpy( nonce_block,
+                nonce,
+                LibSerial::Aead::NONCE_SIZE ) ;
+        return _mm_loadu_si128( reinterpret_cast<const __m128i*>( nonce_block ) ) ;
+    }
+
+    /*
+     * Computes the tag over the additional data and the ciphertext.
+     */
+    AESNI_TARGET inline
+    void
+    ComputeTag( const LoadedKey&     key,
+                const __m128i        nonceBlock,
+                const unsigned char* additionalData,
+                const unsigned int   additionalDataSize,
+                const unsigned char* cipherText,
+                const unsigned int   cipherTextSize,
+                unsigned char*       tag )
+    {
+        __m128i state = _mm_setzero_si128() ;
+        state = GhashUpdate( key, state, additionalData, additionalDataSize ) ;
+        state = GhashUpdate( key, state, cipherText, cipherTextSize ) ;
+        //
+        // The final block holds the bit lengths of both inputs, which
+        // is exactly the byte-swapped representation used here.
+        //
+        const __m128i lengths = _mm_set_epi64x( 8ULL * additionalDataSize,
+                                                8ULL * cipherTextSize ) ;
+        state = Multiply( _mm_xor_si128( state, lengths ),
+                          key.mHashKeyPowers[0] ) ;
+        const __m128i mask = EncryptBlock( key.mRoundKeys,
+                                           CounterBlock( nonceBlock, 1 ) ) ;
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( tag ),
+                          _mm_xor_si128( ByteSwap( state ), mask ) ) ;
+    }
+}
+
+namespace LibSerial
+{
+    namespace Aead
+    {
+        bool
+        IsAesGcmSupported()
+        {
+            return __builtin_cpu_supports( "aes" ) &&
+                   __builtin_cpu_supports( "pclmul" ) &&
+                   __builtin_cpu_supports( "sse4.1" ) ;
+        }
+
+        AESNI_TARGET
+        void
+        AesGcmInit( AesGcmKey&           expandedKey,
+                    const unsigned char* key )
+        {
+            __m128i round_keys[15] ;
+            round_keys[0] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( key ) ) ;
+            round_keys[1] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( key + 16 ) ) ;
+            //
+            // _mm_aeskeygenassist_si128 needs the round constant as an
+            // immediate operand.
+            //
+#define EXPAND_EVEN_ROUND_KEY( index, roundConstant )                      \
+            round_keys[ index ] =                                           \
+                ExpandEvenRoundKey( round_keys[ index - 2 ],                \
+                                    _mm_aeskeygenassist_si128( round_keys[ index - 1 ], \
+                                                               roundConstant ) )
+#define EXPAND_ODD_ROUND_KEY( index )                                       \
+            round_keys[ index ] = ExpandOddRoundKey( round_keys[ index - 1 ], \
+                                                     round_keys[ index - 2 ] )
+            EXPAND_EVEN_ROUND_KEY(  2, 0x01 ) ; EXPAND_ODD_ROUND_KEY(  3 ) ;
+            EXPAND_EVEN_ROUND_KEY(  4, 0x02 ) ; EXPAND_ODD_ROUND_KEY(  5 ) ;
+            EXPAND_EVEN_ROUND_KEY(  6, 0x04 ) ; EXPAND_ODD_ROUND_KEY(  7 ) ;
+            EXPAND_EVEN_ROUND_KEY(  8, 0x08 ) ; EXPAND_ODD_ROUND_KEY(  9 ) ;
+            EXPAND_EVEN_ROUND_KEY( 10, 0x10 ) ; EXPAND_ODD_ROUND_KEY( 11 ) ;
+            EXPAND_EVEN_ROUND_KEY( 12, 0x20 ) ; EXPAND_ODD_ROUND_KEY( 13 ) ;
+            EXPAND_EVEN_ROUND_KEY( 14, 0x40 ) ;
+#undef EXPAND_ODD_ROUND_KEY
+#undef EXPAND_EVEN_ROUND_KEY
+            for( int i=0; i<15; ++i )
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( expandedKey.mRoundKeys[i] ),
+                                  round_keys[i] ) ;
+            }
+            //
+            // Hash key H = E(K, 0) and its powers up to H^4.
+            //
+            __m128i powers[4] ;
+            powers[0] = ByteSwap( EncryptBlock( round_keys, _mm_setzero_si128() ) ) ;
+            for( int i=1; i<4; ++i )
+            {
+                powers[i] = Multiply( powers[ i - 1 ], powers[0] ) ;
+            }
+            for( int i=0; i<4; ++i )
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( expandedKey.mHashKeyPowers[i] ),
+                                  powers[i] ) ;
+            }
+            SecureZero( round_keys, sizeof( round_keys ) ) ;
+        }
+
+        AESNI_TARGET
+        void
+        AesGcmSeal( const AesGcmKey&     expandedKey,
+                    const unsigned char* nonce,
+                    const unsigned char* additionalData,
+                    const unsigned int   additionalDataSize,
+                    unsigned char*       data,
+                    const unsigned int   dataSize,
+                    unsigned char*       tag )
+        {
+            LoadedKey key ;
+            LoadKey( key, expandedKey ) ;
+            const __m128i nonce_block = LoadNonceBlock( nonce ) ;
+            CtrXor( key, nonce_block, data, dataSize ) ;
+            ComputeTag( key,
+                        nonce_block,
+                        additionalData,
+                        additionalDataSize,
+                        data,
+                        dataSize,
+                        tag ) ;
+        }
+
+        AESNI_TARGET
+        bool
+        AesGcmOpen( const AesGcmKey&     expandedKey,
+                    const unsigned char* nonce,
+                    const unsigned char* additionalData,
+                    const unsigned int   additionalDataSize,
+                    unsigned char*       data,
+                    const unsigned int   dataSize,
+                    const unsigned char* tag )
+        {
+            LoadedKey key ;
+            LoadKey( key, expandedKey ) ;
+            const __m128i nonce_block = LoadNonceBlock( nonce ) ;
+            unsigned char expected_tag[ TAG_SIZE ] ;
+            ComputeTag( key,
+                        nonce_block,
+                        additionalData,
+                        additionalDataSize,
+                        data,
+                        dataSize,
+                        expected_tag ) ;
+            if ( ! IsTagEqual( expected_tag, tag ) )
+            {
+                return false ;
+            }
+            CtrXor( key, nonce_block, data, dataSize ) ;
+            return true ;
+        }
+    }
+}
+
+#else // defined(__x86_64__) || defined(__i386__)
+
+//
+// Without AES-NI the channel always falls back to ChaCha20-Poly1305 and
+// the functions below are never called.
+//
+namespace LibSerial
+{
+    namespace Aead
+    {
+        bool
+        IsAesGcmSupported()
+        {
+            return false ;
+        }
+
+        void
+        AesGcmInit( AesGcmKey&           expandedKey,
+                    const unsigned char* )
+        {
+            memset( &expandedKey, 0, sizeof( expandedKey ) ) ;
+        }
+
+        void
+        AesGcmSeal( const AesGcmKey&,
+                    const unsigned char*,
+                    const unsigned char*,
+                    const unsigned int,
+                    unsigned char*,
+                    const unsigned int,
+                    unsigned char*       tag )
+        {
+            memset( tag, 0, TAG_SIZE ) ;
+        }
+
+        bool
+        AesGcmOpen( const AesGcmKey&,
+                    const unsigned char*,
+                    const unsigned char*,
+                    const unsigned int,
+                    unsigned char*,
+                    const unsigned int,
+                    const unsigned char* )
+        {
+            return false ;
+        }
+    }
+}
+
+#endif // defined(__x86_64__) || defined(__i386__)
@@ -0,0 +1,262 @@
+/******************************************************************************
+ *   @file AsciiHex.cpp                                                       *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "AsciiHex.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const unsigned int VECTOR_SIZE = 16 ;
+
+    const unsigned char UPPER_CASE_DIGITS[] = "0123456789ABCDEF" ;
+
+    /*
+     * The value of a hexadecimal digit, or -1 for any other character.
+     */
+    inline
+    int
+    DigitValue( const unsigned char character )
+    {
+        if ( ( character >= '0' ) &&
+             ( character <= '9' ) )
+        {
+            return character - '0' ;
+        }
+        const unsigned char lower_case = character | 0x20 ;
+        if ( ( lower_case >= 'a' ) &&
+             ( lower_case <= 'f' ) )
+        {
+            return lower_case - 'a' + 10 ;
+        }
+        return -1 ;
+    }
+
+#ifdef __SSE2__
+
+    /*
+     * All ones in each byte of value that lies in [first, last].
+     */
+    inline
+    __m128i
+    IsInRange( const __m128i       value,
+               const unsigned char first,
+               const unsigned char last )
+    {
+        const __m128i offset = _mm_sub_epi8( value, _mm_set1_epi8( first ) ) ;
+        const __m128i limit = _mm_set1_epi8( last - first ) ;
+        return _mm_cmpeq_epi8( _mm_min_epu8( offset, limit ),
+                               offset ) ;
+    }
+
+    /*
+     * The values of 16 hexadecimal digits, and in isValid all ones for
+     * each character that is a digit.
+     */
+    inline
+    __m128i
+    DigitValues( const __m128i text,
+                 __m128i&      isValid )
+    {
+        const __m128i lower_case = _mm_or_si128( text, _mm_set1_epi8( 0x20 ) ) ;
+        const __m128i is_decimal = IsInRange( text, '0', '9' ) ;
+        const __m128i is_letter = IsInRange( lower_case, 'a', 'f' ) ;
+        isValid = _mm_or_si128( is_decimal, is_letter ) ;
+        const __m128i decimal_values =
+            _mm_sub_epi8( text, _mm_set1_epi8( '0' ) ) ;
+        const __m128i letter_values =
+            _mm_sub_epi8( lower_case, _mm_set1_epi8( 'a' - 10 ) ) ;
+        return _mm_or_si128( _mm_and_si128( is_decimal, decimal_values ),
+                             _mm_andnot_si128( is_decimal, letter_values ) ) ;
+    }
+
+    /*
+     * Combines the digit values of 16 characters into 8 bytes, one per
+     * 16-bit lane: the first character of each pair is the high nibble.
+     */
+    inline
+    __m128i
+    CombineNibbles( const __m128i values )
+    {
+        const __m128i high = _mm_and_si128( _mm_slli_epi16( values, 4 ),
+                                            _mm_set1_epi16( 0x00F0 ) ) ;
+        return _mm_or_si128( high,
+                             _mm_srli_epi16( values, 8 ) ) ;
+    }
+
+    /*
+     * The upper case hexadecimal digits of 16 nibbles.
+     */
+    inline
+    __m128i
+    NibbleDigits( const __m128i nibbles )
+    {
+        const __m128i is_letter = _mm_cmpgt_epi8( nibbles, _mm_set1_epi8( 9 ) ) ;
+        return _mm_add_epi8( _mm_add_epi8( nibbles, _mm_set1_epi8( '0' ) ),
+                             _mm_and_si128( is_letter, _mm_set1_epi8( 'A' - '0' - 10 ) ) ) ;
+    }
+
+    /*
+     * Adds the horizontal sum of the 64-bit lanes of _mm_sad_epu8().
+     */
+    inline
+    unsigned int
+    LaneSum( const __m128i sums )
+    {
+        return _mm_cvtsi128_si32( sums ) +
+               _mm_cvtsi128_si32( _mm_srli_si128( sums, 8 ) ) ;
+    }
+
+#endif // #ifdef __SSE2__
+}
+
+namespace LibSerial
+{
+    namespace AsciiHex
+    {
+        bool
+        IsHexDigit( const unsigned char character )
+        {
+            return ( DigitValue( character ) >= 0 ) ;
+        }
+
+        unsigned int
+        Encode( const unsigned char* data,
+                const unsigned int   size,
+                unsigned char*       text )
+        {
+            unsigned int sum = 0 ;
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            const __m128i low_nibbles = _mm_set1_epi8( 0x0F ) ;
+            __m128i sums = _mm_setzero_si128() ;
+            for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+            {
+                const __m128i bytes =
+                    _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) ) ;
+                sums = _mm_add_epi64( sums,
+                                      _mm_sad_epu8( bytes, _mm_setzero_si128() ) ) ;
+                const __m128i high = _mm_and_si128( _mm_srli_epi16( bytes, 4 ),
+                                                    low_nibbles ) ;
+                const __m128i low = _mm_and_si128( bytes, low_nibbles ) ;
+                //
+                // Interleaving puts the high nibble of each byte first.
+                //
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( text + 2 * i ),
+                                  NibbleDigits( _mm_unpacklo_epi8( high, low ) ) ) ;
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( text + 2 * i + VECTOR_SIZE ),
+                                  NibbleDigits( _mm_unpackhi_epi8( high, low ) ) ) ;
+            }
+            sum = LaneSum( sums ) ;
+#endif
+            for( ; i < size ; ++i )
+            {
+                sum += data[i] ;
+                text[ 2 * i ]     = UPPER_CASE_DIGITS[ data[i] >> 4 ] ;
+                text[ 2 * i + 1 ] = UPPER_CASE_DIGITS[ data[i] & 0x0F ] ;
+            }
+            return sum ;
+        }
+
+        unsigned int
+        Decode( const unsigned char* text,
+                const unsigned int   textSize,
+                unsigned char*       data,
+                unsigned int&        sum )
+        {
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            //
+            // Decode 32 characters at a time until a block contains a
+            // character that is not a digit. The rest is decoded one pair
+            // at a time, which finds exactly where the digits end.
+            //
+            __m128i sums = _mm_setzero_si128() ;
+            for( ; i + 2 * VECTOR_SIZE <= textSize ; i += 2 * VECTOR_SIZE )
+            {
+                __m128i is_first_valid ;
+                __m128i is_second_valid ;
+                const __m128i first_values =
+                    DigitValues( _mm_loadu_si128( reinterpret_cast<const __m128i*>( text + i ) ),
+                                 is_first_valid ) ;
+                const __m128i second_values =
+                    DigitValues( _mm_loadu_si128( reinterpret_cast<const __m128i*>( text + i + VECTOR_SIZE ) ),
+                                 is_second_valid ) ;
+                if ( 0xFFFF != _mm_movemask_epi8( _mm_and_si128( is_first_valid,
+                                                                 is_second_valid ) ) )
+                {
+                    break ;
+                }
+                const __m128i bytes = _mm_packus_epi16( CombineNibbles( first_values ),
+                                                        CombineNibbles( second_values ) ) ;
+                sums = _mm_add_epi64( sums,
+                                      _mm_sad_epu8( bytes, _mm_setzero_si128() ) ) ;
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( data + i / 2 ),
+                                  bytes ) ;
+            }
+            sum += LaneSum( sums ) ;
+#endif
+            for( ; i + 2 <= textSize ; i += 2 )
+            {
+                const int high = DigitValue( text[i] ) ;
+                const int low = DigitValue( text[ i + 1 ] ) ;
+                if ( ( high < 0 ) ||
+                     ( low < 0 ) )
+                {
+                    break ;
+                }
+                data[ i / 2 ] = ( high << 4 ) | low ;
+                sum += data[ i / 2 ] ;
+            }
+            return i ;
+        }
+
+        void
+        NibbleValues( const unsigned char* text,
+                      const unsigned int   size,
+                      unsigned char*       values )
+        {
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            const __m128i invalid_nibbles = _mm_set1_epi8( INVALID_NIBBLE ) ;
+            for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+            {
+                __m128i is_valid ;
+                const __m128i digit_values =
+                    DigitValues( _mm_loadu_si128( reinterpret_cast<const __m128i*>( text + i ) ),
+                                 is_valid ) ;
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( values + i ),
+                                  _mm_or_si128( _mm_and_si128( is_valid, digit_values ),
+                                                _mm_andnot_si128( is_valid, invalid_nibbles ) ) ) ;
+            }
+#endif
+            for( ; i < size ; ++i )
+            {
+                const int value = DigitValue( text[i] ) ;
+                values[i] = ( value < 0 ) ? INVALID_NIBBLE : value ;
+            }
+            return ;
+        }
+
+    } // namespace AsciiHex
+
+} // namespace LibSerial
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *   @file AsciiHex.h                                                         *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _AsciiHex_h_
+#define _AsciiHex_h_
+
+namespace LibSerial
+{
+    /**
+     * @brief Conversion between bytes and the two hexadecimal digits per
+     *        byte used by Modbus ASCII, Intel HEX and Motorola S-records.
+     *        Both directions process 16 bytes at a time with SSE2 where
+     *        available, and also return the sum of the bytes, from which
+     *        all three formats derive their checksums. The functions
+     *        never allocate memory and may be called from a receive
+     *        handler.
+     */
+    namespace AsciiHex
+    {
+        /**
+         * @brief Value stored by NibbleValues() for characters that are
+         *        not hexadecimal digits.
+         */
+        const unsigned char INVALID_NIBBLE = 0xFF ;
+
+        /**
+         * @brief Determines if the character is a hexadecimal digit in
+         *        either case.
+         */
+        bool
+        IsHexDigit( const unsigned char character ) ;
+
+        /**
+         * @brief Writes two upper case hexadecimal digits for each byte.
+         * @param data The bytes to encode.
+         * @param size The number of bytes to encode.
+         * @param text Receives 2 * size characters.
+         * @return Returns the sum of the bytes.
+         */
+        unsigned int
+        Encode( const unsigned char* data,
+                const unsigned int   size,
+                unsigned char*       text ) ;
+
+        /**
+         * @brief Decodes pairs of hexadecimal digits in either case until
+         *        the first character that is not a hexadecimal digit or
+         *        the end of the text. A single digit left before that
+         *        character is not decoded.
+         * @param text The characters to decode.
+         * @param textSize The number of characters in text.
+         * @param data Receives the decoded bytes, up to textSize / 2.
+         * @param sum The sum of the decoded bytes is added to sum.
+         * @return Returns the number of characters decoded, which is
+         *         always even.
+         */
+        unsigned int
+        Decode( const unsigned char* text,
+                const unsigned int   textSize,
+                unsigned char*       data,
+                unsigned int&        sum ) ;
+
+        /**
+         * @brief Converts every character to the value of the hexadecimal
+         *        digit it represents, in either case, or to
+         *        INVALID_NIBBLE. Record parsers convert a whole block of
+         *        received text at once and then read the digits of each
+         *        field from values, so the OR of the values of a field is
+         *        greater than 0x0F if any of its characters is not a
+         *        digit.
+         * @param text The characters to convert.
+         * @param size The number of characters in text.
+         * @param values Receives size values.
+         */
+        void
+        NibbleValues( const unsigned char* text,
+                      const unsigned int   size,
+                      unsigned char*       values ) ;
+
+    } // namespace AsciiHex
+
+} // namespace LibSerial
+
+#endif // #ifndef _AsciiHex_h_
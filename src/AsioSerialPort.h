@@ -0,0 +1,717 @@
+/******************************************************************************
+ *   @file AsioSerialPort.h                                                   *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _AsioSerialPort_h_
+#define _AsioSerialPort_h_
+
+#include <ExceptionSpecification.h>
+#include <SerialPort.h>
+#include <TransformChain.h>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace LibSerial
+{
+    /**
+     * @brief Makes an open SerialPort usable from a Boost.Asio
+     *        io_context, as a model of the AsyncReadStream and
+     *        AsyncWriteStream concepts. The port keeps its configuration
+     *        methods, transform chains, receive handler and line error
+     *        counters; only the reading of received data moves from the
+     *        SIGIO handler to the io_context.
+     *
+     *        The port must be made non signal driven with
+     *        SerialPort::SetSignalDriven() before it is opened. Its file
+     *        descriptor is then registered with the io_context, and
+     *        either async_read_some() delivers received data, passed
+     *        through the receive transform, to the caller's buffers, or
+     *        async_process_received_data() passes it to the port's
+     *        receive handler or input buffer as the SIGIO handler would.
+     *        async_write_some() applies the transmit transform.
+     *
+     *        The operations accept any Asio completion token: callbacks,
+     *        boost::asio::use_future, boost::asio::yield_context and, in
+     *        C++20 builds, boost::asio::use_awaitable. As for other Asio
+     *        streams, at most one read and one write operation may be
+     *        outstanding at a time, and the adapter must be used from a
+     *        single thread or strand.
+     *
+     *        This header is not part of the compiled library and needs
+     *        only the Boost.Asio headers. It can be included from C++17
+     *        and C++20 code, see ExceptionSpecification.h.
+     */
+    class AsioSerialPort
+    {
+    public:
+        /**
+         * @brief The type of the executor that runs completion handlers.
+         */
+        typedef boost::asio::posix::stream_descriptor::executor_type executor_type ;
+
+        /**
+         * @brief Registers the file descriptor of serialPort with
+         *        ioContext. The port must stay open while the adapter
+         *        exists.
+         * @throw SerialPort::NotOpen This exception is thrown if the port
+         *        is not open.
+         * @throw std::logic_error This exception is thrown if the port
+         *        is signal driven.
+         * @throw std::runtime_error This exception is thrown if the file
+         *        descriptor cannot be registered.
+         */
+        AsioSerialPort( boost::asio::io_context& ioContext,
+                        SerialPort&              serialPort )
+            LIBSERIAL_THROW( SerialPort::NotOpen,
+                             std::logic_error,
+                             std::runtime_error ) ;
+
+        /**
+         * @brief Destructor. Cancels any outstanding operations and
+         *        unregisters the file descriptor without closing it.
+         */
+        ~AsioSerialPort() ;
+
+        /**
+         * @brief Gets the executor of the io_context.
+         */
+        executor_type
+        get_executor() ;
+
+        /**
+         * @brief Gets the adapted serial port, for configuration.
+         */
+        SerialPort&
+        GetSerialPort() ;
+
+        /**
+         * @brief Starts reading received data into buffers. Completes
+         *        with the number of bytes read, after the receive
+         *        transform, once at least one byte is available. Data is
+         *        read into the first non-empty buffer only.
+         * @param buffers The buffers to read into, which must stay valid
+         *        until the operation completes.
+         * @param token The completion token, for a handler with the
+         *        signature void( boost::system::error_code, std::size_t ).
+         */
+        template <typename MutableBufferSequence,
+                  typename ReadToken>
+        BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( ReadToken,
+                                            void( boost::system::error_code, std::size_t ) )
+        async_read_some( const MutableBufferSequence&   buffers,
+                         BOOST_ASIO_MOVE_ARG(ReadToken) token ) ;
+
+        /**
+         * @brief Starts writing data from buffers. Completes with the
+         *        number of bytes taken from the buffers. With a transmit
+         *        transform, up to 4096 bytes are taken at a time and the
+         *        operation completes once all of their transformed bytes
+         *        have been written.
+         * @param buffers The data to write, which must stay valid until
+         *        the operation completes.
+         * @param token The completion token, for a handler with the
+         *        signature void( boost::system::error_code, std::size_t ).
+         */
+        template <typename ConstBufferSequence,
+                  typename WriteToken>
+        BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( WriteToken,
+                                            void( boost::system::error_code, std::size_t ) )
+        async_write_some( const ConstBufferSequence&      buffers,
+                          BOOST_ASIO_MOVE_ARG(WriteToken) token ) ;
+
+        /**
+         * @brief Waits for received data and passes it to the receive
+         *        handler or input buffer of the port with
+         *        SerialPort::ProcessReceivedData(). Use this instead of
+         *        async_read_some() to keep framing receive handlers such
+         *        as ModbusAsciiDecoder attached to the port.
+         * @param token The completion token, for a handler with the
+         *        signature void( boost::system::error_code, std::size_t ),
+         *        which receives the number of bytes read from the port.
+         */
+        template <typename ProcessToken>
+        BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( ProcessToken,
+                                            void( boost::system::error_code, std::size_t ) )
+        async_process_received_data( BOOST_ASIO_MOVE_ARG(ProcessToken) token ) ;
+
+        /**
+         * @brief Cancels all outstanding operations, which complete with
+         *        boost::asio::error::operation_aborted.
+         */
+        void
+        cancel() ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        AsioSerialPort( const AsioSerialPort& otherPort ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        AsioSerialPort& operator=( const AsioSerialPort& otherPort ) ;
+
+        /**
+         * @brief The states of the composed operations below. An
+         *        operation that can complete before it has waited for the
+         *        file descriptor posts itself instead of calling its
+         *        handler from the initiating function.
+         */
+        enum OperationState
+        {
+            STARTING,
+            WAITING,
+            COMPLETING
+        } ;
+
+        /**
+         * @brief The maximum number of bytes transformed by a single
+         *        write operation.
+         */
+        static const unsigned int TRANSMIT_CHUNK_SIZE = 4096 ;
+
+        template <typename MutableBufferSequence>
+        class ReadOperation ;
+
+        template <typename ConstBufferSequence>
+        class WriteOperation ;
+
+        class ProcessOperation ;
+
+        /**
+         * @brief Checks whether the port has hung up or failed, after it
+         *        became readable without any data to read. Without this
+         *        check, a read operation would wait for the descriptor
+         *        over and over, as it stays readable after a hangup.
+         * @param error Receives boost::asio::error::eof after a hangup,
+         *        or the error of the port.
+         * @return Returns true if the port has hung up or failed.
+         */
+        bool
+        IsHungUp( boost::system::error_code& error ) ;
+
+        SerialPort&                                mSerialPort ;
+        boost::asio::posix::stream_descriptor      mDescriptor ;
+
+        /**
+         * @brief Holds the transformed data of the outstanding write
+         *        operation.
+         */
+        std::vector<unsigned char>                 mTransmitBuffer ;
+    } ;
+
+    template <typename MutableBufferSequence>
+    class AsioSerialPort::ReadOperation
+    {
+    public:
+        ReadOperation( AsioSerialPort&              serialPort,
+                       const MutableBufferSequence& buffers ) :
+            mPort( serialPort ),
+            mBuffer(),
+            mState( STARTING ),
+            mError(),
+            mResult( 0 )
+        {
+            //
+            // Reading into the first non-empty buffer keeps the receive
+            // transform working on contiguous data.
+            //
+            for ( auto iterator = boost::asio::buffer_sequence_begin( buffers ) ;
+                  iterator != boost::asio::buffer_sequence_end( buffers ) ;
+                  ++iterator )
+            {
+                boost::asio::mutable_buffer buffer( *iterator ) ;
+                if ( buffer.size() > 0 )
+                {
+                    mBuffer = buffer ;
+                    break ;
+                }
+            }
+        }
+
+        template <typename Self>
+        void
+        operator()( Self&                           self,
+                    const boost::system::error_code error = boost::system::error_code() )
+        {
+            if ( STARTING == mState )
+            {
+                //
+                // Data that arrived before the operation started does
+                // not make the file descriptor readable again, so it is
+                // read right away.
+                //
+                if ( ( 0 == mBuffer.size() ) ||
+                     this->TryRead() )
+                {
+                    mState = COMPLETING ;
+                    boost::asio::post( mPort.mDescriptor.get_executor(),
+                                       std::move( self ) ) ;
+                    return ;
+                }
+                mState = WAITING ;
+                mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_read,
+                                              std::move( self ) ) ;
+                return ;
+            }
+            if ( COMPLETING == mState )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            if ( error )
+            {
+                self.complete( error,
+                               0 ) ;
+                return ;
+            }
+            if ( this->TryRead() )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_read,
+                                          std::move( self ) ) ;
+            return ;
+        }
+
+    private:
+        /**
+         * @brief Reads without blocking.
+         * @return Returns false if no data is available yet, including
+         *         when the receive transform removed all data read.
+         */
+        bool
+        TryRead()
+        {
+            mResult = mPort.mDescriptor.read_some( boost::asio::buffer( mBuffer ),
+                                                   mError ) ;
+            if ( boost::asio::error::would_block == mError )
+            {
+                mError = boost::system::error_code() ;
+                return false ;
+            }
+            if ( mError )
+            {
+                mResult = 0 ;
+                return true ;
+            }
+            TransformChain* receive_transform = mPort.mSerialPort.GetReceiveTransform() ;
+            if ( 0 != receive_transform )
+            {
+                mResult = receive_transform->Apply( static_cast<unsigned char*>( mBuffer.data() ),
+                                                    mResult,
+                                                    mResult ) ;
+            }
+            return ( mResult > 0 ) ;
+        }
+
+        AsioSerialPort&             mPort ;
+        boost::asio::mutable_buffer mBuffer ;
+        OperationState              mState ;
+        boost::system::error_code   mError ;
+        std::size_t                 mResult ;
+    } ;
+
+    template <typename ConstBufferSequence>
+    class AsioSerialPort::WriteOperation
+    {
+    public:
+        WriteOperation( AsioSerialPort&            serialPort,
+                        const ConstBufferSequence& buffers ) :
+            mPort( serialPort ),
+            mData( 0 ),
+            mSize( 0 ),
+            mIsTransformed( false ),
+            mState( STARTING ),
+            mError(),
+            mResult( 0 )
+        {
+            for ( auto iterator = boost::asio::buffer_sequence_begin( buffers ) ;
+                  iterator != boost::asio::buffer_sequence_end( buffers ) ;
+                  ++iterator )
+            {
+                boost::asio::const_buffer buffer( *iterator ) ;
+                if ( buffer.size() > 0 )
+                {
+                    mData = static_cast<const unsigned char*>( buffer.data() ) ;
+                    mSize = buffer.size() ;
+                    break ;
+                }
+            }
+        }
+
+        template <typename Self>
+        void
+        operator()( Self&                           self,
+                    const boost::system::error_code error = boost::system::error_code() )
+        {
+            if ( STARTING == mState )
+            {
+                if ( mSize > 0 )
+                {
+                    this->Transform() ;
+                }
+                if ( ( 0 == mSize ) ||
+                     this->TryWrite() )
+                {
+                    mState = COMPLETING ;
+                    boost::asio::post( mPort.mDescriptor.get_executor(),
+                                       std::move( self ) ) ;
+                    return ;
+                }
+                mState = WAITING ;
+                mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_write,
+                                              std::move( self ) ) ;
+                return ;
+            }
+            if ( COMPLETING == mState )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            if ( error )
+            {
+                self.complete( error,
+                               0 ) ;
+                return ;
+            }
+            if ( this->TryWrite() )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_write,
+                                          std::move( self ) ) ;
+            return ;
+        }
+
+    private:
+        /**
+         * @brief Replaces the data to write by its transformed copy in
+         *        the transmit buffer of the adapter, if the port has a
+         *        transmit transform.
+         */
+        void
+        Transform()
+        {
+            TransformChain* transmit_transform = mPort.mSerialPort.GetTransmitTransform() ;
+            if ( 0 == transmit_transform )
+            {
+                return ;
+            }
+            const unsigned int chunk_size =
+                std::min( mSize, static_cast<std::size_t>( TRANSMIT_CHUNK_SIZE ) ) ;
+            std::vector<unsigned char>& transmit_buffer = mPort.mTransmitBuffer ;
+            const unsigned int capacity = transmit_transform->GetMaxOutputSize( chunk_size ) ;
+            if ( transmit_buffer.size() < capacity )
+            {
+                transmit_buffer.resize( capacity ) ;
+            }
+            memcpy( &transmit_buffer[0],
+                    mData,
+                    chunk_size ) ;
+            mData = &transmit_buffer[0] ;
+            mSize = transmit_transform->Apply( &transmit_buffer[0],
+                                               chunk_size,
+                                               transmit_buffer.size() ) ;
+            mResult = chunk_size ;
+            mIsTransformed = true ;
+            return ;
+        }
+
+        /**
+         * @brief Writes without blocking.
+         * @return Returns false if the operation has to wait until the
+         *         port can take more data.
+         */
+        bool
+        TryWrite()
+        {
+            const std::size_t num_of_bytes_written =
+                mPort.mDescriptor.write_some( boost::asio::buffer( mData,
+                                                                   mSize ),
+                                              mError ) ;
+            if ( boost::asio::error::would_block == mError )
+            {
+                mError = boost::system::error_code() ;
+                return false ;
+            }
+            if ( mError )
+            {
+                mResult = 0 ;
+                return true ;
+            }
+            if ( ! mIsTransformed )
+            {
+                mResult = num_of_bytes_written ;
+                return true ;
+            }
+            //
+            // The transformed data is not the caller's, so all of it has
+            // to be written before the operation completes.
+            //
+            mData += num_of_bytes_written ;
+            mSize -= num_of_bytes_written ;
+            return ( 0 == mSize ) ;
+        }
+
+        AsioSerialPort&           mPort ;
+        const unsigned char*      mData ;
+        std::size_t               mSize ;
+        bool                      mIsTransformed ;
+        OperationState            mState ;
+        boost::system::error_code mError ;
+        std::size_t               mResult ;
+    } ;
+
+    class AsioSerialPort::ProcessOperation
+    {
+    public:
+        explicit
+        ProcessOperation( AsioSerialPort& serialPort ) :
+            mPort( serialPort ),
+            mState( STARTING ),
+            mError(),
+            mResult( 0 )
+        {
+            /* empty */
+        }
+
+        template <typename Self>
+        void
+        operator()( Self&                           self,
+                    const boost::system::error_code error = boost::system::error_code() )
+        {
+            if ( STARTING == mState )
+            {
+                if ( this->TryProcess() )
+                {
+                    mState = COMPLETING ;
+                    boost::asio::post( mPort.mDescriptor.get_executor(),
+                                       std::move( self ) ) ;
+                    return ;
+                }
+                mState = WAITING ;
+                mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_read,
+                                              std::move( self ) ) ;
+                return ;
+            }
+            if ( COMPLETING == mState )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            if ( error )
+            {
+                self.complete( error,
+                               0 ) ;
+                return ;
+            }
+            if ( this->TryProcess() ||
+                 mPort.IsHungUp( mError ) )
+            {
+                self.complete( mError,
+                               mResult ) ;
+                return ;
+            }
+            mPort.mDescriptor.async_wait( boost::asio::posix::stream_descriptor::wait_read,
+                                          std::move( self ) ) ;
+            return ;
+        }
+
+    private:
+        /**
+         * @return Returns false if no data was waiting at the port.
+         */
+        bool
+        TryProcess()
+        {
+            try
+            {
+                mResult = mPort.mSerialPort.ProcessReceivedData() ;
+            }
+            catch( const SerialPort::NotOpen& )
+            {
+                mError = boost::asio::error::bad_descriptor ;
+                return true ;
+            }
+            return ( mResult > 0 ) ;
+        }
+
+        AsioSerialPort&           mPort ;
+        OperationState            mState ;
+        boost::system::error_code mError ;
+        std::size_t               mResult ;
+    } ;
+
+    inline
+    AsioSerialPort::AsioSerialPort( boost::asio::io_context& ioContext,
+                                    SerialPort&              serialPort )
+        LIBSERIAL_THROW( SerialPort::NotOpen,
+                         std::logic_error,
+                         std::runtime_error ) :
+        mSerialPort( serialPort ),
+        mDescriptor( ioContext ),
+        mTransmitBuffer()
+    {
+        const int file_descriptor = serialPort.GetFileDescriptor() ;
+        if ( serialPort.IsSignalDriven() )
+        {
+            throw std::logic_error( "The serial port must not be signal driven." ) ;
+        }
+        mDescriptor.assign( file_descriptor ) ;
+        mDescriptor.non_blocking( true ) ;
+    }
+
+    inline
+    AsioSerialPort::~AsioSerialPort()
+    {
+        //
+        // The file descriptor belongs to the serial port.
+        //
+        mDescriptor.release() ;
+    }
+
+    inline
+    AsioSerialPort::executor_type
+    AsioSerialPort::get_executor()
+    {
+        return mDescriptor.get_executor() ;
+    }
+
+    inline
+    SerialPort&
+    AsioSerialPort::GetSerialPort()
+    {
+        return mSerialPort ;
+    }
+
+    template <typename MutableBufferSequence,
+              typename ReadToken>
+    BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( ReadToken,
+                                        void( boost::system::error_code, std::size_t ) )
+    AsioSerialPort::async_read_some( const MutableBufferSequence&   buffers,
+                                     BOOST_ASIO_MOVE_ARG(ReadToken) token )
+    {
+        return boost::asio::async_compose<ReadToken,
+                                          void( boost::system::error_code, std::size_t )>(
+            ReadOperation<MutableBufferSequence>( *this,
+                                                  buffers ),
+            token,
+            mDescriptor ) ;
+    }
+
+    template <typename ConstBufferSequence,
+              typename WriteToken>
+    BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( WriteToken,
+                                        void( boost::system::error_code, std::size_t ) )
+    AsioSerialPort::async_write_some( const ConstBufferSequence&      buffers,
+                                      BOOST_ASIO_MOVE_ARG(WriteToken) token )
+    {
+        return boost::asio::async_compose<WriteToken,
+                                          void( boost::system::error_code, std::size_t )>(
+            WriteOperation<ConstBufferSequence>( *this,
+                                                 buffers ),
+            token,
+            mDescriptor ) ;
+    }
+
+    template <typename ProcessToken>
+    BOOST_ASIO_INITFN_AUTO_RESULT_TYPE( ProcessToken,
+                                        void( boost::system::error_code, std::size_t ) )
+    AsioSerialPort::async_process_received_data( BOOST_ASIO_MOVE_ARG(ProcessToken) token )
+    {
+        return boost::asio::async_compose<ProcessToken,
+                                          void( boost::system::error_code, std::size_t )>(
+            ProcessOperation( *this ),
+            token,
+            mDescriptor ) ;
+    }
+
+    inline
+    void
+    AsioSerialPort::cancel()
+    {
+        mDescriptor.cancel() ;
+    }
+
+    inline
+    bool
+    AsioSerialPort::IsHungUp( boost::system::error_code& error )
+    {
+        pollfd poll_fd ;
+        poll_fd.fd      = mDescriptor.native_handle() ;
+        poll_fd.events  = POLLIN ;
+        poll_fd.revents = 0 ;
+        if ( poll( &poll_fd,
+                   1,
+                   0 ) < 0 )
+        {
+            if ( EINTR == errno )
+            {
+                return false ;
+            }
+            error = boost::system::error_code( errno,
+                                               boost::system::system_category() ) ;
+            return true ;
+        }
+        if ( 0 != ( poll_fd.revents & POLLNVAL ) )
+        {
+            error = boost::asio::error::bad_descriptor ;
+            return true ;
+        }
+        if ( 0 != ( poll_fd.revents & POLLERR ) )
+        {
+            error = boost::system::error_code( EIO,
+                                               boost::system::system_category() ) ;
+            return true ;
+        }
+        if ( 0 != ( poll_fd.revents & POLLHUP ) )
+        {
+            error = boost::asio::error::eof ;
+            return true ;
+        }
+        return false ;
+    }
+
+} // namespace LibSerial
+
+#endif // #ifndef _AsioSerialPort_h_
@@ -0,0 +1,440 @@
+/******************************************************************************
+ *   @file ChaCha20Poly1305.cpp                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "AeadCiphers.h"
+
+#include <cstring>
+
+namespace
+{
+    using LibSerial::Aead::TAG_SIZE ;
+
+    const unsigned int CHACHA20_BLOCK_SIZE  = 64 ;
+    const unsigned int POLY1305_BLOCK_SIZE  = 16 ;
+    const uint32_t     POLY1305_LIMB_MASK   = 0x3FFFFFF ;
+
+    inline
+    uint32_t
+    Load32( const unsigned char* data )
+    {
+        return static_cast<uint32_t>( data[0] ) |
+               ( static_cast<uint32_t>( data[1] ) << 8 ) |
+               ( static_cast<uint32_t>( data[2] ) << 16 ) |
+               ( static_cast<uint32_t>( data[3] ) << 24 ) ;
+    }
+
+    inline
+    void
+    Store32( unsigned char* data,
+             const uint32_t value )
+    {
+        data[0] = value & 0xFF ;
+        data[1] = ( value >> 8 ) & 0xFF ;
+        data[2] = ( value >> 16 ) & 0xFF ;
+        data[3] = value >> 24 ;
+    }
+
+    inline
+    uint32_t
+    RotateLeft( const uint32_t value,
+                const int      count )
+    {
+        return ( value << count ) | ( value >> ( 32 - count ) ) ;
+    }
+
+    inline
+    void
+    QuarterRound( uint32_t& a,
+                  uint32_t& b,
+                  uint32_t& c,
+                  uint32_t& d )
+    {
+        a += b ; d ^= a ; d = RotateLeft( d, 16 ) ;
+        c += d ; b ^= c ; b = RotateLeft( b, 12 ) ;
+        a += b ; d ^= a ; d = RotateLeft( d, 8 ) ;
+        c += d ; b ^= c ; b = RotateLeft( b, 7 ) ;
+    }
+
+    /*
+     * Computes one 64-byte ChaCha20 key stream block.
+     */
+    void
+    ChaCha20Block( const uint32_t*      key,
+                   const uint32_t       counter,
+                   const unsigned char* nonce,
+                   unsigned char*       keyStream )
+    {
+        uint32_t input[16] ;
+        input[0] = 0x61707865 ;
+        input[1] = 0x3320646E ;
+        input[2] = 0x79622D32 ;
+        input[3] = 0x6B206574 ;
+        memcpy( input + 4, key, 8 * sizeof( uint32_t ) ) ;
+        input[12] = counter ;
+        input[13] = Load32( nonce ) ;
+        input[14] = Load32( nonce + 4 ) ;
+        input[15] = Load32( nonce + 8 ) ;
+        //
+        uint32_t x[16] ;
+        memcpy( x, input, sizeof( x ) ) ;
+        for( int i=0; i<10; ++i )
+        {
+            QuarterRound( x[0], x[4], x[8],  x[12] ) ;
+            QuarterRound( x[1], x[5], x[9],  x[13] ) ;
+            QuarterRound( x[2], x[6], x[10], x[14] ) ;
+            QuarterRound( x[3], x[7], x[11], x[15] ) ;
+            QuarterRound( x[0], x[5], x[10], x[15] ) ;
+            QuarterRound( x[1], x[6], x[11], x[12] ) ;
+            QuarterRound( x[2], x[7], x[8],  x[13] ) ;
+            QuarterRound( x[3], x[4], x[9],  x[14] ) ;
+        }
+        for( int i=0; i<16; ++i )
+        {
+            Store32( keyStream + 4 * i,
+                     x[i] + input[i] ) ;
+        }
+    }
+
+    /*
+     * XORs data with the key stream starting at block 1. Block 0 is used
+     * for the Poly1305 key.
+     */
+    void
+    ChaCha20Xor( const uint32_t*      key,
+                 const unsigned char* nonce,
+                 unsigned char*       data,
+                 const unsigned int   dataSize )
+    {
+        unsigned char key_stream[ CHACHA20_BLOCK_SIZE ] ;
+        uint32_t counter = 1 ;
+        for( unsigned int offset=0; offset<dataSize; offset += CHACHA20_BLOCK_SIZE )
+        {
+            ChaCha20Block( key, counter++, nonce, key_stream ) ;
+            const unsigned int block_size = ( dataSize - offset < CHACHA20_BLOCK_SIZE ) ?
+                                            dataSize - offset :
+                                            CHACHA20_BLOCK_SIZE ;
+            for( unsigned int i=0; i<block_size; ++i )
+            {
+                data[ offset + i ] ^= key_stream[i] ;
+            }
+        }
+        LibSerial::Aead::SecureZero( key_stream, sizeof( key_stream ) ) ;
+    }
+
+    /*
+     * Poly1305 with 26-bit limbs, so that it only needs 32x32->64 bit
+     * multiplications and runs well on the 32-bit processors found in
+     * radio modems as well as on PCs.
+     */
+    class Poly1305
+    {
+    public:
+        explicit
+        Poly1305( const unsigned char* key )
+        {
+            mR[0] = Load32( key ) & 0x3FFFFFF ;
+            mR[1] = ( Load32( key + 3 ) >> 2 ) & 0x3FFFF03 ;
+            mR[2] = ( Load32( key + 6 ) >> 4 ) & 0x3FFC0FF ;
+            mR[3] = ( Load32( key + 9 ) >> 6 ) & 0x3F03FFF ;
+            mR[4] = ( Load32( key + 12 ) >> 8 ) & 0x00FFFFF ;
+            for( int i=0; i<5; ++i )
+            {
+                mH[i] = 0 ;
+            }
+            for( int i=0; i<4; ++i )
+            {
+                mPad[i] = Load32( key + 16 + 4 * i ) ;
+            }
+        }
+
+        ~Poly1305()
+        {
+            LibSerial::Aead::SecureZero( mR, sizeof( mR ) ) ;
+            LibSerial::Aead::SecureZero( mPad, sizeof( mPad ) ) ;
+        }
+
+        /*
+         * Absorbs data, padding a final partial block with zeros as
+         * required by the AEAD construction.
+         */
+        void
+        UpdatePadded( const unsigned char* data,
+                      const unsigned int   dataSize )
+        {
+            const unsigned int full_size = dataSize & ~( POLY1305_BLOCK_SIZE - 1 ) ;
+            this->Blocks( data, full_size ) ;
+            if ( full_size < dataSize )
+            {
+                unsigned char last_block[ POLY1305_BLOCK_SIZE ] = { 0 } ;
+                memcpy( last_block,
+                        data + full_size,
+                        dataSize - full_size ) ;
+                this->Blocks( last_block, POLY1305_BLOCK_SIZE ) ;
+            }
+        }
+
+        void
+        Blocks( const unsigned char* data,
+                unsigned int         dataSize )
+        {
+            const uint32_t r0 = mR[0] ;
+            const uint32_t r1 = mR[1] ;
+            const uint32_t r2 = mR[2] ;
+            const uint32_t r3 = mR[3] ;
+            const uint32_t r4 = mR[4] ;
+            const uint32_t s1 = r1 * 5 ;
+            const uint32_t s2 = r2 * 5 ;
+            const uint32_t s3 = r3 * 5 ;
+            const uint32_t s4 = r4 * 5 ;
+            uint32_t h0 = mH[0] ;
+            uint32_t h1 = mH[1] ;
+            uint32_t h2 = mH[2] ;
+            uint32_t h3 = mH[3] ;
+            uint32_t h4 = mH[4] ;
+            while( dataSize >= POLY1305_BLOCK_SIZE )
+            {
+                h0 += Load32( data ) & POLY1305_LIMB_MASK ;
+                h1 += ( Load32( data + 3 ) >> 2 ) & POLY1305_LIMB_MASK ;
+                h2 += ( Load32( data + 6 ) >> 4 ) & POLY1305_LIMB_MASK ;
+                h3 += ( Load32( data + 9 ) >> 6 ) & POLY1305_LIMB_MASK ;
+                h4 += ( Load32( data + 12 ) >> 8 ) | ( 1 << 24 ) ;
+                //
+                const uint64_t d0 = static_cast<uint64_t>( h0 ) * r0 +
+                                    static_cast<uint64_t>( h1 ) * s4 +
+                                    static_cast<uint64_t>( h2 ) * s3 +
+                                    static_cast<uint64_t>( h3 ) * s2 +
+                                    static_cast<uint64_t>( h4 ) * s1 ;
+                uint64_t d1 = static_cast<uint64_t>( h0 ) * r1 +
+                              static_cast<uint64_t>( h1 ) * r0 +
+                              static_cast<uint64_t>( h2 ) * s4 +
+                              static_cast<uint64_t>( h3 ) * s3 +
+                              static_cast<uint64_t>( h4 ) * s2 ;
+                uint64_t d2 = static_cast<uint64_t>( h0 ) * r2 +
+                              static_cast<uint64_t>( h1 ) * r1 +
+                              static_cast<uint64_t>( h2 ) * r0 +
+                              static_cast<uint64_t>( h3 ) * s4 +
+                              static_cast<uint64_t>( h4 ) * s3 ;
+                uint64_t d3 = static_cast<uint64_t>( h0 ) * r3 +
+                              static_cast<uint64_t>( h1 ) * r2 +
+                              static_cast<uint64_t>( h2 ) * r1 +
+                              static_cast<uint64_t>( h3 ) * r0 +
+                              static_cast<uint64_t>( h4 ) * s4 ;
+                uint64_t d4 = static_cast<uint64_t>( h0 ) * r4 +
+                              static_cast<uint64_t>( h1 ) * r3 +
+                              static_cast<uint64_t>( h2 ) * r2 +
+                              static_cast<uint64_t>( h3 ) * r1 +
+                              static_cast<uint64_t>( h4 ) * r0 ;
+                //
+                // Partial carry propagation.
+                //
+                uint32_t carry = static_cast<uint32_t>( d0 >> 26 ) ;
+                h0 = static_cast<uint32_t>( d0 ) & POLY1305_LIMB_MASK ;
+                d1 += carry ;
+                carry = static_cast<uint32_t>( d1 >> 26 ) ;
+                h1 = static_cast<uint32_t>( d1 ) & POLY1305_LIMB_MASK ;
+                d2 += carry ;
+                carry = static_cast<uint32_t>( d2 >> 26 ) ;
+                h2 = static_cast<uint32_t>( d2 ) & POLY1305_LIMB_MASK ;
+                d3 += carry ;
+                carry = static_cast<uint32_t>( d3 >> 26 ) ;
+                h3 = static_cast<uint32_t>( d3 ) & POLY1305_LIMB_MASK ;
+                d4 += carry ;
+                carry = static_cast<uint32_t>( d4 >> 26 ) ;
+                h4 = static_cast<uint32_t>( d4 ) & POLY1305_LIMB_MASK ;
+                h0 += carry * 5 ;
+                carry = h0 >> 26 ;
+                h0 &= POLY1305_LIMB_MASK ;
+                h1 += carry ;
+                //
+                data += POLY1305_BLOCK_SIZE ;
+                dataSize -= POLY1305_BLOCK_SIZE ;
+            }
+            mH[0] = h0 ;
+            mH[1] = h1 ;
+            mH[2] = h2 ;
+            mH[3] = h3 ;
+            mH[4] = h4 ;
+        }
+
+        void
+        Finish( unsigned char* tag )
+        {
+            uint32_t h0 = mH[0] ;
+            uint32_t h1 = mH[1] ;
+            uint32_t h2 = mH[2] ;
+            uint32_t h3 = mH[3] ;
+            uint32_t h4 = mH[4] ;
+            //
+            // Full carry propagation.
+            //
+            uint32_t carry = h1 >> 26 ; h1 &= POLY1305_LIMB_MASK ;
+            h2 += carry ; carry = h2 >> 26 ; h2 &= POLY1305_LIMB_MASK ;
+            h3 += carry ; carry = h3 >> 26 ; h3 &= POLY1305_LIMB_MASK ;
+            h4 += carry ; carry = h4 >> 26 ; h4 &= POLY1305_LIMB_MASK ;
+            h0 += carry * 5 ; carry = h0 >> 26 ; h0 &= POLY1305_LIMB_MASK ;
+            h1 += carry ;
+            //
+            // Compute h - p = h + 5 - 2^130 and select it in constant
+            // time if it does not underflow.
+            //
+            uint32_t g0 = h0 + 5 ; carry = g0 >> 26 ; g0 &= POLY1305_LIMB_MASK ;
+            uint32_t g1 = h1 + carry ; carry = g1 >> 26 ; g1 &= POLY1305_LIMB_MASK ;
+            uint32_t g2 = h2 + carry ; carry = g2 >> 26 ; g2 &= POLY1305_LIMB_MASK ;
+            uint32_t g3 = h3 + carry ; carry = g3 >> 26 ; g3 &= POLY1305_LIMB_MASK ;
+            uint32_t g4 = h4 + carry - ( 1 << 26 ) ;
+            uint32_t mask = ( g4 >> 31 ) - 1 ;
+            g0 &= mask ; g1 &= mask ; g2 &= mask ; g3 &= mask ; g4 &= mask ;
+            mask = ~mask ;
+            h0 = ( h0 & mask ) | g0 ;
+            h1 = ( h1 & mask ) | g1 ;
+            h2 = ( h2 & mask ) | g2 ;
+            h3 = ( h3 & mask ) | g3 ;
+            h4 = ( h4 & mask ) | g4 ;
+            //
+            // h = h % 2^128, then add the pad.
+            //
+            h0 = h0 | ( h1 << 26 ) ;
+            h1 = ( h1 >> 6 ) | ( h2 << 20 ) ;
+            h2 = ( h2 >> 12 ) | ( h3 << 14 ) ;
+            h3 = ( h3 >> 18 ) | ( h4 << 8 ) ;
+            uint64_t sum = static_cast<uint64_t>( h0 ) + mPad[0] ;
+            Store32( tag, static_cast<uint32_t>( sum ) ) ;
+            sum = static_cast<uint64_t>( h1 ) + mPad[1] + ( sum >> 32 ) ;
+            Store32( tag + 4, static_cast<uint32_t>( sum ) ) ;
+            sum = static_cast<uint64_t>( h2 ) + mPad[2] + ( sum >> 32 ) ;
+            Store32( tag + 8, static_cast<uint32_t>( sum ) ) ;
+            sum = static_cast<uint64_t>( h3 ) + mPad[3] + ( sum >> 32 ) ;
+            Store32( tag + 12, static_cast<uint32_t>( sum ) ) ;
+        }
+
+    private:
+        uint32_t mR[5] ;
+        uint32_t mH[5] ;
+        uint32_t mPad[4] ;
+    } ;
+
+    /*
+     * Computes the RFC 8439 tag over the additional data and the
+     * ciphertext.
+     */
+    void
+    ComputeTag( const uint32_t*      key,
+                const unsigned char* nonce,
+                const unsigned char* additionalData,
+                const unsigned int   additionalDataSize,
+                const unsigned char* cipherText,
+                const unsigned int   cipherTextSize,
+                unsigned char*       tag )
+    {
+        unsigned char poly_key[ CHACHA20_BLOCK_SIZE ] ;
+        ChaCha20Block( key, 0, nonce, poly_key ) ;
+        Poly1305 poly1305( poly_key ) ;
+        LibSerial::Aead::SecureZero( poly_key, sizeof( poly_key ) ) ;
+        poly1305.UpdatePadded( additionalData, additionalDataSize ) ;
+        poly1305.UpdatePadded( cipherText, cipherTextSize ) ;
+        unsigned char lengths[ POLY1305_BLOCK_SIZE ] = { 0 } ;
+        Store32( lengths, additionalDataSize ) ;
+        Store32( lengths + 8, cipherTextSize ) ;
+        poly1305.Blocks( lengths, POLY1305_BLOCK_SIZE ) ;
+        poly1305.Finish( tag ) ;
+    }
+}
+
+namespace LibSerial
+{
+    namespace Aead
+    {
+        void
+        ChaCha20KeyWords( uint32_t*            keyWords,
+                          const unsigned char* key )
+        {
+            for( int i=0; i<8; ++i )
+            {
+                keyWords[i] = Load32( key + 4 * i ) ;
+            }
+        }
+
+        void
+        ChaCha20Poly1305Seal( const uint32_t*      key,
+                              const unsigned char* nonce,
+                              const unsigned char* additionalData,
+                              const unsigned int   additionalDataSize,
+                              unsigned char*       data,
+                              const unsigned int   dataSize,
+                              unsigned char*       tag )
+        {
+            ChaCha20Xor( key, nonce, data, dataSize ) ;
+            ComputeTag( key,
+                        nonce,
+                        additionalData,
+                        additionalDataSize,
+                        data,
+                        dataSize,
+                        tag ) ;
+        }
+
+        bool
+        ChaCha20Poly1305Open( const uint32_t*      key,
+                              const unsigned char* nonce,
+                              const unsigned char* additionalData,
+                              const unsigned int   additionalDataSize,
+                              unsigned char*       data,
+                              const unsigned int   dataSize,
+                              const unsigned char* tag )
+        {
+            unsigned char expected_tag[ TAG_SIZE ] ;
+            ComputeTag( key,
+                        nonce,
+                        additionalData,
+                        additionalDataSize,
+                        data,
+                        dataSize,
+                        expected_tag ) ;
+            if ( ! IsTagEqual( expected_tag, tag ) )
+            {
+                return false ;
+            }
+            ChaCha20Xor( key, nonce, data, dataSize ) ;
+            return true ;
+        }
+
+        bool
+        IsTagEqual( const unsigned char* tag1,
+                    const unsigned char* tag2 )
+        {
+            unsigned char difference = 0 ;
+            for( unsigned int i=0; i<TAG_SIZE; ++i )
+            {
+                difference |= tag1[i] ^ tag2[i] ;
+            }
+            return 0 == difference ;
+        }
+
+        void
+        SecureZero( void*              buffer,
+                    const unsigned int bufferSize )
+        {
+            volatile unsigned char* bytes = static_cast<volatile unsigned char*>( buffer ) ;
+            for( unsigned int i=0; i<bufferSize; ++i )
+            {
+                bytes[i] = 0 ;
+            }
+        }
+    }
+}
@@ -0,0 +1,619 @@
+/******************************************************************************
+ *   @file CyclicScheduler.cpp                                                *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "CyclicScheduler.h"
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <pthread.h>
+#include <queue>
+#include <time.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    const std::string ERR_MSG_EMPTY_PAYLOAD         = "The payload of a message must not be empty." ;
+    const std::string ERR_MSG_PAYLOAD_TOO_LARGE     = "The payload is larger than the initial payload of the message." ;
+    const std::string ERR_MSG_ZERO_PERIOD           = "The period of a message must not be zero." ;
+    const std::string ERR_MSG_SCHEDULER_RUNNING     = "Messages cannot be added while the scheduler is running." ;
+    const std::string ERR_MSG_UNKNOWN_MESSAGE       = "Unknown message identifier." ;
+    const std::string ERR_MSG_CANNOT_START_THREAD   = "Cannot start the scheduler thread." ;
+
+    //
+    // Flag set in the shared slot index of a triple buffer when the slot
+    // holds a payload the scheduler has not picked up yet.
+    //
+    const unsigned int NEW_PAYLOAD_FLAG = 4 ;
+
+    const unsigned int NUM_OF_SLOTS = 3 ;
+
+    inline
+    unsigned long long
+    MonotonicMicroseconds()
+    {
+        struct timespec now ;
+        clock_gettime( CLOCK_MONOTONIC,
+                       &now ) ;
+        return static_cast<unsigned long long>( now.tv_sec ) * 1000000ULL +
+               now.tv_nsec / 1000 ;
+    }
+
+    /*
+     * A message, its triple buffered payload and its statistics.
+     */
+    struct Message
+    {
+        Message( const unsigned int   portIndex,
+                 const unsigned char* payload,
+                 const unsigned int   payloadSize,
+                 const unsigned int   period,
+                 const unsigned int   phase ) :
+            mPortIndex(portIndex),
+            mPeriod(period),
+            mPhase(phase),
+            mCapacity(payloadSize),
+            mSlots(),
+            mSlotSizes(),
+            mWriterSlot(0),
+            mReaderSlot(1),
+            mSharedSlot(2),
+            mNextDueTime(0),
+            mLastSendTime(0),
+            mHasBeenSent(false),
+            mNumOfTransmissions(0),
+            mNumOfMissedDeadlines(0),
+            mMaxLateness(0),
+            mTotalLateness(0),
+            mMaxPeriodJitter(0)
+        {
+            for( unsigned int i=0; i<NUM_OF_SLOTS; ++i )
+            {
+                mSlots[i].assign( payload,
+                                  payload + payloadSize ) ;
+                mSlotSizes[i] = payloadSize ;
+            }
+        }
+
+        const unsigned int       mPortIndex ;
+        const unsigned long long mPeriod ;
+        const unsigned long long mPhase ;
+        const unsigned int       mCapacity ;
+
+        //
+        // Triple buffer. The application writes to mWriterSlot, the
+        // scheduler reads from mReaderSlot and the two swap their slot
+        // with mSharedSlot to pass payloads on.
+        //
+        std::vector<unsigned char> mSlots[ NUM_OF_SLOTS ] ;
+        unsigned int               mSlotSizes[ NUM_OF_SLOTS ] ;
+        unsigned int               mWriterSlot ;
+        unsigned int               mReaderSlot ;
+        std::atomic<unsigned int>  mSharedSlot ;
+
+        //
+        // Schedule, owned by the scheduler thread.
+        //
+        unsigned long long mNextDueTime ;
+        unsigned long long mLastSendTime ;
+        bool               mHasBeenSent ;
+
+        std::atomic<unsigned long>      mNumOfTransmissions ;
+        std::atomic<unsigned long>      mNumOfMissedDeadlines ;
+        std::atomic<unsigned long long> mMaxLateness ;
+        std::atomic<unsigned long long> mTotalLateness ;
+        std::atomic<unsigned long long> mMaxPeriodJitter ;
+
+    private:
+        Message( const Message& ) ;
+        Message& operator=( const Message& ) ;
+    } ;
+
+    /*
+     * A serial port and the batch of messages being assembled for it.
+     */
+    struct PortBatch
+    {
+        SerialPort*                mSerialPort ;
+        std::vector<unsigned char> mBuffer ;
+        unsigned long long         mSendTime ;
+        bool                       mIsWriteSuccessful ;
+    } ;
+
+    /*
+     * Due time and identifier of a message. The queue of due messages is
+     * ordered by due time, then by identifier.
+     */
+    typedef std::pair<unsigned long long, unsigned int> DueMessage ;
+
+    typedef std::priority_queue<DueMessage,
+                                std::vector<DueMessage>,
+                                std::greater<DueMessage> > DueMessageQueue ;
+}
+
+namespace LibSerial
+{
+    class CyclicScheduler::Implementation
+    {
+    public:
+        Implementation() ;
+
+        ~Implementation() ;
+
+        static
+        void*
+        ThreadMain( void* implementation ) ;
+
+        /*
+         * Wait for messages to become due and send them until Stop() is
+         * called.
+         */
+        void
+        Run() ;
+
+        /*
+         * Send all messages that are due before the specified time, one
+         * write per port.
+         */
+        void
+        SendDueMessages( const unsigned long long batchEndTime ) ;
+
+        /*
+         * Update the statistics of a message written at sendTime and
+         * compute its next due time. A failed write counts as a missed
+         * deadline.
+         */
+        void
+        RecordTransmission( Message&                 message,
+                            const unsigned long long sendTime,
+                            const bool               isWriteSuccessful ) ;
+
+        std::vector<Message*>  mMessages ;
+        std::vector<PortBatch> mPorts ;
+
+        pthread_t       mThread ;
+        pthread_mutex_t mMutex ;
+        pthread_cond_t  mCondition ;
+
+        std::atomic<bool>         mIsRunning ;
+        std::atomic<bool>         mIsStopRequested ;
+        std::atomic<unsigned int> mBatchWindow ;
+
+        /*
+         * State owned by the scheduler thread.
+         */
+        DueMessageQueue           mDueMessages ;
+        std::vector<unsigned int> mBatch ;
+
+        std::atomic<unsigned long> mNumOfWrites ;
+        std::atomic<unsigned long> mNumOfFailedWrites ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    CyclicScheduler::CyclicScheduler() :
+        mImpl( new Implementation() )
+    {
+        /* empty */
+    }
+
+    CyclicScheduler::~CyclicScheduler()
+    {
+        this->Stop() ;
+        delete mImpl ;
+    }
+
+    CyclicScheduler::MessageId
+    CyclicScheduler::AddMessage( SerialPort&          serialPort,
+                                 const unsigned char* payload,
+                                 const unsigned int   payloadSize,
+                                 const unsigned int   usPeriod,
+                                 const unsigned int   usPhase )
+        throw( std::invalid_argument,
+               std::logic_error )
+    {
+        if ( this->IsRunning() )
+        {
+            throw std::logic_error( ERR_MSG_SCHEDULER_RUNNING ) ;
+        }
+        if ( ( NULL == payload ) ||
+             ( 0 == payloadSize ) )
+        {
+            throw std::invalid_argument( ERR_MSG_EMPTY_PAYLOAD ) ;
+        }
+        if ( 0 == usPeriod )
+        {
+            throw std::invalid_argument( ERR_MSG_ZERO_PERIOD ) ;
+        }
+        //
+        // Messages for the same port share its batch.
+        //
+        unsigned int port_index = 0 ;
+        while( ( port_index < mImpl->mPorts.size() ) &&
+               ( &serialPort != mImpl->mPorts[port_index].mSerialPort ) )
+        {
+            ++port_index ;
+        }
+        if ( port_index == mImpl->mPorts.size() )
+        {
+            PortBatch port_batch ;
+            port_batch.mSerialPort        = &serialPort ;
+            port_batch.mSendTime          = 0 ;
+            port_batch.mIsWriteSuccessful = false ;
+            mImpl->mPorts.push_back( port_batch ) ;
+        }
+        mImpl->mMessages.push_back( new Message( port_index,
+                                                 payload,
+                                                 payloadSize,
+                                                 usPeriod,
+                                                 usPhase ) ) ;
+        return mImpl->mMessages.size() - 1 ;
+    }
+
+    void
+    CyclicScheduler::UpdatePayload( const MessageId      messageId,
+                                    const unsigned char* payload,
+                                    const unsigned int   payloadSize )
+        throw( std::out_of_range,
+               std::invalid_argument )
+    {
+        if ( messageId >= mImpl->mMessages.size() )
+        {
+            throw std::out_of_range( ERR_MSG_UNKNOWN_MESSAGE ) ;
+        }
+        if ( ( NULL == payload ) ||
+             ( 0 == payloadSize ) )
+        {
+            throw std::invalid_argument( ERR_MSG_EMPTY_PAYLOAD ) ;
+        }
+        Message& message = *mImpl->mMessages[messageId] ;
+        if ( payloadSize > message.mCapacity )
+        {
+            throw std::invalid_argument( ERR_MSG_PAYLOAD_TOO_LARGE ) ;
+        }
+        //
+        // Fill the slot owned by the application, then publish it by
+        // swapping it with the shared slot.
+        //
+        const unsigned int slot = message.mWriterSlot ;
+        memcpy( &message.mSlots[slot][0],
+                payload,
+                payloadSize ) ;
+        message.mSlotSizes[slot] = payloadSize ;
+        message.mWriterSlot =
+            message.mSharedSlot.exchange( slot | NEW_PAYLOAD_FLAG,
+                                          std::memory_order_acq_rel ) & ~NEW_PAYLOAD_FLAG ;
+        return ;
+    }
+
+    void
+    CyclicScheduler::SetBatchWindow( const unsigned int usBatchWindow )
+    {
+        mImpl->mBatchWindow = usBatchWindow ;
+        return ;
+    }
+
+    void
+    CyclicScheduler::Start()
+        throw( std::runtime_error )
+    {
+        if ( this->IsRunning() )
+        {
+            return ;
+        }
+        //
+        // Schedule the first transmission of every message relative to
+        // the current time.
+        //
+        const unsigned long long start_time = MonotonicMicroseconds() ;
+        mImpl->mDueMessages = DueMessageQueue() ;
+        for( unsigned int i=0; i<mImpl->mMessages.size(); ++i )
+        {
+            Message& message = *mImpl->mMessages[i] ;
+            message.mNextDueTime          = start_time + message.mPhase ;
+            message.mHasBeenSent          = false ;
+            message.mNumOfTransmissions   = 0 ;
+            message.mNumOfMissedDeadlines = 0 ;
+            message.mMaxLateness          = 0 ;
+            message.mTotalLateness        = 0 ;
+            message.mMaxPeriodJitter      = 0 ;
+            mImpl->mDueMessages.push( DueMessage( message.mNextDueTime,
+                                                  i ) ) ;
+        }
+        mImpl->mNumOfWrites       = 0 ;
+        mImpl->mNumOfFailedWrites = 0 ;
+        mImpl->mIsStopRequested   = false ;
+        if ( 0 != pthread_create( &mImpl->mThread,
+                                  NULL,
+                                  &Implementation::ThreadMain,
+                                  mImpl ) )
+        {
+            throw std::runtime_error( ERR_MSG_CANNOT_START_THREAD ) ;
+        }
+        mImpl->mIsRunning = true ;
+        return ;
+    }
+
+    void
+    CyclicScheduler::Stop()
+    {
+        if ( ! this->IsRunning() )
+        {
+            return ;
+        }
+        pthread_mutex_lock( &mImpl->mMutex ) ;
+        mImpl->mIsStopRequested = true ;
+        pthread_cond_signal( &mImpl->mCondition ) ;
+        pthread_mutex_unlock( &mImpl->mMutex ) ;
+        pthread_join( mImpl->mThread,
+                      NULL ) ;
+        mImpl->mIsRunning = false ;
+        return ;
+    }
+
+    bool
+    CyclicScheduler::IsRunning() const
+    {
+        return mImpl->mIsRunning ;
+    }
+
+    unsigned int
+    CyclicScheduler::GetNumOfMessages() const
+    {
+        return mImpl->mMessages.size() ;
+    }
+
+    CyclicScheduler::Statistics
+    CyclicScheduler::GetStatistics( const MessageId messageId ) const
+        throw( std::out_of_range )
+    {
+        if ( messageId >= mImpl->mMessages.size() )
+        {
+            throw std::out_of_range( ERR_MSG_UNKNOWN_MESSAGE ) ;
+        }
+        const Message& message = *mImpl->mMessages[messageId] ;
+        Statistics statistics ;
+        statistics.mNumOfTransmissions          = message.mNumOfTransmissions ;
+        statistics.mNumOfMissedDeadlines        = message.mNumOfMissedDeadlines ;
+        statistics.mMaxLatenessMicroseconds     = message.mMaxLateness ;
+        statistics.mMeanLatenessMicroseconds    = 0.0 ;
+        statistics.mMaxPeriodJitterMicroseconds = message.mMaxPeriodJitter ;
+        if ( statistics.mNumOfTransmissions > 0 )
+        {
+            statistics.mMeanLatenessMicroseconds =
+                static_cast<double>( message.mTotalLateness ) /
+                statistics.mNumOfTransmissions ;
+        }
+        return statistics ;
+    }
+
+    unsigned long
+    CyclicScheduler::GetNumOfWrites() const
+    {
+        return mImpl->mNumOfWrites ;
+    }
+
+    unsigned long
+    CyclicScheduler::GetNumOfFailedWrites() const
+    {
+        return mImpl->mNumOfFailedWrites ;
+    }
+
+    /* ------------------------------------------------------------ */
+    CyclicScheduler::Implementation::Implementation() :
+        mMessages(),
+        mPorts(),
+        mThread(),
+        mMutex(),
+        mCondition(),
+        mIsRunning(false),
+        mIsStopRequested(false),
+        mBatchWindow(0),
+        mDueMessages(),
+        mBatch(),
+        mNumOfWrites(0),
+        mNumOfFailedWrites(0)
+    {
+        pthread_mutex_init( &mMutex,
+                            NULL ) ;
+        //
+        // Wait on the monotonic clock so that changes of the system time
+        // do not disturb the schedule.
+        //
+        pthread_condattr_t condition_attributes ;
+        pthread_condattr_init( &condition_attributes ) ;
+        pthread_condattr_setclock( &condition_attributes,
+                                   CLOCK_MONOTONIC ) ;
+        pthread_cond_init( &mCondition,
+                           &condition_attributes ) ;
+        pthread_condattr_destroy( &condition_attributes ) ;
+    }
+
+    CyclicScheduler::Implementation::~Implementation()
+    {
+        for( unsigned int i=0; i<mMessages.size(); ++i )
+        {
+            delete mMessages[i] ;
+        }
+        pthread_cond_destroy( &mCondition ) ;
+        pthread_mutex_destroy( &mMutex ) ;
+    }
+
+    void*
+    CyclicScheduler::Implementation::ThreadMain( void* implementation )
+    {
+        static_cast<Implementation*>( implementation )->Run() ;
+        return NULL ;
+    }
+
+    void
+    CyclicScheduler::Implementation::Run()
+    {
+        pthread_mutex_lock( &mMutex ) ;
+        while( ! mIsStopRequested )
+        {
+            if ( mDueMessages.empty() )
+            {
+                pthread_cond_wait( &mCondition,
+                                   &mMutex ) ;
+                continue ;
+            }
+            //
+            // Sleep until the next message is due. Messages due within
+            // the batch window after that join its batch.
+            //
+            const unsigned long long now = MonotonicMicroseconds() ;
+            const unsigned long long next_due_time = mDueMessages.top().first ;
+            if ( next_due_time > now )
+            {
+                struct timespec wakeup_timespec ;
+                wakeup_timespec.tv_sec  = next_due_time / 1000000ULL ;
+                wakeup_timespec.tv_nsec = ( next_due_time % 1000000ULL ) * 1000 ;
+                pthread_cond_timedwait( &mCondition,
+                                        &mMutex,
+                                        &wakeup_timespec ) ;
+                continue ;
+            }
+            pthread_mutex_unlock( &mMutex ) ;
+            this->SendDueMessages( now + mBatchWindow ) ;
+            pthread_mutex_lock( &mMutex ) ;
+        }
+        pthread_mutex_unlock( &mMutex ) ;
+        return ;
+    }
+
+    void
+    CyclicScheduler::Implementation::SendDueMessages( const unsigned long long batchEndTime )
+    {
+        //
+        // Append the latest payload of every message in the batch to the
+        // buffer of its port, in order of due time.
+        //
+        mBatch.clear() ;
+        while( ( ! mDueMessages.empty() ) &&
+               ( mDueMessages.top().first <= batchEndTime ) )
+        {
+            const unsigned int message_id = mDueMessages.top().second ;
+            mDueMessages.pop() ;
+            mBatch.push_back( message_id ) ;
+
+            Message& message = *mMessages[message_id] ;
+            if ( message.mSharedSlot.load( std::memory_order_relaxed ) & NEW_PAYLOAD_FLAG )
+            {
+                message.mReaderSlot =
+                    message.mSharedSlot.exchange( message.mReaderSlot,
+                                                  std::memory_order_acq_rel ) & ~NEW_PAYLOAD_FLAG ;
+            }
+            const std::vector<unsigned char>& payload = message.mSlots[message.mReaderSlot] ;
+            std::vector<unsigned char>& buffer = mPorts[message.mPortIndex].mBuffer ;
+            buffer.insert( buffer.end(),
+                           payload.begin(),
+                           payload.begin() + message.mSlotSizes[message.mReaderSlot] ) ;
+        }
+        //
+        // One write per port.
+        //
+        for( unsigned int i=0; i<mPorts.size(); ++i )
+        {
+            PortBatch& port_batch = mPorts[i] ;
+            if ( port_batch.mBuffer.empty() )
+            {
+                continue ;
+            }
+            port_batch.mSendTime = MonotonicMicroseconds() ;
+            try
+            {
+                port_batch.mSerialPort->Write( &port_batch.mBuffer[0],
+                                               port_batch.mBuffer.size() ) ;
+                port_batch.mIsWriteSuccessful = true ;
+                ++mNumOfWrites ;
+            }
+            catch( const std::exception& )
+            {
+                port_batch.mIsWriteSuccessful = false ;
+                ++mNumOfFailedWrites ;
+            }
+            port_batch.mBuffer.clear() ;
+        }
+        //
+        // Reschedule the messages of the batch.
+        //
+        for( unsigned int i=0; i<mBatch.size(); ++i )
+        {
+            Message& message = *mMessages[ mBatch[i] ] ;
+            const PortBatch& port_batch = mPorts[message.mPortIndex] ;
+            this->RecordTransmission( message,
+                                      port_batch.mSendTime,
+                                      port_batch.mIsWriteSuccessful ) ;
+            mDueMessages.push( DueMessage( message.mNextDueTime,
+                                           mBatch[i] ) ) ;
+        }
+        return ;
+    }
+
+    void
+    CyclicScheduler::Implementation::RecordTransmission( Message&                 message,
+                                                         const unsigned long long sendTime,
+                                                         const bool               isWriteSuccessful )
+    {
+        const unsigned long long due_time = message.mNextDueTime ;
+        //
+        // Messages sent early to join a batch are not late.
+        //
+        const unsigned long long lateness = ( sendTime > due_time ) ?
+                                            sendTime - due_time :
+                                            0 ;
+        //
+        // Skip the periods that have passed completely instead of
+        // catching up with a burst of late messages.
+        //
+        const unsigned long long num_of_missed_periods = lateness / message.mPeriod ;
+        message.mNumOfMissedDeadlines += num_of_missed_periods ;
+        message.mNextDueTime = due_time + ( num_of_missed_periods + 1 ) * message.mPeriod ;
+        if ( ! isWriteSuccessful )
+        {
+            ++message.mNumOfMissedDeadlines ;
+            return ;
+        }
+        if ( lateness > message.mMaxLateness )
+        {
+            message.mMaxLateness = lateness ;
+        }
+        message.mTotalLateness += lateness ;
+        if ( message.mHasBeenSent )
+        {
+            const unsigned long long interval = sendTime - message.mLastSendTime ;
+            const unsigned long long jitter = ( interval > message.mPeriod ) ?
+                                              interval - message.mPeriod :
+                                              message.mPeriod - interval ;
+            if ( jitter > message.mMaxPeriodJitter )
+            {
+                message.mMaxPeriodJitter = jitter ;
+            }
+        }
+        message.mLastSendTime = sendTime ;
+        message.mHasBeenSent  = true ;
+        ++message.mNumOfTransmissions ;
+        return ;
+    }
+}
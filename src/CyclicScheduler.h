@@ -0,0 +1,217 @@
+/******************************************************************************
+ *   @file CyclicScheduler.h                                                  *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _CyclicScheduler_h_
+#define _CyclicScheduler_h_
+
+#include <SerialPort.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief Sends periodic messages, such as status and heartbeat
+     *        messages, on any number of serial ports from a single
+     *        thread.
+     *
+     *        Each message has a period and a phase offset: while the
+     *        scheduler runs, it is due at phase, phase + period,
+     *        phase + 2 * period and so on, measured from Start(). All
+     *        messages due for the same port at the same time are packed,
+     *        in order of their due time, into one buffer and passed to
+     *        SerialPort::Write() in a single call. SetBatchWindow() lets
+     *        messages that are due shortly after join the batch.
+     *
+     *        The application may replace the payload of a message at any
+     *        time with UpdatePayload(). Payloads are triple buffered, so
+     *        neither the application nor the scheduler thread ever waits
+     *        for the other, and every transmission uses the latest
+     *        complete payload.
+     *
+     *        A transmission that happens one period or more after its due
+     *        time has missed its deadline. The scheduler then skips the
+     *        periods it missed instead of sending a burst of late
+     *        messages, and counts each of them as a missed deadline.
+     *
+     *        Writes to the ports are blocking, so a port that cannot
+     *        keep up delays the messages of all other ports.
+     */
+    class CyclicScheduler
+    {
+    public:
+        /**
+         * @brief Identifies a message added to the scheduler.
+         */
+        typedef unsigned int MessageId ;
+
+        /**
+         * @brief Timing statistics of a message since Start().
+         */
+        struct Statistics
+        {
+            unsigned long      mNumOfTransmissions ;          //!< Number of times the message was sent.
+            unsigned long      mNumOfMissedDeadlines ;        //!< Number of periods in which the message was not sent.
+            unsigned long long mMaxLatenessMicroseconds ;     //!< Largest delay between due time and write.
+            double             mMeanLatenessMicroseconds ;    //!< Average delay between due time and write.
+            unsigned long long mMaxPeriodJitterMicroseconds ; //!< Largest deviation of the time between two writes from the period.
+        } ;
+
+        /**
+         * @brief Constructs a scheduler without any messages.
+         */
+        CyclicScheduler() ;
+
+        /**
+         * @brief Destructor. Stops the scheduler if it is running.
+         */
+        ~CyclicScheduler() ;
+
+        /**
+         * @brief Adds a message to be sent on serialPort every
+         *        usPeriod microseconds, starting usPhase microseconds
+         *        after Start(). The message initially contains a copy of
+         *        payload. Messages can only be added while the scheduler
+         *        is stopped. The serial port must stay alive as long as
+         *        the scheduler.
+         * @param serialPort The serial port to send the message on.
+         * @param payload The initial payload of the message.
+         * @param payloadSize The size of payload. Later payloads of the
+         *        message may not be larger.
+         * @param usPeriod The period of the message in microseconds.
+         * @param usPhase The due time of the first transmission, relative
+         *        to Start(), in microseconds.
+         * @return Returns the identifier of the new message.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        payload is empty or the period is zero.
+         * @throw std::logic_error This exception is thrown if the
+         *        scheduler is running.
+         */
+        MessageId
+        AddMessage( SerialPort&          serialPort,
+                    const unsigned char* payload,
+                    const unsigned int   payloadSize,
+                    const unsigned int   usPeriod,
+                    const unsigned int   usPhase = 0 )
+            throw( std::invalid_argument,
+                   std::logic_error ) ;
+
+        /**
+         * @brief Replaces the payload of a message. The new payload is
+         *        used from the next transmission on. This method never
+         *        blocks and may be called while the scheduler runs, but
+         *        not concurrently for the same message.
+         * @throw std::out_of_range This exception is thrown if messageId
+         *        does not identify a message.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        payload is empty or larger than the initial payload.
+         */
+        void
+        UpdatePayload( const MessageId      messageId,
+                       const unsigned char* payload,
+                       const unsigned int   payloadSize )
+            throw( std::out_of_range,
+                   std::invalid_argument ) ;
+
+        /**
+         * @brief Sets how long before their due time messages may be
+         *        sent to join the batch of a message that is due. The
+         *        default is zero: only messages that are already due are
+         *        batched.
+         */
+        void
+        SetBatchWindow( const unsigned int usBatchWindow ) ;
+
+        /**
+         * @brief Starts the scheduler thread and resets all statistics.
+         * @throw std::runtime_error This exception is thrown if the
+         *        thread cannot be created.
+         */
+        void
+        Start()
+            throw( std::runtime_error ) ;
+
+        /**
+         * @brief Stops the scheduler thread.
+         */
+        void
+        Stop() ;
+
+        /**
+         * @brief Determines if the scheduler is currently running.
+         */
+        bool
+        IsRunning() const ;
+
+        /**
+         * @brief Gets the number of messages added to the scheduler.
+         */
+        unsigned int
+        GetNumOfMessages() const ;
+
+        /**
+         * @brief Gets the timing statistics of a message.
+         * @throw std::out_of_range This exception is thrown if messageId
+         *        does not identify a message.
+         */
+        Statistics
+        GetStatistics( const MessageId messageId ) const
+            throw( std::out_of_range ) ;
+
+        /**
+         * @brief Gets the number of calls to SerialPort::Write() since
+         *        Start(). Each call sends a batch of one or more messages.
+         */
+        unsigned long
+        GetNumOfWrites() const ;
+
+        /**
+         * @brief Gets the number of calls to SerialPort::Write() that
+         *        failed since Start().
+         */
+        unsigned long
+        GetNumOfFailedWrites() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        CyclicScheduler( const CyclicScheduler& otherScheduler ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        CyclicScheduler& operator=( const CyclicScheduler& otherScheduler ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _CyclicScheduler_h_
@@ -0,0 +1,41 @@
+/******************************************************************************
+ *   @file ExceptionSpecification.h                                           *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _ExceptionSpecification_h_
+#define _ExceptionSpecification_h_
+
+/**
+ * @brief Declares the exceptions a function may throw.
+ *
+ *        The library is built as C++11 and documents the exceptions of
+ *        its functions with dynamic exception specifications. C++17
+ *        removed them, so in C++17 and later the specification expands
+ *        to nothing and the headers that use this macro can still be
+ *        included, for example by applications that use C++20
+ *        coroutines with AsioSerialPort. The exceptions that may be
+ *        thrown are the same either way.
+ */
+#if __cplusplus >= 201703L
+#define LIBSERIAL_THROW(...)
+#else
+#define LIBSERIAL_THROW(...) throw( __VA_ARGS__ )
+#endif
+
+#endif // #ifndef _ExceptionSpecification_h_
@@ -0,0 +1,805 @@
+/******************************************************************************
+ *   @file HexImage.cpp                                                       *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "HexImage.h"
+#include "AsciiHex.h"
+#include "HexLineParser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+namespace
+{
+    const std::string ERR_MSG_IMAGE_TOO_LARGE     = "The image does not fit in a 32-bit address space." ;
+    const std::string ERR_MSG_INVALID_RECORD_SIZE = "Invalid number of data bytes per record." ;
+    const std::string ERR_MSG_INVALID_ADDRESS     = "The start address does not fit in 32 bits." ;
+    const std::string ERR_MSG_BUFFER_TOO_SMALL    = "The buffer is too small for a record." ;
+
+    const unsigned long MAX_ADDRESS = 0xFFFFFFFFUL ;
+
+    //
+    // Intel HEX records: byte count, 16-bit address, record type, data
+    // and checksum.
+    //
+    const unsigned int INTEL_HEX_OVERHEAD = 5 ;
+    const unsigned int MAX_RECORD_DATA_SIZE = 255 ;
+
+    enum IntelHexRecordType
+    {
+        DATA_RECORD                     = 0x00,
+        END_OF_FILE_RECORD              = 0x01,
+        EXTENDED_SEGMENT_ADDRESS_RECORD = 0x02,
+        START_SEGMENT_ADDRESS_RECORD    = 0x03,
+        EXTENDED_LINEAR_ADDRESS_RECORD  = 0x04,
+        START_LINEAR_ADDRESS_RECORD     = 0x05
+    } ;
+
+    inline
+    unsigned long
+    BigEndianValue( const unsigned char* bytes,
+                    const unsigned int   size )
+    {
+        unsigned long value = 0 ;
+        for( unsigned int i = 0 ; i < size ; ++i )
+        {
+            value = ( value << 8 ) | bytes[i] ;
+        }
+        return value ;
+    }
+
+    /*
+     * The number of address bytes of an S-record type, or 0 if the type
+     * is unknown.
+     */
+    inline
+    unsigned int
+    SRecordAddressSize( const unsigned char typeCharacter )
+    {
+        switch( typeCharacter )
+        {
+        case '0': case '1': case '5': case '9': return 2 ;
+        case '2': case '6': case '8':           return 3 ;
+        case '3': case '7':                     return 4 ;
+        default:                                return 0 ;
+        }
+    }
+
+    /*
+     * The number of bytes needed for an S-record address.
+     */
+    inline
+    unsigned int
+    SRecordAddressSizeFor( const unsigned long address )
+    {
+        if ( address <= 0xFFFF )
+        {
+            return 2 ;
+        }
+        return ( address <= 0xFFFFFF ) ? 3 : 4 ;
+    }
+}
+
+namespace LibSerial
+{
+    class HexImageDecoder::Implementation : public HexLineParser::LineHandler
+    {
+    public:
+        Implementation( const HexImageFormat format,
+                        HexImageHandler&     imageHandler ) :
+            mFormat(format),
+            mImageHandler(imageHandler),
+            mParser( *this,
+                     ( INTEL_HEX == format ) ? ':' : 'S',
+                     ( S_RECORD == format ),
+                     ( INTEL_HEX == format ) ? INTEL_HEX_OVERHEAD + MAX_RECORD_DATA_SIZE :
+                                               1 + MAX_RECORD_DATA_SIZE ),
+            mBaseAddress(0),
+            mNumOfDataRecords(0),
+            mIsComplete(false),
+            mNumOfRecords(0),
+            mNumOfChecksumErrors(0),
+            mNumOfMalformedRecords(0)
+        {
+            /* empty */
+        }
+
+        void
+        HandleLine( const unsigned char  typeCharacter,
+                    const unsigned char* bytes,
+                    const unsigned int   size,
+                    const unsigned int   sum )
+        {
+            const bool is_valid = ( INTEL_HEX == mFormat ) ?
+                this->HandleIntelHexRecord( bytes, size, sum ) :
+                this->HandleSRecord( typeCharacter, bytes, size, sum ) ;
+            if ( is_valid )
+            {
+                ++mNumOfRecords ;
+            }
+            return ;
+        }
+
+        void
+        HandleMalformedLine()
+        {
+            ++mNumOfMalformedRecords ;
+            return ;
+        }
+
+        /*
+         * Check and process a record. Errors are counted here.
+         * @return Returns true if the record is valid.
+         */
+        bool
+        HandleIntelHexRecord( const unsigned char* bytes,
+                              const unsigned int   size,
+                              const unsigned int   sum ) ;
+
+        bool
+        HandleSRecord( const unsigned char  typeCharacter,
+                       const unsigned char* bytes,
+                       const unsigned int   size,
+                       const unsigned int   sum ) ;
+
+        const HexImageFormat mFormat ;
+        HexImageHandler&     mImageHandler ;
+        HexLineParser        mParser ;
+
+        /*
+         * Extended address of Intel HEX data records.
+         */
+        unsigned long        mBaseAddress ;
+
+        /*
+         * Number of S-record data records, checked by the count record.
+         */
+        unsigned long        mNumOfDataRecords ;
+
+        std::atomic<bool>          mIsComplete ;
+        std::atomic<unsigned long> mNumOfRecords ;
+        std::atomic<unsigned long> mNumOfChecksumErrors ;
+        std::atomic<unsigned long> mNumOfMalformedRecords ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    bool
+    HexImageDecoder::Implementation::HandleIntelHexRecord( const unsigned char* bytes,
+                                                           const unsigned int   size,
+                                                           const unsigned int   sum )
+    {
+        if ( ( size < INTEL_HEX_OVERHEAD ) ||
+             ( size != bytes[0] + INTEL_HEX_OVERHEAD ) )
+        {
+            ++mNumOfMalformedRecords ;
+            return false ;
+        }
+        //
+        // The checksum makes the sum of all bytes of the record zero.
+        //
+        if ( 0 != ( sum & 0xFF ) )
+        {
+            ++mNumOfChecksumErrors ;
+            return false ;
+        }
+        const unsigned int data_size = bytes[0] ;
+        const unsigned long offset = BigEndianValue( bytes + 1, 2 ) ;
+        const unsigned char* data = bytes + 4 ;
+        switch( bytes[3] )
+        {
+        case DATA_RECORD:
+            mImageHandler.HandleData( ( mBaseAddress + offset ) & MAX_ADDRESS,
+                                      data,
+                                      data_size ) ;
+            return true ;
+        case END_OF_FILE_RECORD:
+            mIsComplete = true ;
+            mImageHandler.HandleEnd() ;
+            return true ;
+        case EXTENDED_SEGMENT_ADDRESS_RECORD:
+            if ( 2 == data_size )
+            {
+                mBaseAddress = BigEndianValue( data, 2 ) << 4 ;
+                return true ;
+            }
+            break ;
+        case START_SEGMENT_ADDRESS_RECORD:
+            if ( 4 == data_size )
+            {
+                mImageHandler.HandleStartAddress( ( BigEndianValue( data, 2 ) << 4 ) +
+                                                  BigEndianValue( data + 2, 2 ) ) ;
+                return true ;
+            }
+            break ;
+        case EXTENDED_LINEAR_ADDRESS_RECORD:
+            if ( 2 == data_size )
+            {
+                mBaseAddress = BigEndianValue( data, 2 ) << 16 ;
+                return true ;
+            }
+            break ;
+        case START_LINEAR_ADDRESS_RECORD:
+            if ( 4 == data_size )
+            {
+                mImageHandler.HandleStartAddress( BigEndianValue( data, 4 ) ) ;
+                return true ;
+            }
+            break ;
+        }
+        ++mNumOfMalformedRecords ;
+        return false ;
+    }
+
+    bool
+    HexImageDecoder::Implementation::HandleSRecord( const unsigned char  typeCharacter,
+                                                    const unsigned char* bytes,
+                                                    const unsigned int   size,
+                                                    const unsigned int   sum )
+    {
+        const unsigned int address_size = SRecordAddressSize( typeCharacter ) ;
+        if ( ( 0 == address_size ) ||
+             ( size < 1 ) ||
+             ( size != bytes[0] + 1U ) ||
+             ( bytes[0] < address_size + 1 ) )
+        {
+            ++mNumOfMalformedRecords ;
+            return false ;
+        }
+        //
+        // The checksum is the ones' complement of the sum of the other
+        // bytes, so all bytes add up to 0xFF.
+        //
+        if ( 0xFF != ( sum & 0xFF ) )
+        {
+            ++mNumOfChecksumErrors ;
+            return false ;
+        }
+        const unsigned long address = BigEndianValue( bytes + 1, address_size ) ;
+        const unsigned char* data = bytes + 1 + address_size ;
+        const unsigned int data_size = bytes[0] - address_size - 1 ;
+        switch( typeCharacter )
+        {
+        case '0':
+            //
+            // The header carries no image data.
+            //
+            break ;
+        case '1': case '2': case '3':
+            ++mNumOfDataRecords ;
+            mImageHandler.HandleData( address,
+                                      data,
+                                      data_size ) ;
+            break ;
+        case '5': case '6':
+            {
+                const unsigned long count_mask = ( '5' == typeCharacter ) ? 0xFFFF : 0xFFFFFF ;
+                if ( address != ( mNumOfDataRecords & count_mask ) )
+                {
+                    ++mNumOfMalformedRecords ;
+                    return false ;
+                }
+            }
+            break ;
+        default:
+            mIsComplete = true ;
+            mImageHandler.HandleStartAddress( address ) ;
+            mImageHandler.HandleEnd() ;
+            break ;
+        }
+        return true ;
+    }
+
+    HexImageDecoder::HexImageDecoder( const HexImageFormat format,
+                                      HexImageHandler&     imageHandler ) :
+        mImpl( new Implementation( format,
+                                   imageHandler ) )
+    {
+        /* empty */
+    }
+
+    HexImageDecoder::~HexImageDecoder()
+    {
+        delete mImpl ;
+    }
+
+    void
+    HexImageDecoder::HandleReceivedData( const unsigned char* dataBuffer,
+                                         const unsigned int   bufferSize )
+    {
+        mImpl->mParser.Parse( dataBuffer,
+                              bufferSize ) ;
+        return ;
+    }
+
+    void
+    HexImageDecoder::Reset()
+    {
+        mImpl->mParser.Reset() ;
+        mImpl->mBaseAddress      = 0 ;
+        mImpl->mNumOfDataRecords = 0 ;
+        mImpl->mIsComplete       = false ;
+        return ;
+    }
+
+    bool
+    HexImageDecoder::IsComplete() const
+    {
+        return mImpl->mIsComplete.load() ;
+    }
+
+    unsigned long
+    HexImageDecoder::GetNumOfRecords() const
+    {
+        return mImpl->mNumOfRecords.load() ;
+    }
+
+    unsigned long
+    HexImageDecoder::GetNumOfChecksumErrors() const
+    {
+        return mImpl->mNumOfChecksumErrors.load() ;
+    }
+
+    unsigned long
+    HexImageDecoder::GetNumOfMalformedRecords() const
+    {
+        return mImpl->mNumOfMalformedRecords.load() ;
+    }
+
+    class HexImageEncoder::Implementation
+    {
+    public:
+        enum Phase
+        {
+            HEADER,
+            DATA,
+            COUNT,
+            START_ADDRESS,
+            END,
+            COMPLETE
+        } ;
+
+        Implementation( const HexImageFormat format,
+                        const unsigned char* image,
+                        const unsigned long  imageSize,
+                        const unsigned long  baseAddress,
+                        const unsigned int   recordDataSize ) :
+            mFormat(format),
+            mImage(image),
+            mImageSize(imageSize),
+            mBaseAddress(baseAddress),
+            mRecordDataSize(recordDataSize),
+            mStartAddress(0),
+            mHasStartAddress(false),
+            mAddressSize(0),
+            mPhase(HEADER),
+            mPosition(0),
+            mUpperAddress(0),
+            mNumOfDataRecords(0)
+        {
+            /* empty */
+        }
+
+        /*
+         * The number of characters of a record with the specified number
+         * of data bytes.
+         */
+        unsigned int
+        RecordSize( const unsigned int dataSize ) const
+        {
+            if ( INTEL_HEX == mFormat )
+            {
+                return 1 + 2 * ( INTEL_HEX_OVERHEAD + dataSize ) + 2 ;
+            }
+            return 2 + 2 * ( 1 + mAddressSize + dataSize + 1 ) + 2 ;
+        }
+
+        /*
+         * Write the next record if it fits.
+         * @return Returns the number of characters written, or 0 if the
+         *         record does not fit.
+         */
+        unsigned int
+        EncodeNextRecord( unsigned char*     text,
+                          const unsigned int capacity ) ;
+
+        /*
+         * Write a record made of a prefix, a header and data, followed by
+         * the checksum and CR LF.
+         */
+        unsigned int
+        ComposeRecord( unsigned char*       text,
+                       const unsigned char  typeCharacter,
+                       const unsigned char* header,
+                       const unsigned int   headerSize,
+                       const unsigned char* data,
+                       const unsigned int   dataSize ) const ;
+
+        unsigned int
+        ComposeIntelHexRecord( unsigned char*       text,
+                               const unsigned char  recordType,
+                               const unsigned long  offset,
+                               const unsigned char* data,
+                               const unsigned int   dataSize ) const ;
+
+        unsigned int
+        ComposeSRecord( unsigned char*       text,
+                        const unsigned char  typeCharacter,
+                        const unsigned long  address,
+                        const unsigned char* data,
+                        const unsigned int   dataSize ) const ;
+
+        const HexImageFormat mFormat ;
+        const unsigned char* mImage ;
+        const unsigned long  mImageSize ;
+        const unsigned long  mBaseAddress ;
+        const unsigned int   mRecordDataSize ;
+        unsigned long        mStartAddress ;
+        bool                 mHasStartAddress ;
+
+        /*
+         * Number of address bytes of S-records.
+         */
+        unsigned int         mAddressSize ;
+
+        Phase                mPhase ;
+        unsigned long        mPosition ;
+        unsigned long        mUpperAddress ;
+        unsigned long        mNumOfDataRecords ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    unsigned int
+    HexImageEncoder::Implementation::ComposeRecord( unsigned char*       text,
+                                                    const unsigned char  typeCharacter,
+                                                    const unsigned char* header,
+                                                    const unsigned int   headerSize,
+                                                    const unsigned char* data,
+                                                    const unsigned int   dataSize ) const
+    {
+        unsigned int size = 0 ;
+        if ( INTEL_HEX == mFormat )
+        {
+            text[ size++ ] = ':' ;
+        }
+        else
+        {
+            text[ size++ ] = 'S' ;
+            text[ size++ ] = typeCharacter ;
+        }
+        unsigned int sum = AsciiHex::Encode( header,
+                                             headerSize,
+                                             text + size ) ;
+        size += 2 * headerSize ;
+        sum += AsciiHex::Encode( data,
+                                 dataSize,
+                                 text + size ) ;
+        size += 2 * dataSize ;
+        const unsigned char checksum = ( INTEL_HEX == mFormat ) ?
+            static_cast<unsigned char>( -sum ) :
+            static_cast<unsigned char>( ~sum ) ;
+        AsciiHex::Encode( &checksum,
+                          1,
+                          text + size ) ;
+        size += 2 ;
+        text[ size++ ] = '\r' ;
+        text[ size++ ] = '\n' ;
+        return size ;
+    }
+
+    unsigned int
+    HexImageEncoder::Implementation::ComposeIntelHexRecord( unsigned char*       text,
+                                                            const unsigned char  recordType,
+                                                            const unsigned long  offset,
+                                                            const unsigned char* data,
+                                                            const unsigned int   dataSize ) const
+    {
+        const unsigned char header[] =
+        {
+            static_cast<unsigned char>( dataSize ),
+            static_cast<unsigned char>( offset >> 8 ),
+            static_cast<unsigned char>( offset ),
+            recordType
+        } ;
+        return this->ComposeRecord( text,
+                                    0,
+                                    header,
+                                    sizeof( header ),
+                                    data,
+                                    dataSize ) ;
+    }
+
+    unsigned int
+    HexImageEncoder::Implementation::ComposeSRecord( unsigned char*       text,
+                                                     const unsigned char  typeCharacter,
+                                                     const unsigned long  address,
+                                                     const unsigned char* data,
+                                                     const unsigned int   dataSize ) const
+    {
+        const unsigned int address_size = SRecordAddressSize( typeCharacter ) ;
+        unsigned char header[5] ;
+        header[0] = static_cast<unsigned char>( address_size + dataSize + 1 ) ;
+        for( unsigned int i = 0 ; i < address_size ; ++i )
+        {
+            header[ address_size - i ] = static_cast<unsigned char>( address >> ( 8 * i ) ) ;
+        }
+        return this->ComposeRecord( text,
+                                    typeCharacter,
+                                    header,
+                                    1 + address_size,
+                                    data,
+                                    dataSize ) ;
+    }
+
+    unsigned int
+    HexImageEncoder::Implementation::EncodeNextRecord( unsigned char*     text,
+                                                       const unsigned int capacity )
+    {
+        //
+        // Every record but the data records is at most as long as a data
+        // record with four bytes.
+        //
+        if ( ( DATA != mPhase ) &&
+             ( capacity < this->RecordSize( 4 ) ) )
+        {
+            return 0 ;
+        }
+        //
+        // S-record address sizes: 1 for S1/S5/S9, 2 for S2/S6/S8 and 3
+        // for S3/S7, counted from the data record type.
+        //
+        const unsigned char data_type = '0' + mAddressSize - 1 ;
+        switch( mPhase )
+        {
+        case HEADER:
+            mPhase = DATA ;
+            if ( S_RECORD == mFormat )
+            {
+                return this->ComposeSRecord( text, '0', 0, NULL, 0 ) ;
+            }
+            // fall through
+        case DATA:
+            {
+                if ( mPosition == mImageSize )
+                {
+                    mPhase = ( INTEL_HEX == mFormat ) ? START_ADDRESS : COUNT ;
+                    return this->EncodeNextRecord( text, capacity ) ;
+                }
+                const unsigned long address = mBaseAddress + mPosition ;
+                if ( ( INTEL_HEX == mFormat ) &&
+                     ( ( address >> 16 ) != mUpperAddress ) )
+                {
+                    if ( capacity < this->RecordSize( 2 ) )
+                    {
+                        return 0 ;
+                    }
+                    mUpperAddress = address >> 16 ;
+                    const unsigned char upper_address[] =
+                    {
+                        static_cast<unsigned char>( mUpperAddress >> 8 ),
+                        static_cast<unsigned char>( mUpperAddress )
+                    } ;
+                    return this->ComposeIntelHexRecord( text,
+                                                        EXTENDED_LINEAR_ADDRESS_RECORD,
+                                                        0,
+                                                        upper_address,
+                                                        sizeof( upper_address ) ) ;
+                }
+                //
+                // Intel HEX data records must not cross a 64 KiB boundary.
+                //
+                unsigned long data_size = std::min( static_cast<unsigned long>( mRecordDataSize ),
+                                                    mImageSize - mPosition ) ;
+                if ( INTEL_HEX == mFormat )
+                {
+                    data_size = std::min( data_size,
+                                          0x10000 - ( address & 0xFFFF ) ) ;
+                }
+                if ( capacity < this->RecordSize( data_size ) )
+                {
+                    return 0 ;
+                }
+                const unsigned char* data = mImage + mPosition ;
+                mPosition += data_size ;
+                ++mNumOfDataRecords ;
+                if ( INTEL_HEX == mFormat )
+                {
+                    return this->ComposeIntelHexRecord( text,
+                                                        DATA_RECORD,
+                                                        address & 0xFFFF,
+                                                        data,
+                                                        data_size ) ;
+                }
+                return this->ComposeSRecord( text,
+                                             data_type,
+                                             address,
+                                             data,
+                                             data_size ) ;
+            }
+        case COUNT:
+            //
+            // The count record is optional and only written if the
+            // count fits.
+            //
+            mPhase = START_ADDRESS ;
+            if ( mNumOfDataRecords <= 0xFFFFFF )
+            {
+                return this->ComposeSRecord( text,
+                                             ( mNumOfDataRecords <= 0xFFFF ) ? '5' : '6',
+                                             mNumOfDataRecords,
+                                             NULL,
+                                             0 ) ;
+            }
+            // fall through
+        case START_ADDRESS:
+            mPhase = END ;
+            if ( S_RECORD == mFormat )
+            {
+                mPhase = COMPLETE ;
+                return this->ComposeSRecord( text,
+                                             '0' + 11 - mAddressSize,
+                                             mStartAddress,
+                                             NULL,
+                                             0 ) ;
+            }
+            if ( mHasStartAddress )
+            {
+                const unsigned char start_address[] =
+                {
+                    static_cast<unsigned char>( mStartAddress >> 24 ),
+                    static_cast<unsigned char>( mStartAddress >> 16 ),
+                    static_cast<unsigned char>( mStartAddress >> 8 ),
+                    static_cast<unsigned char>( mStartAddress )
+                } ;
+                return this->ComposeIntelHexRecord( text,
+                                                    START_LINEAR_ADDRESS_RECORD,
+                                                    0,
+                                                    start_address,
+                                                    sizeof( start_address ) ) ;
+            }
+            // fall through
+        case END:
+            mPhase = COMPLETE ;
+            return this->ComposeIntelHexRecord( text,
+                                                END_OF_FILE_RECORD,
+                                                0,
+                                                NULL,
+                                                0 ) ;
+        case COMPLETE:
+            break ;
+        }
+        return 0 ;
+    }
+
+    HexImageEncoder::HexImageEncoder( const HexImageFormat format,
+                                      const unsigned char* image,
+                                      const unsigned long  imageSize,
+                                      const unsigned long  baseAddress,
+                                      const unsigned int   recordDataSize )
+        throw( std::invalid_argument ) :
+        mImpl(0)
+    {
+        if ( ( baseAddress > MAX_ADDRESS ) ||
+             ( imageSize > MAX_ADDRESS - baseAddress + 1 ) )
+        {
+            throw std::invalid_argument( ERR_MSG_IMAGE_TOO_LARGE ) ;
+        }
+        const unsigned long last_address =
+            ( imageSize > 0 ) ? baseAddress + imageSize - 1 : baseAddress ;
+        const unsigned int address_size = SRecordAddressSizeFor( last_address ) ;
+        //
+        // An S-record holds at most 255 bytes after the byte count.
+        //
+        const unsigned int max_record_data_size = ( INTEL_HEX == format ) ?
+            MAX_RECORD_DATA_SIZE : MAX_RECORD_DATA_SIZE - address_size - 1 ;
+        if ( ( 0 == recordDataSize ) ||
+             ( recordDataSize > max_record_data_size ) )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_RECORD_SIZE ) ;
+        }
+        mImpl = new Implementation( format,
+                                    image,
+                                    imageSize,
+                                    baseAddress,
+                                    recordDataSize ) ;
+        mImpl->mAddressSize = address_size ;
+    }
+
+    HexImageEncoder::~HexImageEncoder()
+    {
+        delete mImpl ;
+    }
+
+    void
+    HexImageEncoder::SetStartAddress( const unsigned long startAddress )
+        throw( std::invalid_argument )
+    {
+        if ( startAddress > MAX_ADDRESS )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_ADDRESS ) ;
+        }
+        //
+        // The termination record of S-records has the same address size
+        // as the data records, so the start address may widen both. The
+        // encoder is only changed once the records are known to fit.
+        //
+        const unsigned int address_size =
+            std::max( mImpl->mAddressSize,
+                      SRecordAddressSizeFor( startAddress ) ) ;
+        if ( ( S_RECORD == mImpl->mFormat ) &&
+             ( mImpl->mRecordDataSize > MAX_RECORD_DATA_SIZE - address_size - 1 ) )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_RECORD_SIZE ) ;
+        }
+        mImpl->mAddressSize = address_size ;
+        mImpl->mStartAddress = startAddress ;
+        mImpl->mHasStartAddress = true ;
+        return ;
+    }
+
+    unsigned int
+    HexImageEncoder::GetMaxRecordSize() const
+    {
+        return mImpl->RecordSize( std::max( mImpl->mRecordDataSize, 4U ) ) ;
+    }
+
+    unsigned int
+    HexImageEncoder::Encode( unsigned char*     text,
+                             const unsigned int capacity )
+        throw( std::invalid_argument )
+    {
+        if ( capacity < this->GetMaxRecordSize() )
+        {
+            throw std::invalid_argument( ERR_MSG_BUFFER_TOO_SMALL ) ;
+        }
+        unsigned int size = 0 ;
+        unsigned int record_size = 0 ;
+        do
+        {
+            record_size = mImpl->EncodeNextRecord( text + size,
+                                                   capacity - size ) ;
+            size += record_size ;
+        }
+        while( record_size > 0 ) ;
+        return size ;
+    }
+
+    bool
+    HexImageEncoder::IsComplete() const
+    {
+        return ( Implementation::COMPLETE == mImpl->mPhase ) ;
+    }
+
+    void
+    HexImageEncoder::Rewind()
+    {
+        mImpl->mPhase            = Implementation::HEADER ;
+        mImpl->mPosition         = 0 ;
+        mImpl->mUpperAddress     = 0 ;
+        mImpl->mNumOfDataRecords = 0 ;
+        return ;
+    }
+
+} // namespace LibSerial
@@ -0,0 +1,303 @@
+/******************************************************************************
+ *   @file HexImage.h                                                         *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _HexImage_h_
+#define _HexImage_h_
+
+#include <SerialPortReceiveHandler.h>
+#include <stdexcept>
+
+namespace LibSerial
+{
+    /**
+     * @brief The text formats for memory images accepted by bootloaders.
+     */
+    enum HexImageFormat
+    {
+        INTEL_HEX,  //!< Intel HEX with extended segment and linear addresses.
+        S_RECORD    //!< Motorola S-records with 16, 24 or 32-bit addresses.
+    } ;
+
+    /**
+     * @brief Receives the contents of a memory image from a
+     *        HexImageDecoder. The methods are called from the SIGIO
+     *        handler when the decoder is attached to a serial port, with
+     *        the same restrictions as a receive handler.
+     */
+    class HexImageHandler
+    {
+    public:
+        /**
+         * @brief Called for each data record.
+         * @param address The absolute address of the first byte.
+         * @param data The bytes of the record.
+         * @param size The number of bytes in data.
+         */
+        virtual void HandleData( const unsigned long  address,
+                                 const unsigned char* data,
+                                 const unsigned int   size ) = 0 ;
+
+        /**
+         * @brief Called for a start address record. Does nothing by
+         *        default.
+         */
+        virtual void HandleStartAddress( const unsigned long address ) ;
+
+        /**
+         * @brief Called for the end of file or termination record. Does
+         *        nothing by default.
+         */
+        virtual void HandleEnd() ;
+
+        virtual ~HexImageHandler() = 0 ;
+    } ;
+
+    /**
+     * @brief Decodes a stream of Intel HEX or S-records and passes the
+     *        data records, with absolute addresses, to a
+     *        HexImageHandler. The hexadecimal digits are decoded and the
+     *        record checksum summed as each chunk of text arrives, so no
+     *        text is buffered.
+     *
+     *        Like ModbusAsciiDecoder, the decoder is a receive handler
+     *        that can be attached to a serial port with
+     *        SerialPort::SetReceiveHandler() or fed by calling
+     *        HandleReceivedData() directly.
+     */
+    class HexImageDecoder : public SerialPortReceiveHandler
+    {
+    public:
+        /**
+         * @brief Constructs a decoder passing the image to imageHandler,
+         *        which must outlive the decoder.
+         */
+        HexImageDecoder( const HexImageFormat format,
+                         HexImageHandler&     imageHandler ) ;
+
+        /**
+         * @brief Destructor.
+         */
+        ~HexImageDecoder() ;
+
+        /**
+         * @brief Decodes the next chunk of text.
+         */
+        void
+        HandleReceivedData( const unsigned char* dataBuffer,
+                            const unsigned int   bufferSize ) ;
+
+        /**
+         * @brief Discards a partially received record and the current
+         *        extended address, to start a new image.
+         */
+        void
+        Reset() ;
+
+        /**
+         * @brief Determines if the end of file or termination record
+         *        has been received since the last Reset().
+         */
+        bool
+        IsComplete() const ;
+
+        /**
+         * @brief Gets the number of valid records received.
+         */
+        unsigned long
+        GetNumOfRecords() const ;
+
+        /**
+         * @brief Gets the number of records dropped because of a wrong
+         *        checksum.
+         */
+        unsigned long
+        GetNumOfChecksumErrors() const ;
+
+        /**
+         * @brief Gets the number of records dropped because they were
+         *        malformed, had an unknown type or a length that does not
+         *        match their byte count. An S-record count record that
+         *        does not match the number of data records is counted
+         *        here as well.
+         */
+        unsigned long
+        GetNumOfMalformedRecords() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        HexImageDecoder( const HexImageDecoder& otherDecoder ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        HexImageDecoder& operator=( const HexImageDecoder& otherDecoder ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+    /**
+     * @brief Encodes a memory image as Intel HEX or S-records, a few
+     *        records at a time, into a buffer supplied by the caller.
+     *        The image is read in place and never copied, so it may be a
+     *        MappedFile of any size. Each call to Encode() fills the
+     *        buffer with as many complete records as fit, ready to be
+     *        passed to SerialPort::Write() or sent one record at a time
+     *        to bootloaders that acknowledge each record.
+     *
+     *        Intel HEX output uses extended linear address records when
+     *        the image extends beyond 64 KiB and ends with an end of file
+     *        record. S-record output starts with an empty S0 header,
+     *        uses the shortest address size that fits the image, and
+     *        ends with a count record and a termination record.
+     */
+    class HexImageEncoder
+    {
+    public:
+        /**
+         * @param format The format to encode the image in.
+         * @param image The image, which must stay valid while the encoder
+         *        is used.
+         * @param imageSize The number of bytes in image.
+         * @param baseAddress The address of the first byte of image.
+         * @param recordDataSize The maximum number of image bytes per
+         *        data record.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        image does not fit in a 32-bit address space or
+         *        recordDataSize is zero or too large for the format.
+         */
+        HexImageEncoder( const HexImageFormat format,
+                         const unsigned char* image,
+                         const unsigned long  imageSize,
+                         const unsigned long  baseAddress = 0,
+                         const unsigned int   recordDataSize = 32 )
+            throw( std::invalid_argument ) ;
+
+        /**
+         * @brief Destructor.
+         */
+        ~HexImageEncoder() ;
+
+        /**
+         * @brief Sets the start address written before the end of the
+         *        image. Without a start address, Intel HEX output has no
+         *        start address record and S-record output a start
+         *        address of 0. Must be called before the first call to
+         *        Encode().
+         * @throw std::invalid_argument This exception is thrown if the
+         *        address does not fit in 32 bits, or if S-records of the
+         *        record data size would not fit the longer address it
+         *        needs. The encoder is left unchanged in that case.
+         */
+        void
+        SetStartAddress( const unsigned long startAddress )
+            throw( std::invalid_argument ) ;
+
+        /**
+         * @brief Gets the number of characters of the longest record.
+         *        Buffers passed to Encode() must be at least this large.
+         */
+        unsigned int
+        GetMaxRecordSize() const ;
+
+        /**
+         * @brief Writes as many complete records as fit into text.
+         * @throw std::invalid_argument This exception is thrown if
+         *        capacity is smaller than GetMaxRecordSize().
+         * @return Returns the number of characters written, which is 0
+         *         once the image is complete.
+         */
+        unsigned int
+        Encode( unsigned char*     text,
+                const unsigned int capacity )
+            throw( std::invalid_argument ) ;
+
+        /**
+         * @brief Determines if all records have been encoded.
+         */
+        bool
+        IsComplete() const ;
+
+        /**
+         * @brief Starts again with the first record.
+         */
+        void
+        Rewind() ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        HexImageEncoder( const HexImageEncoder& otherEncoder ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        HexImageEncoder& operator=( const HexImageEncoder& otherEncoder ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+    inline
+    void
+    HexImageHandler::HandleStartAddress( const unsigned long )
+    {
+        /* empty */
+    }
+
+    inline
+    void
+    HexImageHandler::HandleEnd()
+    {
+        /* empty */
+    }
+
+    inline
+    HexImageHandler::~HexImageHandler()
+    {
+        /* empty */
+    }
+
+} // namespace LibSerial
+
+#endif // #ifndef _HexImage_h_
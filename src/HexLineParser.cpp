@@ -0,0 +1,191 @@
+/******************************************************************************
+ *   @file HexLineParser.cpp                                                  *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "HexLineParser.h"
+#include "AsciiHex.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LibSerial
+{
+    HexLineParser::HexLineParser( LineHandler&        lineHandler,
+                                  const unsigned char startCharacter,
+                                  const bool          hasTypeCharacter,
+                                  const unsigned int  maxNumOfBytes ) :
+        mLineHandler(lineHandler),
+        mStartCharacter(startCharacter),
+        mHasTypeCharacter(hasTypeCharacter),
+        mState(WAITING_FOR_START),
+        mTypeCharacter(0),
+        mBytes(maxNumOfBytes),
+        mNumOfBytes(0),
+        mSum(0),
+        mHasPendingDigit(false),
+        mPendingDigit(0)
+    {
+        /* empty */
+    }
+
+    void
+    HexLineParser::Parse( const unsigned char* text,
+                          const unsigned int   textSize )
+    {
+        unsigned int position = 0 ;
+        while( position < textSize )
+        {
+            switch( mState )
+            {
+            case WAITING_FOR_START:
+                {
+                    const unsigned char* start =
+                        static_cast<const unsigned char*>( memchr( text + position,
+                                                                   mStartCharacter,
+                                                                   textSize - position ) ) ;
+                    if ( NULL == start )
+                    {
+                        return ;
+                    }
+                    position = start - text + 1 ;
+                    mTypeCharacter   = 0 ;
+                    mNumOfBytes      = 0 ;
+                    mSum             = 0 ;
+                    mHasPendingDigit = false ;
+                    mState = mHasTypeCharacter ? WAITING_FOR_TYPE : IN_LINE ;
+                }
+                break ;
+            case WAITING_FOR_TYPE:
+                mTypeCharacter = text[ position++ ] ;
+                mState = IN_LINE ;
+                break ;
+            case IN_LINE:
+                position = this->ParseDigits( text,
+                                              position,
+                                              textSize ) ;
+                break ;
+            }
+        }
+        return ;
+    }
+
+    void
+    HexLineParser::Reset()
+    {
+        mState = WAITING_FOR_START ;
+        return ;
+    }
+
+    unsigned int
+    HexLineParser::ParseDigits( const unsigned char* text,
+                                unsigned int         position,
+                                const unsigned int   textSize )
+    {
+        const unsigned int max_num_of_bytes = mBytes.size() ;
+        if ( mHasPendingDigit )
+        {
+            if ( ! AsciiHex::IsHexDigit( text[ position ] ) )
+            {
+                return this->EndLine( text,
+                                      position ) ;
+            }
+            if ( mNumOfBytes == max_num_of_bytes )
+            {
+                mLineHandler.HandleMalformedLine() ;
+                mState = WAITING_FOR_START ;
+                return position + 1 ;
+            }
+            const unsigned char pair[] = { mPendingDigit, text[ position ] } ;
+            AsciiHex::Decode( pair,
+                              sizeof( pair ),
+                              &mBytes[ mNumOfBytes++ ],
+                              mSum ) ;
+            mHasPendingDigit = false ;
+            ++position ;
+        }
+        //
+        // Decode as many digits as the line can still hold, straight from
+        // the text.
+        //
+        const unsigned int num_of_characters =
+            std::min( textSize - position,
+                      2 * ( max_num_of_bytes - mNumOfBytes ) ) ;
+        const unsigned int num_of_decoded_characters =
+            AsciiHex::Decode( text + position,
+                              num_of_characters,
+                              &mBytes[0] + mNumOfBytes,
+                              mSum ) ;
+        mNumOfBytes += num_of_decoded_characters / 2 ;
+        position += num_of_decoded_characters ;
+        if ( ( position == textSize ) ||
+             ( ! AsciiHex::IsHexDigit( text[ position ] ) ) )
+        {
+            return ( position == textSize ) ? position :
+                                              this->EndLine( text, position ) ;
+        }
+        //
+        // The digits stopped at a digit: either the first digit of a pair
+        // at the end of the chunk, or the line is too long.
+        //
+        if ( ( position + 1 == textSize ) &&
+             ( mNumOfBytes < max_num_of_bytes ) )
+        {
+            mPendingDigit = text[ position ] ;
+            mHasPendingDigit = true ;
+            return textSize ;
+        }
+        if ( mNumOfBytes < max_num_of_bytes )
+        {
+            //
+            // A single digit followed by a character that ends the line.
+            //
+            mHasPendingDigit = true ;
+            return this->EndLine( text,
+                                  position + 1 ) ;
+        }
+        mLineHandler.HandleMalformedLine() ;
+        mState = WAITING_FOR_START ;
+        return position + 1 ;
+    }
+
+    unsigned int
+    HexLineParser::EndLine( const unsigned char* text,
+                            const unsigned int   position )
+    {
+        mState = WAITING_FOR_START ;
+        const unsigned char end_character = text[ position ] ;
+        const bool is_end_of_line = ( ( '\r' == end_character ) ||
+                                      ( '\n' == end_character ) ) ;
+        if ( is_end_of_line &&
+             ( ! mHasPendingDigit ) )
+        {
+            mLineHandler.HandleLine( mTypeCharacter,
+                                     &mBytes[0],
+                                     mNumOfBytes,
+                                     mSum ) ;
+            return position + 1 ;
+        }
+        //
+        // Any other character, including the start of the next line,
+        // ends a malformed line and is then looked at again.
+        //
+        mLineHandler.HandleMalformedLine() ;
+        return is_end_of_line ? position + 1 : position ;
+    }
+
+} // namespace LibSerial
@@ -0,0 +1,149 @@
+/******************************************************************************
+ *   @file HexLineParser.h                                                    *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _HexLineParser_h_
+#define _HexLineParser_h_
+
+#include <vector>
+
+namespace LibSerial
+{
+    /**
+     * @brief Splits a stream of text into lines of the form
+     *        start character, optional type character, pairs of
+     *        hexadecimal digits, CR and/or LF, as used by Modbus ASCII,
+     *        Intel HEX and S-records. The digits are decoded as they
+     *        arrive, so text can be parsed in chunks of any size, and
+     *        the sum of the decoded bytes is kept up to date for the
+     *        checksum. Parse() never allocates memory.
+     */
+    class HexLineParser
+    {
+    public:
+        /**
+         * @brief Receives the lines found by the parser.
+         */
+        class LineHandler
+        {
+        public:
+            /**
+             * @brief Called for each complete line.
+             * @param typeCharacter The character following the start
+             *        character, or 0 if the format has none.
+             * @param bytes The decoded bytes of the line.
+             * @param size The number of decoded bytes.
+             * @param sum The sum of the decoded bytes.
+             */
+            virtual void HandleLine( const unsigned char  typeCharacter,
+                                     const unsigned char* bytes,
+                                     const unsigned int   size,
+                                     const unsigned int   sum ) = 0 ;
+
+            /**
+             * @brief Called for each line that contains a character other
+             *        than a hexadecimal digit, an odd number of digits or
+             *        more bytes than the parser holds.
+             */
+            virtual void HandleMalformedLine() = 0 ;
+
+            virtual ~LineHandler() = 0 ;
+        } ;
+
+        /**
+         * @param lineHandler Receives the lines.
+         * @param startCharacter The character that starts a line.
+         * @param hasTypeCharacter Set if a type character follows the
+         *        start character.
+         * @param maxNumOfBytes The maximum number of bytes in a line.
+         */
+        HexLineParser( LineHandler&        lineHandler,
+                       const unsigned char startCharacter,
+                       const bool          hasTypeCharacter,
+                       const unsigned int  maxNumOfBytes ) ;
+
+        /**
+         * @brief Parses the next chunk of text.
+         */
+        void
+        Parse( const unsigned char* text,
+               const unsigned int   textSize ) ;
+
+        /**
+         * @brief Discards a partially received line.
+         */
+        void
+        Reset() ;
+
+    private:
+        enum State
+        {
+            WAITING_FOR_START,
+            WAITING_FOR_TYPE,
+            IN_LINE
+        } ;
+
+        /*
+         * Decode digits starting at position and handle the character
+         * that ends them.
+         * @return Returns the position of the first character not
+         *         handled.
+         */
+        unsigned int
+        ParseDigits( const unsigned char* text,
+                     unsigned int         position,
+                     const unsigned int   textSize ) ;
+
+        /*
+         * End the current line at the specified character.
+         * @return Returns the position of the first character not
+         *         handled.
+         */
+        unsigned int
+        EndLine( const unsigned char* text,
+                 const unsigned int   position ) ;
+
+        HexLineParser( const HexLineParser& ) ;
+        HexLineParser& operator=( const HexLineParser& ) ;
+
+        LineHandler&               mLineHandler ;
+        const unsigned char        mStartCharacter ;
+        const bool                 mHasTypeCharacter ;
+        State                      mState ;
+        unsigned char              mTypeCharacter ;
+        std::vector<unsigned char> mBytes ;
+        unsigned int               mNumOfBytes ;
+        unsigned int               mSum ;
+
+        //
+        // A digit at the end of a chunk waits here for the second digit
+        // of its pair.
+        //
+        bool                       mHasPendingDigit ;
+        unsigned char              mPendingDigit ;
+    } ;
+
+    inline
+    HexLineParser::LineHandler::~LineHandler()
+    {
+        /* empty */
+    }
+
+} // namespace LibSerial
+
+#endif // #ifndef _HexLineParser_h_
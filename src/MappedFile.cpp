@@ -0,0 +1,126 @@
+/******************************************************************************
+ *   @file MappedFile.cpp                                                     *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LibSerial
+{
+    class MappedFile::Implementation
+    {
+    public:
+        Implementation() :
+            mData(0),
+            mSize(0)
+        {
+            /* empty */
+        }
+
+        void*         mData ;
+        unsigned long mSize ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    MappedFile::MappedFile( const std::string& fileName )
+        throw( std::runtime_error ) :
+        mImpl( new Implementation() )
+    {
+        const int file_descriptor = open( fileName.c_str(),
+                                          O_RDONLY ) ;
+        if ( file_descriptor < 0 )
+        {
+            const std::string error = strerror( errno ) ;
+            delete mImpl ;
+            throw std::runtime_error( fileName + ": " + error ) ;
+        }
+        struct stat file_status ;
+        if ( fstat( file_descriptor, &file_status ) < 0 )
+        {
+            const std::string error = strerror( errno ) ;
+            close( file_descriptor ) ;
+            delete mImpl ;
+            throw std::runtime_error( fileName + ": " + error ) ;
+        }
+        //
+        // Empty files cannot be mapped and have no data.
+        //
+        mImpl->mSize = file_status.st_size ;
+        if ( mImpl->mSize > 0 )
+        {
+            void* data = mmap( NULL,
+                               mImpl->mSize,
+                               PROT_READ,
+                               MAP_PRIVATE,
+                               file_descriptor,
+                               0 ) ;
+            if ( MAP_FAILED == data )
+            {
+                const std::string error = strerror( errno ) ;
+                close( file_descriptor ) ;
+                delete mImpl ;
+                throw std::runtime_error( fileName + ": " + error ) ;
+            }
+            //
+            // Images are read front to back, so the kernel may read ahead
+            // aggressively.
+            //
+            madvise( data,
+                     mImpl->mSize,
+                     MADV_SEQUENTIAL ) ;
+            mImpl->mData = data ;
+        }
+        //
+        // The mapping stays valid after the file is closed.
+        //
+        close( file_descriptor ) ;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if ( 0 != mImpl->mData )
+        {
+            munmap( mImpl->mData,
+                    mImpl->mSize ) ;
+        }
+        delete mImpl ;
+    }
+
+    const unsigned char*
+    MappedFile::GetData() const
+    {
+        return static_cast<const unsigned char*>( mImpl->mData ) ;
+    }
+
+    unsigned long
+    MappedFile::GetSize() const
+    {
+        return mImpl->mSize ;
+    }
+
+} // namespace LibSerial
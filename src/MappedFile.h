@@ -0,0 +1,92 @@
+/******************************************************************************
+ *   @file MappedFile.h                                                       *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _MappedFile_h_
+#define _MappedFile_h_
+
+#include <stdexcept>
+#include <string>
+
+namespace LibSerial
+{
+    /**
+     * @brief A file mapped read-only into memory, such as a firmware
+     *        image to be sent with HexImageEncoder. Pages are read from
+     *        the file as they are first accessed, so images of any size
+     *        can be streamed without copying them into a buffer first.
+     */
+    class MappedFile
+    {
+    public:
+        /**
+         * @brief Maps the complete file.
+         * @throw std::runtime_error This exception is thrown if the file
+         *        cannot be opened or mapped.
+         */
+        explicit
+        MappedFile( const std::string& fileName )
+            throw( std::runtime_error ) ;
+
+        /**
+         * @brief Destructor. Unmaps the file.
+         */
+        ~MappedFile() ;
+
+        /**
+         * @brief Gets the contents of the file, or a null pointer if the
+         *        file is empty.
+         */
+        const unsigned char*
+        GetData() const ;
+
+        /**
+         * @brief Gets the size of the file.
+         */
+        unsigned long
+        GetSize() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        MappedFile( const MappedFile& otherFile ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        MappedFile& operator=( const MappedFile& otherFile ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _MappedFile_h_
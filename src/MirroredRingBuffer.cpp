@@ -0,0 +1,323 @@
+/******************************************************************************
+ *   @file MirroredRingBuffer.cpp                                             *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "MirroredRingBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_CAPACITY = "Invalid ring buffer capacity." ;
+    const std::string ERR_MSG_CONSUME_TOO_MUCH = "Cannot consume more bytes than are readable." ;
+    const std::string ERR_MSG_COMMIT_TOO_MUCH  = "Cannot commit more bytes than are free." ;
+
+    //
+    // Largest supported capacity. Keeps twice the capacity within an
+    // unsigned int.
+    //
+    const unsigned int MAX_CAPACITY = 1U << 30 ;
+
+    /*
+     * Creates an anonymous shared memory object of the specified size
+     * and maps it twice, back to back. Returns NULL if this is not
+     * possible on this system.
+     */
+    unsigned char*
+    MapMirrored( const unsigned int capacity )
+    {
+#if defined(__linux__) && defined(SYS_memfd_create)
+        //
+        // Call memfd_create() through syscall() as older C libraries
+        // do not provide a wrapper.
+        //
+        const unsigned int MEMFD_CLOEXEC = 1 ;
+        const int fd = syscall( SYS_memfd_create,
+                                "libserial-ring",
+                                MEMFD_CLOEXEC ) ;
+        if ( fd < 0 )
+        {
+            return NULL ;
+        }
+        if ( ftruncate( fd, capacity ) < 0 )
+        {
+            close( fd ) ;
+            return NULL ;
+        }
+        //
+        // Reserve a contiguous range of addresses for both copies, then
+        // map the object over each half.
+        //
+        void* const reserved = mmap( NULL,
+                                     2 * static_cast<size_t>( capacity ),
+                                     PROT_NONE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS,
+                                     -1,
+                                     0 ) ;
+        if ( MAP_FAILED == reserved )
+        {
+            close( fd ) ;
+            return NULL ;
+        }
+        unsigned char* const base = static_cast<unsigned char*>( reserved ) ;
+        if ( ( MAP_FAILED == mmap( base,
+                                   capacity,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_FIXED,
+                                   fd,
+                                   0 ) ) ||
+             ( MAP_FAILED == mmap( base + capacity,
+                                   capacity,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_FIXED,
+                                   fd,
+                                   0 ) ) )
+        {
+            munmap( reserved, 2 * static_cast<size_t>( capacity ) ) ;
+            close( fd ) ;
+            return NULL ;
+        }
+        //
+        // The mappings keep the memory object alive.
+        //
+        close( fd ) ;
+        return base ;
+#else
+        ( void )capacity ;
+        return NULL ;
+#endif
+    }
+}
+
+namespace LibSerial
+{
+    class MirroredRingBuffer::Implementation
+    {
+    public:
+        Implementation( unsigned char*     storage,
+                        const unsigned int capacity,
+                        const bool         isMirrored ) ;
+
+        unsigned char* const mStorage ;
+        const unsigned int   mCapacity ;
+        const bool           mIsMirrored ;
+
+        //
+        // Total number of bytes ever written and read. Each counter has a
+        // single writer. The capacity is a power of two, so the counters
+        // may wrap around freely.
+        //
+        std::atomic<unsigned int> mWriteCount ;
+        std::atomic<unsigned int> mReadCount ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    MirroredRingBuffer::MirroredRingBuffer( const unsigned int minimumCapacity,
+                                            const bool         allowMirroring )
+        throw( std::invalid_argument,
+               std::bad_alloc ) :
+        mImpl( NULL )
+    {
+        if ( ( 0 == minimumCapacity ) ||
+             ( minimumCapacity > MAX_CAPACITY ) )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_CAPACITY ) ;
+        }
+        const unsigned int page_size = sysconf( _SC_PAGESIZE ) ;
+        unsigned int capacity = 1 ;
+        while( ( capacity < minimumCapacity ) ||
+               ( capacity < page_size ) )
+        {
+            capacity <<= 1 ;
+        }
+        unsigned char* storage = allowMirroring ? MapMirrored( capacity ) : NULL ;
+        const bool is_mirrored = ( NULL != storage ) ;
+        if ( ! is_mirrored )
+        {
+            storage = new unsigned char[ capacity ] ;
+        }
+        mImpl = new Implementation( storage,
+                                    capacity,
+                                    is_mirrored ) ;
+    }
+
+    MirroredRingBuffer::~MirroredRingBuffer()
+    {
+        if ( mImpl->mIsMirrored )
+        {
+            munmap( mImpl->mStorage,
+                    2 * static_cast<size_t>( mImpl->mCapacity ) ) ;
+        }
+        else
+        {
+            delete [] mImpl->mStorage ;
+        }
+        delete mImpl ;
+    }
+
+    bool
+    MirroredRingBuffer::IsMirrored() const
+    {
+        return mImpl->mIsMirrored ;
+    }
+
+    unsigned int
+    MirroredRingBuffer::GetCapacity() const
+    {
+        return mImpl->mCapacity ;
+    }
+
+    unsigned int
+    MirroredRingBuffer::GetSize() const
+    {
+        return mImpl->mWriteCount.load( std::memory_order_acquire ) -
+               mImpl->mReadCount.load( std::memory_order_acquire ) ;
+    }
+
+    unsigned int
+    MirroredRingBuffer::GetFreeSpace() const
+    {
+        return mImpl->mCapacity - this->GetSize() ;
+    }
+
+    const unsigned char*
+    MirroredRingBuffer::GetReadSpan( unsigned int& spanSize ) const
+    {
+        const unsigned int read_count = mImpl->mReadCount.load( std::memory_order_relaxed ) ;
+        const unsigned int offset = read_count & ( mImpl->mCapacity - 1 ) ;
+        spanSize = mImpl->mWriteCount.load( std::memory_order_acquire ) - read_count ;
+        if ( ! mImpl->mIsMirrored )
+        {
+            spanSize = std::min( spanSize, mImpl->mCapacity - offset ) ;
+        }
+        return mImpl->mStorage + offset ;
+    }
+
+    void
+    MirroredRingBuffer::Consume( const unsigned int numOfBytes )
+        throw( std::out_of_range )
+    {
+        if ( numOfBytes > this->GetSize() )
+        {
+            throw std::out_of_range( ERR_MSG_CONSUME_TOO_MUCH ) ;
+        }
+        mImpl->mReadCount.fetch_add( numOfBytes,
+                                     std::memory_order_release ) ;
+        return ;
+    }
+
+    unsigned char*
+    MirroredRingBuffer::GetWriteSpan( unsigned int& spanSize )
+    {
+        const unsigned int write_count = mImpl->mWriteCount.load( std::memory_order_relaxed ) ;
+        const unsigned int offset = write_count & ( mImpl->mCapacity - 1 ) ;
+        spanSize = mImpl->mCapacity -
+                   ( write_count - mImpl->mReadCount.load( std::memory_order_acquire ) ) ;
+        if ( ! mImpl->mIsMirrored )
+        {
+            spanSize = std::min( spanSize, mImpl->mCapacity - offset ) ;
+        }
+        return mImpl->mStorage + offset ;
+    }
+
+    void
+    MirroredRingBuffer::Commit( const unsigned int numOfBytes )
+        throw( std::out_of_range )
+    {
+        if ( numOfBytes > this->GetFreeSpace() )
+        {
+            throw std::out_of_range( ERR_MSG_COMMIT_TOO_MUCH ) ;
+        }
+        mImpl->mWriteCount.fetch_add( numOfBytes,
+                                      std::memory_order_release ) ;
+        return ;
+    }
+
+    unsigned int
+    MirroredRingBuffer::Write( const unsigned char* dataBuffer,
+                               const unsigned int   bufferSize )
+    {
+        unsigned int num_of_bytes_written = 0 ;
+        while( num_of_bytes_written < bufferSize )
+        {
+            unsigned int span_size = 0 ;
+            unsigned char* const span = this->GetWriteSpan( span_size ) ;
+            if ( 0 == span_size )
+            {
+                break ;
+            }
+            const unsigned int chunk_size = std::min( span_size,
+                                                      bufferSize - num_of_bytes_written ) ;
+            memcpy( span,
+                    dataBuffer + num_of_bytes_written,
+                    chunk_size ) ;
+            mImpl->mWriteCount.fetch_add( chunk_size,
+                                          std::memory_order_release ) ;
+            num_of_bytes_written += chunk_size ;
+        }
+        return num_of_bytes_written ;
+    }
+
+    unsigned int
+    MirroredRingBuffer::Read( unsigned char*     dataBuffer,
+                              const unsigned int bufferSize )
+    {
+        unsigned int num_of_bytes_read = 0 ;
+        while( num_of_bytes_read < bufferSize )
+        {
+            unsigned int span_size = 0 ;
+            const unsigned char* const span = this->GetReadSpan( span_size ) ;
+            if ( 0 == span_size )
+            {
+                break ;
+            }
+            const unsigned int chunk_size = std::min( span_size,
+                                                      bufferSize - num_of_bytes_read ) ;
+            memcpy( dataBuffer + num_of_bytes_read,
+                    span,
+                    chunk_size ) ;
+            mImpl->mReadCount.fetch_add( chunk_size,
+                                         std::memory_order_release ) ;
+            num_of_bytes_read += chunk_size ;
+        }
+        return num_of_bytes_read ;
+    }
+
+    /* ------------------------------------------------------------ */
+    MirroredRingBuffer::Implementation::Implementation( unsigned char*     storage,
+                                                        const unsigned int capacity,
+                                                        const bool         isMirrored ) :
+        mStorage(storage),
+        mCapacity(capacity),
+        mIsMirrored(isMirrored),
+        mWriteCount(0),
+        mReadCount(0)
+    {
+        /* empty */
+    }
+}
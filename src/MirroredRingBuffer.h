@@ -0,0 +1,185 @@
+/******************************************************************************
+ *   @file MirroredRingBuffer.h                                               *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _MirroredRingBuffer_h_
+#define _MirroredRingBuffer_h_
+
+#include <new>
+#include <stdexcept>
+
+namespace LibSerial
+{
+    /**
+     * @brief A single-producer single-consumer byte ring buffer whose
+     *        storage is mapped twice, back to back, in virtual memory.
+     *        Since the byte following the last byte of the buffer is the
+     *        first byte again, the readable data and the free space are
+     *        each always available as one contiguous span, whatever their
+     *        position in the ring. Parsers, memchr() and read() can work
+     *        on the spans directly without handling the wrap-around.
+     *
+     *        Mirroring needs memfd_create() and is therefore only
+     *        available on Linux. Elsewhere, or if the mapping fails, the
+     *        buffer falls back to an ordinary ring whose spans stop at
+     *        the end of the storage, so that a second call is needed to
+     *        get the data that wrapped around.
+     *
+     *        The producer and the consumer may run concurrently without
+     *        locking, including from a signal handler: the methods never
+     *        block and never allocate memory.
+     */
+    class MirroredRingBuffer
+    {
+    public:
+        /**
+         * @brief Constructs a ring buffer that holds at least
+         *        minimumCapacity bytes. The capacity is rounded up to a
+         *        power of two and to a whole number of pages.
+         * @param minimumCapacity The minimum number of bytes to hold.
+         * @param allowMirroring Set to false to always use an ordinary
+         *        ring.
+         * @throw std::invalid_argument This exception is thrown if
+         *        minimumCapacity is zero or too large.
+         * @throw std::bad_alloc This exception is thrown if the storage
+         *        cannot be allocated.
+         */
+        explicit
+        MirroredRingBuffer( const unsigned int minimumCapacity,
+                            const bool         allowMirroring = true )
+            throw( std::invalid_argument,
+                   std::bad_alloc ) ;
+
+        /**
+         * @brief Destructor. Unmaps or frees the storage.
+         */
+        ~MirroredRingBuffer() ;
+
+        /**
+         * @brief Determines if the storage is mapped twice so that all
+         *        spans are contiguous.
+         */
+        bool
+        IsMirrored() const ;
+
+        /**
+         * @brief Gets the number of bytes the buffer can hold.
+         */
+        unsigned int
+        GetCapacity() const ;
+
+        /**
+         * @brief Gets the number of bytes that can be read.
+         */
+        unsigned int
+        GetSize() const ;
+
+        /**
+         * @brief Gets the number of bytes that can be written.
+         */
+        unsigned int
+        GetFreeSpace() const ;
+
+        /**
+         * @brief Gets the readable data as a single span. If the buffer
+         *        is mirrored, the span covers all readable data.
+         *        Consumer only.
+         * @param spanSize Receives the number of bytes in the span.
+         * @return Returns a pointer to the first readable byte.
+         */
+        const unsigned char*
+        GetReadSpan( unsigned int& spanSize ) const ;
+
+        /**
+         * @brief Discards numOfBytes bytes from the front of the readable
+         *        data, making their space available to the producer.
+         *        Consumer only.
+         * @throw std::out_of_range This exception is thrown if fewer than
+         *        numOfBytes bytes are readable.
+         */
+        void
+        Consume( const unsigned int numOfBytes )
+            throw( std::out_of_range ) ;
+
+        /**
+         * @brief Gets the free space as a single span. If the buffer is
+         *        mirrored, the span covers all free space. Producer only.
+         * @param spanSize Receives the number of bytes in the span.
+         * @return Returns a pointer to the first free byte.
+         */
+        unsigned char*
+        GetWriteSpan( unsigned int& spanSize ) ;
+
+        /**
+         * @brief Makes numOfBytes bytes written to the write span
+         *        readable. Producer only.
+         * @throw std::out_of_range This exception is thrown if fewer than
+         *        numOfBytes bytes are free.
+         */
+        void
+        Commit( const unsigned int numOfBytes )
+            throw( std::out_of_range ) ;
+
+        /**
+         * @brief Copies up to bufferSize bytes into the buffer. Producer
+         *        only.
+         * @return Returns the number of bytes copied, which is smaller
+         *         than bufferSize if the buffer is full.
+         */
+        unsigned int
+        Write( const unsigned char* dataBuffer,
+               const unsigned int   bufferSize ) ;
+
+        /**
+         * @brief Copies up to bufferSize bytes out of the buffer and
+         *        consumes them. Consumer only.
+         * @return Returns the number of bytes copied.
+         */
+        unsigned int
+        Read( unsigned char*     dataBuffer,
+              const unsigned int bufferSize ) ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        MirroredRingBuffer( const MirroredRingBuffer& otherBuffer ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        MirroredRingBuffer& operator=( const MirroredRingBuffer& otherBuffer ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _MirroredRingBuffer_h_
@@ -0,0 +1,211 @@
+/******************************************************************************
+ *   @file Modbus.cpp                                                         *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "Modbus.h"
+#include "AsciiHex.h"
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_FRAME_SIZE = "Invalid Modbus frame size." ;
+
+    /*
+     * Lookup table for the reflected CRC-16 polynomial 0xA001 used by
+     * Modbus RTU, filled in during static initialization.
+     */
+    struct Crc16Table
+    {
+        unsigned short mEntries[256] ;
+
+        Crc16Table()
+        {
+            for( unsigned int i=0; i<256; ++i )
+            {
+                unsigned short crc = i ;
+                for( int bit=0; bit<8; ++bit )
+                {
+                    crc = ( crc & 1 ) ? ( ( crc >> 1 ) ^ 0xA001 ) : ( crc >> 1 ) ;
+                }
+                mEntries[i] = crc ;
+            }
+        }
+    } ;
+
+    const Crc16Table CRC16_TABLE ;
+
+    //
+    // Number of bits in a single character on the wire: one start bit,
+    // eight data bits, one parity or stop bit and one stop bit.
+    //
+    const unsigned int BITS_PER_CHARACTER = 11 ;
+
+    const unsigned int MICROSECONDS_PER_SECOND = 1000000 ;
+}
+
+namespace LibSerial
+{
+    namespace Modbus
+    {
+        unsigned short
+        Crc16( const unsigned char* dataBuffer,
+               const unsigned int   bufferSize )
+        {
+            unsigned short crc = 0xFFFF ;
+            for( unsigned int i=0; i<bufferSize; ++i )
+            {
+                crc = ( crc >> 8 ) ^
+                      CRC16_TABLE.mEntries[ ( crc ^ dataBuffer[i] ) & 0xFF ] ;
+            }
+            return crc ;
+        }
+
+        unsigned char
+        Lrc( const unsigned char* dataBuffer,
+             const unsigned int   bufferSize )
+        {
+            unsigned int sum = 0 ;
+            for( unsigned int i=0; i<bufferSize; ++i )
+            {
+                sum += dataBuffer[i] ;
+            }
+            return static_cast<unsigned char>( -sum ) ;
+        }
+
+        unsigned int
+        EncodeAsciiFrame( const unsigned char* frame,
+                          const unsigned int   frameSize,
+                          unsigned char*       text )
+            throw( std::invalid_argument )
+        {
+            if ( ( frameSize < 2 ) ||
+                 ( frameSize > MAX_RTU_FRAME_SIZE - 2 ) )
+            {
+                throw std::invalid_argument( ERR_MSG_INVALID_FRAME_SIZE ) ;
+            }
+            text[0] = ':' ;
+            const unsigned int sum = AsciiHex::Encode( frame,
+                                                       frameSize,
+                                                       text + 1 ) ;
+            const unsigned char lrc = static_cast<unsigned char>( -sum ) ;
+            AsciiHex::Encode( &lrc,
+                              1,
+                              text + 1 + 2 * frameSize ) ;
+            text[ 2 * frameSize + 3 ] = '\r' ;
+            text[ 2 * frameSize + 4 ] = '\n' ;
+            return 2 * frameSize + 5 ;
+        }
+
+        unsigned int
+        InterFrameGapMicroseconds( const SerialPort::BaudRate baudRate )
+        {
+            const unsigned int bits_per_second = SerialPort::GetBitsPerSecond( baudRate ) ;
+            if ( ( 0 == bits_per_second ) ||
+                 ( bits_per_second > 19200 ) )
+            {
+                return 1750 ;
+            }
+            //
+            // 3.5 character times, rounded up.
+            //
+            return ( 7 * BITS_PER_CHARACTER * MICROSECONDS_PER_SECOND +
+                     2 * bits_per_second - 1 ) / ( 2 * bits_per_second ) ;
+        }
+
+        int
+        RequestFrameSize( const unsigned char* frame,
+                          const unsigned int   frameSize )
+        {
+            //
+            // We need at least the address and the function code.
+            //
+            if ( frameSize < 2 )
+            {
+                return 0 ;
+            }
+            switch( frame[1] )
+            {
+            case READ_COILS:
+            case READ_DISCRETE_INPUTS:
+            case READ_HOLDING_REGISTERS:
+            case READ_INPUT_REGISTERS:
+            case WRITE_SINGLE_COIL:
+            case WRITE_SINGLE_REGISTER:
+                //
+                // Address, function code, two 16-bit fields and the CRC.
+                //
+                return 8 ;
+            case WRITE_MULTIPLE_COILS:
+            case WRITE_MULTIPLE_REGISTERS:
+                //
+                // Address, function code, starting address, quantity,
+                // byte count, the data bytes and the CRC.
+                //
+                if ( frameSize < 7 )
+                {
+                    return 0 ;
+                }
+                return 9 + frame[6] ;
+            default:
+                break ;
+            }
+            return -1 ;
+        }
+
+        int
+        ResponseFrameSize( const unsigned char* frame,
+                           const unsigned int   frameSize )
+        {
+            if ( frameSize < 2 )
+            {
+                return 0 ;
+            }
+            //
+            // Exception responses carry a single exception code.
+            //
+            if ( frame[1] & 0x80 )
+            {
+                return 5 ;
+            }
+            switch( frame[1] )
+            {
+            case READ_COILS:
+            case READ_DISCRETE_INPUTS:
+            case READ_HOLDING_REGISTERS:
+            case READ_INPUT_REGISTERS:
+                //
+                // Address, function code, byte count, the data bytes and
+                // the CRC.
+                //
+                if ( frameSize < 3 )
+                {
+                    return 0 ;
+                }
+                return 5 + frame[2] ;
+            case WRITE_SINGLE_COIL:
+            case WRITE_SINGLE_REGISTER:
+            case WRITE_MULTIPLE_COILS:
+            case WRITE_MULTIPLE_REGISTERS:
+                return 8 ;
+            default:
+                break ;
+            }
+            return -1 ;
+        }
+    }
+}
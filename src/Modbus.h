@@ -0,0 +1,179 @@
+/******************************************************************************
+ *   @file Modbus.h                                                           *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _Modbus_h_
+#define _Modbus_h_
+
+#include <SerialPort.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief Constants and helper functions shared by the Modbus
+     *        components of libserial.
+     */
+    namespace Modbus
+    {
+        /**
+         * @brief The Modbus function codes understood by libserial.
+         */
+        enum FunctionCode {
+            READ_COILS                = 0x01,
+            READ_DISCRETE_INPUTS      = 0x02,
+            READ_HOLDING_REGISTERS    = 0x03,
+            READ_INPUT_REGISTERS      = 0x04,
+            WRITE_SINGLE_COIL         = 0x05,
+            WRITE_SINGLE_REGISTER     = 0x06,
+            WRITE_MULTIPLE_COILS      = 0x0F,
+            WRITE_MULTIPLE_REGISTERS  = 0x10
+        } ;
+
+        /**
+         * @brief The Modbus exception codes returned in exception
+         *        responses.
+         */
+        enum ExceptionCode {
+            ILLEGAL_FUNCTION           = 0x01,
+            ILLEGAL_DATA_ADDRESS       = 0x02,
+            ILLEGAL_DATA_VALUE         = 0x03,
+            SLAVE_DEVICE_FAILURE       = 0x04,
+            SLAVE_DEVICE_BUSY          = 0x06,
+            GATEWAY_PATH_UNAVAILABLE   = 0x0A,
+            GATEWAY_TARGET_NO_RESPONSE = 0x0B
+        } ;
+
+        /**
+         * @brief The broadcast slave address. Requests sent to this
+         *        address are processed by all slaves and never answered.
+         */
+        const unsigned char BROADCAST_ADDRESS = 0 ;
+
+        /**
+         * @brief Maximum size of a Modbus RTU frame including the address
+         *        and the CRC.
+         */
+        const unsigned int MAX_RTU_FRAME_SIZE = 256 ;
+
+        /**
+         * @brief Maximum size of a Modbus ASCII frame: the colon, two
+         *        hexadecimal digits for each byte of the address, the PDU
+         *        and the LRC, and CR LF.
+         */
+        const unsigned int MAX_ASCII_FRAME_SIZE = 1 + 2 * ( MAX_RTU_FRAME_SIZE - 1 ) + 2 ;
+
+        /**
+         * @brief Maximum number of registers in a single read request.
+         */
+        const unsigned int MAX_READ_REGISTERS = 125 ;
+
+        /**
+         * @brief Maximum number of registers in a single write request.
+         */
+        const unsigned int MAX_WRITE_REGISTERS = 123 ;
+
+        /**
+         * @brief Maximum number of coils or discrete inputs in a single
+         *        read request.
+         */
+        const unsigned int MAX_READ_BITS = 2000 ;
+
+        /**
+         * @brief Maximum number of coils in a single write request.
+         */
+        const unsigned int MAX_WRITE_BITS = 1968 ;
+
+        /**
+         * @brief Computes the Modbus RTU CRC-16 of the specified bytes.
+         *        The CRC is transmitted low byte first.
+         * @param dataBuffer The bytes to compute the CRC of.
+         * @param bufferSize The number of bytes in dataBuffer.
+         * @return Returns the CRC-16 of the data.
+         */
+        unsigned short
+        Crc16( const unsigned char* dataBuffer,
+               const unsigned int   bufferSize ) ;
+
+        /**
+         * @brief Computes the Modbus ASCII LRC of the specified bytes:
+         *        the two's complement of their sum.
+         */
+        unsigned char
+        Lrc( const unsigned char* dataBuffer,
+             const unsigned int   bufferSize ) ;
+
+        /**
+         * @brief Encodes a frame as a Modbus ASCII frame, appending the
+         *        LRC.
+         * @param frame The address and the PDU, without a checksum.
+         * @param frameSize The number of bytes in frame.
+         * @param text Receives the frame, which takes 2 * frameSize + 5
+         *        characters.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        frame is shorter than an address and a function code or
+         *        too long for a Modbus frame.
+         * @return Returns the number of characters written to text.
+         */
+        unsigned int
+        EncodeAsciiFrame( const unsigned char* frame,
+                          const unsigned int   frameSize,
+                          unsigned char*       text )
+            throw( std::invalid_argument ) ;
+
+        /**
+         * @brief Returns the minimum silent interval between two Modbus
+         *        RTU frames (3.5 character times) in microseconds at the
+         *        specified baud rate. As recommended by the Modbus over
+         *        serial line specification, a fixed value of 1750us is
+         *        used for baud rates above 19200.
+         */
+        unsigned int
+        InterFrameGapMicroseconds( const SerialPort::BaudRate baudRate ) ;
+
+        /**
+         * @brief Returns the expected size of a complete Modbus RTU
+         *        request frame, including the address and the CRC, given
+         *        the first frameSize bytes of the frame.
+         * @return Returns the expected size of the frame, 0 if more bytes
+         *         are needed to determine it, or -1 if the function code
+         *         is not supported and the frame size cannot be
+         *         determined.
+         */
+        int
+        RequestFrameSize( const unsigned char* frame,
+                          const unsigned int   frameSize ) ;
+
+        /**
+         * @brief Returns the expected size of a complete Modbus RTU
+         *        response frame, including the address and the CRC, given
+         *        the first frameSize bytes of the frame.
+         * @return Returns the expected size of the frame, 0 if more bytes
+         *         are needed to determine it, or -1 if the function code
+         *         is not supported and the frame size cannot be
+         *         determined.
+         */
+        int
+        ResponseFrameSize( const unsigned char* frame,
+                           const unsigned int   frameSize ) ;
+
+    } // namespace Modbus
+
+} // namespace LibSerial
+
+#endif // #ifndef _Modbus_h_
@@ -0,0 +1,134 @@
+/******************************************************************************
+ *   @file ModbusAsciiDecoder.cpp                                             *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "ModbusAsciiDecoder.h"
+#include "HexLineParser.h"
+
+#include <atomic>
+
+namespace LibSerial
+{
+    class ModbusAsciiDecoder::Implementation : public HexLineParser::LineHandler
+    {
+    public:
+        explicit
+        Implementation( FrameHandler& frameHandler ) :
+            mFrameHandler(frameHandler),
+            mParser( *this,
+                     ':',
+                     false,
+                     Modbus::MAX_RTU_FRAME_SIZE - 1 ),
+            mNumOfFrames(0),
+            mNumOfLrcErrors(0),
+            mNumOfMalformedFrames(0)
+        {
+            /* empty */
+        }
+
+        void
+        HandleLine( const unsigned char,
+                    const unsigned char* bytes,
+                    const unsigned int   size,
+                    const unsigned int   sum )
+        {
+            //
+            // At least an address, a function code and the LRC. The sum
+            // of all bytes including the LRC is zero.
+            //
+            if ( size < 3 )
+            {
+                ++mNumOfMalformedFrames ;
+                return ;
+            }
+            if ( 0 != ( sum & 0xFF ) )
+            {
+                ++mNumOfLrcErrors ;
+                return ;
+            }
+            ++mNumOfFrames ;
+            mFrameHandler.HandleFrame( bytes,
+                                       size - 1 ) ;
+            return ;
+        }
+
+        void
+        HandleMalformedLine()
+        {
+            ++mNumOfMalformedFrames ;
+            return ;
+        }
+
+        FrameHandler&              mFrameHandler ;
+        HexLineParser              mParser ;
+        std::atomic<unsigned long> mNumOfFrames ;
+        std::atomic<unsigned long> mNumOfLrcErrors ;
+        std::atomic<unsigned long> mNumOfMalformedFrames ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    ModbusAsciiDecoder::ModbusAsciiDecoder( FrameHandler& frameHandler ) :
+        mImpl( new Implementation( frameHandler ) )
+    {
+        /* empty */
+    }
+
+    ModbusAsciiDecoder::~ModbusAsciiDecoder()
+    {
+        delete mImpl ;
+    }
+
+    void
+    ModbusAsciiDecoder::HandleReceivedData( const unsigned char* dataBuffer,
+                                            const unsigned int   bufferSize )
+    {
+        mImpl->mParser.Parse( dataBuffer,
+                              bufferSize ) ;
+        return ;
+    }
+
+    void
+    ModbusAsciiDecoder::Reset()
+    {
+        mImpl->mParser.Reset() ;
+        return ;
+    }
+
+    unsigned long
+    ModbusAsciiDecoder::GetNumOfFrames() const
+    {
+        return mImpl->mNumOfFrames.load() ;
+    }
+
+    unsigned long
+    ModbusAsciiDecoder::GetNumOfLrcErrors() const
+    {
+        return mImpl->mNumOfLrcErrors.load() ;
+    }
+
+    unsigned long
+    ModbusAsciiDecoder::GetNumOfMalformedFrames() const
+    {
+        return mImpl->mNumOfMalformedFrames.load() ;
+    }
+
+} // namespace LibSerial
@@ -0,0 +1,141 @@
+/******************************************************************************
+ *   @file ModbusAsciiDecoder.h                                               *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _ModbusAsciiDecoder_h_
+#define _ModbusAsciiDecoder_h_
+
+#include <Modbus.h>
+#include <SerialPortReceiveHandler.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief Decodes a stream of Modbus ASCII frames, as produced by
+     *        Modbus::EncodeAsciiFrame(). The hexadecimal digits are
+     *        decoded and the LRC summed as each chunk of text arrives, so
+     *        no text is buffered and a frame is passed on as soon as its
+     *        CR is received.
+     *
+     *        The decoder is a receive handler: attached to a serial port
+     *        with SerialPort::SetReceiveHandler(), it decodes the data
+     *        in the buffer the SIGIO handler read it into. It may also be
+     *        fed from SerialPort::GetReceivedData() or any other source
+     *        by calling HandleReceivedData() directly.
+     */
+    class ModbusAsciiDecoder : public SerialPortReceiveHandler
+    {
+    public:
+        /**
+         * @brief Receives the frames with a valid LRC. Called from the
+         *        SIGIO handler when the decoder is attached to a serial
+         *        port, with the same restrictions as a receive handler.
+         */
+        class FrameHandler
+        {
+        public:
+            /**
+             * @param frame The address and the PDU, without the LRC.
+             * @param frameSize The number of bytes in frame.
+             */
+            virtual void HandleFrame( const unsigned char* frame,
+                                      const unsigned int   frameSize ) = 0 ;
+
+            virtual ~FrameHandler() = 0 ;
+        } ;
+
+        /**
+         * @brief Constructs a decoder passing frames to frameHandler,
+         *        which must outlive the decoder.
+         */
+        explicit
+        ModbusAsciiDecoder( FrameHandler& frameHandler ) ;
+
+        /**
+         * @brief Destructor.
+         */
+        ~ModbusAsciiDecoder() ;
+
+        /**
+         * @brief Decodes the next chunk of text.
+         */
+        void
+        HandleReceivedData( const unsigned char* dataBuffer,
+                            const unsigned int   bufferSize ) ;
+
+        /**
+         * @brief Discards a partially received frame.
+         */
+        void
+        Reset() ;
+
+        /**
+         * @brief Gets the number of frames passed to the frame handler.
+         */
+        unsigned long
+        GetNumOfFrames() const ;
+
+        /**
+         * @brief Gets the number of frames dropped because of a wrong
+         *        LRC.
+         */
+        unsigned long
+        GetNumOfLrcErrors() const ;
+
+        /**
+         * @brief Gets the number of frames dropped because they were
+         *        malformed or too short.
+         */
+        unsigned long
+        GetNumOfMalformedFrames() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        ModbusAsciiDecoder( const ModbusAsciiDecoder& otherDecoder ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        ModbusAsciiDecoder& operator=( const ModbusAsciiDecoder& otherDecoder ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+    inline
+    ModbusAsciiDecoder::FrameHandler::~FrameHandler()
+    {
+        /* empty */
+    }
+
+} // namespace LibSerial
+
+#endif // #ifndef _ModbusAsciiDecoder_h_
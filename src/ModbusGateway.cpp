@@ -0,0 +1,1313 @@
+/******************************************************************************
+ *   @file ModbusGateway.cpp                                                  *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "ModbusGateway.h"
+#include "Modbus.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_BIND_ADDRESS = "Invalid gateway bind address." ;
+    const std::string ERR_MSG_CANNOT_START_THREAD  = "Cannot start the gateway thread." ;
+
+    //
+    // Size of the Modbus TCP application protocol (MBAP) header including
+    // the unit identifier.
+    //
+    const unsigned int MBAP_HEADER_SIZE = 7 ;
+
+    //
+    // Largest value of the MBAP length field: the unit identifier and a
+    // PDU that fits in a Modbus RTU frame.
+    //
+    const unsigned int MAX_MBAP_LENGTH = LibSerial::Modbus::MAX_RTU_FRAME_SIZE - 2 ;
+
+    const unsigned int DEFAULT_RESPONSE_TIMEOUT_MS = 1000 ;
+
+    const int LISTEN_BACKLOG = 16 ;
+
+    const int NUM_OF_UNITS = 256 ;
+
+    /*
+     * A request from a TCP client waiting for the serial bus.
+     */
+    struct PendingRequest
+    {
+        unsigned long              mClientId ;
+        unsigned short             mTransactionId ;
+        unsigned char              mUnitIdentifier ;
+        std::vector<unsigned char> mPdu ;
+        unsigned int               mStartAddress ;
+        unsigned int               mQuantity ;
+        int                        mPriority ;
+        unsigned long              mSequence ;
+        bool                       mIsCoalescable ;
+    } ;
+
+    /*
+     * A value read from the bus and the time at which it was read.
+     */
+    struct CacheEntry
+    {
+        unsigned short     mValue ;
+        unsigned long long mTimestamp ;
+    } ;
+
+    /*
+     * A connected Modbus TCP client.
+     */
+    struct ClientConnection
+    {
+        int                        mFileDescriptor ;
+        std::vector<unsigned char> mInputBuffer ;
+    } ;
+
+    inline
+    unsigned short
+    GetUint16( const unsigned char* data )
+    {
+        return ( data[0] << 8 ) | data[1] ;
+    }
+
+    inline
+    void
+    PutUint16( unsigned char* data,
+               const unsigned short value )
+    {
+        data[0] = value >> 8 ;
+        data[1] = value & 0xFF ;
+    }
+
+    inline
+    unsigned long long
+    MonotonicMicroseconds()
+    {
+        struct timespec now ;
+        clock_gettime( CLOCK_MONOTONIC,
+                       &now ) ;
+        return static_cast<unsigned long long>( now.tv_sec ) * 1000000ULL +
+               now.tv_nsec / 1000 ;
+    }
+
+    inline
+    bool
+    IsBitFunction( const unsigned char functionCode )
+    {
+        return ( LibSerial::Modbus::READ_COILS == functionCode ) ||
+               ( LibSerial::Modbus::READ_DISCRETE_INPUTS == functionCode ) ;
+    }
+
+    /*
+     * Key of a cache entry: the unit, the read function code that
+     * identifies the table, and the address.
+     */
+    inline
+    unsigned long
+    CacheKey( const unsigned char  unitIdentifier,
+              const unsigned char  functionCode,
+              const unsigned int   address )
+    {
+        return ( static_cast<unsigned long>( unitIdentifier ) << 24 ) |
+               ( static_cast<unsigned long>( functionCode ) << 16 ) |
+               address ;
+    }
+}
+
+namespace LibSerial
+{
+    class ModbusGateway::Implementation
+    {
+    public:
+        Implementation( SerialPort&          serialPort,
+                        const unsigned short tcpPort,
+                        const std::string&   bindAddress ) ;
+
+        /*
+         * Entry point of the worker thread.
+         */
+        static
+        void*
+        ThreadMain( void* implementation ) ;
+
+        /*
+         * The worker loop: accept clients, read requests and run one bus
+         * transaction per iteration.
+         */
+        void
+        Run() ;
+
+        void
+        AcceptClient() ;
+
+        void
+        CloseClient( const unsigned long clientId ) ;
+
+        void
+        CloseAllClients() ;
+
+        /*
+         * Read data from a client and handle all complete requests.
+         */
+        void
+        ReadClient( const unsigned long clientId ) ;
+
+        void
+        HandleClientRequest( const unsigned long  clientId,
+                             const unsigned char* frame,
+                             const unsigned int   frameSize ) ;
+
+        void
+        SendResponse( const unsigned long  clientId,
+                      const unsigned short transactionId,
+                      const unsigned char  unitIdentifier,
+                      const unsigned char* pdu,
+                      const unsigned int   pduSize ) ;
+
+        void
+        SendException( const unsigned long         clientId,
+                       const unsigned short        transactionId,
+                       const unsigned char         unitIdentifier,
+                       const unsigned char         functionCode,
+                       const Modbus::ExceptionCode exceptionCode ) ;
+
+        /*
+         * Answer a read request from the specified values.
+         */
+        void
+        SendReadResponse( const PendingRequest& request,
+                          const unsigned short* values ) ;
+
+        /*
+         * Answer a read request from the cache if all the entries it
+         * covers are fresh.
+         */
+        bool
+        AnswerFromCache( const PendingRequest& request ) ;
+
+        void
+        InvalidateCache( const unsigned char unitIdentifier,
+                         const unsigned char functionCode,
+                         const unsigned int  startAddress,
+                         const unsigned int  quantity ) ;
+
+        /*
+         * Run the next bus transaction: the most urgent write if there
+         * is one, otherwise the oldest read merged with all compatible
+         * pending reads.
+         */
+        void
+        ServiceBus() ;
+
+        void
+        ExecuteWrite( const PendingRequest& request ) ;
+
+        void
+        ExecuteRead() ;
+
+        /*
+         * Send an RTU request consisting of the unit identifier and a
+         * PDU, and wait for the response if expectResponse is true.
+         * Returns the size of the response without the CRC, or -1 if no
+         * valid response was received.
+         */
+        int
+        Transact( const unsigned char* request,
+                  const unsigned int   requestSize,
+                  unsigned char*       response,
+                  const bool           expectResponse ) ;
+
+        SerialPort&    mSerialPort ;
+        unsigned short mTcpPort ;
+        std::string    mBindAddress ;
+
+        int       mListenFileDescriptor ;
+        int       mWakeupPipe[2] ;
+        pthread_t mThread ;
+
+        std::atomic<bool>         mIsRunning ;
+        std::atomic<bool>         mIsStopRequested ;
+        std::atomic<unsigned int> mCacheFreshness ;
+        std::atomic<unsigned int> mResponseTimeout ;
+        std::atomic<int>          mWritePriorities[ NUM_OF_UNITS ] ;
+
+        /*
+         * State owned by the worker thread.
+         */
+        std::map<unsigned long, ClientConnection> mClients ;
+        unsigned long                             mNextClientId ;
+        std::list<PendingRequest>                 mPendingReads ;
+        std::vector<PendingRequest>               mPendingWrites ;
+        unsigned long                             mNextSequence ;
+        std::map<unsigned long, CacheEntry>       mCache ;
+        unsigned int                              mInterFrameGap ;
+        unsigned long long                        mLastBusActivity ;
+
+        /*
+         * Statistics.
+         */
+        std::atomic<unsigned long>      mNumOfClientRequests ;
+        std::atomic<unsigned long>      mNumOfReadRequests ;
+        std::atomic<unsigned long>      mNumOfCacheHits ;
+        std::atomic<unsigned long>      mNumOfCoalescedRequests ;
+        std::atomic<unsigned long>      mNumOfBusTransactions ;
+        std::atomic<unsigned long>      mNumOfBusTimeouts ;
+        std::atomic<unsigned long long> mBusBusyMicroseconds ;
+        std::atomic<unsigned long long> mStartTime ;
+        std::atomic<unsigned long long> mStopTime ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    ModbusGateway::ModbusGateway( SerialPort&          serialPort,
+                                  const unsigned short tcpPort,
+                                  const std::string&   bindAddress ) :
+        mImpl( new Implementation( serialPort,
+                                   tcpPort,
+                                   bindAddress ) )
+    {
+        /* empty */
+    }
+
+    ModbusGateway::~ModbusGateway()
+    {
+        this->Stop() ;
+        delete mImpl ;
+    }
+
+    void
+    ModbusGateway::Start()
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        if ( this->IsRunning() )
+        {
+            return ;
+        }
+        mImpl->mInterFrameGap =
+            Modbus::InterFrameGapMicroseconds( mImpl->mSerialPort.GetBaudRate() ) ;
+        //
+        // Create the listening socket.
+        //
+        struct sockaddr_in address ;
+        memset( &address, 0, sizeof( address ) ) ;
+        address.sin_family = AF_INET ;
+        address.sin_port   = htons( mImpl->mTcpPort ) ;
+        if ( 1 != inet_pton( AF_INET,
+                             mImpl->mBindAddress.c_str(),
+                             &address.sin_addr ) )
+        {
+            throw std::runtime_error( ERR_MSG_INVALID_BIND_ADDRESS ) ;
+        }
+        const int listen_fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 ) ;
+        if ( listen_fd < 0 )
+        {
+            throw std::runtime_error( strerror(errno) ) ;
+        }
+        const int reuse_address = 1 ;
+        setsockopt( listen_fd,
+                    SOL_SOCKET,
+                    SO_REUSEADDR,
+                    &reuse_address,
+                    sizeof( reuse_address ) ) ;
+        socklen_t address_size = sizeof( address ) ;
+        if ( ( bind( listen_fd,
+                     reinterpret_cast<struct sockaddr*>( &address ),
+                     sizeof( address ) ) < 0 ) ||
+             ( listen( listen_fd, LISTEN_BACKLOG ) < 0 ) ||
+             ( getsockname( listen_fd,
+                            reinterpret_cast<struct sockaddr*>( &address ),
+                            &address_size ) < 0 ) )
+        {
+            const std::string error_message = strerror(errno) ;
+            close( listen_fd ) ;
+            throw std::runtime_error( error_message ) ;
+        }
+        mImpl->mTcpPort = ntohs( address.sin_port ) ;
+        //
+        // The pipe wakes the worker thread up when the gateway is stopped.
+        //
+        if ( pipe( mImpl->mWakeupPipe ) < 0 )
+        {
+            const std::string error_message = strerror(errno) ;
+            close( listen_fd ) ;
+            throw std::runtime_error( error_message ) ;
+        }
+        mImpl->mListenFileDescriptor = listen_fd ;
+        mImpl->mIsStopRequested = false ;
+        mImpl->mLastBusActivity = 0 ;
+        mImpl->mStartTime = MonotonicMicroseconds() ;
+        if ( 0 != pthread_create( &mImpl->mThread,
+                                  NULL,
+                                  &Implementation::ThreadMain,
+                                  mImpl ) )
+        {
+            close( mImpl->mWakeupPipe[0] ) ;
+            close( mImpl->mWakeupPipe[1] ) ;
+            close( listen_fd ) ;
+            mImpl->mListenFileDescriptor = -1 ;
+            throw std::runtime_error( ERR_MSG_CANNOT_START_THREAD ) ;
+        }
+        mImpl->mIsRunning = true ;
+        return ;
+    }
+
+    void
+    ModbusGateway::Stop()
+    {
+        if ( ! this->IsRunning() )
+        {
+            return ;
+        }
+        mImpl->mIsStopRequested = true ;
+        const char wakeup = 0 ;
+        while( ( write( mImpl->mWakeupPipe[1], &wakeup, 1 ) < 0 ) &&
+               ( EINTR == errno ) )
+        {
+            /* retry */
+        }
+        pthread_join( mImpl->mThread,
+                      NULL ) ;
+        //
+        mImpl->CloseAllClients() ;
+        close( mImpl->mListenFileDescriptor ) ;
+        close( mImpl->mWakeupPipe[0] ) ;
+        close( mImpl->mWakeupPipe[1] ) ;
+        mImpl->mListenFileDescriptor = -1 ;
+        mImpl->mPendingReads.clear() ;
+        mImpl->mPendingWrites.clear() ;
+        mImpl->mStopTime = MonotonicMicroseconds() ;
+        mImpl->mIsRunning = false ;
+        return ;
+    }
+
+    bool
+    ModbusGateway::IsRunning() const
+    {
+        return mImpl->mIsRunning ;
+    }
+
+    unsigned short
+    ModbusGateway::GetTcpPort() const
+    {
+        return mImpl->mTcpPort ;
+    }
+
+    void
+    ModbusGateway::SetCacheFreshness( const unsigned int msFreshness )
+    {
+        mImpl->mCacheFreshness = msFreshness ;
+        return ;
+    }
+
+    void
+    ModbusGateway::SetResponseTimeout( const unsigned int msTimeout )
+    {
+        mImpl->mResponseTimeout = std::max( msTimeout, 1U ) ;
+        return ;
+    }
+
+    void
+    ModbusGateway::SetWritePriority( const unsigned char unitIdentifier,
+                                     const int           priority )
+    {
+        mImpl->mWritePriorities[ unitIdentifier ] = priority ;
+        return ;
+    }
+
+    ModbusGateway::Statistics
+    ModbusGateway::GetStatistics() const
+    {
+        Statistics statistics ;
+        statistics.mNumOfClientRequests    = mImpl->mNumOfClientRequests ;
+        statistics.mNumOfCacheHits         = mImpl->mNumOfCacheHits ;
+        statistics.mNumOfCoalescedRequests = mImpl->mNumOfCoalescedRequests ;
+        statistics.mNumOfBusTransactions   = mImpl->mNumOfBusTransactions ;
+        statistics.mNumOfBusTimeouts       = mImpl->mNumOfBusTimeouts ;
+        statistics.mBusBusyMicroseconds    = mImpl->mBusBusyMicroseconds ;
+        const unsigned long long end_time = this->IsRunning() ?
+                                            MonotonicMicroseconds() :
+                                            mImpl->mStopTime.load() ;
+        statistics.mUptimeMicroseconds = end_time - mImpl->mStartTime ;
+        return statistics ;
+    }
+
+    double
+    ModbusGateway::GetCacheHitRate() const
+    {
+        const unsigned long num_of_reads = mImpl->mNumOfReadRequests ;
+        if ( 0 == num_of_reads )
+        {
+            return 0.0 ;
+        }
+        return static_cast<double>( mImpl->mNumOfCacheHits ) / num_of_reads ;
+    }
+
+    double
+    ModbusGateway::GetBusUtilisation() const
+    {
+        const Statistics statistics = this->GetStatistics() ;
+        if ( 0 == statistics.mUptimeMicroseconds )
+        {
+            return 0.0 ;
+        }
+        return static_cast<double>( statistics.mBusBusyMicroseconds ) /
+               statistics.mUptimeMicroseconds ;
+    }
+
+    /* ------------------------------------------------------------ */
+    ModbusGateway::Implementation::Implementation( SerialPort&          serialPort,
+                                                   const unsigned short tcpPort,
+                                                   const std::string&   bindAddress ) :
+        mSerialPort(serialPort),
+        mTcpPort(tcpPort),
+        mBindAddress(bindAddress),
+        mListenFileDescriptor(-1),
+        mWakeupPipe(),
+        mThread(),
+        mIsRunning(false),
+        mIsStopRequested(false),
+        mCacheFreshness(0),
+        mResponseTimeout(DEFAULT_RESPONSE_TIMEOUT_MS),
+        mClients(),
+        mNextClientId(0),
+        mPendingReads(),
+        mPendingWrites(),
+        mNextSequence(0),
+        mCache(),
+        mInterFrameGap(0),
+        mLastBusActivity(0),
+        mNumOfClientRequests(0),
+        mNumOfReadRequests(0),
+        mNumOfCacheHits(0),
+        mNumOfCoalescedRequests(0),
+        mNumOfBusTransactions(0),
+        mNumOfBusTimeouts(0),
+        mBusBusyMicroseconds(0),
+        mStartTime(0),
+        mStopTime(0)
+    {
+        for( int i=0; i<NUM_OF_UNITS; ++i )
+        {
+            mWritePriorities[i] = 0 ;
+        }
+    }
+
+    void*
+    ModbusGateway::Implementation::ThreadMain( void* implementation )
+    {
+        static_cast<Implementation*>( implementation )->Run() ;
+        return NULL ;
+    }
+
+    void
+    ModbusGateway::Implementation::Run()
+    {
+        std::vector<struct pollfd> poll_fds ;
+        std::vector<unsigned long> client_ids ;
+        while( ! mIsStopRequested )
+        {
+            //
+            // Wait for client activity only when there is nothing to
+            // send on the bus.
+            //
+            const bool has_pending_requests = ( ! mPendingReads.empty() ) ||
+                                              ( ! mPendingWrites.empty() ) ;
+            poll_fds.clear() ;
+            client_ids.clear() ;
+            struct pollfd poll_fd ;
+            poll_fd.events  = POLLIN ;
+            poll_fd.revents = 0 ;
+            poll_fd.fd = mWakeupPipe[0] ;
+            poll_fds.push_back( poll_fd ) ;
+            poll_fd.fd = mListenFileDescriptor ;
+            poll_fds.push_back( poll_fd ) ;
+            for( std::map<unsigned long, ClientConnection>::const_iterator i=mClients.begin() ;
+                 i != mClients.end() ;
+                 ++i )
+            {
+                poll_fd.fd = i->second.mFileDescriptor ;
+                poll_fds.push_back( poll_fd ) ;
+                client_ids.push_back( i->first ) ;
+            }
+            const int num_of_ready = poll( &poll_fds[0],
+                                           poll_fds.size(),
+                                           has_pending_requests ? 0 : -1 ) ;
+            if ( ( num_of_ready < 0 ) &&
+                 ( EINTR != errno ) )
+            {
+                break ;
+            }
+            if ( num_of_ready > 0 )
+            {
+                if ( poll_fds[0].revents )
+                {
+                    continue ;
+                }
+                if ( poll_fds[1].revents & POLLIN )
+                {
+                    this->AcceptClient() ;
+                }
+                for( unsigned int i=0; i<client_ids.size(); ++i )
+                {
+                    if ( poll_fds[ i + 2 ].revents )
+                    {
+                        this->ReadClient( client_ids[i] ) ;
+                    }
+                }
+            }
+            this->ServiceBus() ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::AcceptClient()
+    {
+        //
+        // The listening socket is non-blocking: accept every pending
+        // connection so that requests from all of them are seen before
+        // the next bus transaction.
+        //
+        while( true )
+        {
+            const int client_fd = accept( mListenFileDescriptor,
+                                          NULL,
+                                          NULL ) ;
+            if ( client_fd < 0 )
+            {
+                if ( EINTR == errno )
+                {
+                    continue ;
+                }
+                break ;
+            }
+            ClientConnection client ;
+            client.mFileDescriptor = client_fd ;
+            mClients[ mNextClientId++ ] = client ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::CloseClient( const unsigned long clientId )
+    {
+        std::map<unsigned long, ClientConnection>::iterator client =
+            mClients.find( clientId ) ;
+        if ( mClients.end() != client )
+        {
+            close( client->second.mFileDescriptor ) ;
+            mClients.erase( client ) ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::CloseAllClients()
+    {
+        while( ! mClients.empty() )
+        {
+            this->CloseClient( mClients.begin()->first ) ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::ReadClient( const unsigned long clientId )
+    {
+        std::map<unsigned long, ClientConnection>::iterator client =
+            mClients.find( clientId ) ;
+        if ( mClients.end() == client )
+        {
+            return ;
+        }
+        unsigned char read_buffer[ 4096 ] ;
+        const ssize_t num_of_bytes_read = recv( client->second.mFileDescriptor,
+                                                read_buffer,
+                                                sizeof( read_buffer ),
+                                                MSG_DONTWAIT ) ;
+        if ( num_of_bytes_read < 0 )
+        {
+            if ( ( EINTR != errno ) &&
+                 ( EAGAIN != errno ) &&
+                 ( EWOULDBLOCK != errno ) )
+            {
+                this->CloseClient( clientId ) ;
+            }
+            return ;
+        }
+        if ( 0 == num_of_bytes_read )
+        {
+            this->CloseClient( clientId ) ;
+            return ;
+        }
+        client->second.mInputBuffer.insert( client->second.mInputBuffer.end(),
+                                            read_buffer,
+                                            read_buffer + num_of_bytes_read ) ;
+        //
+        // Handle all complete requests in the buffer.
+        //
+        unsigned int offset = 0 ;
+        while( client->second.mInputBuffer.size() - offset >= MBAP_HEADER_SIZE )
+        {
+            std::vector<unsigned char>& input_buffer = client->second.mInputBuffer ;
+            const unsigned char* frame = &input_buffer[ offset ] ;
+            const unsigned int protocol_id = GetUint16( frame + 2 ) ;
+            const unsigned int length      = GetUint16( frame + 4 ) ;
+            if ( ( 0 != protocol_id ) ||
+                 ( length < 2 ) ||
+                 ( length > MAX_MBAP_LENGTH ) )
+            {
+                //
+                // This is not a Modbus TCP client or the stream is out
+                // of sync. Drop the connection.
+                //
+                this->CloseClient( clientId ) ;
+                return ;
+            }
+            const unsigned int frame_size = 6 + length ;
+            if ( input_buffer.size() - offset < frame_size )
+            {
+                break ;
+            }
+            this->HandleClientRequest( clientId,
+                                       frame,
+                                       frame_size ) ;
+            offset += frame_size ;
+            //
+            // An answer that cannot be sent closes the connection, which
+            // frees the input buffer along with the rest of the client.
+            //
+            client = mClients.find( clientId ) ;
+            if ( mClients.end() == client )
+            {
+                return ;
+            }
+        }
+        client->second.mInputBuffer.erase( client->second.mInputBuffer.begin(),
+                                           client->second.mInputBuffer.begin() + offset ) ;
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::HandleClientRequest( const unsigned long  clientId,
+                                                        const unsigned char* frame,
+                                                        const unsigned int   frameSize )
+    {
+        ++mNumOfClientRequests ;
+        PendingRequest request ;
+        request.mClientId       = clientId ;
+        request.mTransactionId  = GetUint16( frame ) ;
+        request.mUnitIdentifier = frame[6] ;
+        request.mPdu.assign( frame + MBAP_HEADER_SIZE,
+                             frame + frameSize ) ;
+        request.mStartAddress   = 0 ;
+        request.mQuantity       = 0 ;
+        request.mPriority       = 0 ;
+        request.mSequence       = mNextSequence++ ;
+        request.mIsCoalescable  = true ;
+        //
+        const std::vector<unsigned char>& pdu = request.mPdu ;
+        const unsigned char function_code = pdu[0] ;
+        switch( function_code )
+        {
+        case Modbus::READ_COILS:
+        case Modbus::READ_DISCRETE_INPUTS:
+        case Modbus::READ_HOLDING_REGISTERS:
+        case Modbus::READ_INPUT_REGISTERS:
+        {
+            ++mNumOfReadRequests ;
+            if ( 5 != pdu.size() )
+            {
+                this->SendException( clientId,
+                                     request.mTransactionId,
+                                     request.mUnitIdentifier,
+                                     function_code,
+                                     Modbus::ILLEGAL_DATA_VALUE ) ;
+                return ;
+            }
+            request.mStartAddress = GetUint16( &pdu[1] ) ;
+            request.mQuantity     = GetUint16( &pdu[3] ) ;
+            const unsigned int max_quantity = IsBitFunction( function_code ) ?
+                                              Modbus::MAX_READ_BITS :
+                                              Modbus::MAX_READ_REGISTERS ;
+            if ( ( 0 == request.mQuantity ) ||
+                 ( request.mQuantity > max_quantity ) )
+            {
+                this->SendException( clientId,
+                                     request.mTransactionId,
+                                     request.mUnitIdentifier,
+                                     function_code,
+                                     Modbus::ILLEGAL_DATA_VALUE ) ;
+                return ;
+            }
+            //
+            // Broadcast reads cannot be answered.
+            //
+            if ( Modbus::BROADCAST_ADDRESS == request.mUnitIdentifier )
+            {
+                this->SendException( clientId,
+                                     request.mTransactionId,
+                                     request.mUnitIdentifier,
+                                     function_code,
+                                     Modbus::GATEWAY_PATH_UNAVAILABLE ) ;
+                return ;
+            }
+            if ( this->AnswerFromCache( request ) )
+            {
+                ++mNumOfCacheHits ;
+                return ;
+            }
+            mPendingReads.push_back( request ) ;
+            return ;
+        }
+        case Modbus::WRITE_SINGLE_COIL:
+        case Modbus::WRITE_SINGLE_REGISTER:
+        case Modbus::WRITE_MULTIPLE_COILS:
+        case Modbus::WRITE_MULTIPLE_REGISTERS:
+        {
+            const bool is_single_write = ( function_code <= Modbus::WRITE_SINGLE_REGISTER ) ;
+            const bool is_valid_size = is_single_write ?
+                                       ( 5 == pdu.size() ) :
+                                       ( ( pdu.size() >= 6 ) &&
+                                         ( pdu.size() == 6U + pdu[5] ) ) ;
+            if ( ! is_valid_size )
+            {
+                this->SendException( clientId,
+                                     request.mTransactionId,
+                                     request.mUnitIdentifier,
+                                     function_code,
+                                     Modbus::ILLEGAL_DATA_VALUE ) ;
+                return ;
+            }
+            request.mStartAddress = GetUint16( &pdu[1] ) ;
+            request.mQuantity     = is_single_write ? 1 : GetUint16( &pdu[3] ) ;
+            request.mPriority     = mWritePriorities[ request.mUnitIdentifier ] ;
+            mPendingWrites.push_back( request ) ;
+            return ;
+        }
+        default:
+            break ;
+        }
+        this->SendException( clientId,
+                             request.mTransactionId,
+                             request.mUnitIdentifier,
+                             function_code,
+                             Modbus::ILLEGAL_FUNCTION ) ;
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::SendResponse( const unsigned long  clientId,
+                                                 const unsigned short transactionId,
+                                                 const unsigned char  unitIdentifier,
+                                                 const unsigned char* pdu,
+                                                 const unsigned int   pduSize )
+    {
+        std::map<unsigned long, ClientConnection>::iterator client =
+            mClients.find( clientId ) ;
+        if ( mClients.end() == client )
+        {
+            //
+            // The client went away while its request was pending.
+            //
+            return ;
+        }
+        unsigned char frame[ MBAP_HEADER_SIZE + Modbus::MAX_RTU_FRAME_SIZE ] ;
+        PutUint16( frame, transactionId ) ;
+        PutUint16( frame + 2, 0 ) ;
+        PutUint16( frame + 4, pduSize + 1 ) ;
+        frame[6] = unitIdentifier ;
+        memcpy( frame + MBAP_HEADER_SIZE,
+                pdu,
+                pduSize ) ;
+        //
+        // Responses are small and should always fit in the socket
+        // buffer. A client that does not keep up is disconnected rather
+        // than being allowed to stall the bus.
+        //
+        const ssize_t frame_size = MBAP_HEADER_SIZE + pduSize ;
+        ssize_t num_of_bytes_sent = -1 ;
+        do
+        {
+            num_of_bytes_sent = send( client->second.mFileDescriptor,
+                                      frame,
+                                      frame_size,
+                                      MSG_NOSIGNAL | MSG_DONTWAIT ) ;
+        }
+        while( ( num_of_bytes_sent < 0 ) &&
+               ( EINTR == errno ) ) ;
+        if ( num_of_bytes_sent != frame_size )
+        {
+            this->CloseClient( clientId ) ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::SendException( const unsigned long         clientId,
+                                                  const unsigned short        transactionId,
+                                                  const unsigned char         unitIdentifier,
+                                                  const unsigned char         functionCode,
+                                                  const Modbus::ExceptionCode exceptionCode )
+    {
+        const unsigned char pdu[2] = { static_cast<unsigned char>( functionCode | 0x80 ),
+                                       static_cast<unsigned char>( exceptionCode ) } ;
+        this->SendResponse( clientId,
+                            transactionId,
+                            unitIdentifier,
+                            pdu,
+                            sizeof( pdu ) ) ;
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::SendReadResponse( const PendingRequest& request,
+                                                     const unsigned short* values )
+    {
+        unsigned char pdu[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        const unsigned char function_code = request.mPdu[0] ;
+        unsigned int byte_count = 0 ;
+        if ( IsBitFunction( function_code ) )
+        {
+            byte_count = ( request.mQuantity + 7 ) / 8 ;
+            memset( pdu + 2, 0, byte_count ) ;
+            for( unsigned int i=0; i<request.mQuantity; ++i )
+            {
+                if ( values[i] )
+                {
+                    pdu[ 2 + i / 8 ] |= ( 1 << ( i % 8 ) ) ;
+                }
+            }
+        }
+        else
+        {
+            byte_count = 2 * request.mQuantity ;
+            for( unsigned int i=0; i<request.mQuantity; ++i )
+            {
+                PutUint16( pdu + 2 + 2 * i,
+                           values[i] ) ;
+            }
+        }
+        pdu[0] = function_code ;
+        pdu[1] = byte_count ;
+        this->SendResponse( request.mClientId,
+                            request.mTransactionId,
+                            request.mUnitIdentifier,
+                            pdu,
+                            2 + byte_count ) ;
+        return ;
+    }
+
+    bool
+    ModbusGateway::Implementation::AnswerFromCache( const PendingRequest& request )
+    {
+        const unsigned long long freshness = mCacheFreshness * 1000ULL ;
+        if ( 0 == freshness )
+        {
+            return false ;
+        }
+        const unsigned long long now = MonotonicMicroseconds() ;
+        unsigned short values[ Modbus::MAX_READ_BITS ] ;
+        for( unsigned int i=0; i<request.mQuantity; ++i )
+        {
+            std::map<unsigned long, CacheEntry>::const_iterator entry =
+                mCache.find( CacheKey( request.mUnitIdentifier,
+                                       request.mPdu[0],
+                                       request.mStartAddress + i ) ) ;
+            if ( ( mCache.end() == entry ) ||
+                 ( now - entry->second.mTimestamp > freshness ) )
+            {
+                return false ;
+            }
+            values[i] = entry->second.mValue ;
+        }
+        this->SendReadResponse( request,
+                                values ) ;
+        return true ;
+    }
+
+    void
+    ModbusGateway::Implementation::InvalidateCache( const unsigned char unitIdentifier,
+                                                    const unsigned char functionCode,
+                                                    const unsigned int  startAddress,
+                                                    const unsigned int  quantity )
+    {
+        //
+        // A broadcast write may have changed any unit.
+        //
+        if ( Modbus::BROADCAST_ADDRESS == unitIdentifier )
+        {
+            mCache.clear() ;
+            return ;
+        }
+        for( unsigned int i=0; i<quantity; ++i )
+        {
+            mCache.erase( CacheKey( unitIdentifier,
+                                    functionCode,
+                                    startAddress + i ) ) ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::ServiceBus()
+    {
+        if ( ! mPendingWrites.empty() )
+        {
+            //
+            // Highest priority first, then first come first served.
+            //
+            std::vector<PendingRequest>::iterator next_write = mPendingWrites.begin() ;
+            for( std::vector<PendingRequest>::iterator i=mPendingWrites.begin() ;
+                 i != mPendingWrites.end() ;
+                 ++i )
+            {
+                if ( ( i->mPriority > next_write->mPriority ) ||
+                     ( ( i->mPriority == next_write->mPriority ) &&
+                       ( i->mSequence < next_write->mSequence ) ) )
+                {
+                    next_write = i ;
+                }
+            }
+            const PendingRequest request = *next_write ;
+            mPendingWrites.erase( next_write ) ;
+            this->ExecuteWrite( request ) ;
+            return ;
+        }
+        if ( ! mPendingReads.empty() )
+        {
+            this->ExecuteRead() ;
+        }
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::ExecuteWrite( const PendingRequest& request )
+    {
+        unsigned char rtu_request[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        rtu_request[0] = request.mUnitIdentifier ;
+        memcpy( rtu_request + 1,
+                &request.mPdu[0],
+                request.mPdu.size() ) ;
+        const bool is_broadcast = ( Modbus::BROADCAST_ADDRESS == request.mUnitIdentifier ) ;
+        unsigned char rtu_response[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        const int response_size = this->Transact( rtu_request,
+                                                  1 + request.mPdu.size(),
+                                                  rtu_response,
+                                                  ! is_broadcast ) ;
+        //
+        // Whatever happened, the cached values may be stale now.
+        //
+        const unsigned char function_code = request.mPdu[0] ;
+        const unsigned char read_function_code =
+            ( ( Modbus::WRITE_SINGLE_COIL == function_code ) ||
+              ( Modbus::WRITE_MULTIPLE_COILS == function_code ) ) ?
+            Modbus::READ_COILS :
+            Modbus::READ_HOLDING_REGISTERS ;
+        this->InvalidateCache( request.mUnitIdentifier,
+                               read_function_code,
+                               request.mStartAddress,
+                               request.mQuantity ) ;
+        //
+        if ( is_broadcast )
+        {
+            //
+            // Slaves never answer broadcasts. The normal response to a
+            // write echoes the first four bytes after the function code.
+            //
+            this->SendResponse( request.mClientId,
+                                request.mTransactionId,
+                                request.mUnitIdentifier,
+                                &request.mPdu[0],
+                                5 ) ;
+            return ;
+        }
+        if ( response_size < 0 )
+        {
+            this->SendException( request.mClientId,
+                                 request.mTransactionId,
+                                 request.mUnitIdentifier,
+                                 function_code,
+                                 Modbus::GATEWAY_TARGET_NO_RESPONSE ) ;
+            return ;
+        }
+        this->SendResponse( request.mClientId,
+                            request.mTransactionId,
+                            request.mUnitIdentifier,
+                            rtu_response + 1,
+                            response_size - 1 ) ;
+        return ;
+    }
+
+    void
+    ModbusGateway::Implementation::ExecuteRead()
+    {
+        //
+        // Start with the oldest pending read and merge every compatible
+        // read whose range overlaps or touches the merged range.
+        //
+        std::list<PendingRequest> group ;
+        group.splice( group.end(),
+                      mPendingReads,
+                      mPendingReads.begin() ) ;
+        const PendingRequest& first = group.front() ;
+        const unsigned char unit_identifier = first.mUnitIdentifier ;
+        const unsigned char function_code   = first.mPdu[0] ;
+        const unsigned int  max_quantity    = IsBitFunction( function_code ) ?
+                                              Modbus::MAX_READ_BITS :
+                                              Modbus::MAX_READ_REGISTERS ;
+        unsigned int range_start = first.mStartAddress ;
+        unsigned int range_end   = first.mStartAddress + first.mQuantity ;
+        bool is_merged = first.mIsCoalescable ;
+        while( is_merged )
+        {
+            is_merged = false ;
+            std::list<PendingRequest>::iterator i = mPendingReads.begin() ;
+            while( i != mPendingReads.end() )
+            {
+                const unsigned int start = i->mStartAddress ;
+                const unsigned int end   = i->mStartAddress + i->mQuantity ;
+                if ( i->mIsCoalescable &&
+                     ( unit_identifier == i->mUnitIdentifier ) &&
+                     ( function_code == i->mPdu[0] ) &&
+                     ( start <= range_end ) &&
+                     ( end >= range_start ) &&
+                     ( std::max( end, range_end ) -
+                       std::min( start, range_start ) <= max_quantity ) )
+                {
+                    range_start = std::min( start, range_start ) ;
+                    range_end   = std::max( end, range_end ) ;
+                    group.splice( group.end(),
+                                  mPendingReads,
+                                  i++ ) ;
+                    ++mNumOfCoalescedRequests ;
+                    is_merged = true ;
+                    continue ;
+                }
+                ++i ;
+            }
+        }
+        //
+        // Run the merged transaction.
+        //
+        const unsigned int quantity = range_end - range_start ;
+        unsigned char rtu_request[6] ;
+        rtu_request[0] = unit_identifier ;
+        rtu_request[1] = function_code ;
+        PutUint16( rtu_request + 2, range_start ) ;
+        PutUint16( rtu_request + 4, quantity ) ;
+        unsigned char rtu_response[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        const int response_size = this->Transact( rtu_request,
+                                                  sizeof( rtu_request ),
+                                                  rtu_response,
+                                                  true ) ;
+        const unsigned int byte_count = IsBitFunction( function_code ) ?
+                                        ( quantity + 7 ) / 8 :
+                                        2 * quantity ;
+        if ( ( response_size > 0 ) &&
+             ( rtu_response[1] & 0x80 ) )
+        {
+            //
+            // The slave refused the request. If several requests were
+            // merged, the union may cover addresses that none of the
+            // individual requests does, so retry them one by one.
+            //
+            if ( group.size() > 1 )
+            {
+                for( std::list<PendingRequest>::iterator i=group.begin() ;
+                     i != group.end() ;
+                     ++i )
+                {
+                    i->mIsCoalescable = false ;
+                }
+                mNumOfCoalescedRequests -= group.size() - 1 ;
+                mPendingReads.splice( mPendingReads.begin(),
+                                      group ) ;
+                return ;
+            }
+            this->SendResponse( first.mClientId,
+                                first.mTransactionId,
+                                first.mUnitIdentifier,
+                                rtu_response + 1,
+                                response_size - 1 ) ;
+            return ;
+        }
+        if ( ( response_size < 0 ) ||
+             ( static_cast<unsigned int>( response_size ) != 3 + byte_count ) ||
+             ( rtu_response[2] != byte_count ) )
+        {
+            for( std::list<PendingRequest>::const_iterator i=group.begin() ;
+                 i != group.end() ;
+                 ++i )
+            {
+                this->SendException( i->mClientId,
+                                     i->mTransactionId,
+                                     i->mUnitIdentifier,
+                                     function_code,
+                                     Modbus::GATEWAY_TARGET_NO_RESPONSE ) ;
+            }
+            return ;
+        }
+        //
+        // Decode the values, refresh the cache and answer every request
+        // from its slice of the merged range.
+        //
+        unsigned short values[ Modbus::MAX_READ_BITS ] ;
+        const unsigned char* data = rtu_response + 3 ;
+        const unsigned long long now = MonotonicMicroseconds() ;
+        for( unsigned int i=0; i<quantity; ++i )
+        {
+            values[i] = IsBitFunction( function_code ) ?
+                        ( ( data[ i / 8 ] >> ( i % 8 ) ) & 1 ) :
+                        GetUint16( data + 2 * i ) ;
+            CacheEntry& entry = mCache[ CacheKey( unit_identifier,
+                                                  function_code,
+                                                  range_start + i ) ] ;
+            entry.mValue     = values[i] ;
+            entry.mTimestamp = now ;
+        }
+        for( std::list<PendingRequest>::const_iterator i=group.begin() ;
+             i != group.end() ;
+             ++i )
+        {
+            this->SendReadResponse( *i,
+                                    values + ( i->mStartAddress - range_start ) ) ;
+        }
+        return ;
+    }
+
+    int
+    ModbusGateway::Implementation::Transact( const unsigned char* request,
+                                             const unsigned int   requestSize,
+                                             unsigned char*       response,
+                                             const bool           expectResponse )
+    {
+        //
+        // Keep the bus silent for at least one inter-frame gap between
+        // two transactions.
+        //
+        unsigned long long now = MonotonicMicroseconds() ;
+        if ( now - mLastBusActivity < mInterFrameGap )
+        {
+            usleep( mInterFrameGap - ( now - mLastBusActivity ) ) ;
+        }
+        //
+        // Drop anything left over from a previous transaction, such as
+        // a late response.
+        //
+        try
+        {
+            while( mSerialPort.IsDataAvailable() )
+            {
+                mSerialPort.ReadByte( 1 ) ;
+            }
+        }
+        catch( ... )
+        {
+            /* nothing left to drop */
+        }
+        //
+        unsigned char frame[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        memcpy( frame, request, requestSize ) ;
+        const unsigned short crc = Modbus::Crc16( frame, requestSize ) ;
+        frame[ requestSize ]     = crc & 0xFF ;
+        frame[ requestSize + 1 ] = crc >> 8 ;
+        //
+        const unsigned long long start_time = MonotonicMicroseconds() ;
+        ++mNumOfBusTransactions ;
+        int response_size = -1 ;
+        try
+        {
+            mSerialPort.Write( frame,
+                               requestSize + 2 ) ;
+            if ( ! expectResponse )
+            {
+                response_size = 0 ;
+            }
+            else
+            {
+                const unsigned int timeout = mResponseTimeout ;
+                unsigned int num_of_bytes_received = 0 ;
+                while( true )
+                {
+                    response[ num_of_bytes_received++ ] = mSerialPort.ReadByte( timeout ) ;
+                    const int frame_size = Modbus::ResponseFrameSize( response,
+                                                                      num_of_bytes_received ) ;
+                    if ( ( frame_size < 0 ) ||
+                         ( frame_size > static_cast<int>( Modbus::MAX_RTU_FRAME_SIZE ) ) )
+                    {
+                        break ;
+                    }
+                    if ( static_cast<int>( num_of_bytes_received ) == frame_size )
+                    {
+                        const unsigned short received_crc =
+                            response[ frame_size - 2 ] |
+                            ( response[ frame_size - 1 ] << 8 ) ;
+                        if ( ( response[0] == request[0] ) &&
+                             ( ( response[1] & 0x7F ) == request[1] ) &&
+                             ( Modbus::Crc16( response, frame_size - 2 ) == received_crc ) )
+                        {
+                            response_size = frame_size - 2 ;
+                        }
+                        break ;
+                    }
+                }
+            }
+        }
+        catch( ... )
+        {
+            //
+            // Read timeout or I/O error: no valid response.
+            //
+        }
+        if ( response_size < 0 )
+        {
+            ++mNumOfBusTimeouts ;
+        }
+        //
+        // A broadcast occupies the bus until the slaves had time to act
+        // on it.
+        //
+        if ( ! expectResponse )
+        {
+            usleep( mInterFrameGap ) ;
+        }
+        now = MonotonicMicroseconds() ;
+        mBusBusyMicroseconds += now - start_time ;
+        mLastBusActivity = now ;
+        return response_size ;
+    }
+}
@@ -0,0 +1,192 @@
+/******************************************************************************
+ *   @file ModbusGateway.h                                                    *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _ModbusGateway_h_
+#define _ModbusGateway_h_
+
+#include <SerialPort.h>
+
+#include <string>
+
+namespace LibSerial
+{
+    /**
+     * @brief A Modbus TCP to Modbus RTU gateway. Requests received from
+     *        Modbus TCP clients are forwarded to the RTU slaves on a
+     *        serial port, one transaction at a time, by a single worker
+     *        thread.
+     *
+     *        The gateway keeps the serial bus as idle as possible:
+     *
+     *        - Read requests for the same unit and table whose address
+     *          ranges overlap or touch, including identical requests from
+     *          different clients, are merged into a single bus transaction
+     *          covering the union of the ranges. All requests that arrive
+     *          while a transaction is in progress are candidates.
+     *
+     *        - Every value read from the bus is cached per register. A
+     *          read whose entries are all younger than the configured
+     *          freshness is answered from the cache without touching the
+     *          bus. Writes invalidate the cache entries they cover.
+     *
+     *        - Write requests are always sent before pending reads, in
+     *          order of the priority of their unit and then in order of
+     *          arrival.
+     *
+     *        The serial port must be open and must not have a receive
+     *        handler attached while the gateway runs.
+     */
+    class ModbusGateway
+    {
+    public:
+        /**
+         * @brief Counters describing the activity of the gateway.
+         */
+        struct Statistics
+        {
+            unsigned long      mNumOfClientRequests ;    //!< Requests received from TCP clients.
+            unsigned long      mNumOfCacheHits ;         //!< Reads answered from the cache.
+            unsigned long      mNumOfCoalescedRequests ; //!< Reads merged into another read's transaction.
+            unsigned long      mNumOfBusTransactions ;   //!< Requests sent on the serial bus.
+            unsigned long      mNumOfBusTimeouts ;       //!< Transactions without a valid response.
+            unsigned long long mBusBusyMicroseconds ;    //!< Time spent in bus transactions.
+            unsigned long long mUptimeMicroseconds ;     //!< Time since the gateway was started.
+        } ;
+
+        /**
+         * @brief Constructs a gateway forwarding requests received on
+         *        tcpPort to the slaves on serialPort. A tcpPort of zero
+         *        lets the operating system pick a free port, which can be
+         *        obtained with GetTcpPort() after Start().
+         */
+        ModbusGateway( SerialPort&          serialPort,
+                       const unsigned short tcpPort     = 502,
+                       const std::string&   bindAddress = "0.0.0.0" ) ;
+
+        /**
+         * @brief Destructor. Stops the gateway if it is running.
+         */
+        ~ModbusGateway() ;
+
+        /**
+         * @brief Starts listening for Modbus TCP clients and starts the
+         *        worker thread.
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::runtime_error This exception is thrown if the TCP
+         *        socket or the worker thread cannot be created.
+         */
+        void
+        Start()
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Stops the worker thread and closes all client
+         *        connections. Pending requests are dropped.
+         */
+        void
+        Stop() ;
+
+        /**
+         * @brief Determines if the gateway is currently running.
+         */
+        bool
+        IsRunning() const ;
+
+        /**
+         * @brief Gets the TCP port the gateway listens on.
+         */
+        unsigned short
+        GetTcpPort() const ;
+
+        /**
+         * @brief Sets the maximum age of cached values that may be used
+         *        to answer read requests. A value of zero, the default,
+         *        disables the cache.
+         */
+        void
+        SetCacheFreshness( const unsigned int msFreshness ) ;
+
+        /**
+         * @brief Sets the time to wait for the response of a slave before
+         *        answering the client with a "gateway target device failed
+         *        to respond" exception. The default is 1000ms.
+         */
+        void
+        SetResponseTimeout( const unsigned int msTimeout ) ;
+
+        /**
+         * @brief Sets the priority of write requests for the specified
+         *        unit. Writes with a higher priority are sent first. All
+         *        units have priority zero by default.
+         */
+        void
+        SetWritePriority( const unsigned char unitIdentifier,
+                          const int           priority ) ;
+
+        /**
+         * @brief Gets a copy of the current statistics of the gateway.
+         */
+        Statistics
+        GetStatistics() const ;
+
+        /**
+         * @brief Gets the fraction of read requests answered from the
+         *        cache.
+         */
+        double
+        GetCacheHitRate() const ;
+
+        /**
+         * @brief Gets the fraction of time since Start() during which the
+         *        serial bus was busy with a transaction.
+         */
+        double
+        GetBusUtilisation() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        ModbusGateway( const ModbusGateway& otherGateway ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        ModbusGateway& operator=( const ModbusGateway& otherGateway ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _ModbusGateway_h_
@@ -0,0 +1,254 @@
+/******************************************************************************
+ *   @file ModbusRegisterMap.cpp                                              *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "ModbusRegisterMap.h"
+
+#include <atomic>
+#include <string>
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_ADDRESS = "Register address out of range." ;
+
+    const int NUM_OF_TABLES = 4 ;
+}
+
+namespace LibSerial
+{
+    class ModbusRegisterMap::Implementation
+    {
+    public:
+        Implementation( const unsigned int numOfCoils,
+                        const unsigned int numOfDiscreteInputs,
+                        const unsigned int numOfHoldingRegisters,
+                        const unsigned int numOfInputRegisters ) ;
+
+        ~Implementation() ;
+
+        /*
+         * Entries of each table. Coils and discrete inputs use one
+         * entry per bit.
+         */
+        std::atomic<unsigned short>* mTables[ NUM_OF_TABLES ] ;
+
+        /*
+         * Number of entries in each table.
+         */
+        unsigned int mSizes[ NUM_OF_TABLES ] ;
+
+        /*
+         * Sequence counter advanced by the application. It is odd while
+         * an update is in progress.
+         */
+        std::atomic<unsigned long> mApplicationSequence ;
+
+        /*
+         * Sequence counter advanced by writes from the Modbus master.
+         * It is odd while a write is in progress.
+         */
+        std::atomic<unsigned long> mMasterSequence ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    ModbusRegisterMap::Implementation::Implementation(
+        const unsigned int numOfCoils,
+        const unsigned int numOfDiscreteInputs,
+        const unsigned int numOfHoldingRegisters,
+        const unsigned int numOfInputRegisters ) :
+        mApplicationSequence(0),
+        mMasterSequence(0)
+    {
+        mSizes[ COILS ]             = numOfCoils ;
+        mSizes[ DISCRETE_INPUTS ]   = numOfDiscreteInputs ;
+        mSizes[ HOLDING_REGISTERS ] = numOfHoldingRegisters ;
+        mSizes[ INPUT_REGISTERS ]   = numOfInputRegisters ;
+        for( int i=0; i<NUM_OF_TABLES; ++i )
+        {
+            mTables[i] = new std::atomic<unsigned short>[ mSizes[i] ] ;
+            for( unsigned int j=0; j<mSizes[i]; ++j )
+            {
+                mTables[i][j].store( 0, std::memory_order_relaxed ) ;
+            }
+        }
+    }
+
+    ModbusRegisterMap::Implementation::~Implementation()
+    {
+        for( int i=0; i<NUM_OF_TABLES; ++i )
+        {
+            delete [] mTables[i] ;
+        }
+    }
+
+    ModbusRegisterMap::ModbusRegisterMap( const unsigned int numOfCoils,
+                                          const unsigned int numOfDiscreteInputs,
+                                          const unsigned int numOfHoldingRegisters,
+                                          const unsigned int numOfInputRegisters ) :
+        mImpl( new Implementation( numOfCoils,
+                                   numOfDiscreteInputs,
+                                   numOfHoldingRegisters,
+                                   numOfInputRegisters ) )
+    {
+        /* empty */
+    }
+
+    ModbusRegisterMap::~ModbusRegisterMap()
+    {
+        delete mImpl ;
+    }
+
+    unsigned int
+    ModbusRegisterMap::GetSize( const Table table ) const
+    {
+        return mImpl->mSizes[ table ] ;
+    }
+
+    void
+    ModbusRegisterMap::BeginUpdate()
+    {
+        //
+        // Make the sequence odd before touching any entry. The fence
+        // keeps the entry stores from being reordered before it.
+        //
+        const unsigned long sequence =
+            mImpl->mApplicationSequence.load( std::memory_order_relaxed ) ;
+        mImpl->mApplicationSequence.store( sequence + 1,
+                                           std::memory_order_relaxed ) ;
+        std::atomic_thread_fence( std::memory_order_release ) ;
+        return ;
+    }
+
+    void
+    ModbusRegisterMap::EndUpdate()
+    {
+        const unsigned long sequence =
+            mImpl->mApplicationSequence.load( std::memory_order_relaxed ) ;
+        mImpl->mApplicationSequence.store( sequence + 1,
+                                           std::memory_order_release ) ;
+        return ;
+    }
+
+    void
+    ModbusRegisterMap::SetValue( const Table          table,
+                                 const unsigned int   address,
+                                 const unsigned short value )
+        throw( std::out_of_range )
+    {
+        if ( address >= mImpl->mSizes[ table ] )
+        {
+            throw std::out_of_range( ERR_MSG_INVALID_ADDRESS ) ;
+        }
+        unsigned short stored_value = value ;
+        if ( ( COILS == table ) ||
+             ( DISCRETE_INPUTS == table ) )
+        {
+            stored_value = ( 0 != value ) ? 1 : 0 ;
+        }
+        mImpl->mTables[ table ][ address ].store( stored_value,
+                                                  std::memory_order_relaxed ) ;
+        return ;
+    }
+
+    unsigned short
+    ModbusRegisterMap::GetValue( const Table        table,
+                                 const unsigned int address ) const
+        throw( std::out_of_range )
+    {
+        if ( address >= mImpl->mSizes[ table ] )
+        {
+            throw std::out_of_range( ERR_MSG_INVALID_ADDRESS ) ;
+        }
+        return mImpl->mTables[ table ][ address ].load( std::memory_order_relaxed ) ;
+    }
+
+    bool
+    ModbusRegisterMap::Read( const Table         table,
+                             const unsigned int  startAddress,
+                             const unsigned int  quantity,
+                             unsigned short*     values,
+                             const unsigned int  maxRetries ) const
+    {
+        const std::atomic<unsigned short>* entries =
+            mImpl->mTables[ table ] + startAddress ;
+        for( unsigned int attempt=0; ; ++attempt )
+        {
+            const unsigned long application_sequence =
+                mImpl->mApplicationSequence.load( std::memory_order_acquire ) ;
+            const unsigned long master_sequence =
+                mImpl->mMasterSequence.load( std::memory_order_acquire ) ;
+            //
+            // An odd sequence means that an update is in progress.
+            //
+            if ( 0 == ( ( application_sequence | master_sequence ) & 1 ) )
+            {
+                for( unsigned int i=0; i<quantity; ++i )
+                {
+                    values[i] = entries[i].load( std::memory_order_relaxed ) ;
+                }
+                std::atomic_thread_fence( std::memory_order_acquire ) ;
+                if ( ( application_sequence ==
+                       mImpl->mApplicationSequence.load( std::memory_order_relaxed ) ) &&
+                     ( master_sequence ==
+                       mImpl->mMasterSequence.load( std::memory_order_relaxed ) ) )
+                {
+                    return true ;
+                }
+            }
+            if ( ( UNLIMITED_RETRIES != maxRetries ) &&
+                 ( attempt >= maxRetries ) )
+            {
+                return false ;
+            }
+        }
+    }
+
+    void
+    ModbusRegisterMap::WriteFromMaster( const Table           table,
+                                        const unsigned int    startAddress,
+                                        const unsigned int    quantity,
+                                        const unsigned short* values )
+    {
+        const unsigned long sequence =
+            mImpl->mMasterSequence.load( std::memory_order_relaxed ) ;
+        mImpl->mMasterSequence.store( sequence + 1,
+                                      std::memory_order_relaxed ) ;
+        std::atomic_thread_fence( std::memory_order_release ) ;
+        //
+        std::atomic<unsigned short>* entries = mImpl->mTables[ table ] + startAddress ;
+        for( unsigned int i=0; i<quantity; ++i )
+        {
+            entries[i].store( values[i],
+                              std::memory_order_relaxed ) ;
+        }
+        //
+        mImpl->mMasterSequence.store( sequence + 2,
+                                      std::memory_order_release ) ;
+        return ;
+    }
+
+    unsigned long
+    ModbusRegisterMap::GetMasterWriteCount() const
+    {
+        return mImpl->mMasterSequence.load( std::memory_order_acquire ) / 2 ;
+    }
+}
@@ -0,0 +1,185 @@
+/******************************************************************************
+ *   @file ModbusRegisterMap.h                                                *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _ModbusRegisterMap_h_
+#define _ModbusRegisterMap_h_
+
+#include <stdexcept>
+
+namespace LibSerial
+{
+    /**
+     * @brief The data model of a Modbus slave: coils, discrete inputs,
+     *        holding registers and input registers.
+     *
+     *        The register map is shared between the application and a
+     *        ModbusRtuSlave that answers requests from the SIGIO handler
+     *        of the serial port, so none of its methods take a lock.
+     *        Every entry is an atomic value. Two sequence counters
+     *        (seqlocks) make multi-register reads consistent: one is
+     *        advanced by the application around BeginUpdate() and
+     *        EndUpdate(), the other by the slave around writes received
+     *        from the Modbus master. Each counter has a single writer, so
+     *        neither side ever waits for the other to release anything.
+     *
+     * @note The application must not call Read() with an unlimited number
+     *       of retries between BeginUpdate() and EndUpdate().
+     */
+    class ModbusRegisterMap
+    {
+    public:
+        /**
+         * @brief The four tables of the Modbus data model.
+         */
+        enum Table {
+            COILS,
+            DISCRETE_INPUTS,
+            HOLDING_REGISTERS,
+            INPUT_REGISTERS
+        } ;
+
+        /**
+         * @brief Value of maxRetries that makes Read() retry until it
+         *        obtains a consistent snapshot.
+         */
+        static const unsigned int UNLIMITED_RETRIES = ~0U ;
+
+        /**
+         * @brief Constructs a register map with the specified number of
+         *        entries in each table. All entries are initially zero.
+         */
+        ModbusRegisterMap( const unsigned int numOfCoils,
+                           const unsigned int numOfDiscreteInputs,
+                           const unsigned int numOfHoldingRegisters,
+                           const unsigned int numOfInputRegisters ) ;
+
+        /**
+         * @brief Destructor.
+         */
+        ~ModbusRegisterMap() ;
+
+        /**
+         * @brief Gets the number of entries in the specified table.
+         */
+        unsigned int
+        GetSize( const Table table ) const ;
+
+        /**
+         * @brief Marks the start of a group of application updates that
+         *        must be seen atomically by the Modbus master. Calls to
+         *        BeginUpdate() and EndUpdate() must not be nested and must
+         *        only be made by a single application thread.
+         */
+        void
+        BeginUpdate() ;
+
+        /**
+         * @brief Marks the end of a group of application updates started
+         *        with BeginUpdate().
+         */
+        void
+        EndUpdate() ;
+
+        /**
+         * @brief Sets the value of a single entry from the application.
+         *        Coils and discrete inputs are set if value is non-zero.
+         * @throw std::out_of_range This exception is thrown if address is
+         *        beyond the end of the table.
+         */
+        void
+        SetValue( const Table          table,
+                  const unsigned int   address,
+                  const unsigned short value )
+            throw( std::out_of_range ) ;
+
+        /**
+         * @brief Gets the current value of a single entry. Coils and
+         *        discrete inputs are returned as 0 or 1.
+         * @throw std::out_of_range This exception is thrown if address is
+         *        beyond the end of the table.
+         */
+        unsigned short
+        GetValue( const Table        table,
+                  const unsigned int address ) const
+            throw( std::out_of_range ) ;
+
+        /**
+         * @brief Reads a consistent snapshot of a range of entries. The
+         *        caller must ensure that the range lies within the table.
+         * @param maxRetries The number of times the read is retried if an
+         *        update is in progress. The ModbusRtuSlave uses a small
+         *        number here and answers "slave device busy" on failure.
+         * @return Returns true iff a consistent snapshot was obtained.
+         */
+        bool
+        Read( const Table         table,
+              const unsigned int  startAddress,
+              const unsigned int  quantity,
+              unsigned short*     values,
+              const unsigned int  maxRetries = UNLIMITED_RETRIES ) const ;
+
+        /**
+         * @brief Writes a range of entries on behalf of the Modbus master.
+         *        This is called by the ModbusRtuSlave and must only be
+         *        called from one context at a time. The caller must ensure
+         *        that the range lies within the table.
+         */
+        void
+        WriteFromMaster( const Table           table,
+                         const unsigned int    startAddress,
+                         const unsigned int    quantity,
+                         const unsigned short* values ) ;
+
+        /**
+         * @brief Gets the number of write requests from the Modbus master
+         *        applied to the register map so far. Applications can poll
+         *        this to detect changes made by the master.
+         */
+        unsigned long
+        GetMasterWriteCount() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        ModbusRegisterMap( const ModbusRegisterMap& otherRegisterMap ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        ModbusRegisterMap& operator=( const ModbusRegisterMap& otherRegisterMap ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _ModbusRegisterMap_h_
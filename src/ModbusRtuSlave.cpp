@@ -0,0 +1,629 @@
+/******************************************************************************
+ *   @file ModbusRtuSlave.cpp                                                 *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "ModbusRtuSlave.h"
+#include "Modbus.h"
+
+#include <atomic>
+#include <time.h>
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_SLAVE_ADDRESS = "Invalid Modbus slave address." ;
+
+    //
+    // Highest unicast slave address allowed by the Modbus specification.
+    //
+    const unsigned char MAX_SLAVE_ADDRESS = 247 ;
+
+    //
+    // Number of times a read of the register map is retried while the
+    // application is updating it before answering "slave device busy".
+    //
+    const unsigned int MAX_SNAPSHOT_RETRIES = 64 ;
+
+    //
+    // Values of a coil in a "write single coil" request.
+    //
+    const unsigned short COIL_ON  = 0xFF00 ;
+    const unsigned short COIL_OFF = 0x0000 ;
+
+    /*
+     * Read a big-endian 16-bit value.
+     */
+    inline
+    unsigned short
+    GetUint16( const unsigned char* data )
+    {
+        return ( data[0] << 8 ) | data[1] ;
+    }
+
+    /*
+     * Write a big-endian 16-bit value.
+     */
+    inline
+    void
+    PutUint16( unsigned char* data,
+               const unsigned short value )
+    {
+        data[0] = value >> 8 ;
+        data[1] = value & 0xFF ;
+    }
+
+    /*
+     * Current value of the monotonic clock in microseconds.
+     * clock_gettime() is async-signal-safe.
+     */
+    inline
+    unsigned long long
+    MonotonicMicroseconds()
+    {
+        struct timespec now ;
+        clock_gettime( CLOCK_MONOTONIC,
+                       &now ) ;
+        return static_cast<unsigned long long>( now.tv_sec ) * 1000000ULL +
+               now.tv_nsec / 1000 ;
+    }
+}
+
+namespace LibSerial
+{
+    class ModbusRtuSlave::Implementation
+    {
+    public:
+        Implementation( SerialPort&         serialPort,
+                        ModbusRegisterMap&  registerMap,
+                        const unsigned char slaveAddress ) ;
+
+        /*
+         * Discard the frame currently being received.
+         */
+        void
+        ResetFrame() ;
+
+        /*
+         * Ingest bytes received by the serial port.
+         */
+        void
+        Ingest( const unsigned char* dataBuffer,
+                const unsigned int   bufferSize ) ;
+
+        /*
+         * Check and execute the complete request in mFrame.
+         */
+        void
+        ProcessFrame() ;
+
+        /*
+         * Execute the request in mFrame and build the response in
+         * response. Returns the size of the response without the CRC.
+         */
+        unsigned int
+        ExecuteRequest( unsigned char* response ) ;
+
+        /*
+         * Build an exception response. Returns its size without the CRC.
+         */
+        unsigned int
+        ExceptionResponse( unsigned char*              response,
+                           const Modbus::ExceptionCode exceptionCode ) ;
+
+        SerialPort&        mSerialPort ;
+        ModbusRegisterMap& mRegisterMap ;
+        unsigned char      mSlaveAddress ;
+
+        /*
+         * True while the slave is attached to the serial port.
+         */
+        std::atomic<bool> mIsRunning ;
+
+        /*
+         * Inter-frame gap set by the user, or zero for the default.
+         */
+        unsigned int mInterFrameGapOverride ;
+
+        /*
+         * Inter-frame gap in microseconds used while the slave runs.
+         */
+        unsigned int mInterFrameGap ;
+
+        /*
+         * The request frame currently being received.
+         */
+        unsigned char mFrame[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        unsigned int  mFrameSize ;
+
+        /*
+         * True while the bytes of a frame that is not for us, or that
+         * cannot be decoded, are being dropped.
+         */
+        bool mIsSkippingFrame ;
+
+        /*
+         * Time at which the last chunk of data was received.
+         */
+        unsigned long long mLastReceiveTime ;
+
+        /*
+         * Statistics. These are updated from the SIGIO handler and read
+         * by the application.
+         */
+        std::atomic<unsigned long> mNumOfRequests ;
+        std::atomic<unsigned long> mNumOfResponses ;
+        std::atomic<unsigned long> mNumOfBroadcasts ;
+        std::atomic<unsigned long> mNumOfExceptions ;
+        std::atomic<unsigned long> mNumOfBusyResponses ;
+        std::atomic<unsigned long> mNumOfCrcErrors ;
+        std::atomic<unsigned long> mNumOfDiscardedFrames ;
+        std::atomic<unsigned long> mNumOfIgnoredFrames ;
+        std::atomic<unsigned long> mNumOfWriteErrors ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    ModbusRtuSlave::ModbusRtuSlave( SerialPort&         serialPort,
+                                    ModbusRegisterMap&  registerMap,
+                                    const unsigned char slaveAddress )
+        throw( std::invalid_argument ) :
+        mImpl(0)
+    {
+        if ( ( Modbus::BROADCAST_ADDRESS == slaveAddress ) ||
+             ( slaveAddress > MAX_SLAVE_ADDRESS ) )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_SLAVE_ADDRESS ) ;
+        }
+        mImpl = new Implementation( serialPort,
+                                    registerMap,
+                                    slaveAddress ) ;
+    }
+
+    ModbusRtuSlave::~ModbusRtuSlave()
+    {
+        this->Stop() ;
+        delete mImpl ;
+    }
+
+    void
+    ModbusRtuSlave::Start()
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        if ( this->IsRunning() )
+        {
+            return ;
+        }
+        //
+        // GetBaudRate() throws NotOpen if the port is not open.
+        //
+        const SerialPort::BaudRate baud_rate = mImpl->mSerialPort.GetBaudRate() ;
+        mImpl->mInterFrameGap = mImpl->mInterFrameGapOverride ;
+        if ( 0 == mImpl->mInterFrameGap )
+        {
+            mImpl->mInterFrameGap = Modbus::InterFrameGapMicroseconds( baud_rate ) ;
+        }
+        mImpl->ResetFrame() ;
+        mImpl->mLastReceiveTime = 0 ;
+        mImpl->mIsRunning = true ;
+        mImpl->mSerialPort.SetReceiveHandler( this ) ;
+        return ;
+    }
+
+    void
+    ModbusRtuSlave::Stop()
+    {
+        if ( ! this->IsRunning() )
+        {
+            return ;
+        }
+        mImpl->mSerialPort.SetReceiveHandler( 0 ) ;
+        mImpl->mIsRunning = false ;
+        return ;
+    }
+
+    bool
+    ModbusRtuSlave::IsRunning() const
+    {
+        return mImpl->mIsRunning ;
+    }
+
+    void
+    ModbusRtuSlave::SetInterFrameGap( const unsigned int microseconds )
+    {
+        mImpl->mInterFrameGapOverride = microseconds ;
+        return ;
+    }
+
+    ModbusRtuSlave::Statistics
+    ModbusRtuSlave::GetStatistics() const
+    {
+        Statistics statistics ;
+        statistics.mNumOfRequests        = mImpl->mNumOfRequests ;
+        statistics.mNumOfResponses       = mImpl->mNumOfResponses ;
+        statistics.mNumOfBroadcasts      = mImpl->mNumOfBroadcasts ;
+        statistics.mNumOfExceptions      = mImpl->mNumOfExceptions ;
+        statistics.mNumOfBusyResponses   = mImpl->mNumOfBusyResponses ;
+        statistics.mNumOfCrcErrors       = mImpl->mNumOfCrcErrors ;
+        statistics.mNumOfDiscardedFrames = mImpl->mNumOfDiscardedFrames ;
+        statistics.mNumOfIgnoredFrames   = mImpl->mNumOfIgnoredFrames ;
+        statistics.mNumOfWriteErrors     = mImpl->mNumOfWriteErrors ;
+        return statistics ;
+    }
+
+    void
+    ModbusRtuSlave::HandleReceivedData( const unsigned char* dataBuffer,
+                                        const unsigned int   bufferSize )
+    {
+        mImpl->Ingest( dataBuffer,
+                       bufferSize ) ;
+        return ;
+    }
+
+    /* ------------------------------------------------------------ */
+    ModbusRtuSlave::Implementation::Implementation( SerialPort&         serialPort,
+                                                    ModbusRegisterMap&  registerMap,
+                                                    const unsigned char slaveAddress ) :
+        mSerialPort(serialPort),
+        mRegisterMap(registerMap),
+        mSlaveAddress(slaveAddress),
+        mIsRunning(false),
+        mInterFrameGapOverride(0),
+        mInterFrameGap(0),
+        mFrame(),
+        mFrameSize(0),
+        mIsSkippingFrame(false),
+        mLastReceiveTime(0),
+        mNumOfRequests(0),
+        mNumOfResponses(0),
+        mNumOfBroadcasts(0),
+        mNumOfExceptions(0),
+        mNumOfBusyResponses(0),
+        mNumOfCrcErrors(0),
+        mNumOfDiscardedFrames(0),
+        mNumOfIgnoredFrames(0),
+        mNumOfWriteErrors(0)
+    {
+        /* empty */
+    }
+
+    void
+    ModbusRtuSlave::Implementation::ResetFrame()
+    {
+        mFrameSize = 0 ;
+        mIsSkippingFrame = false ;
+        return ;
+    }
+
+    void
+    ModbusRtuSlave::Implementation::Ingest( const unsigned char* dataBuffer,
+                                            const unsigned int   bufferSize )
+    {
+        //
+        // A silence of at least one inter-frame gap since the last chunk
+        // terminates whatever frame was being received.
+        //
+        const unsigned long long now = MonotonicMicroseconds() ;
+        if ( now - mLastReceiveTime >= mInterFrameGap )
+        {
+            if ( mFrameSize > 0 )
+            {
+                ++mNumOfDiscardedFrames ;
+            }
+            this->ResetFrame() ;
+        }
+        mLastReceiveTime = now ;
+        //
+        for( unsigned int i=0; i<bufferSize; ++i )
+        {
+            if ( mIsSkippingFrame )
+            {
+                continue ;
+            }
+            //
+            // Filter on the address byte so that frames for other
+            // slaves are never buffered.
+            //
+            if ( ( 0 == mFrameSize ) &&
+                 ( mSlaveAddress != dataBuffer[i] ) &&
+                 ( Modbus::BROADCAST_ADDRESS != dataBuffer[i] ) )
+            {
+                ++mNumOfIgnoredFrames ;
+                mIsSkippingFrame = true ;
+                continue ;
+            }
+            mFrame[ mFrameSize++ ] = dataBuffer[i] ;
+            //
+            const int frame_size = Modbus::RequestFrameSize( mFrame,
+                                                             mFrameSize ) ;
+            if ( ( frame_size < 0 ) ||
+                 ( frame_size > static_cast<int>( Modbus::MAX_RTU_FRAME_SIZE ) ) )
+            {
+                ++mNumOfDiscardedFrames ;
+                mFrameSize = 0 ;
+                mIsSkippingFrame = true ;
+                continue ;
+            }
+            if ( static_cast<int>( mFrameSize ) == frame_size )
+            {
+                this->ProcessFrame() ;
+                mFrameSize = 0 ;
+            }
+        }
+        return ;
+    }
+
+    void
+    ModbusRtuSlave::Implementation::ProcessFrame()
+    {
+        //
+        // Verify the CRC, which is transmitted low byte first.
+        //
+        const unsigned short received_crc = mFrame[ mFrameSize - 2 ] |
+                                            ( mFrame[ mFrameSize - 1 ] << 8 ) ;
+        if ( Modbus::Crc16( mFrame, mFrameSize - 2 ) != received_crc )
+        {
+            ++mNumOfCrcErrors ;
+            return ;
+        }
+        //
+        const bool is_broadcast = ( Modbus::BROADCAST_ADDRESS == mFrame[0] ) ;
+        if ( is_broadcast )
+        {
+            ++mNumOfBroadcasts ;
+        }
+        else
+        {
+            ++mNumOfRequests ;
+        }
+        //
+        unsigned char response[ Modbus::MAX_RTU_FRAME_SIZE ] ;
+        unsigned int response_size = this->ExecuteRequest( response ) ;
+        //
+        // Broadcast requests are never answered.
+        //
+        if ( is_broadcast )
+        {
+            return ;
+        }
+        const unsigned short crc = Modbus::Crc16( response,
+                                                  response_size ) ;
+        response[ response_size++ ] = crc & 0xFF ;
+        response[ response_size++ ] = crc >> 8 ;
+        try
+        {
+            mSerialPort.Write( response,
+                               response_size ) ;
+            ++mNumOfResponses ;
+        }
+        catch( ... )
+        {
+            ++mNumOfWriteErrors ;
+        }
+        return ;
+    }
+
+    unsigned int
+    ModbusRtuSlave::Implementation::ExceptionResponse(
+        unsigned char*              response,
+        const Modbus::ExceptionCode exceptionCode )
+    {
+        ++mNumOfExceptions ;
+        response[0] = mFrame[0] ;
+        response[1] = mFrame[1] | 0x80 ;
+        response[2] = exceptionCode ;
+        return 3 ;
+    }
+
+    unsigned int
+    ModbusRtuSlave::Implementation::ExecuteRequest( unsigned char* response )
+    {
+        const bool is_broadcast = ( Modbus::BROADCAST_ADDRESS == mFrame[0] ) ;
+        const unsigned char function_code = mFrame[1] ;
+        const unsigned int start_address = GetUint16( mFrame + 2 ) ;
+        const unsigned int quantity      = GetUint16( mFrame + 4 ) ;
+        unsigned short values[ Modbus::MAX_READ_BITS ] ;
+        //
+        response[0] = mFrame[0] ;
+        response[1] = function_code ;
+        //
+        switch( function_code )
+        {
+        case Modbus::READ_COILS:
+        case Modbus::READ_DISCRETE_INPUTS:
+        case Modbus::READ_HOLDING_REGISTERS:
+        case Modbus::READ_INPUT_REGISTERS:
+        {
+            //
+            // Read requests are meaningless when broadcast.
+            //
+            if ( is_broadcast )
+            {
+                return 0 ;
+            }
+            const bool is_bit_read = ( function_code <= Modbus::READ_DISCRETE_INPUTS ) ;
+            const unsigned int max_quantity = is_bit_read ?
+                                              Modbus::MAX_READ_BITS :
+                                              Modbus::MAX_READ_REGISTERS ;
+            if ( ( 0 == quantity ) ||
+                 ( quantity > max_quantity ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_VALUE ) ;
+            }
+            ModbusRegisterMap::Table table = ModbusRegisterMap::COILS ;
+            switch( function_code )
+            {
+            case Modbus::READ_DISCRETE_INPUTS:
+                table = ModbusRegisterMap::DISCRETE_INPUTS ;
+                break ;
+            case Modbus::READ_HOLDING_REGISTERS:
+                table = ModbusRegisterMap::HOLDING_REGISTERS ;
+                break ;
+            case Modbus::READ_INPUT_REGISTERS:
+                table = ModbusRegisterMap::INPUT_REGISTERS ;
+                break ;
+            default:
+                break ;
+            }
+            if ( start_address + quantity > mRegisterMap.GetSize( table ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_ADDRESS ) ;
+            }
+            if ( ! mRegisterMap.Read( table,
+                                      start_address,
+                                      quantity,
+                                      values,
+                                      MAX_SNAPSHOT_RETRIES ) )
+            {
+                ++mNumOfBusyResponses ;
+                return this->ExceptionResponse( response,
+                                                Modbus::SLAVE_DEVICE_BUSY ) ;
+            }
+            if ( is_bit_read )
+            {
+                //
+                // Pack the bits, least significant bit first.
+                //
+                const unsigned int byte_count = ( quantity + 7 ) / 8 ;
+                response[2] = byte_count ;
+                for( unsigned int i=0; i<byte_count; ++i )
+                {
+                    response[ 3 + i ] = 0 ;
+                }
+                for( unsigned int i=0; i<quantity; ++i )
+                {
+                    if ( values[i] )
+                    {
+                        response[ 3 + i / 8 ] |= ( 1 << ( i % 8 ) ) ;
+                    }
+                }
+                return 3 + byte_count ;
+            }
+            response[2] = 2 * quantity ;
+            for( unsigned int i=0; i<quantity; ++i )
+            {
+                PutUint16( response + 3 + 2 * i,
+                           values[i] ) ;
+            }
+            return 3 + 2 * quantity ;
+        }
+        case Modbus::WRITE_SINGLE_COIL:
+        {
+            //
+            // The second field is the value of the coil here.
+            //
+            if ( ( COIL_ON != quantity ) &&
+                 ( COIL_OFF != quantity ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_VALUE ) ;
+            }
+            if ( start_address >= mRegisterMap.GetSize( ModbusRegisterMap::COILS ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_ADDRESS ) ;
+            }
+            values[0] = ( COIL_ON == quantity ) ? 1 : 0 ;
+            mRegisterMap.WriteFromMaster( ModbusRegisterMap::COILS,
+                                          start_address,
+                                          1,
+                                          values ) ;
+            //
+            // The response is an echo of the request.
+            //
+            for( unsigned int i=2; i<6; ++i )
+            {
+                response[i] = mFrame[i] ;
+            }
+            return 6 ;
+        }
+        case Modbus::WRITE_SINGLE_REGISTER:
+        {
+            if ( start_address >= mRegisterMap.GetSize( ModbusRegisterMap::HOLDING_REGISTERS ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_ADDRESS ) ;
+            }
+            values[0] = quantity ;
+            mRegisterMap.WriteFromMaster( ModbusRegisterMap::HOLDING_REGISTERS,
+                                          start_address,
+                                          1,
+                                          values ) ;
+            for( unsigned int i=2; i<6; ++i )
+            {
+                response[i] = mFrame[i] ;
+            }
+            return 6 ;
+        }
+        case Modbus::WRITE_MULTIPLE_COILS:
+        case Modbus::WRITE_MULTIPLE_REGISTERS:
+        {
+            const bool is_bit_write = ( Modbus::WRITE_MULTIPLE_COILS == function_code ) ;
+            const unsigned int byte_count = mFrame[6] ;
+            const unsigned int max_quantity = is_bit_write ?
+                                              Modbus::MAX_WRITE_BITS :
+                                              Modbus::MAX_WRITE_REGISTERS ;
+            const unsigned int expected_byte_count = is_bit_write ?
+                                                     ( quantity + 7 ) / 8 :
+                                                     2 * quantity ;
+            if ( ( 0 == quantity ) ||
+                 ( quantity > max_quantity ) ||
+                 ( byte_count != expected_byte_count ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_VALUE ) ;
+            }
+            const ModbusRegisterMap::Table table = is_bit_write ?
+                                                   ModbusRegisterMap::COILS :
+                                                   ModbusRegisterMap::HOLDING_REGISTERS ;
+            if ( start_address + quantity > mRegisterMap.GetSize( table ) )
+            {
+                return this->ExceptionResponse( response,
+                                                Modbus::ILLEGAL_DATA_ADDRESS ) ;
+            }
+            const unsigned char* data = mFrame + 7 ;
+            for( unsigned int i=0; i<quantity; ++i )
+            {
+                values[i] = is_bit_write ?
+                            ( ( data[ i / 8 ] >> ( i % 8 ) ) & 1 ) :
+                            GetUint16( data + 2 * i ) ;
+            }
+            mRegisterMap.WriteFromMaster( table,
+                                          start_address,
+                                          quantity,
+                                          values ) ;
+            //
+            // The response echoes the starting address and quantity.
+            //
+            for( unsigned int i=2; i<6; ++i )
+            {
+                response[i] = mFrame[i] ;
+            }
+            return 6 ;
+        }
+        default:
+            break ;
+        }
+        return this->ExceptionResponse( response,
+                                        Modbus::ILLEGAL_FUNCTION ) ;
+    }
+}
@@ -0,0 +1,163 @@
+/******************************************************************************
+ *   @file ModbusRtuSlave.h                                                   *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _ModbusRtuSlave_h_
+#define _ModbusRtuSlave_h_
+
+#include <ModbusRegisterMap.h>
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief A Modbus RTU slave that answers requests directly from the
+     *        SIGIO handler of a serial port, without involving any
+     *        application thread.
+     *
+     *        Frames are delimited by the inter-frame gap: a silence of at
+     *        least 3.5 character times discards any partial frame. Since
+     *        the SIGIO handler only runs when data arrives, a frame
+     *        addressed to this slave is considered complete as soon as the
+     *        number of bytes implied by its function code has been
+     *        received, and is answered immediately if its CRC is valid.
+     *        Frames addressed to other slaves are dropped byte by byte
+     *        while they are ingested and are never buffered.
+     *
+     *        The supported function codes are 0x01 to 0x06, 0x0F and
+     *        0x10. Requests for other function codes cannot be delimited
+     *        without a timer and are silently dropped up to the next
+     *        inter-frame gap, so the master sees a timeout.
+     */
+    class ModbusRtuSlave : public SerialPortReceiveHandler
+    {
+    public:
+        /**
+         * @brief Counters describing the activity of the slave.
+         */
+        struct Statistics
+        {
+            unsigned long mNumOfRequests ;        //!< Valid requests for this slave.
+            unsigned long mNumOfResponses ;       //!< Responses written to the port.
+            unsigned long mNumOfBroadcasts ;      //!< Broadcast requests processed.
+            unsigned long mNumOfExceptions ;      //!< Exception responses sent.
+            unsigned long mNumOfBusyResponses ;   //!< Reads refused because of a concurrent update.
+            unsigned long mNumOfCrcErrors ;       //!< Frames for this slave with a bad CRC.
+            unsigned long mNumOfDiscardedFrames ; //!< Partial or undecodable frames dropped.
+            unsigned long mNumOfIgnoredFrames ;   //!< Frames addressed to other slaves.
+            unsigned long mNumOfWriteErrors ;     //!< Responses that could not be written.
+        } ;
+
+        /**
+         * @brief Constructs a slave that answers requests for slaveAddress
+         *        on serialPort using the entries of registerMap. The slave
+         *        does not process any data until Start() is called.
+         * @throw std::invalid_argument This exception is thrown if
+         *        slaveAddress is not in the range 1 to 247.
+         */
+        ModbusRtuSlave( SerialPort&         serialPort,
+                        ModbusRegisterMap&  registerMap,
+                        const unsigned char slaveAddress )
+            throw( std::invalid_argument ) ;
+
+        /**
+         * @brief Destructor. Detaches the slave from the serial port if it
+         *        is running.
+         */
+        ~ModbusRtuSlave() ;
+
+        /**
+         * @brief Attaches the slave to its serial port. The inter-frame gap
+         *        is derived from the current baud rate of the port unless
+         *        it was set with SetInterFrameGap().
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::runtime_error This exception is thrown if the baud
+         *        rate of the serial port cannot be read.
+         */
+        void
+        Start()
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Detaches the slave from its serial port. Received data is
+         *        placed in the input buffer of the port again.
+         */
+        void
+        Stop() ;
+
+        /**
+         * @brief Determines if the slave is currently attached to its
+         *        serial port.
+         */
+        bool
+        IsRunning() const ;
+
+        /**
+         * @brief Overrides the inter-frame gap derived from the baud rate.
+         *        A value of zero restores the default.
+         * @param microseconds The minimum silence between two frames.
+         */
+        void
+        SetInterFrameGap( const unsigned int microseconds ) ;
+
+        /**
+         * @brief Gets a copy of the current statistics of the slave.
+         */
+        Statistics
+        GetStatistics() const ;
+
+        /**
+         * @brief Ingests data received by the serial port. This is called
+         *        from the SIGIO handler of the port.
+         */
+        void
+        HandleReceivedData( const unsigned char* dataBuffer,
+                            const unsigned int   bufferSize ) ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        ModbusRtuSlave( const ModbusRtuSlave& otherSlave ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        ModbusRtuSlave& operator=( const ModbusRtuSlave& otherSlave ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _ModbusRtuSlave_h_
@@ -20,6 +20,7 @@
 #include "PosixSignalDispatcher.h"
 #include "PosixSignalHandler.h"
 
+#include <atomic>
 #include <cstring>
 #include <map>
 #include <sstream>
@@ -28,6 +29,20 @@
 
 namespace
 {
+    /*
+     * A signal handler attached to the dispatcher, with its service
+     * class and byte budget. The flags are only used while a signal is
+     * dispatched.
+     */
+    struct SignalHandlerEntry
+    {
+        PosixSignalHandler* mSignalHandler ;
+        unsigned int        mServiceClass ;
+        unsigned int        mByteBudget ;
+        bool                mIsPending ;
+        bool                mIsNewWakeup ;
+    } ;
+
     /**
      * Implementation class for the PosixSignalDispatcher.
      */
@@ -48,7 +63,9 @@ namespace
          */
         void
         AttachHandler( const int           posixSignalNumber,
-                       PosixSignalHandler& signalHandler )
+                       PosixSignalHandler& signalHandler,
+                       const unsigned int  serviceClass,
+                       const unsigned int  byteBudget )
         throw( PosixSignalDispatcher::CannotAttachHandler ) ;
 
         /*
@@ -62,9 +79,10 @@ namespace
     private:
         /*
          * List of signal handlers that are currently associated
-         * with the dispatcher.
+         * with the dispatcher. The handlers of each signal are kept in
+         * order of decreasing service class.
          */
-        typedef std::multimap<int, PosixSignalHandler*> SignalHandlerList ;
+        typedef std::multimap<int, SignalHandlerEntry> SignalHandlerList ;
         static SignalHandlerList mSignalHandlerList ;
 
         /*
@@ -91,6 +109,21 @@ namespace
         static
         void
         SigactionHandler( int signalNumber ) ;
+
+        /*
+         * Call the handlers associated with the signal.
+         */
+        static
+        void
+        DispatchSignal( int signalNumber ) ;
+
+        /*
+         * Number of signals received since the current dispatch started.
+         * A signal that is delivered to another thread while a dispatch
+         * is in progress is left to the dispatching thread, so that
+         * handlers never run concurrently and read data in order.
+         */
+        static std::atomic<unsigned int> mNumOfDispatchRequests ;
     } ;
 
     //
@@ -102,6 +135,9 @@ namespace
     PosixSignalDispatcherImpl::OriginalSigactionList
     PosixSignalDispatcherImpl::mOriginalSigactionList ;
 
+    std::atomic<unsigned int>
+    PosixSignalDispatcherImpl::mNumOfDispatchRequests(0) ;
+
 }
 
 PosixSignalDispatcher::PosixSignalDispatcher()
@@ -123,11 +159,15 @@ PosixSignalDispatcher::Instance()
 
 void
 PosixSignalDispatcher::AttachHandler( const int           posixSignalNumber,
-                                      PosixSignalHandler& signalHandler )
+                                      PosixSignalHandler& signalHandler,
+                                      const unsigned int  serviceClass,
+                                      const unsigned int  byteBudget )
     throw( CannotAttachHandler )
 {
     PosixSignalDispatcherImpl::Instance().AttachHandler( posixSignalNumber,
-            signalHandler ) ;
+            signalHandler,
+            serviceClass,
+            byteBudget ) ;
     return ;
 }
 
@@ -167,7 +207,9 @@ namespace
     void
     PosixSignalDispatcherImpl::AttachHandler(
         const int           posixSignalNumber,
-        PosixSignalHandler& signalHandler )
+        PosixSignalHandler& signalHandler,
+        const unsigned int  serviceClass,
+        const unsigned int  byteBudget )
     throw( PosixSignalDispatcher::CannotAttachHandler )
     {
         /*
@@ -198,11 +240,27 @@ namespace
                                                    old_action ) ) ;
         }
         /*
-         * Add the specified handler to the list of handlers associated with the signal.
+         * Add the specified handler to the list of handlers associated
+         * with the signal, after the handlers of the same or a higher
+         * service class.
          */
-        mSignalHandlerList.insert(
-            SignalHandlerList::value_type( posixSignalNumber,
-                                           &signalHandler ) ) ;
+        std::pair<SignalHandlerList::iterator, SignalHandlerList::iterator>
+        iterator_range = mSignalHandlerList.equal_range( posixSignalNumber ) ;
+        SignalHandlerList::iterator position = iterator_range.first ;
+        while ( ( iterator_range.second != position ) &&
+                ( position->second.mServiceClass >= serviceClass ) )
+        {
+            ++position ;
+        }
+        SignalHandlerEntry entry ;
+        entry.mSignalHandler = &signalHandler ;
+        entry.mServiceClass  = serviceClass ;
+        entry.mByteBudget    = byteBudget ;
+        entry.mIsPending     = false ;
+        entry.mIsNewWakeup   = false ;
+        mSignalHandlerList.insert( position,
+                                   SignalHandlerList::value_type( posixSignalNumber,
+                                                                  entry ) ) ;
         return ;
     }
 
@@ -228,7 +286,7 @@ namespace
                 i != iterator_range.second ;
                 ++i )
         {
-            if ( i->second == &signalHandler )
+            if ( i->second.mSignalHandler == &signalHandler )
             {
                 sig_handler_location = i ;
                 break ;
@@ -293,41 +351,96 @@ namespace
             throw std::runtime_error(err_msg.str()) ;
         }
 
+        //
+        // Only the first thread to receive the signal dispatches it. It
+        // dispatches once more for all signals that arrived on other
+        // threads in the meantime.
+        //
+        unsigned int num_of_requests = 1 ;
+        if ( mNumOfDispatchRequests.fetch_add( num_of_requests ) > 0 )
+        {
+            return ;
+        }
+        do
+        {
+            DispatchSignal( signalNumber ) ;
+            num_of_requests = mNumOfDispatchRequests.fetch_sub( num_of_requests ) -
+                              num_of_requests ;
+        }
+        while ( num_of_requests > 0 ) ;
+        return ;
+    }
+
+    void
+    PosixSignalDispatcherImpl::DispatchSignal( int signalNumber )
+    {
         /*
          * Get a list of handlers associated with signalNumber.
          */
         std::pair<SignalHandlerList::iterator, SignalHandlerList::iterator>
         iterator_range = mSignalHandlerList.equal_range( signalNumber ) ;
         /*
-         * Call each handler.
+         * Every handler starts a new wakeup.
          */
         for( SignalHandlerList::iterator i=iterator_range.first ;
                 i != iterator_range.second ;
                 ++i )
         {
-            i->second->HandlePosixSignal( signalNumber ) ;
+            i->second.mIsPending   = true ;
+            i->second.mIsNewWakeup = true ;
         }
         //
-        // :TODO: Why is the following code commented out using "#if 0" ?
-        // Check and remove this code if it is not necessary. Otherwise, if 
-        // it has been commented out due to a bug then debug and correct it. 
+        // Give each pending handler of the highest class with pending
+        // work one turn, until no work is left. With the default class
+        // and no budgets, every handler is called exactly once.
         //
-#if 0
-        /*
-         * Get the original handler that was associated with the
-         * signal and call it if possible.
-         */
-        OriginalSigactionList::iterator original_sigaction =
-            mOriginalSigactionList.find( posixSignalNumber ) ;
-        if ( ( mOriginalSigactionList.end() != original_sigaction ) &&
-                ( SIG_DFL != original_sigaction->second.sa_handler ) &&
-                ( SIG_IGN != original_sigaction->second.sa_handler ) &&
-                ( 0 != original_sigaction->second.sa_handler ) )
+        for ( ;; )
         {
-            original_sigaction->second.sa_handler( signalNumber ) ;
+            SignalHandlerList::iterator first = iterator_range.first ;
+            while ( ( iterator_range.second != first ) &&
+                    ( ! first->second.mIsPending ) )
+            {
+                ++first ;
+            }
+            if ( iterator_range.second == first )
+            {
+                break ;
+            }
+            const unsigned int service_class = first->second.mServiceClass ;
+            bool is_work_left = false ;
+            for( SignalHandlerList::iterator i=first ;
+                    i != iterator_range.second ;
+                    ++i )
+            {
+                SignalHandlerEntry& entry = i->second ;
+                if ( entry.mIsPending &&
+                     ( service_class == entry.mServiceClass ) )
+                {
+                    entry.mIsPending =
+                        entry.mSignalHandler->ServicePosixSignal( signalNumber,
+                                                                  entry.mByteBudget,
+                                                                  entry.mIsNewWakeup ) ;
+                    entry.mIsNewWakeup = false ;
+                }
+                is_work_left = is_work_left || entry.mIsPending ;
+            }
+            //
+            // Strict priority: before this class continues or a lower one
+            // starts, the higher classes are checked for work that arrived
+            // in the meantime.
+            //
+            if ( is_work_left )
+            {
+                for( SignalHandlerList::iterator i=iterator_range.first ;
+                        ( i != iterator_range.second ) &&
+                        ( i->second.mServiceClass > service_class ) ;
+                        ++i )
+                {
+                    i->second.mIsPending   = true ;
+                    i->second.mIsNewWakeup = true ;
+                }
+            }
         }
-#endif
-        //
         return ;
     }
 }
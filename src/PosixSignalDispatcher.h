@@ -34,6 +34,15 @@ class PosixSignalHandler ;
  *       function is already attached to a signal that the dispatcher is asked
  *       to administer, that signal handler will be called after all the
  *       attached PosixSignalHandlers.
+ *
+ * @note Only one thread dispatches a signal at a time, so that handlers
+ *       never run concurrently and read data from their ports in order.
+ *       A thread that receives the signal while another thread is
+ *       dispatching it leaves the work to that thread, which dispatches
+ *       once more before returning. Under continuous traffic the
+ *       dispatching thread can therefore stay busy for a long time.
+ *       Threads that must not be delayed by receive processing should
+ *       block SIGIO with pthread_sigmask().
  * 
  * @todo Make this a singleton class.
  */
@@ -83,15 +92,29 @@ public:
      *        it should also be detached as many times as it was attached
      *        before it is destroyed. Otherwise, undefined behavior may result.
      *
+     *        Handlers are serviced in order of their service class, highest
+     *        first, with strict priority: after every round of slices in a
+     *        class, all higher classes are checked again for new work
+     *        before the class continues. Within a class, handlers take
+     *        turns, each servicing at most byteBudget bytes per turn (see
+     *        PosixSignalHandler::ServicePosixSignal()), so a busy handler
+     *        cannot hold up the others in its class for long.
+     *
      * @param posixSignalNumber The signal number that will result in
      *        call to the HandlePosixSignal() method of the signal handler.
      * @param signalHandler The signal handler to be invoked on receiving
      *        a posixSignalNumber signal.
+     * @param serviceClass The service class of the handler. Handlers in
+     *        higher classes are serviced first.
+     * @param byteBudget The maximum number of bytes the handler services
+     *        per turn, or 0 for no limit.
      * @throw CannotDetachHandler This exception is thrown if the method cannot
      *        detach the handler.
      */
     void AttachHandler( const int           posixSignalNumber,
-                        PosixSignalHandler& signalHandler )
+                        PosixSignalHandler& signalHandler,
+                        const unsigned int  serviceClass = 0,
+                        const unsigned int  byteBudget = 0 )
         throw( CannotAttachHandler ) ;
 
     /**
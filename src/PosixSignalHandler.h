@@ -35,6 +35,27 @@ public:
      *        this handler.
      */
     virtual void HandlePosixSignal( int signalNumber ) = 0 ;
+
+    /**
+     * @brief Called by the PosixSignalDispatcher instead of
+     *        HandlePosixSignal(), so that handlers can do their work in
+     *        slices of limited size. A wakeup starts with a call where
+     *        isNewWakeup is true; the handler should then note how much
+     *        work is waiting and do at most byteBudget bytes of it. It is
+     *        called again, with isNewWakeup false, for as long as it
+     *        returns true. A handler may see several wakeups per signal.
+     *        The default implementation calls HandlePosixSignal() once
+     *        per wakeup.
+     * @param signalNumber The signal received.
+     * @param byteBudget The maximum number of bytes to service in this
+     *        call, or 0 for no limit.
+     * @param isNewWakeup True for the first call of a wakeup.
+     * @return Returns true if work that was waiting at the start of the
+     *         wakeup remains.
+     */
+    virtual bool ServicePosixSignal( int          signalNumber,
+                                     unsigned int byteBudget,
+                                     bool         isNewWakeup ) ;
      
     /**
      * @brief Destructor is declared virtual as we expect this class to be
@@ -44,6 +65,19 @@ public:
     virtual ~PosixSignalHandler() = 0 ;
 } ;
 
+inline
+bool
+PosixSignalHandler::ServicePosixSignal( int          signalNumber,
+                                        unsigned int ,
+                                        bool         isNewWakeup )
+{
+    if ( isNewWakeup )
+    {
+        this->HandlePosixSignal( signalNumber ) ;
+    }
+    return false ;
+}
+
 inline
 PosixSignalHandler::~PosixSignalHandler()
 {
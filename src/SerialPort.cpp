@@ -20,13 +20,22 @@
  *****************************************************************************/
 
 #include "SerialPort.h"
+#include "MirroredRingBuffer.h"
 #include "PosixSignalDispatcher.h"
 #include "PosixSignalHandler.h"
+#include "SerialPortReceiveHandler.h"
+#include "TransformChain.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <iostream>
 #include <fcntl.h>
 #include <queue>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
@@ -45,6 +54,40 @@ namespace
     const std::string ERR_MSG_INVALID_PARITY       = "Invalid parity setting." ;
     const std::string ERR_MSG_INVALID_STOP_BITS    = "Invalid number of stop bits." ;
     const std::string ERR_MSG_INVALID_FLOW_CONTROL = "Invalid flow control." ;
+    const std::string ERR_MSG_NO_RECEIVE_RING      = "No receive ring buffer has been set." ;
+    const std::string ERR_MSG_EXPANDING_TRANSFORM  = "A receive transform must not make data longer." ;
+    const std::string ERR_MSG_SIGNAL_DRIVEN        = "Received data is read by the SIGIO handler." ;
+    const std::string ERR_MSG_WRITE_STALLED        = "Serial port output stalled: the line is not being drained." ;
+    const std::string ERR_MSG_WRITE_FAILED         = "Serial port cannot be written: error or hangup." ;
+
+    //
+    // Maximum number of bytes read from the serial port with a single
+    // call to read() in the SIGIO handler.
+    //
+    const int READ_CHUNK_SIZE = 1024 ;
+
+    //
+    // Number of bytes transformed at a time by a transmit transform
+    // chain. The transmit buffer is sized for one chunk when the chain
+    // is attached, so writing never allocates memory.
+    //
+    const unsigned int TRANSMIT_CHUNK_SIZE = 4096 ;
+
+    //
+    // A write made by a receive handler gives up when the output queue
+    // of the driver has not drained at all for this long. The handler
+    // may run in the SIGIO handler, where waiting forever would stop
+    // the dispatch of received data on every port. Other writes wait
+    // for as long as the line is held up, as a blocking write would.
+    //
+    const int WRITE_POLL_INTERVAL_MILLISECONDS = 100 ;
+    const int WRITE_STALL_TIMEOUT_MILLISECONDS = 2000 ;
+
+    //
+    // Number of receive handlers the current thread is running, of any
+    // port.
+    //
+    thread_local unsigned int tNumOfActiveReceiveHandlers = 0 ;
 
     /*
      * Return the difference between the two specified timeval values.
@@ -226,12 +269,98 @@ public:
     GetDsr() const 
         throw( SerialPort::NotOpen,
                std::runtime_error ) ;
+
+    void
+    SetReceiveHandler( SerialPortReceiveHandler* receiveHandler ) ;
+
+    void
+    SetReceiveBufferCapacity( const unsigned int capacity,
+                              const bool         allowMirroring )
+        throw( SerialPort::AlreadyOpen,
+               std::invalid_argument,
+               std::bad_alloc ) ;
+
+    bool
+    IsReceiveBufferMirrored() const ;
+
+    const unsigned char*
+    GetReceivedData( unsigned int& size ) const
+        throw( SerialPort::NotOpen,
+               std::logic_error ) ;
+
+    void
+    ConsumeReceivedData( const unsigned int numOfBytes )
+        throw( SerialPort::NotOpen,
+               std::logic_error,
+               std::out_of_range ) ;
+
+    SerialPortReceiveHandler*
+    GetReceiveHandler() const ;
+
+    void
+    SetReceiveTransform( LibSerial::TransformChain* transformChain )
+        throw( SerialPort::AlreadyOpen,
+               std::invalid_argument,
+               std::logic_error ) ;
+
+    void
+    SetTransmitTransform( LibSerial::TransformChain* transformChain )
+        throw( SerialPort::AlreadyOpen,
+               std::bad_alloc,
+               std::logic_error ) ;
+
+    LibSerial::TransformChain*
+    GetReceiveTransform() const ;
+
+    LibSerial::TransformChain*
+    GetTransmitTransform() const ;
+
+    void
+    SetSignalDriven( const bool isSignalDriven )
+        throw( SerialPort::AlreadyOpen ) ;
+
+    bool
+    IsSignalDriven() const ;
+
+    int
+    GetFileDescriptor() const
+        throw( SerialPort::NotOpen ) ;
+
+    unsigned int
+    ProcessReceivedData()
+        throw( SerialPort::NotOpen,
+               std::logic_error ) ;
+
+    void
+    SetServiceClass( const unsigned int serviceClass,
+                     const unsigned int receiveBudget )
+        throw( SerialPort::AlreadyOpen ) ;
+
+    unsigned int
+    GetServiceClass() const ;
+
+    unsigned int
+    GetReceiveBudget() const ;
+
+    bool
+    GetLineErrorCounters( SerialPort::LineErrorCounters& counters ) const
+        throw( SerialPort::NotOpen ) ;
+
     /*
      * This method must be defined by all subclasses of
      * PosixSignalHandler.
      */
     void
     HandlePosixSignal(int signalNumber) ;
+
+    /*
+     * Read at most byteBudget bytes of the data that was waiting at the
+     * start of the wakeup.
+     */
+    bool
+    ServicePosixSignal( int          signalNumber,
+                        unsigned int byteBudget,
+                        bool         isNewWakeup ) ;
 private:
     /**
      * Name of the serial port. On POSIX systems this is the name of
@@ -249,6 +378,25 @@ private:
      */
     int mFileDescriptor ;
 
+    /**
+     * Flag that indicates whether received data is read by the SIGIO
+     * handler rather than by an event loop of the application.
+     */
+    bool mIsSignalDriven ;
+
+    /**
+     * The service class and receive budget the port is attached to the
+     * signal dispatcher with.
+     */
+    unsigned int mServiceClass ;
+    unsigned int mReceiveBudget ;
+
+    /**
+     * Number of bytes that were waiting at the start of the current
+     * wakeup of the signal dispatcher and have not been read yet.
+     */
+    int mNumOfBytesPending ;
+
     /**
      * Serial port settings are saved into this variable immediately
      * after the port is opened. These settings are restored when the
@@ -287,6 +435,93 @@ private:
      */
     volatile bool mIsQueueDataAvailable;
 
+    /*
+     * Handler that consumes received data directly from the SIGIO
+     * handler. When this is null, received data is stored in
+     * mInputBuffer.
+     */
+    std::atomic<SerialPortReceiveHandler*> mReceiveHandler ;
+
+    /*
+     * Set while the receive handler is being called so that
+     * SetReceiveHandler() can wait for a call running on another
+     * thread to complete before the old handler goes away.
+     */
+    std::atomic<bool> mIsInReceiveHandler ;
+
+    /*
+     * Optional fixed size ring buffer that replaces mInputBuffer. The
+     * SIGIO handler is its only producer and reads from the serial
+     * port directly into it, so no lock is needed.
+     */
+    LibSerial::MirroredRingBuffer* mReceiveRing ;
+
+    /*
+     * Optional transform chains for received and transmitted data.
+     * Transmitted data is transformed in mTransmitBuffer, which is sized
+     * for a chunk when the chain is attached and which mTransmitMutex
+     * protects.
+     */
+    LibSerial::TransformChain* mReceiveTransform ;
+    LibSerial::TransformChain* mTransmitTransform ;
+    std::vector<unsigned char> mTransmitBuffer ;
+    pthread_mutex_t            mTransmitMutex ;
+
+    /**
+     * Apply the receive transform chain, if any, to data just read from
+     * the serial port.
+     * @return Returns the size of the transformed data.
+     */
+    unsigned int
+    ApplyReceiveTransform( unsigned char*     dataBuffer,
+                           const unsigned int bufferSize ) ;
+
+    /**
+     * Write the complete buffer to the serial port.
+     */
+    void
+    WriteToFileDescriptor( const unsigned char* dataBuffer,
+                           const unsigned int   bufferSize )
+        throw( std::runtime_error ) ;
+
+    /**
+     * Read the specified number of bytes from the serial port directly
+     * into the receive ring. Bytes that do not fit are discarded.
+     * @return Returns the number of bytes read from the serial port.
+     */
+    unsigned int
+    ReadIntoReceiveRing( int numOfBytes ) ;
+
+    /**
+     * Read all data waiting at the serial port and store it, on behalf
+     * of the SIGIO handler or ProcessReceivedData().
+     * @return Returns the number of bytes read from the serial port.
+     */
+    unsigned int
+    ReceiveAvailableData() ;
+
+    /**
+     * Read up to the specified number of bytes from the serial port and
+     * store them.
+     * @return Returns the number of bytes read from the serial port.
+     */
+    unsigned int
+    ReceiveData( int numOfBytes ) ;
+
+    /**
+     * Get the number of received bytes that have not been read yet.
+     */
+    unsigned int
+    GetNumOfBufferedBytes() ;
+
+    /**
+     * Pass a chunk of data read from the serial port to the receive
+     * handler, or store it in the input buffer if there is none.
+     */
+    void
+    StoreReceivedData( const unsigned char* dataBuffer,
+                       const unsigned int   bufferSize ) ;
+
     /**
      * Set the specified modem control line to the specified value. 
      *
@@ -411,6 +646,51 @@ SerialPort::GetBaudRate() const
     return mSerialPortImpl->GetBaudRate() ;
 }
 
+unsigned int
+SerialPort::GetBitsPerSecond( const BaudRate baudRate )
+{
+    switch( baudRate )
+    {
+    case BAUD_50:      return 50 ;
+    case BAUD_75:      return 75 ;
+    case BAUD_110:     return 110 ;
+    case BAUD_134:     return 134 ;
+    case BAUD_150:     return 150 ;
+    case BAUD_200:     return 200 ;
+    case BAUD_300:     return 300 ;
+    case BAUD_600:     return 600 ;
+    case BAUD_1200:    return 1200 ;
+    case BAUD_1800:    return 1800 ;
+    case BAUD_2400:    return 2400 ;
+    case BAUD_4800:    return 4800 ;
+    case BAUD_9600:    return 9600 ;
+    case BAUD_19200:   return 19200 ;
+    case BAUD_38400:   return 38400 ;
+    case BAUD_57600:   return 57600 ;
+    case BAUD_115200:  return 115200 ;
+    case BAUD_230400:  return 230400 ;
+#ifdef __linux__
+    case BAUD_460800:  return 460800 ;
+    case BAUD_500000:  return 500000 ;
+    case BAUD_576000:  return 576000 ;
+    case BAUD_921600:  return 921600 ;
+    case BAUD_1000000: return 1000000 ;
+    case BAUD_1152000: return 1152000 ;
+    case BAUD_1500000: return 1500000 ;
+    case BAUD_2000000: return 2000000 ;
+#if __MAX_BAUD > B2000000
+    case BAUD_2500000: return 2500000 ;
+    case BAUD_3000000: return 3000000 ;
+    case BAUD_3500000: return 3500000 ;
+    case BAUD_4000000: return 4000000 ;
+#endif
+#endif /* __linux__ */
+    default:
+        break ;
+    }
+    return 0 ;
+}
+
 void
 SerialPort::SetCharSize( const CharacterSize charSize )
     throw( NotOpen,
@@ -576,6 +856,17 @@ SerialPort::Write(const std::string& dataString)
     return ;
 }
 
+void
+SerialPort::Write( const unsigned char* dataBuffer,
+                   const unsigned int   bufferSize )
+    throw( NotOpen,
+           std::runtime_error )
+{
+    mSerialPortImpl->Write( dataBuffer,
+                            bufferSize ) ;
+    return ;
+}
+
 void
 SerialPort::WriteByte( const unsigned char dataByte )
     throw( SerialPort::NotOpen,
@@ -585,23 +876,177 @@ SerialPort::WriteByte( const unsigned char dataByte )
     return ;
 }
 
+void
+SerialPort::SetReceiveHandler( SerialPortReceiveHandler* receiveHandler )
+{
+    mSerialPortImpl->SetReceiveHandler( receiveHandler ) ;
+    return ;
+}
+
+void
+SerialPort::SetReceiveBufferCapacity( const unsigned int capacity,
+                                      const bool         allowMirroring )
+    throw( AlreadyOpen,
+           std::invalid_argument,
+           std::bad_alloc )
+{
+    mSerialPortImpl->SetReceiveBufferCapacity( capacity,
+                                               allowMirroring ) ;
+    return ;
+}
+
+bool
+SerialPort::IsReceiveBufferMirrored() const
+{
+    return mSerialPortImpl->IsReceiveBufferMirrored() ;
+}
+
+const unsigned char*
+SerialPort::GetReceivedData( unsigned int& size ) const
+    throw( NotOpen,
+           std::logic_error )
+{
+    return mSerialPortImpl->GetReceivedData( size ) ;
+}
+
+void
+SerialPort::ConsumeReceivedData( const unsigned int numOfBytes )
+    throw( NotOpen,
+           std::logic_error,
+           std::out_of_range )
+{
+    mSerialPortImpl->ConsumeReceivedData( numOfBytes ) ;
+    return ;
+}
+
+SerialPortReceiveHandler*
+SerialPort::GetReceiveHandler() const
+{
+    return mSerialPortImpl->GetReceiveHandler() ;
+}
+
+void
+SerialPort::SetReceiveTransform( LibSerial::TransformChain* transformChain )
+    throw( AlreadyOpen,
+           std::invalid_argument,
+           std::logic_error )
+{
+    mSerialPortImpl->SetReceiveTransform( transformChain ) ;
+    return ;
+}
+
+void
+SerialPort::SetTransmitTransform( LibSerial::TransformChain* transformChain )
+    throw( AlreadyOpen,
+           std::bad_alloc,
+           std::logic_error )
+{
+    mSerialPortImpl->SetTransmitTransform( transformChain ) ;
+    return ;
+}
+
+LibSerial::TransformChain*
+SerialPort::GetReceiveTransform() const
+{
+    return mSerialPortImpl->GetReceiveTransform() ;
+}
+
+LibSerial::TransformChain*
+SerialPort::GetTransmitTransform() const
+{
+    return mSerialPortImpl->GetTransmitTransform() ;
+}
+
+void
+SerialPort::SetSignalDriven( const bool isSignalDriven )
+    throw( AlreadyOpen )
+{
+    mSerialPortImpl->SetSignalDriven( isSignalDriven ) ;
+    return ;
+}
+
+bool
+SerialPort::IsSignalDriven() const
+{
+    return mSerialPortImpl->IsSignalDriven() ;
+}
+
+int
+SerialPort::GetFileDescriptor() const
+    throw( NotOpen )
+{
+    return mSerialPortImpl->GetFileDescriptor() ;
+}
+
+unsigned int
+SerialPort::ProcessReceivedData()
+    throw( NotOpen,
+           std::logic_error )
+{
+    return mSerialPortImpl->ProcessReceivedData() ;
+}
+
+void
+SerialPort::SetServiceClass( const unsigned int serviceClass,
+                             const unsigned int receiveBudget )
+    throw( AlreadyOpen )
+{
+    mSerialPortImpl->SetServiceClass( serviceClass,
+                                      receiveBudget ) ;
+    return ;
+}
+
+unsigned int
+SerialPort::GetServiceClass() const
+{
+    return mSerialPortImpl->GetServiceClass() ;
+}
+
+unsigned int
+SerialPort::GetReceiveBudget() const
+{
+    return mSerialPortImpl->GetReceiveBudget() ;
+}
+
+bool
+SerialPort::GetLineErrorCounters( LineErrorCounters& counters ) const
+    throw( NotOpen )
+{
+    return mSerialPortImpl->GetLineErrorCounters( counters ) ;
+}
+
 /* ------------------------------------------------------------ */
 inline
 SerialPort::SerialPortImpl::SerialPortImpl( const std::string& serialPortName ) :
     mSerialPortName(serialPortName),
     mIsOpen(false),
     mFileDescriptor(-1),
+    mIsSignalDriven(true),
+    mServiceClass(0),
+    mReceiveBudget(0),
+    mNumOfBytesPending(0),
     mOldPortSettings(),
     mInputBuffer(),
     mShadowInputBuffer(), 
     mQueueMutex(),
-    mIsQueueDataAvailable(false)
+    mIsQueueDataAvailable(false),
+    mReceiveHandler(0),
+    mIsInReceiveHandler(false),
+    mReceiveRing(0),
+    mReceiveTransform(0),
+    mTransmitTransform(0),
+    mTransmitBuffer(),
+    mTransmitMutex()
 {
 	//Initializing the mutex
 	if (pthread_mutex_init(&mQueueMutex, NULL) != 0)
     {
 		std::cerr << "SerialPort.cpp: Could not initialize mutex!" << std::endl;
 	}
+    if ( pthread_mutex_init( &mTransmitMutex, NULL ) != 0 )
+    {
+        std::cerr << "SerialPort.cpp: Could not initialize mutex!" << std::endl ;
+    }
 }
 
 inline
@@ -614,6 +1059,16 @@ SerialPort::SerialPortImpl::~SerialPortImpl()
     {
         this->Close() ;
     }
+    delete mReceiveRing ;
+    if ( 0 != mReceiveTransform )
+    {
+        mReceiveTransform->Detach() ;
+    }
+    if ( 0 != mTransmitTransform )
+    {
+        mTransmitTransform->Detach() ;
+    }
+    pthread_mutex_destroy( &mTransmitMutex ) ;
     return ;
 }
 
@@ -648,29 +1103,41 @@ SerialPort::SerialPortImpl::Open()
     }
 
 
-    PosixSignalDispatcher& signal_dispatcher = PosixSignalDispatcher::Instance() ;
-    signal_dispatcher.AttachHandler( SIGIO,
-                                     *this ) ;
-
-    /*
-     * Direct all SIGIO and SIGURG signals for the port to the current
-     * process.
-     */
-    if ( fcntl( mFileDescriptor,
-                F_SETOWN,
-                getpid() ) < 0 )
+    //
+    // Ports that are not signal driven stay in non-blocking mode and
+    // are read by an event loop of the application instead.
+    //
+    if ( mIsSignalDriven )
     {
-        throw SerialPort::OpenFailed( strerror(errno) ) ;
-    }
+        PosixSignalDispatcher& signal_dispatcher = PosixSignalDispatcher::Instance() ;
+        signal_dispatcher.AttachHandler( SIGIO,
+                                         *this,
+                                         mServiceClass,
+                                         mReceiveBudget ) ;
 
-    /*
-     * Enable asynchronous I/O with the serial port.
-     */
-    if ( fcntl( mFileDescriptor,
-                F_SETFL,
-                FASYNC ) < 0 )
-    {
-        throw SerialPort::OpenFailed( strerror(errno) ) ;
+        /*
+         * Direct all SIGIO and SIGURG signals for the port to the current
+         * process.
+         */
+        if ( fcntl( mFileDescriptor,
+                    F_SETOWN,
+                    getpid() ) < 0 )
+        {
+            throw SerialPort::OpenFailed( strerror(errno) ) ;
+        }
+
+        /*
+         * Enable asynchronous I/O with the serial port. The port stays
+         * non-blocking, so that a receive handler waiting for room in the
+         * output queue can give up instead of blocking in the kernel. Reads
+         * never ask for more than FIONREAD reports.
+         */
+        if ( fcntl( mFileDescriptor,
+                    F_SETFL,
+                    FASYNC | O_NONBLOCK ) < 0 )
+        {
+            throw SerialPort::OpenFailed( strerror(errno) ) ;
+        }
     }
 
     /*
@@ -706,6 +1173,15 @@ SerialPort::SerialPortImpl::Open()
     //
     port_settings.c_cc[ VMIN  ] = 0 ;
     port_settings.c_cc[ VTIME ] = 0 ;
+    //
+    // A port that is not signal driven is in non-blocking mode anyway.
+    // With VMIN at one, a read finding no data fails with EAGAIN instead
+    // of returning zero, which event loops take as end of file.
+    //
+    if ( ! mIsSignalDriven )
+    {
+        port_settings.c_cc[ VMIN ] = 1 ;
+    }
     /*
      * Flush the input buffer associated with the port.
      */
@@ -732,6 +1208,25 @@ SerialPort::SerialPortImpl::Open()
     //Reset flag
     mIsQueueDataAvailable = false;
 
+    //
+    // Discard any data left in the receive ring from a previous session.
+    //
+    if ( 0 != mReceiveRing )
+    {
+        mReceiveRing->Consume( mReceiveRing->GetSize() ) ;
+    }
+    //
+    // Transformed streams start afresh as well.
+    //
+    if ( 0 != mReceiveTransform )
+    {
+        mReceiveTransform->ResetTransforms() ;
+    }
+    if ( 0 != mTransmitTransform )
+    {
+        mTransmitTransform->ResetTransforms() ;
+    }
+
     return ;
 }
 
@@ -748,9 +1243,12 @@ SerialPort::SerialPortImpl::Close()
         throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
     }
     //
-    PosixSignalDispatcher& signal_dispatcher = PosixSignalDispatcher::Instance() ;
-    signal_dispatcher.DetachHandler( SIGIO,
-                                     *this ) ;
+    if ( mIsSignalDriven )
+    {
+        PosixSignalDispatcher& signal_dispatcher = PosixSignalDispatcher::Instance() ;
+        signal_dispatcher.DetachHandler( SIGIO,
+                                         *this ) ;
+    }
     //
     // Restore the old settings of the port.
     //
@@ -792,6 +1290,10 @@ SerialPort::SerialPortImpl::IsDataAvailable() const
     //
     // Check if any data is available in the input buffer.
     //
+    if ( 0 != mReceiveRing )
+    {
+        return ( mReceiveRing->GetSize() > 0 ) ;
+    }
     //return ( mInputBuffer.size() > 0 ? true : false ) ;
     //Here comes an (almost) thread safe alternative
     return mIsQueueDataAvailable;
@@ -1267,30 +1769,334 @@ SerialPort::SerialPortImpl::GetDsr() const
 
 inline
 void
-SerialPort::SerialPortImpl::SetModemControlLine( const int  modemLine,
-                                                 const bool lineState )
-    throw( SerialPort::NotOpen,
-           std::runtime_error )
+SerialPort::SerialPortImpl::SetReceiveHandler( SerialPortReceiveHandler* receiveHandler )
 {
+    mReceiveHandler.store( receiveHandler ) ;
     //
-    // Make sure that the serial port is open.
+    // Wait for any call to the previous handler from a SIGIO handler
+    // running on another thread. This must therefore never be called
+    // from the receive handler itself.
     //
-    if ( ! this->IsOpen() )
+    while( mIsInReceiveHandler.load() )
     {
-        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+        /* spin */
     }
+    return ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetReceiveBufferCapacity( const unsigned int capacity,
+                                                      const bool         allowMirroring )
+    throw( SerialPort::AlreadyOpen,
+           std::invalid_argument,
+           std::bad_alloc )
+{
     //
-    // :TODO: Check to make sure that modemLine is a valid value.
-    // 
-    // Set or unset the specified bit according to the value of
-    // lineState.
+    // The SIGIO handler may use the ring at any time while the port is
+    // open, so it can only be replaced while the port is closed.
     //
-    int ioctl_result = -1 ;
-    if ( true == lineState )
+    if ( this->IsOpen() )
     {
-        int set_line_mask = modemLine ;
-        ioctl_result = ioctl( mFileDescriptor, 
-                              TIOCMBIS,
+        throw SerialPort::AlreadyOpen( ERR_MSG_PORT_ALREADY_OPEN ) ;
+    }
+    LibSerial::MirroredRingBuffer* receive_ring = 0 ;
+    if ( capacity > 0 )
+    {
+        receive_ring = new LibSerial::MirroredRingBuffer( capacity,
+                                                          allowMirroring ) ;
+    }
+    delete mReceiveRing ;
+    mReceiveRing = receive_ring ;
+    return ;
+}
+
+inline
+bool
+SerialPort::SerialPortImpl::IsReceiveBufferMirrored() const
+{
+    return ( ( 0 != mReceiveRing ) &&
+             mReceiveRing->IsMirrored() ) ;
+}
+
+inline
+const unsigned char*
+SerialPort::SerialPortImpl::GetReceivedData( unsigned int& size ) const
+    throw( SerialPort::NotOpen,
+           std::logic_error )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    if ( 0 == mReceiveRing )
+    {
+        throw std::logic_error( ERR_MSG_NO_RECEIVE_RING ) ;
+    }
+    return mReceiveRing->GetReadSpan( size ) ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::ConsumeReceivedData( const unsigned int numOfBytes )
+    throw( SerialPort::NotOpen,
+           std::logic_error,
+           std::out_of_range )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    if ( 0 == mReceiveRing )
+    {
+        throw std::logic_error( ERR_MSG_NO_RECEIVE_RING ) ;
+    }
+    mReceiveRing->Consume( numOfBytes ) ;
+    return ;
+}
+
+inline
+SerialPortReceiveHandler*
+SerialPort::SerialPortImpl::GetReceiveHandler() const
+{
+    return mReceiveHandler.load() ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetReceiveTransform( LibSerial::TransformChain* transformChain )
+    throw( SerialPort::AlreadyOpen,
+           std::invalid_argument,
+           std::logic_error )
+{
+    //
+    // The SIGIO handler may apply the chain at any time while the port
+    // is open. It transforms data in the buffer the data was read into,
+    // so the data must not grow.
+    //
+    if ( this->IsOpen() )
+    {
+        throw SerialPort::AlreadyOpen( ERR_MSG_PORT_ALREADY_OPEN ) ;
+    }
+    if ( transformChain == mReceiveTransform )
+    {
+        return ;
+    }
+    if ( ( 0 != transformChain ) &&
+         transformChain->IsExpanding() )
+    {
+        throw std::invalid_argument( ERR_MSG_EXPANDING_TRANSFORM ) ;
+    }
+    //
+    // The chain is frozen while it is attached, so it stays
+    // non-expanding.
+    //
+    if ( 0 != transformChain )
+    {
+        transformChain->Attach() ;
+    }
+    if ( 0 != mReceiveTransform )
+    {
+        mReceiveTransform->Detach() ;
+    }
+    mReceiveTransform = transformChain ;
+    return ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetTransmitTransform( LibSerial::TransformChain* transformChain )
+    throw( SerialPort::AlreadyOpen,
+           std::bad_alloc,
+           std::logic_error )
+{
+    if ( this->IsOpen() )
+    {
+        throw SerialPort::AlreadyOpen( ERR_MSG_PORT_ALREADY_OPEN ) ;
+    }
+    if ( transformChain == mTransmitTransform )
+    {
+        return ;
+    }
+    if ( 0 != transformChain )
+    {
+        //
+        // The chain is frozen while it is attached, so one chunk always
+        // fits the buffer.
+        //
+        const unsigned int capacity =
+            transformChain->GetMaxOutputSize( TRANSMIT_CHUNK_SIZE ) ;
+        if ( mTransmitBuffer.size() < capacity )
+        {
+            mTransmitBuffer.resize( capacity ) ;
+        }
+        transformChain->Attach() ;
+    }
+    if ( 0 != mTransmitTransform )
+    {
+        mTransmitTransform->Detach() ;
+    }
+    mTransmitTransform = transformChain ;
+    return ;
+}
+
+inline
+LibSerial::TransformChain*
+SerialPort::SerialPortImpl::GetReceiveTransform() const
+{
+    return mReceiveTransform ;
+}
+
+inline
+LibSerial::TransformChain*
+SerialPort::SerialPortImpl::GetTransmitTransform() const
+{
+    return mTransmitTransform ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetSignalDriven( const bool isSignalDriven )
+    throw( SerialPort::AlreadyOpen )
+{
+    if ( this->IsOpen() )
+    {
+        throw SerialPort::AlreadyOpen( ERR_MSG_PORT_ALREADY_OPEN ) ;
+    }
+    mIsSignalDriven = isSignalDriven ;
+    return ;
+}
+
+inline
+bool
+SerialPort::SerialPortImpl::IsSignalDriven() const
+{
+    return mIsSignalDriven ;
+}
+
+inline
+int
+SerialPort::SerialPortImpl::GetFileDescriptor() const
+    throw( SerialPort::NotOpen )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    return mFileDescriptor ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::ProcessReceivedData()
+    throw( SerialPort::NotOpen,
+           std::logic_error )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    //
+    // The SIGIO handler would be a second reader of the port.
+    //
+    if ( mIsSignalDriven )
+    {
+        throw std::logic_error( ERR_MSG_SIGNAL_DRIVEN ) ;
+    }
+    return this->ReceiveAvailableData() ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetServiceClass( const unsigned int serviceClass,
+                                             const unsigned int receiveBudget )
+    throw( SerialPort::AlreadyOpen )
+{
+    //
+    // The port is attached to the signal dispatcher with its class and
+    // budget when it is opened.
+    //
+    if ( this->IsOpen() )
+    {
+        throw SerialPort::AlreadyOpen( ERR_MSG_PORT_ALREADY_OPEN ) ;
+    }
+    mServiceClass  = serviceClass ;
+    mReceiveBudget = receiveBudget ;
+    return ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::GetServiceClass() const
+{
+    return mServiceClass ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::GetReceiveBudget() const
+{
+    return mReceiveBudget ;
+}
+
+inline
+bool
+SerialPort::SerialPortImpl::GetLineErrorCounters( SerialPort::LineErrorCounters& counters ) const
+    throw( SerialPort::NotOpen )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+#if defined(__linux__) && defined(TIOCGICOUNT)
+    struct serial_icounter_struct interrupt_counts ;
+    memset( &interrupt_counts,
+            0,
+            sizeof( interrupt_counts ) ) ;
+    if ( ioctl( mFileDescriptor,
+                TIOCGICOUNT,
+                &interrupt_counts ) < 0 )
+    {
+        return false ;
+    }
+    counters.mNumOfOverruns       = interrupt_counts.overrun ;
+    counters.mNumOfBufferOverruns = interrupt_counts.buf_overrun ;
+    counters.mNumOfFramingErrors  = interrupt_counts.frame ;
+    counters.mNumOfParityErrors   = interrupt_counts.parity ;
+    counters.mNumOfBreaks         = interrupt_counts.brk ;
+    return true ;
+#else
+    ( void )counters ;
+    return false ;
+#endif
+}
+
+inline
+void
+SerialPort::SerialPortImpl::SetModemControlLine( const int  modemLine,
+                                                 const bool lineState )
+    throw( SerialPort::NotOpen,
+           std::runtime_error )
+{
+    //
+    // Make sure that the serial port is open.
+    //
+    if ( ! this->IsOpen() )
+    {
+        throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    //
+    // :TODO: Check to make sure that modemLine is a valid value.
+    // 
+    // Set or unset the specified bit according to the value of
+    // lineState.
+    //
+    int ioctl_result = -1 ;
+    if ( true == lineState )
+    {
+        int set_line_mask = modemLine ;
+        ioctl_result = ioctl( mFileDescriptor, 
+                              TIOCMBIS,
                               &set_line_mask ) ;
     }
     else
@@ -1346,9 +2152,7 @@ SerialPort::SerialPortImpl::ReadByte(const unsigned int msTimeout)
            SerialPort::ReadTimeout,
            std::runtime_error )
 {
-	pthread_mutex_lock(&mQueueMutex);
-	int queueSize = mInputBuffer.size();
-	pthread_mutex_unlock(&mQueueMutex);
+	unsigned int queueSize = this->GetNumOfBufferedBytes();
     //
     // Make sure that the serial port is open.
     //
@@ -1405,9 +2209,17 @@ SerialPort::SerialPortImpl::ReadByte(const unsigned int msTimeout)
         // Wait for 1ms (1000us) for data to arrive.
         //
         usleep( MICROSECONDS_PER_MS ) ;
-        pthread_mutex_lock(&mQueueMutex);
-		queueSize = mInputBuffer.size();
-		pthread_mutex_unlock(&mQueueMutex);
+        queueSize = this->GetNumOfBufferedBytes();
+    }
+    //
+    // Return the first byte and remove it from the ring.
+    //
+    if ( 0 != mReceiveRing )
+    {
+        unsigned char next_char = 0 ;
+        mReceiveRing->Read( &next_char,
+                            1 ) ;
+        return next_char ;
     }
     //
     // Return the first byte and remove it from the queue.
@@ -1588,27 +2400,142 @@ SerialPort::SerialPortImpl::Write( const unsigned char* dataBuffer,
     {
         throw SerialPort::NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
     }
-    //
-    // Write the data to the serial port. Keep retrying if EAGAIN
-    // error is received.
-    //
-    int num_of_bytes_written = -1 ;
-    do
+    if ( ( 0 == mTransmitTransform ) ||
+         ( 0 == bufferSize ) )
     {
-        num_of_bytes_written = write( mFileDescriptor,
-                                      dataBuffer,
-                                      bufferSize ) ;
+        this->WriteToFileDescriptor( dataBuffer,
+                                     bufferSize ) ;
+        return ;
     }
-    while ( ( num_of_bytes_written < 0 ) &&
-            ( EAGAIN == errno ) ) ;
     //
-    if ( num_of_bytes_written < 0 )
+    // Transform a copy of the data in the transmit buffer, one chunk at
+    // a time, so that nothing is allocated here. Receive handlers may
+    // call Write() from the SIGIO handler, so SIGIO is blocked while
+    // this thread holds mTransmitMutex: the handler can then never
+    // interrupt the thread holding the mutex and wait for it forever.
+    //
+    sigset_t sigio_set ;
+    sigset_t old_set ;
+    sigemptyset( &sigio_set ) ;
+    sigaddset( &sigio_set,
+               SIGIO ) ;
+    pthread_sigmask( SIG_BLOCK,
+                     &sigio_set,
+                     &old_set ) ;
+    pthread_mutex_lock( &mTransmitMutex ) ;
+    try
     {
-        throw std::runtime_error( strerror(errno) ) ;
+        unsigned int num_of_bytes_done = 0 ;
+        while ( num_of_bytes_done < bufferSize )
+        {
+            const unsigned int chunk_size =
+                std::min( bufferSize - num_of_bytes_done,
+                          TRANSMIT_CHUNK_SIZE ) ;
+            memcpy( &mTransmitBuffer[0],
+                    dataBuffer + num_of_bytes_done,
+                    chunk_size ) ;
+            const unsigned int num_of_bytes =
+                mTransmitTransform->ApplyTransforms( &mTransmitBuffer[0],
+                                                     chunk_size ) ;
+            this->WriteToFileDescriptor( &mTransmitBuffer[0],
+                                         num_of_bytes ) ;
+            num_of_bytes_done += chunk_size ;
+        }
     }
+    catch( ... )
+    {
+        pthread_mutex_unlock( &mTransmitMutex ) ;
+        pthread_sigmask( SIG_SETMASK,
+                         &old_set,
+                         0 ) ;
+        throw ;
+    }
+    pthread_mutex_unlock( &mTransmitMutex ) ;
+    pthread_sigmask( SIG_SETMASK,
+                     &old_set,
+                     0 ) ;
+    return ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::WriteToFileDescriptor( const unsigned char* dataBuffer,
+                                                   const unsigned int   bufferSize )
+    throw( std::runtime_error )
+{
     //
-    // :FIXME: What happens if num_of_bytes_written < bufferSize ?
-    //
+    // Write the data to the serial port. The file descriptor is non
+    // blocking, so a write may take only part of the data when the
+    // output queue of the driver fills up. Wait until there is room
+    // again and write the rest. In a receive handler, a slow line keeps
+    // draining the queue, which restarts the stall timeout, while a
+    // line that is not drained at all (CTS low, a pseudo terminal
+    // without a reader) makes the write fail.
+    //
+    const int poll_timeout = ( tNumOfActiveReceiveHandlers > 0 ) ?
+                             WRITE_POLL_INTERVAL_MILLISECONDS :
+                             -1 ;
+    unsigned int num_of_bytes_written = 0 ;
+    int ms_stalled = 0 ;
+    int last_queue_size = -1 ;
+    while ( num_of_bytes_written < bufferSize )
+    {
+        const ssize_t result = write( mFileDescriptor,
+                                      dataBuffer + num_of_bytes_written,
+                                      bufferSize - num_of_bytes_written ) ;
+        if ( result >= 0 )
+        {
+            num_of_bytes_written += result ;
+            continue ;
+        }
+        if ( EINTR == errno )
+        {
+            continue ;
+        }
+        if ( EAGAIN != errno )
+        {
+            throw std::runtime_error( strerror(errno) ) ;
+        }
+        struct pollfd poll_fd ;
+        poll_fd.fd      = mFileDescriptor ;
+        poll_fd.events  = POLLOUT ;
+        poll_fd.revents = 0 ;
+        const int poll_result = poll( &poll_fd,
+                                      1,
+                                      poll_timeout ) ;
+        if ( poll_result < 0 )
+        {
+            if ( EINTR == errno )
+            {
+                continue ;
+            }
+            throw std::runtime_error( strerror(errno) ) ;
+        }
+        if ( poll_result > 0 )
+        {
+            if ( 0 != ( poll_fd.revents & ( POLLERR | POLLHUP | POLLNVAL ) ) )
+            {
+                throw std::runtime_error( ERR_MSG_WRITE_FAILED ) ;
+            }
+            ms_stalled = 0 ;
+            continue ;
+        }
+        int queue_size = 0 ;
+        ioctl( mFileDescriptor,
+               TIOCOUTQ,
+               &queue_size ) ;
+        if ( queue_size != last_queue_size )
+        {
+            last_queue_size = queue_size ;
+            ms_stalled = 0 ;
+            continue ;
+        }
+        ms_stalled += WRITE_POLL_INTERVAL_MILLISECONDS ;
+        if ( ms_stalled >= WRITE_STALL_TIMEOUT_MILLISECONDS )
+        {
+            throw std::runtime_error( ERR_MSG_WRITE_STALLED ) ;
+        }
+    }
     return ;
 }
 
@@ -1623,6 +2550,57 @@ SerialPort::SerialPortImpl::HandlePosixSignal( int signalNumber )
     {
         return ;
     }
+    this->ReceiveAvailableData() ;
+    return ;
+}
+
+inline
+bool
+SerialPort::SerialPortImpl::ServicePosixSignal( int          signalNumber,
+                                                unsigned int byteBudget,
+                                                bool         isNewWakeup )
+{
+    if ( SIGIO != signalNumber )
+    {
+        return false ;
+    }
+    //
+    // Data arriving during the wakeup raises another SIGIO, so only the
+    // data waiting at its start is read here.
+    //
+    if ( isNewWakeup )
+    {
+        mNumOfBytesPending = 0 ;
+        if ( ioctl( mFileDescriptor,
+                    FIONREAD,
+                    &mNumOfBytesPending ) < 0 )
+        {
+            mNumOfBytesPending = 0 ;
+        }
+    }
+    int num_of_bytes = mNumOfBytesPending ;
+    if ( ( byteBudget > 0 ) &&
+         ( static_cast<unsigned int>( num_of_bytes ) > byteBudget ) )
+    {
+        num_of_bytes = byteBudget ;
+    }
+    const int num_of_bytes_read = this->ReceiveData( num_of_bytes ) ;
+    //
+    // Stop on a read error rather than trying again in the next turn.
+    //
+    if ( num_of_bytes_read < num_of_bytes )
+    {
+        mNumOfBytesPending = 0 ;
+        return false ;
+    }
+    mNumOfBytesPending -= num_of_bytes_read ;
+    return ( mNumOfBytesPending > 0 ) ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::ReceiveAvailableData()
+{
     //
     // Check if any data is available at the specified file
     // descriptor.
@@ -1635,6 +2613,93 @@ SerialPort::SerialPortImpl::HandlePosixSignal( int signalNumber )
         /*
          * Ignore any errors and return immediately.
          */
+        return 0 ;
+    }
+    return this->ReceiveData( num_of_bytes_available ) ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::ReceiveData( int numOfBytes )
+{
+    //
+    // Without a receive handler, data for the receive ring is read
+    // into the ring directly.
+    //
+    if ( ( 0 != mReceiveRing ) &&
+         ( 0 == mReceiveHandler.load() ) )
+    {
+        return this->ReadIntoReceiveRing( numOfBytes ) ;
+    }
+
+    //
+    // Read all available data in chunks of up to READ_CHUNK_SIZE bytes
+    // rather than one byte at a time.
+    //
+    unsigned int total_num_of_bytes_read = 0 ;
+    unsigned char read_buffer[ READ_CHUNK_SIZE ] ;
+    while( numOfBytes > 0 )
+    {
+        const ssize_t num_of_bytes_read =
+            read( mFileDescriptor,
+                  read_buffer,
+                  std::min( numOfBytes, READ_CHUNK_SIZE ) ) ;
+        if ( num_of_bytes_read <= 0 )
+        {
+            break ;
+        }
+        numOfBytes -= num_of_bytes_read ;
+        total_num_of_bytes_read += num_of_bytes_read ;
+        const unsigned int num_of_bytes =
+            this->ApplyReceiveTransform( read_buffer,
+                                         num_of_bytes_read ) ;
+        if ( num_of_bytes > 0 )
+        {
+            this->StoreReceivedData( read_buffer,
+                                     num_of_bytes ) ;
+        }
+    }
+    return total_num_of_bytes_read ;
+}
+
+inline
+void
+SerialPort::SerialPortImpl::StoreReceivedData( const unsigned char* dataBuffer,
+                                               const unsigned int   bufferSize )
+{
+    //
+    // If a receive handler is attached, it consumes the data directly.
+    //
+    mIsInReceiveHandler.store( true ) ;
+    SerialPortReceiveHandler* receive_handler = mReceiveHandler.load() ;
+    if ( 0 != receive_handler )
+    {
+        ++tNumOfActiveReceiveHandlers ;
+        try
+        {
+            receive_handler->HandleReceivedData( dataBuffer,
+                                                 bufferSize ) ;
+        }
+        catch( ... )
+        {
+            --tNumOfActiveReceiveHandlers ;
+            mIsInReceiveHandler.store( false ) ;
+            throw ;
+        }
+        --tNumOfActiveReceiveHandlers ;
+        mIsInReceiveHandler.store( false ) ;
+        return ;
+    }
+    mIsInReceiveHandler.store( false ) ;
+
+    //
+    // The ring has a single producer and needs no lock. Data that does
+    // not fit is discarded.
+    //
+    if ( 0 != mReceiveRing )
+    {
+        mReceiveRing->Write( dataBuffer,
+                             bufferSize ) ;
         return ;
     }
 
@@ -1651,25 +2716,9 @@ SerialPort::SerialPortImpl::HandlePosixSignal( int signalNumber )
     		mShadowInputBuffer.pop();
 		}
 
-		//
-		// If data is available, read all available data and shove
-		// it into the corresponding input buffer.
-		//
-		for(int i=0; i<num_of_bytes_available; ++i)
+		for(unsigned int i=0; i<bufferSize; ++i)
 		{
-			unsigned char next_byte ;
-			if ( read( mFileDescriptor,
-					   &next_byte,
-					   1 ) > 0 )
-			{
-				mInputBuffer.push( next_byte );
-			}
-			else
-			{
-				//Updating flag
-				pthread_mutex_unlock(&mQueueMutex);
-				break ;
-			}
+			mInputBuffer.push( dataBuffer[i] );
 		}
 
 		//Updating flag
@@ -1679,28 +2728,85 @@ SerialPort::SerialPortImpl::HandlePosixSignal( int signalNumber )
 		pthread_mutex_unlock(&mQueueMutex);
     } else {
     	//Mutex is locked - using shadowQueue to avoid a deadlock!
-    	//
-		// If data is available, read all available data and shove
-		// it temporarily into the shadow buffer.
-		//
-		for(int i=0; i<num_of_bytes_available; ++i)
+		for(unsigned int i=0; i<bufferSize; ++i)
 		{
-			unsigned char next_byte ;
-			if ( read( mFileDescriptor,
-					   &next_byte,
-					   1 ) > 0 )
-			{
-				mShadowInputBuffer.push( next_byte );
-			}
-			else
-			{
-				break ;
-			}
+			mShadowInputBuffer.push( dataBuffer[i] );
 		}
     }
     return ;
 }
 
+inline
+unsigned int
+SerialPort::SerialPortImpl::ReadIntoReceiveRing( int numOfBytes )
+{
+    unsigned int total_num_of_bytes_read = 0 ;
+    while( numOfBytes > 0 )
+    {
+        unsigned int span_size = 0 ;
+        unsigned char* span = mReceiveRing->GetWriteSpan( span_size ) ;
+        //
+        // If the ring is full, the data still has to be read from the
+        // serial port so that the next SIGIO reports new data only.
+        //
+        unsigned char discard_buffer[ READ_CHUNK_SIZE ] ;
+        const bool is_discarding = ( 0 == span_size ) ;
+        if ( is_discarding )
+        {
+            span = discard_buffer ;
+            span_size = READ_CHUNK_SIZE ;
+        }
+        const ssize_t num_of_bytes_read =
+            read( mFileDescriptor,
+                  span,
+                  std::min( static_cast<unsigned int>( numOfBytes ), span_size ) ) ;
+        if ( num_of_bytes_read <= 0 )
+        {
+            break ;
+        }
+        numOfBytes -= num_of_bytes_read ;
+        total_num_of_bytes_read += num_of_bytes_read ;
+        if ( ! is_discarding )
+        {
+            mReceiveRing->Commit( this->ApplyReceiveTransform( span,
+                                                               num_of_bytes_read ) ) ;
+        }
+    }
+    return total_num_of_bytes_read ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::ApplyReceiveTransform( unsigned char*     dataBuffer,
+                                                   const unsigned int bufferSize )
+{
+    if ( 0 == mReceiveTransform )
+    {
+        return bufferSize ;
+    }
+    //
+    // SetReceiveTransform() only accepts chains that do not make data
+    // longer and freezes them, so the data always fits the buffer it
+    // was read into and nothing can be thrown in the SIGIO handler.
+    //
+    return mReceiveTransform->ApplyTransforms( dataBuffer,
+                                               bufferSize ) ;
+}
+
+inline
+unsigned int
+SerialPort::SerialPortImpl::GetNumOfBufferedBytes()
+{
+    if ( 0 != mReceiveRing )
+    {
+        return mReceiveRing->GetSize() ;
+    }
+    pthread_mutex_lock(&mQueueMutex);
+    const unsigned int queue_size = mInputBuffer.size();
+    pthread_mutex_unlock(&mQueueMutex);
+    return queue_size ;
+}
+
 namespace
 {
     const struct timeval
@@ -22,10 +22,21 @@
 #ifndef _SerialPort_h_
 #define _SerialPort_h_
 
+#include <ExceptionSpecification.h>
+
+#include <new>
 #include <stdexcept>
+#include <string>
 #include <termios.h>
 #include <vector>
 
+class SerialPortReceiveHandler ;
+
+namespace LibSerial
+{
+    class TransformChain ;
+}
+
 //
 // @todo - This class will be placed in LibSerial namespace in the next 
 // version. 
@@ -172,6 +183,80 @@ public:
         ReadTimeout() : runtime_error( "Read timeout" ) { }
     } ;
 
+    /**
+     * @brief Line error counters maintained by the serial driver since it
+     *        was loaded. Only the differences between two readings are
+     *        meaningful.
+     */
+    struct LineErrorCounters
+    {
+        unsigned long mNumOfOverruns ;       //!< Characters lost because the UART was not read in time.
+        unsigned long mNumOfBufferOverruns ; //!< Characters lost because the tty buffer was full.
+        unsigned long mNumOfFramingErrors ;  //!< Characters received with a framing error.
+        unsigned long mNumOfParityErrors ;   //!< Characters received with a parity error.
+        unsigned long mNumOfBreaks ;         //!< Break conditions received.
+    } ;
+
+    /**
+     * @brief The parameters of a SelfTest() run. Every combination of
+     *        baud rate and payload size is tested.
+     */
+    struct SelfTestSettings
+    {
+        /**
+         * @brief Constructs the default settings: the current baud rate,
+         *        payloads of 1, 16, 64 and 256 bytes, 20 latency probes
+         *        per payload size, a probe timeout of 500ms and 200ms of
+         *        throughput measurement.
+         */
+        SelfTestSettings() ;
+
+        std::vector<BaudRate>     mBaudRates ;            //!< Rates to test, in order. Empty for the current rate.
+        std::vector<unsigned int> mPayloadSizes ;         //!< Payload sizes to test, in order.
+        unsigned int              mNumOfProbes ;          //!< Round trips timed per combination.
+        unsigned int              mMsProbeTimeout ;       //!< Time after which a probe is considered lost.
+        unsigned int              mMsThroughputDuration ; //!< Duration of the throughput measurement.
+    } ;
+
+    /**
+     * @brief The measurements of a SelfTest() run for one combination of
+     *        baud rate and payload size.
+     */
+    struct SelfTestResult
+    {
+        BaudRate      mBaudRate ;
+        unsigned int  mPayloadSize ;
+        unsigned int  mNumOfProbes ;             //!< Round trips attempted.
+        unsigned int  mNumOfLostProbes ;         //!< Round trips that timed out.
+        double        mMinLatencyMicroseconds ;  //!< Round-trip latency of the fastest probe.
+        double        mMedianLatencyMicroseconds ;
+        double        mP90LatencyMicroseconds ;
+        double        mP99LatencyMicroseconds ;
+        double        mMaxLatencyMicroseconds ;
+        double        mThroughput ;              //!< Bytes per second echoed while streaming.
+        double        mLineUtilisation ;         //!< Throughput relative to the nominal rate of 8N1 characters.
+        unsigned long mNumOfBytesSent ;
+        unsigned long mNumOfBytesReceived ;
+        unsigned long mNumOfCorruptBytes ;       //!< Received bytes that differ from those sent.
+        long          mNumOfOverruns ;           //!< Overruns reported by the driver, or -1 if not available.
+        bool          mIsErrorFree ;             //!< No lost probes, corrupt or missing bytes, or overruns.
+    } ;
+
+    /**
+     * @brief The results of a SelfTest() run and their summary.
+     */
+    struct SelfTestReport
+    {
+        std::vector<SelfTestResult> mResults ;                   //!< One result per combination, in test order.
+        bool                        mIsOverrunCountAvailable ;   //!< The driver supports TIOCGICOUNT.
+        double                      mMaxErrorFreeThroughput ;    //!< Highest throughput of an error-free result, in bytes per second.
+        BaudRate                    mMaxErrorFreeBaudRate ;      //!< Baud rate of that result.
+        unsigned int                mMaxErrorFreePayloadSize ;   //!< Payload size of that result.
+        bool                        mHasOverrunOnset ;           //!< Some result reported overruns.
+        BaudRate                    mOverrunOnsetBaudRate ;      //!< Baud rate of the first result with overruns.
+        unsigned int                mOverrunOnsetPayloadSize ;   //!< Payload size of the first result with overruns.
+    } ;
+
     /**
      * @brief Default Constructor for a serial port object.
      */
@@ -180,7 +265,7 @@ public:
     /**
      * @brief Default Destructor for a serial port object.
      */
-    virtual ~SerialPort() throw() ;
+    virtual ~SerialPort() LIBSERIAL_THROW() ;
 
     /**
      * @brief Opens the serial port with the specified settings.
@@ -198,10 +283,10 @@ public:
           const Parity        parityType  = PARITY_DEFAULT,
           const StopBits      stopBits    = STOP_BITS_DEFAULT,
           const FlowControl   flowControl = FLOW_CONTROL_DEFAULT )
-        throw( AlreadyOpen,
-               OpenFailed,
-               UnsupportedBaudRate,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( AlreadyOpen,
+                         OpenFailed,
+                         UnsupportedBaudRate,
+                         std::invalid_argument ) ;
 
     /**
      * @brief Closes the serial port. All settings of the serial port will be
@@ -211,7 +296,7 @@ public:
      */
     void
     Close()
-        throw(NotOpen) ;
+        LIBSERIAL_THROW(NotOpen) ;
 
     /**
      * @brief Determines if the serial port is open for I/O.
@@ -228,7 +313,7 @@ public:
      */
     bool
     IsDataAvailable() const
-        throw(NotOpen) ;
+        LIBSERIAL_THROW(NotOpen) ;
 
     /**
      * @brief Sets the baud rate for the serial port to the specified value
@@ -242,9 +327,9 @@ public:
      */
     void
     SetBaudRate( const BaudRate baudRate )
-        throw( UnsupportedBaudRate,
-               NotOpen,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( UnsupportedBaudRate,
+                         NotOpen,
+                         std::invalid_argument ) ;
 
     /**
      * @brief Gets the current baud rate for the serial port.
@@ -255,8 +340,18 @@ public:
      */
     BaudRate
     GetBaudRate() const
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
+
+    /**
+     * @brief Gets the number of bits per second corresponding to the
+     *        specified baud rate.
+     * @return Returns the number of bits per second, or 0 if the baud
+     *         rate is not known.
+     */
+    static
+    unsigned int
+    GetBitsPerSecond( const BaudRate baudRate ) ;
 
     /**
      * @brief Sets the character size for the serial port.
@@ -269,8 +364,8 @@ public:
      */
     void
     SetCharSize( const CharacterSize charSize )
-        throw( NotOpen,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::invalid_argument ) ;
     /**
      * @brief Gets the current character size for the serial port.
      * @throw NotOpen This exception is thrown if this method is called while
@@ -278,7 +373,7 @@ public:
      */
     CharacterSize
     GetCharSize() const
-        throw(NotOpen) ;
+        LIBSERIAL_THROW(NotOpen) ;
 
     /**
      * @brief Sets the parity type for the serial port.
@@ -289,8 +384,8 @@ public:
      */
     void
     SetParity( const Parity parityType )
-        throw( NotOpen,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::invalid_argument ) ;
 
     /**
      * @brief Gets the parity type for the serial port.
@@ -299,7 +394,7 @@ public:
      */
     Parity
     GetParity() const
-        throw(NotOpen) ;
+        LIBSERIAL_THROW(NotOpen) ;
 
     /**
      * @brief Sets the number of stop bits to be used with the serial port.
@@ -311,8 +406,8 @@ public:
      */
     void
     SetNumOfStopBits( const StopBits numOfStopBits )
-        throw( NotOpen,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::invalid_argument ) ;
 
     /**
      * @brief Gets the number of stop bits currently being used by the serial
@@ -322,7 +417,7 @@ public:
      */
     StopBits
     GetNumOfStopBits() const
-        throw(NotOpen) ;
+        LIBSERIAL_THROW(NotOpen) ;
 
      /**
      * @brief Sets flow control for the serial port.
@@ -333,8 +428,8 @@ public:
      */
     void
     SetFlowControl( const FlowControl   flowControl )
-        throw( NotOpen,
-               std::invalid_argument ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::invalid_argument ) ;
 
     /**
      * @brief Get the current flow control setting.
@@ -344,7 +439,7 @@ public:
      */
     FlowControl
     GetFlowControl() const
-        throw( NotOpen ) ;
+        LIBSERIAL_THROW( NotOpen ) ;
 
     /**
      * @brief Sets the DTR line to the specified value.
@@ -357,8 +452,8 @@ public:
      */
     void
     SetDtr( const bool dtrState = true )
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
      /**
      * @brief Gets the status of the DTR line.
@@ -369,8 +464,8 @@ public:
      */
     bool
     GetDtr() const
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
     /**
      * @brief Sets the RTS (ready-to-send) line to the specified value.
@@ -383,8 +478,8 @@ public:
      */
     void
     SetRts( const bool rtsState = true )
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
     /**
      * @brief Gets the status of the RTS (ready-to-send) line.
@@ -395,8 +490,8 @@ public:
      */
     bool
     GetRts() const
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
         
     /**
      * @brief Gets the status of the CTS (clear-to-send) line.
@@ -407,8 +502,8 @@ public:
      */
     bool
     GetCts() const
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
     /**
      * @brief Gets the status of the DSR (data-set-ready) line.
@@ -419,8 +514,8 @@ public:
      */
     bool
     GetDsr() const
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
     
     /**
      * @brief A vector of character types to store data bytes read from the
@@ -451,9 +546,9 @@ public:
     Read( DataBuffer&        dataBuffer,
           const unsigned int numOfBytes = 0,
           const unsigned int msTimeout  = 0 )
-        throw( NotOpen,
-               ReadTimeout,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         ReadTimeout,
+                         std::runtime_error ) ;
 
     /**
      * @brief Reads a single byte from the serial port.
@@ -472,9 +567,9 @@ public:
      */
     unsigned char
     ReadByte( const unsigned int msTimeout = 0 )
-        throw( NotOpen,
-               ReadTimeout,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         ReadTimeout,
+                         std::runtime_error ) ;
 
     /**
      * @brief Reads a line of characters from the serial port.
@@ -500,9 +595,9 @@ public:
     const std::string
     ReadLine( const unsigned int msTimeout = 0,
               const char         lineTerminator = '\n' )
-        throw( NotOpen,
-               ReadTimeout,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         ReadTimeout,
+                         std::runtime_error ) ;
 
     /**
      * @brief Writes a DataBuffer vector to the serial port.
@@ -515,8 +610,8 @@ public:
      */
     void
     Write(const DataBuffer& dataBuffer)
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
     /**
      * @brief Writes a std::string to the serial port.
@@ -526,8 +621,30 @@ public:
      */
     void
     Write(const std::string& dataString)
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
+
+    /**
+     * @brief Writes the specified number of bytes from a raw memory
+     *        buffer to the serial port without copying them. When the
+     *        output queue of the driver is full, the method waits for
+     *        room. Called from a receive handler, it gives up if the
+     *        queue does not drain at all for two seconds, so that a
+     *        stalled line cannot stop the dispatch of received data.
+     * @param dataBuffer The bytes to be written to the serial port.
+     * @param bufferSize The number of bytes in dataBuffer.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @throw std::runtime_error This exception is thrown if any standard
+     *        runtime error is encountered, if the port reports an error
+     *        or hangup, or if the output of a receive handler stalls.
+     *        Part of the data may have been written in that case.
+     */
+    void
+    Write( const unsigned char* dataBuffer,
+           const unsigned int   bufferSize )
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
 
     /**
      * @brief Writes a single byte to the serial port.
@@ -539,8 +656,292 @@ public:
      */
     void
     WriteByte(const unsigned char dataByte)
-        throw( NotOpen,
-               std::runtime_error ) ;
+        LIBSERIAL_THROW( NotOpen,
+                         std::runtime_error ) ;
+
+    /**
+     * @brief Attaches a receive handler to the serial port. While a
+     *        handler is attached, all data read from the serial port is
+     *        passed to its HandleReceivedData() method directly from the
+     *        SIGIO handler instead of being placed in the input buffer.
+     *        Pass a null pointer to detach the current handler. The
+     *        handler must stay alive while it is attached. This method
+     *        waits for a call to the previous handler that is in progress
+     *        on another thread, so it must not be called from the
+     *        HandleReceivedData() method of a receive handler.
+     * @param receiveHandler The handler to attach, or 0 to detach.
+     */
+    void
+    SetReceiveHandler( SerialPortReceiveHandler* receiveHandler ) ;
+
+    /**
+     * @brief Replaces the default input buffer with a fixed size ring
+     *        buffer of at least the specified capacity. Where possible
+     *        the ring is mapped twice in virtual memory, so that all
+     *        received data is available as a single contiguous span
+     *        through GetReceivedData(), even across the wrap-around
+     *        (see LibSerial::MirroredRingBuffer). The SIGIO handler then
+     *        reads from the serial port directly into the ring, without
+     *        taking any lock. Data that arrives while the ring is full
+     *        is discarded. ReadByte(), Read() and ReadLine() take their
+     *        data from the ring as well.
+     * @param capacity The minimum capacity in bytes, or 0 to restore the
+     *        default input buffer.
+     * @param allowMirroring Set to false to always use an ordinary ring,
+     *        whose data may be split into two spans at the wrap-around.
+     * @throw AlreadyOpen This exception is thrown if this method is called
+     *        while the serial port is open.
+     * @throw std::invalid_argument This exception is thrown if capacity
+     *        is too large.
+     * @throw std::bad_alloc This exception is thrown if the ring cannot
+     *        be allocated.
+     */
+    void
+    SetReceiveBufferCapacity( const unsigned int capacity,
+                              const bool         allowMirroring = true )
+        LIBSERIAL_THROW( AlreadyOpen,
+                         std::invalid_argument,
+                         std::bad_alloc ) ;
+
+    /**
+     * @brief Determines if a ring buffer set with
+     *        SetReceiveBufferCapacity() is mirrored, so that
+     *        GetReceivedData() always returns all received data.
+     */
+    bool
+    IsReceiveBufferMirrored() const ;
+
+    /**
+     * @brief Gets the received data that has not been consumed yet
+     *        directly from the ring buffer, without copying it. The data
+     *        stays valid until it is consumed with ConsumeReceivedData().
+     *        If the ring is mirrored, this is all received data,
+     *        otherwise the span ends at the end of the ring and the rest
+     *        follows once the span has been consumed.
+     * @param size Receives the number of bytes available at the returned
+     *        address.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @throw std::logic_error This exception is thrown if no ring buffer
+     *        was set with SetReceiveBufferCapacity().
+     * @return Returns a pointer to the oldest received byte.
+     */
+    const unsigned char*
+    GetReceivedData( unsigned int& size ) const
+        LIBSERIAL_THROW( NotOpen,
+                         std::logic_error ) ;
+
+    /**
+     * @brief Discards the specified number of bytes from the front of the
+     *        data returned by GetReceivedData().
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @throw std::logic_error This exception is thrown if no ring buffer
+     *        was set with SetReceiveBufferCapacity().
+     * @throw std::out_of_range This exception is thrown if fewer than
+     *        numOfBytes bytes have been received.
+     */
+    void
+    ConsumeReceivedData( const unsigned int numOfBytes )
+        LIBSERIAL_THROW( NotOpen,
+                         std::logic_error,
+                         std::out_of_range ) ;
+
+    /**
+     * @brief Gets the receive handler attached with SetReceiveHandler(),
+     *        or 0 if there is none.
+     */
+    SerialPortReceiveHandler*
+    GetReceiveHandler() const ;
+
+    /**
+     * @brief Attaches a transform chain that the SIGIO handler applies to
+     *        all data read from the serial port, in the buffer the data
+     *        was read into, before it reaches the receive handler or
+     *        input buffer. Pass a null pointer to detach the current
+     *        chain. The chain must stay alive while it is attached, and
+     *        it cannot be changed until it is detached (see
+     *        TransformChain::IsAttached()).
+     * @throw AlreadyOpen This exception is thrown if this method is called
+     *        while the serial port is open.
+     * @throw std::invalid_argument This exception is thrown if the chain
+     *        may make data longer.
+     * @throw std::logic_error This exception is thrown if the chain is
+     *        attached elsewhere, as the transmit transform of this or
+     *        the receive or transmit transform of another port.
+     */
+    void
+    SetReceiveTransform( LibSerial::TransformChain* transformChain )
+        LIBSERIAL_THROW( AlreadyOpen,
+                         std::invalid_argument,
+                         std::logic_error ) ;
+
+    /**
+     * @brief Attaches a transform chain that is applied to all data
+     *        before it is written to the serial port. The data is copied
+     *        into a transmit buffer owned by the port and transformed
+     *        there, so the caller's buffer is left unchanged. Pass a null
+     *        pointer to detach the current chain. The chain must stay
+     *        alive while it is attached, and it cannot be changed until
+     *        it is detached (see TransformChain::IsAttached()). The
+     *        transmit buffer is allocated here, so Write() may also be
+     *        called from a receive handler while a chain is attached.
+     * @throw AlreadyOpen This exception is thrown if this method is called
+     *        while the serial port is open.
+     * @throw std::bad_alloc This exception is thrown if the transmit
+     *        buffer cannot be allocated.
+     * @throw std::logic_error This exception is thrown if the chain is
+     *        attached elsewhere, as the receive transform of this or
+     *        the receive or transmit transform of another port.
+     */
+    void
+    SetTransmitTransform( LibSerial::TransformChain* transformChain )
+        LIBSERIAL_THROW( AlreadyOpen,
+                         std::bad_alloc,
+                         std::logic_error ) ;
+
+    /**
+     * @brief Gets the chain attached with SetReceiveTransform(), or 0 if
+     *        there is none.
+     */
+    LibSerial::TransformChain*
+    GetReceiveTransform() const ;
+
+    /**
+     * @brief Gets the chain attached with SetTransmitTransform(), or 0
+     *        if there is none.
+     */
+    LibSerial::TransformChain*
+    GetTransmitTransform() const ;
+
+    /**
+     * @brief Selects whether received data is read by the SIGIO handler,
+     *        which is the default, or by an event loop of the
+     *        application such as an Asio io_context (see
+     *        LibSerial::AsioSerialPort). A port that is not signal driven
+     *        does not use SIGIO at all and keeps its file descriptor in
+     *        non-blocking mode. The event loop then either reads from
+     *        the file descriptor itself or calls ProcessReceivedData()
+     *        whenever it becomes readable. All configuration methods work
+     *        as usual.
+     * @throw AlreadyOpen This exception is thrown if this method is called
+     *        while the serial port is open.
+     */
+    void
+    SetSignalDriven( const bool isSignalDriven )
+        LIBSERIAL_THROW( AlreadyOpen ) ;
+
+    /**
+     * @brief Determines if received data is read by the SIGIO handler.
+     */
+    bool
+    IsSignalDriven() const ;
+
+    /**
+     * @brief Gets the file descriptor of the open serial port, for
+     *        registering ports that are not signal driven with an event
+     *        loop. The descriptor must not be closed.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     */
+    int
+    GetFileDescriptor() const
+        LIBSERIAL_THROW( NotOpen ) ;
+
+    /**
+     * @brief Reads all data waiting at a serial port that is not signal
+     *        driven and passes it through the receive transform to the
+     *        receive handler or input buffer, exactly as the SIGIO handler
+     *        does for signal driven ports. Receive handlers are called on
+     *        the calling thread.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @throw std::logic_error This exception is thrown if the port is
+     *        signal driven.
+     * @return Returns the number of bytes read from the serial port.
+     */
+    unsigned int
+    ProcessReceivedData()
+        LIBSERIAL_THROW( NotOpen,
+                         std::logic_error ) ;
+
+    /**
+     * @brief Sets the service class and receive budget of the port.
+     *        When SIGIO reports new data on several ports, ports in a
+     *        higher service class are serviced first. A port in a lower
+     *        class reads at most receiveBudget bytes at a time, after
+     *        which all higher classes are checked again for new data, so
+     *        a latency-critical port waits for at most one budget of
+     *        each busy port in a lower class. Ports in the same class take
+     *        turns of at most receiveBudget bytes each. The default is
+     *        class 0 with no budget, which reads all waiting data at once.
+     * @param serviceClass The service class. Higher classes are serviced
+     *        first.
+     * @param receiveBudget The maximum number of bytes read per turn, or
+     *        0 for no limit.
+     * @throw AlreadyOpen This exception is thrown if this method is called
+     *        while the serial port is open.
+     */
+    void
+    SetServiceClass( const unsigned int serviceClass,
+                     const unsigned int receiveBudget = 0 )
+        LIBSERIAL_THROW( AlreadyOpen ) ;
+
+    /**
+     * @brief Gets the service class set with SetServiceClass().
+     */
+    unsigned int
+    GetServiceClass() const ;
+
+    /**
+     * @brief Gets the receive budget set with SetServiceClass().
+     */
+    unsigned int
+    GetReceiveBudget() const ;
+
+    /**
+     * @brief Reads the line error counters of the serial driver.
+     * @param counters Receives the counters.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @return Returns false if the driver does not maintain the counters,
+     *         as is the case for pseudo terminals and most USB adapters.
+     */
+    bool
+    GetLineErrorCounters( LineErrorCounters& counters ) const
+        LIBSERIAL_THROW( NotOpen ) ;
+
+    /**
+     * @brief Measures what the port, cable and remote end actually
+     *        deliver. Every byte sent must come back unchanged, either
+     *        through a loopback plug or from a peer that echoes all data.
+     *        For each combination of baud rate and payload size in
+     *        settings, the round-trip latency of single payloads is timed,
+     *        then payloads are streamed for a while to measure the
+     *        throughput. Overruns reported by the driver during each
+     *        combination are counted.
+     *
+     *        While the test runs, received data goes to an internal
+     *        receive handler. The previous receive handler and baud rate
+     *        are restored when the test ends. The port must not be used
+     *        by other threads during the test.
+     * @param settings The combinations to test and their parameters.
+     * @throw NotOpen This exception is thrown if this method is called while
+     *        the serial port is not open.
+     * @throw UnsupportedBaudRate This exception is thrown if one of the baud
+     *        rates cannot be set.
+     * @throw std::invalid_argument This exception is thrown if settings
+     *        contains a payload size of zero or no payload size at all.
+     * @throw std::runtime_error This exception is thrown if any standard
+     *        runtime error is encountered.
+     * @return Returns the measurements and their summary.
+     */
+    SelfTestReport
+    SelfTest( const SelfTestSettings& settings = SelfTestSettings() )
+        LIBSERIAL_THROW( NotOpen,
+                         UnsupportedBaudRate,
+                         std::invalid_argument,
+                         std::runtime_error ) ;
 
 private:
     /**
@@ -0,0 +1,63 @@
+/******************************************************************************
+ *   @file SerialPortReceiveHandler.h                                         *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _SerialPortReceiveHandler_h_
+#define _SerialPortReceiveHandler_h_
+
+/**
+ * @brief Gets a method called with the data read from a serial port as soon
+ *        as it is ingested, before it is placed in the input buffer of the
+ *        port. A SerialPortReceiveHandler must be attached to a SerialPort
+ *        using SerialPort::SetReceiveHandler() for it to be called.
+ *
+ * @note HandleReceivedData() is called from the SIGIO signal handler of the
+ *       serial port. Implementations must restrict themselves to
+ *       async-signal-safe operations: no heap allocation, no locking of
+ *       mutexes that the interrupted thread may hold, and no blocking I/O
+ *       other than writes to the serial port itself.
+ */
+class SerialPortReceiveHandler
+{
+public:
+    /**
+     * @brief This method is called with every chunk of data read from the
+     *        serial port while the handler is attached. The data is
+     *        consumed by the handler and is not made available to
+     *        SerialPort::Read() and related methods.
+     * @param dataBuffer The bytes read from the serial port.
+     * @param bufferSize The number of bytes in dataBuffer.
+     */
+    virtual void HandleReceivedData( const unsigned char* dataBuffer,
+                                     const unsigned int   bufferSize ) = 0 ;
+
+    /**
+     * @brief Destructor is declared virtual as we expect this class to be
+     *        subclassed. It is also declared pure abstract to make this
+     *        class a pure abstract class.
+     */
+    virtual ~SerialPortReceiveHandler() = 0 ;
+} ;
+
+inline
+SerialPortReceiveHandler::~SerialPortReceiveHandler()
+{
+    /* empty */
+}
+#endif // #ifndef _SerialPortReceiveHandler_h_
@@ -0,0 +1,448 @@
+/******************************************************************************
+ *   @file SerialPortSelfTest.cpp                                             *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "SerialPort.h"
+#include "SerialPortReceiveHandler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::string ERR_MSG_PORT_NOT_OPEN      = "Serial port not open." ;
+    const std::string ERR_MSG_NO_PAYLOAD_SIZES   = "The self-test needs at least one payload size." ;
+    const std::string ERR_MSG_ZERO_PAYLOAD_SIZE  = "Self-test payload sizes must not be zero." ;
+
+    //
+    // The line is considered idle when no byte arrived for this long.
+    //
+    const unsigned long long QUIET_PERIOD_MICROSECONDS = 20000 ;
+
+    //
+    // Interval at which the test thread checks for echoed data. Arrival
+    // times are taken by the receive handler, so this does not affect
+    // the measured latency.
+    //
+    const unsigned int POLL_INTERVAL_MICROSECONDS = 50 ;
+
+    //
+    // Amount of data kept in flight while streaming, in seconds of line
+    // time.
+    //
+    const double STREAMING_WINDOW_SECONDS = 0.02 ;
+
+    //
+    // Bits per character with one start bit, eight data bits and one
+    // stop bit.
+    //
+    const double BITS_PER_CHARACTER = 10.0 ;
+
+    inline
+    unsigned long long
+    MonotonicMicroseconds()
+    {
+        struct timespec now ;
+        clock_gettime( CLOCK_MONOTONIC,
+                       &now ) ;
+        return static_cast<unsigned long long>( now.tv_sec ) * 1000000ULL +
+               now.tv_nsec / 1000 ;
+    }
+
+    /*
+     * The byte at the specified position of the test stream. Any lost,
+     * duplicated or reordered byte makes the following bytes mismatch.
+     */
+    inline
+    unsigned char
+    PatternByte( const unsigned long position )
+    {
+        return ( ( position * 0x9E3779B1UL ) >> 13 ) & 0xFF ;
+    }
+
+    /*
+     * Returns the nearest-rank percentile of sorted values.
+     */
+    double
+    Percentile( const std::vector<double>& sortedValues,
+                const double               percent )
+    {
+        if ( sortedValues.empty() )
+        {
+            return 0.0 ;
+        }
+        const size_t rank = static_cast<size_t>( std::ceil( percent / 100.0 * sortedValues.size() ) ) ;
+        return sortedValues[ std::max<size_t>( rank, 1 ) - 1 ] ;
+    }
+
+    /*
+     * Receive handler that checks echoed bytes against the test stream
+     * as they arrive and records the time of the latest arrival.
+     */
+    class EchoMonitor : public SerialPortReceiveHandler
+    {
+    public:
+        EchoMonitor() :
+            mNumOfBytesReceived(0),
+            mNumOfCorruptBytes(0),
+            mLastArrivalTime(0)
+        {
+            /* empty */
+        }
+
+        void
+        HandleReceivedData( const unsigned char* dataBuffer,
+                            const unsigned int   bufferSize )
+        {
+            const unsigned long position = mNumOfBytesReceived.load( std::memory_order_relaxed ) ;
+            unsigned long num_of_corrupt_bytes = 0 ;
+            for( unsigned int i=0; i<bufferSize; ++i )
+            {
+                if ( PatternByte( position + i ) != dataBuffer[i] )
+                {
+                    ++num_of_corrupt_bytes ;
+                }
+            }
+            mNumOfCorruptBytes.fetch_add( num_of_corrupt_bytes,
+                                          std::memory_order_relaxed ) ;
+            mLastArrivalTime.store( MonotonicMicroseconds(),
+                                    std::memory_order_relaxed ) ;
+            mNumOfBytesReceived.store( position + bufferSize,
+                                       std::memory_order_release ) ;
+        }
+
+        std::atomic<unsigned long>      mNumOfBytesReceived ;
+        std::atomic<unsigned long>      mNumOfCorruptBytes ;
+        std::atomic<unsigned long long> mLastArrivalTime ;
+    } ;
+
+    /*
+     * Runs the self-test on a port whose received data goes to an
+     * EchoMonitor.
+     */
+    class SelfTestRunner
+    {
+    public:
+        SelfTestRunner( SerialPort&                         serialPort,
+                        const SerialPort::SelfTestSettings& settings ) :
+            mSerialPort(serialPort),
+            mSettings(settings),
+            mMonitor(),
+            mNumOfBytesSent(0),
+            mBuffer()
+        {
+            /* empty */
+        }
+
+        /*
+         * Measures the current baud rate with the specified payload size.
+         */
+        SerialPort::SelfTestResult
+        Run( const unsigned int payloadSize ) ;
+
+        /*
+         * The receive handler to attach to the port under test.
+         */
+        EchoMonitor&
+        GetMonitor()
+        {
+            return mMonitor ;
+        }
+
+    private:
+        SelfTestRunner( const SelfTestRunner& ) ;
+        SelfTestRunner& operator=( const SelfTestRunner& ) ;
+
+        /*
+         * Sends the next payloadSize bytes of the test stream.
+         */
+        void
+        SendPayload( const unsigned int payloadSize ) ;
+
+        /*
+         * Waits until everything sent has been echoed, or until the
+         * timeout elapses. Returns false on timeout.
+         */
+        bool
+        WaitForEcho( const unsigned long long usTimeout ) ;
+
+        /*
+         * Waits for the line to become idle and realigns the monitor
+         * with the sender, so that bytes lost earlier do not make the
+         * rest of the test fail.
+         */
+        void
+        Resynchronise() ;
+
+        SerialPort&                         mSerialPort ;
+        const SerialPort::SelfTestSettings& mSettings ;
+        EchoMonitor                         mMonitor ;
+        unsigned long                       mNumOfBytesSent ;
+        std::vector<unsigned char>          mBuffer ;
+    } ;
+
+    void
+    SelfTestRunner::SendPayload( const unsigned int payloadSize )
+    {
+        mBuffer.resize( payloadSize ) ;
+        for( unsigned int i=0; i<payloadSize; ++i )
+        {
+            mBuffer[i] = PatternByte( mNumOfBytesSent + i ) ;
+        }
+        mNumOfBytesSent += payloadSize ;
+        mSerialPort.Write( &mBuffer[0],
+                           payloadSize ) ;
+    }
+
+    bool
+    SelfTestRunner::WaitForEcho( const unsigned long long usTimeout )
+    {
+        const unsigned long long deadline = MonotonicMicroseconds() + usTimeout ;
+        while( mMonitor.mNumOfBytesReceived.load( std::memory_order_acquire ) < mNumOfBytesSent )
+        {
+            if ( MonotonicMicroseconds() > deadline )
+            {
+                return false ;
+            }
+            usleep( POLL_INTERVAL_MICROSECONDS ) ;
+        }
+        return true ;
+    }
+
+    void
+    SelfTestRunner::Resynchronise()
+    {
+        unsigned long num_of_bytes_received = mMonitor.mNumOfBytesReceived ;
+        unsigned long long quiet_since = MonotonicMicroseconds() ;
+        const unsigned long long deadline = quiet_since +
+                                            1000ULL * mSettings.mMsProbeTimeout ;
+        while( MonotonicMicroseconds() - quiet_since < QUIET_PERIOD_MICROSECONDS )
+        {
+            if ( MonotonicMicroseconds() > deadline )
+            {
+                break ;
+            }
+            usleep( POLL_INTERVAL_MICROSECONDS ) ;
+            if ( mMonitor.mNumOfBytesReceived != num_of_bytes_received )
+            {
+                num_of_bytes_received = mMonitor.mNumOfBytesReceived ;
+                quiet_since = MonotonicMicroseconds() ;
+            }
+        }
+        mMonitor.mNumOfBytesReceived.store( mNumOfBytesSent,
+                                            std::memory_order_release ) ;
+    }
+
+    SerialPort::SelfTestResult
+    SelfTestRunner::Run( const unsigned int payloadSize )
+    {
+        SerialPort::SelfTestResult result ;
+        result.mBaudRate    = mSerialPort.GetBaudRate() ;
+        result.mPayloadSize = payloadSize ;
+
+        this->Resynchronise() ;
+        SerialPort::LineErrorCounters counters_before ;
+        const bool has_counters = mSerialPort.GetLineErrorCounters( counters_before ) ;
+        const unsigned long corrupt_bytes_before = mMonitor.mNumOfCorruptBytes ;
+        const unsigned long bytes_sent_before = mNumOfBytesSent ;
+        unsigned long num_of_bytes_lost = 0 ;
+        //
+        // Time round trips of single payloads.
+        //
+        std::vector<double> latencies ;
+        result.mNumOfProbes     = mSettings.mNumOfProbes ;
+        result.mNumOfLostProbes = 0 ;
+        for( unsigned int i=0; i<mSettings.mNumOfProbes; ++i )
+        {
+            const unsigned long long send_time = MonotonicMicroseconds() ;
+            this->SendPayload( payloadSize ) ;
+            if ( ! this->WaitForEcho( 1000ULL * mSettings.mMsProbeTimeout ) )
+            {
+                ++result.mNumOfLostProbes ;
+                num_of_bytes_lost += mNumOfBytesSent - mMonitor.mNumOfBytesReceived ;
+                this->Resynchronise() ;
+                continue ;
+            }
+            latencies.push_back( static_cast<double>( mMonitor.mLastArrivalTime - send_time ) ) ;
+        }
+        std::sort( latencies.begin(),
+                   latencies.end() ) ;
+        result.mMinLatencyMicroseconds    = latencies.empty() ? 0.0 : latencies.front() ;
+        result.mMedianLatencyMicroseconds = Percentile( latencies, 50.0 ) ;
+        result.mP90LatencyMicroseconds    = Percentile( latencies, 90.0 ) ;
+        result.mP99LatencyMicroseconds    = Percentile( latencies, 99.0 ) ;
+        result.mMaxLatencyMicroseconds    = latencies.empty() ? 0.0 : latencies.back() ;
+        //
+        // Stream payloads back to back, keeping a few milliseconds of
+        // line time in flight so that the echo never stalls the sender.
+        //
+        const double bytes_per_second = SerialPort::GetBitsPerSecond( result.mBaudRate ) / BITS_PER_CHARACTER ;
+        const unsigned long window =
+            std::max( 2UL * payloadSize,
+                      static_cast<unsigned long>( bytes_per_second * STREAMING_WINDOW_SECONDS ) ) ;
+        const unsigned long bytes_received_before = mMonitor.mNumOfBytesReceived ;
+        const unsigned long long start_time = MonotonicMicroseconds() ;
+        const unsigned long long end_time = start_time +
+                                            1000ULL * mSettings.mMsThroughputDuration ;
+        while( MonotonicMicroseconds() < end_time )
+        {
+            if ( mNumOfBytesSent - mMonitor.mNumOfBytesReceived + payloadSize <= window )
+            {
+                this->SendPayload( payloadSize ) ;
+            }
+            else
+            {
+                usleep( POLL_INTERVAL_MICROSECONDS ) ;
+            }
+        }
+        if ( ! this->WaitForEcho( 1000ULL * mSettings.mMsProbeTimeout ) )
+        {
+            num_of_bytes_lost += mNumOfBytesSent - mMonitor.mNumOfBytesReceived ;
+        }
+        const unsigned long streamed_bytes = mMonitor.mNumOfBytesReceived - bytes_received_before ;
+        const unsigned long long last_arrival_time = mMonitor.mLastArrivalTime ;
+        result.mThroughput = 0.0 ;
+        if ( ( streamed_bytes > 0 ) &&
+             ( last_arrival_time > start_time ) )
+        {
+            result.mThroughput = streamed_bytes * 1e6 /
+                                 ( last_arrival_time - start_time ) ;
+        }
+        result.mLineUtilisation = ( bytes_per_second > 0.0 ) ?
+                                  result.mThroughput / bytes_per_second :
+                                  0.0 ;
+        //
+        // Collect the error counts.
+        //
+        result.mNumOfBytesSent     = mNumOfBytesSent - bytes_sent_before ;
+        result.mNumOfBytesReceived = result.mNumOfBytesSent - num_of_bytes_lost ;
+        result.mNumOfCorruptBytes  = mMonitor.mNumOfCorruptBytes - corrupt_bytes_before ;
+        result.mNumOfOverruns      = -1 ;
+        SerialPort::LineErrorCounters counters_after ;
+        if ( has_counters &&
+             mSerialPort.GetLineErrorCounters( counters_after ) )
+        {
+            result.mNumOfOverruns =
+                ( counters_after.mNumOfOverruns - counters_before.mNumOfOverruns ) +
+                ( counters_after.mNumOfBufferOverruns - counters_before.mNumOfBufferOverruns ) ;
+        }
+        result.mIsErrorFree = ( 0 == result.mNumOfLostProbes ) &&
+                              ( 0 == num_of_bytes_lost ) &&
+                              ( 0 == result.mNumOfCorruptBytes ) &&
+                              ( result.mNumOfOverruns <= 0 ) ;
+        return result ;
+    }
+}
+
+SerialPort::SelfTestSettings::SelfTestSettings() :
+    mBaudRates(),
+    mPayloadSizes(),
+    mNumOfProbes(20),
+    mMsProbeTimeout(500),
+    mMsThroughputDuration(200)
+{
+    mPayloadSizes.push_back(1) ;
+    mPayloadSizes.push_back(16) ;
+    mPayloadSizes.push_back(64) ;
+    mPayloadSizes.push_back(256) ;
+}
+
+SerialPort::SelfTestReport
+SerialPort::SelfTest( const SelfTestSettings& settings )
+    throw( NotOpen,
+           UnsupportedBaudRate,
+           std::invalid_argument,
+           std::runtime_error )
+{
+    if ( ! this->IsOpen() )
+    {
+        throw NotOpen( ERR_MSG_PORT_NOT_OPEN ) ;
+    }
+    if ( settings.mPayloadSizes.empty() )
+    {
+        throw std::invalid_argument( ERR_MSG_NO_PAYLOAD_SIZES ) ;
+    }
+    if ( std::find( settings.mPayloadSizes.begin(),
+                    settings.mPayloadSizes.end(),
+                    0U ) != settings.mPayloadSizes.end() )
+    {
+        throw std::invalid_argument( ERR_MSG_ZERO_PAYLOAD_SIZE ) ;
+    }
+    //
+    // Route received data to the monitor for the duration of the test
+    // and restore the previous state whatever happens.
+    //
+    const BaudRate original_baud_rate = this->GetBaudRate() ;
+    SerialPortReceiveHandler* const original_handler = this->GetReceiveHandler() ;
+    SelfTestRunner runner( *this,
+                           settings ) ;
+    this->SetReceiveHandler( &runner.GetMonitor() ) ;
+
+    SelfTestReport report ;
+    LineErrorCounters counters ;
+    report.mIsOverrunCountAvailable = this->GetLineErrorCounters( counters ) ;
+    report.mMaxErrorFreeThroughput  = 0.0 ;
+    report.mMaxErrorFreeBaudRate    = original_baud_rate ;
+    report.mMaxErrorFreePayloadSize = 0 ;
+    report.mHasOverrunOnset         = false ;
+    report.mOverrunOnsetBaudRate    = original_baud_rate ;
+    report.mOverrunOnsetPayloadSize = 0 ;
+    try
+    {
+        const size_t num_of_rates = std::max<size_t>( settings.mBaudRates.size(), 1 ) ;
+        for( size_t r=0; r<num_of_rates; ++r )
+        {
+            if ( ! settings.mBaudRates.empty() )
+            {
+                this->SetBaudRate( settings.mBaudRates[r] ) ;
+            }
+            for( size_t s=0; s<settings.mPayloadSizes.size(); ++s )
+            {
+                const SelfTestResult result = runner.Run( settings.mPayloadSizes[s] ) ;
+                report.mResults.push_back( result ) ;
+                if ( result.mIsErrorFree &&
+                     ( result.mThroughput > report.mMaxErrorFreeThroughput ) )
+                {
+                    report.mMaxErrorFreeThroughput  = result.mThroughput ;
+                    report.mMaxErrorFreeBaudRate    = result.mBaudRate ;
+                    report.mMaxErrorFreePayloadSize = result.mPayloadSize ;
+                }
+                if ( ( result.mNumOfOverruns > 0 ) &&
+                     ( ! report.mHasOverrunOnset ) )
+                {
+                    report.mHasOverrunOnset         = true ;
+                    report.mOverrunOnsetBaudRate    = result.mBaudRate ;
+                    report.mOverrunOnsetPayloadSize = result.mPayloadSize ;
+                }
+            }
+        }
+    }
+    catch( ... )
+    {
+        this->SetReceiveHandler( original_handler ) ;
+        this->SetBaudRate( original_baud_rate ) ;
+        throw ;
+    }
+    this->SetReceiveHandler( original_handler ) ;
+    this->SetBaudRate( original_baud_rate ) ;
+    return report ;
+}
@@ -0,0 +1,740 @@
+/******************************************************************************
+ *   @file SlcanAdapter.cpp                                                   *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "SlcanAdapter.h"
+#include "AsciiHex.h"
+#include "MirroredRingBuffer.h"
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::string ERR_MSG_INVALID_QUEUE_CAPACITY = "Invalid SLCAN frame queue capacity." ;
+    const std::string ERR_MSG_INVALID_FRAME          = "CAN frame identifier or length out of range." ;
+    const std::string ERR_MSG_COMMAND_REFUSED        = "SLCAN adapter refused command: " ;
+    const std::string ERR_MSG_NO_RESPONSE            = "No response from SLCAN adapter to command: " ;
+
+    //
+    // Number of received characters parsed at a time.
+    //
+    const unsigned int BLOCK_SIZE = 1024 ;
+
+    //
+    // Longest record: "T", eight identifier digits, the length digit,
+    // 16 data digits, four timestamp digits and the carriage return.
+    //
+    const unsigned int MAX_RECORD_SIZE = 31 ;
+
+    //
+    // Size of the buffer in which frames are encoded for transmission.
+    //
+    const unsigned int TRANSMIT_BUFFER_SIZE = 4096 ;
+
+    const unsigned int MAX_STANDARD_ID = 0x7FF ;
+    const unsigned int MAX_EXTENDED_ID = 0x1FFFFFFF ;
+    const unsigned int MAX_DATA_LENGTH = 8 ;
+
+    const unsigned int STANDARD_ID_DIGITS = 3 ;
+    const unsigned int EXTENDED_ID_DIGITS = 8 ;
+
+    const unsigned char RECORD_TERMINATOR = '\r' ;
+    const unsigned char ERROR_RESPONSE    = '\a' ;
+
+    //
+    // Time the adapter is given to answer a command, and the interval
+    // at which the answer is checked.
+    //
+    const unsigned int COMMAND_TIMEOUT_MICROSECONDS = 1000000 ;
+    const unsigned int POLL_INTERVAL_MICROSECONDS   = 100 ;
+
+    const unsigned char UPPER_CASE_DIGITS[] = "0123456789ABCDEF" ;
+
+    /*
+     * Current value of the monotonic clock in microseconds.
+     * clock_gettime() is async-signal-safe.
+     */
+    inline
+    unsigned long long
+    MonotonicMicroseconds()
+    {
+        struct timespec now ;
+        clock_gettime( CLOCK_MONOTONIC,
+                       &now ) ;
+        return static_cast<unsigned long long>( now.tv_sec ) * 1000000ULL +
+               now.tv_nsec / 1000 ;
+    }
+
+    /*
+     * Combine numOfDigits nibble values into a number.
+     */
+    inline
+    unsigned int
+    CombineNibbles( const unsigned char* nibbles,
+                    const unsigned int   numOfDigits )
+    {
+        unsigned int value = 0 ;
+        for( unsigned int i=0; i<numOfDigits; ++i )
+        {
+            value = ( value << 4 ) | nibbles[i] ;
+        }
+        return value ;
+    }
+}
+
+namespace LibSerial
+{
+    class SlcanAdapter::Implementation
+    {
+    public:
+        Implementation( SerialPort&        serialPort,
+                        const unsigned int queueCapacity )
+            throw( std::invalid_argument,
+                   std::bad_alloc ) ;
+
+        /*
+         * Parse data received by the serial port.
+         */
+        void
+        Ingest( const unsigned char* dataBuffer,
+                const unsigned int   bufferSize ) ;
+
+        /*
+         * Parse the records in mText and queue their frames. Returns the
+         * number of characters consumed. Only an incomplete record, which
+         * is shorter than MAX_RECORD_SIZE, is left. Text being skipped is
+         * always consumed.
+         */
+        unsigned int
+        ParseText( const unsigned long long timestamp ) ;
+
+        /*
+         * Get space for the next received frame in the queue, or null if
+         * the queue is full.
+         */
+        CanFrame*
+        AllocateFrame() ;
+
+        /*
+         * Make the frames allocated so far readable.
+         */
+        void
+        CommitFrames() ;
+
+        /*
+         * Record the response to a command.
+         */
+        void
+        CommandResponse( const bool isOk ) ;
+
+        /*
+         * Send a command and wait for the response. Returns false if the
+         * adapter refuses the command.
+         */
+        bool
+        SendCommand( const std::string& command )
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /*
+         * Send a command and throw if the adapter refuses it.
+         */
+        void
+        ExecuteCommand( const std::string& command )
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /*
+         * Encode a frame as a transmit record. Returns the size of the
+         * record.
+         */
+        unsigned int
+        EncodeFrame( const CanFrame& frame,
+                     unsigned char*  record ) ;
+
+        SerialPort&        mSerialPort ;
+        MirroredRingBuffer mQueue ;
+
+        /*
+         * Received text that has not been parsed yet, and the values of
+         * its hexadecimal digits.
+         */
+        unsigned char mText[ MAX_RECORD_SIZE + BLOCK_SIZE ] ;
+        unsigned char mNibbles[ MAX_RECORD_SIZE + BLOCK_SIZE ] ;
+        unsigned int  mTextSize ;
+
+        /*
+         * True while the rest of a malformed record is being dropped.
+         */
+        bool mIsSkippingRecord ;
+
+        /*
+         * Free space of the queue being filled by ParseText().
+         */
+        CanFrame*    mWriteSpan ;
+        unsigned int mNumOfWritableFrames ;
+        unsigned int mNumOfAllocatedFrames ;
+
+        /*
+         * Number of responses to commands received so far, and whether
+         * the last one was positive.
+         */
+        std::atomic<unsigned int> mNumOfCommandResponses ;
+        std::atomic<bool>         mIsLastCommandOk ;
+
+        /*
+         * Statistics. The receive counters are updated from the SIGIO
+         * handler and read by the application.
+         */
+        std::atomic<unsigned long> mNumOfReceivedFrames ;
+        std::atomic<unsigned long> mNumOfTransmittedFrames ;
+        std::atomic<unsigned long> mNumOfTransmitAcks ;
+        std::atomic<unsigned long> mNumOfErrorResponses ;
+        std::atomic<unsigned long> mNumOfMalformedRecords ;
+        std::atomic<unsigned long> mNumOfOverruns ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    SlcanAdapter::SlcanAdapter( SerialPort&        serialPort,
+                                const unsigned int queueCapacity )
+        throw( std::invalid_argument,
+               std::bad_alloc ) :
+        mImpl(0)
+    {
+        if ( ( 0 == queueCapacity ) ||
+             ( queueCapacity > UINT_MAX / 2 / sizeof( CanFrame ) ) )
+        {
+            throw std::invalid_argument( ERR_MSG_INVALID_QUEUE_CAPACITY ) ;
+        }
+        mImpl = new Implementation( serialPort,
+                                    queueCapacity ) ;
+        serialPort.SetReceiveHandler( this ) ;
+    }
+
+    SlcanAdapter::~SlcanAdapter()
+    {
+        mImpl->mSerialPort.SetReceiveHandler( 0 ) ;
+        delete mImpl ;
+    }
+
+    void
+    SlcanAdapter::Open( const BitRate bitRate,
+                        const bool    isListenOnly )
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        //
+        // The bit rate can only be changed while the channel is closed.
+        // An adapter that is already closed refuses the close command.
+        //
+        mImpl->SendCommand( "C" ) ;
+        mImpl->ExecuteCommand( std::string( "S" ) +
+                               static_cast<char>( '0' + bitRate ) ) ;
+        mImpl->ExecuteCommand( isListenOnly ? "L" : "O" ) ;
+        return ;
+    }
+
+    void
+    SlcanAdapter::Close()
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        mImpl->ExecuteCommand( "C" ) ;
+        return ;
+    }
+
+    void
+    SlcanAdapter::SetAdapterTimestamps( const bool isEnabled )
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        mImpl->ExecuteCommand( isEnabled ? "Z1" : "Z0" ) ;
+        return ;
+    }
+
+    unsigned int
+    SlcanAdapter::ReadFrames( CanFrame*          frames,
+                              const unsigned int maxNumOfFrames,
+                              const unsigned int msTimeout )
+        throw( SerialPort::ReadTimeout )
+    {
+        if ( 0 == maxNumOfFrames )
+        {
+            return 0 ;
+        }
+        const unsigned long long entry_time = MonotonicMicroseconds() ;
+        while ( 0 == this->GetNumOfQueuedFrames() )
+        {
+            if ( ( msTimeout > 0 ) &&
+                 ( MonotonicMicroseconds() - entry_time > msTimeout * 1000ULL ) )
+            {
+                throw SerialPort::ReadTimeout() ;
+            }
+            usleep( POLL_INTERVAL_MICROSECONDS ) ;
+        }
+        //
+        // Frames never straddle the end of the storage, so the read span
+        // always holds whole frames. A second span is only needed if the
+        // ring is not mirrored.
+        //
+        unsigned int num_of_frames = 0 ;
+        while ( num_of_frames < maxNumOfFrames )
+        {
+            unsigned int span_size = 0 ;
+            const unsigned char* span = mImpl->mQueue.GetReadSpan( span_size ) ;
+            unsigned int count = span_size / sizeof( CanFrame ) ;
+            if ( 0 == count )
+            {
+                break ;
+            }
+            if ( count > maxNumOfFrames - num_of_frames )
+            {
+                count = maxNumOfFrames - num_of_frames ;
+            }
+            memcpy( frames + num_of_frames,
+                    span,
+                    count * sizeof( CanFrame ) ) ;
+            mImpl->mQueue.Consume( count * sizeof( CanFrame ) ) ;
+            num_of_frames += count ;
+        }
+        return num_of_frames ;
+    }
+
+    unsigned int
+    SlcanAdapter::GetNumOfQueuedFrames() const
+    {
+        return mImpl->mQueue.GetSize() / sizeof( CanFrame ) ;
+    }
+
+    void
+    SlcanAdapter::WriteFrames( const CanFrame*    frames,
+                               const unsigned int numOfFrames )
+        throw( SerialPort::NotOpen,
+               std::invalid_argument,
+               std::runtime_error )
+    {
+        for( unsigned int i=0; i<numOfFrames; ++i )
+        {
+            const unsigned int max_id = ( frames[i].mFlags & CanFrame::EXTENDED_ID ) ?
+                                        MAX_EXTENDED_ID : MAX_STANDARD_ID ;
+            if ( ( frames[i].mId > max_id ) ||
+                 ( frames[i].mLength > MAX_DATA_LENGTH ) )
+            {
+                throw std::invalid_argument( ERR_MSG_INVALID_FRAME ) ;
+            }
+        }
+        unsigned char buffer[ TRANSMIT_BUFFER_SIZE ] ;
+        unsigned int buffer_size = 0 ;
+        for( unsigned int i=0; i<numOfFrames; ++i )
+        {
+            if ( buffer_size + MAX_RECORD_SIZE > TRANSMIT_BUFFER_SIZE )
+            {
+                mImpl->mSerialPort.Write( buffer,
+                                          buffer_size ) ;
+                buffer_size = 0 ;
+            }
+            buffer_size += mImpl->EncodeFrame( frames[i],
+                                               buffer + buffer_size ) ;
+        }
+        if ( buffer_size > 0 )
+        {
+            mImpl->mSerialPort.Write( buffer,
+                                      buffer_size ) ;
+        }
+        mImpl->mNumOfTransmittedFrames += numOfFrames ;
+        return ;
+    }
+
+    SlcanAdapter::Statistics
+    SlcanAdapter::GetStatistics() const
+    {
+        Statistics statistics ;
+        statistics.mNumOfReceivedFrames    = mImpl->mNumOfReceivedFrames ;
+        statistics.mNumOfTransmittedFrames = mImpl->mNumOfTransmittedFrames ;
+        statistics.mNumOfTransmitAcks      = mImpl->mNumOfTransmitAcks ;
+        statistics.mNumOfErrorResponses    = mImpl->mNumOfErrorResponses ;
+        statistics.mNumOfMalformedRecords  = mImpl->mNumOfMalformedRecords ;
+        statistics.mNumOfOverruns          = mImpl->mNumOfOverruns ;
+        return statistics ;
+    }
+
+    void
+    SlcanAdapter::HandleReceivedData( const unsigned char* dataBuffer,
+                                      const unsigned int   bufferSize )
+    {
+        mImpl->Ingest( dataBuffer,
+                       bufferSize ) ;
+        return ;
+    }
+
+    /* ------------------------------------------------------------ */
+    SlcanAdapter::Implementation::Implementation( SerialPort&        serialPort,
+                                                  const unsigned int queueCapacity )
+        throw( std::invalid_argument,
+               std::bad_alloc ) :
+        mSerialPort(serialPort),
+        mQueue( queueCapacity * sizeof( CanFrame ) ),
+        mText(),
+        mNibbles(),
+        mTextSize(0),
+        mIsSkippingRecord(false),
+        mWriteSpan(0),
+        mNumOfWritableFrames(0),
+        mNumOfAllocatedFrames(0),
+        mNumOfCommandResponses(0),
+        mIsLastCommandOk(false),
+        mNumOfReceivedFrames(0),
+        mNumOfTransmittedFrames(0),
+        mNumOfTransmitAcks(0),
+        mNumOfErrorResponses(0),
+        mNumOfMalformedRecords(0),
+        mNumOfOverruns(0)
+    {
+        /* empty */
+    }
+
+    void
+    SlcanAdapter::Implementation::Ingest( const unsigned char* dataBuffer,
+                                          const unsigned int   bufferSize )
+    {
+        //
+        // All frames of this chunk get the same timestamp. Reading the
+        // clock once per frame would cost more than parsing it.
+        //
+        const unsigned long long timestamp = MonotonicMicroseconds() ;
+        unsigned int i = 0 ;
+        while ( i < bufferSize )
+        {
+            unsigned int count = bufferSize - i ;
+            if ( count > BLOCK_SIZE )
+            {
+                count = BLOCK_SIZE ;
+            }
+            memcpy( mText + mTextSize,
+                    dataBuffer + i,
+                    count ) ;
+            mTextSize += count ;
+            i += count ;
+            //
+            // Keep the incomplete record at the end for the next block.
+            //
+            const unsigned int num_of_parsed_chars = this->ParseText( timestamp ) ;
+            mTextSize -= num_of_parsed_chars ;
+            memmove( mText,
+                     mText + num_of_parsed_chars,
+                     mTextSize ) ;
+        }
+        return ;
+    }
+
+    unsigned int
+    SlcanAdapter::Implementation::ParseText( const unsigned long long timestamp )
+    {
+        AsciiHex::NibbleValues( mText,
+                                mTextSize,
+                                mNibbles ) ;
+        unsigned int position = 0 ;
+        while ( position < mTextSize )
+        {
+            //
+            // Drop a malformed record up to its terminator. A BEL ends it
+            // as well, since it is a response of its own.
+            //
+            if ( mIsSkippingRecord )
+            {
+                while ( ( position < mTextSize ) &&
+                        ( RECORD_TERMINATOR != mText[ position ] ) &&
+                        ( ERROR_RESPONSE != mText[ position ] ) )
+                {
+                    ++position ;
+                }
+                if ( position == mTextSize )
+                {
+                    break ;
+                }
+                mIsSkippingRecord = false ;
+                if ( RECORD_TERMINATOR == mText[ position ] )
+                {
+                    ++position ;
+                }
+                continue ;
+            }
+            //
+            const unsigned char record_type = mText[ position ] ;
+            unsigned int num_of_id_digits = 0 ;
+            unsigned char flags = 0 ;
+            switch( record_type )
+            {
+            case RECORD_TERMINATOR:
+                this->CommandResponse( true ) ;
+                ++position ;
+                continue ;
+            case ERROR_RESPONSE:
+                ++mNumOfErrorResponses ;
+                this->CommandResponse( false ) ;
+                ++position ;
+                continue ;
+            case 'z':
+            case 'Z':
+                if ( position + 1 == mTextSize )
+                {
+                    break ;
+                }
+                if ( RECORD_TERMINATOR == mText[ position + 1 ] )
+                {
+                    ++mNumOfTransmitAcks ;
+                    position += 2 ;
+                    continue ;
+                }
+                ++mNumOfMalformedRecords ;
+                mIsSkippingRecord = true ;
+                ++position ;
+                continue ;
+            case 't':
+                num_of_id_digits = STANDARD_ID_DIGITS ;
+                break ;
+            case 'T':
+                num_of_id_digits = EXTENDED_ID_DIGITS ;
+                flags = CanFrame::EXTENDED_ID ;
+                break ;
+            case 'r':
+                num_of_id_digits = STANDARD_ID_DIGITS ;
+                flags = CanFrame::REMOTE ;
+                break ;
+            case 'R':
+                num_of_id_digits = EXTENDED_ID_DIGITS ;
+                flags = CanFrame::EXTENDED_ID | CanFrame::REMOTE ;
+                break ;
+            default:
+                ++mNumOfMalformedRecords ;
+                mIsSkippingRecord = true ;
+                ++position ;
+                continue ;
+            }
+            if ( 0 == num_of_id_digits )
+            {
+                //
+                // Incomplete acknowledgement.
+                //
+                break ;
+            }
+            //
+            // The record is "<type><id><length><data>[<timestamp>]\r".
+            // The length digit gives the number of data digits, and the
+            // character after the data tells if a timestamp follows. An
+            // incomplete record is left for the next block.
+            //
+            const unsigned int length_position = position + 1 + num_of_id_digits ;
+            if ( length_position >= mTextSize )
+            {
+                break ;
+            }
+            const unsigned int length = mNibbles[ length_position ] ;
+            if ( length > MAX_DATA_LENGTH )
+            {
+                ++mNumOfMalformedRecords ;
+                mIsSkippingRecord = true ;
+                ++position ;
+                continue ;
+            }
+            const unsigned int data_position = length_position + 1 ;
+            const unsigned int num_of_data_digits = ( flags & CanFrame::REMOTE ) ?
+                                                    0 : 2 * length ;
+            unsigned int end_position = data_position + num_of_data_digits ;
+            if ( end_position >= mTextSize )
+            {
+                break ;
+            }
+            bool has_timestamp = false ;
+            if ( RECORD_TERMINATOR != mText[ end_position ] )
+            {
+                if ( end_position + 4 >= mTextSize )
+                {
+                    break ;
+                }
+                has_timestamp = true ;
+                end_position += 4 ;
+            }
+            //
+            // Any character that is not a digit makes the OR of the
+            // nibble values greater than 0x0F.
+            //
+            unsigned char digits = 0 ;
+            for( unsigned int i=position+1; i<end_position; ++i )
+            {
+                digits |= mNibbles[i] ;
+            }
+            const unsigned int id = CombineNibbles( mNibbles + position + 1,
+                                                    num_of_id_digits ) ;
+            const unsigned int max_id = ( flags & CanFrame::EXTENDED_ID ) ?
+                                        MAX_EXTENDED_ID : MAX_STANDARD_ID ;
+            if ( ( digits > 0x0F ) ||
+                 ( id > max_id ) ||
+                 ( RECORD_TERMINATOR != mText[ end_position ] ) )
+            {
+                ++mNumOfMalformedRecords ;
+                mIsSkippingRecord = true ;
+                ++position ;
+                continue ;
+            }
+            //
+            CanFrame* frame = this->AllocateFrame() ;
+            if ( 0 == frame )
+            {
+                ++mNumOfOverruns ;
+            }
+            else
+            {
+                memset( frame,
+                        0,
+                        sizeof( CanFrame ) ) ;
+                frame->mTimestamp = timestamp ;
+                frame->mId        = id ;
+                frame->mLength    = length ;
+                frame->mFlags     = flags ;
+                if ( has_timestamp )
+                {
+                    frame->mAdapterTimestamp = CombineNibbles( mNibbles + end_position - 4,
+                                                               4 ) ;
+                    frame->mFlags |= CanFrame::ADAPTER_TIMESTAMP ;
+                }
+                const unsigned char* data_nibbles = mNibbles + data_position ;
+                for( unsigned int i=0; i<num_of_data_digits/2; ++i )
+                {
+                    frame->mData[i] = ( data_nibbles[ 2 * i ] << 4 ) |
+                                      data_nibbles[ 2 * i + 1 ] ;
+                }
+                ++mNumOfReceivedFrames ;
+            }
+            position = end_position + 1 ;
+        }
+        this->CommitFrames() ;
+        return position ;
+    }
+
+    CanFrame*
+    SlcanAdapter::Implementation::AllocateFrame()
+    {
+        if ( mNumOfAllocatedFrames == mNumOfWritableFrames )
+        {
+            this->CommitFrames() ;
+            unsigned int span_size = 0 ;
+            mWriteSpan = reinterpret_cast<CanFrame*>( mQueue.GetWriteSpan( span_size ) ) ;
+            mNumOfWritableFrames = span_size / sizeof( CanFrame ) ;
+            if ( 0 == mNumOfWritableFrames )
+            {
+                return 0 ;
+            }
+        }
+        return mWriteSpan + mNumOfAllocatedFrames++ ;
+    }
+
+    void
+    SlcanAdapter::Implementation::CommitFrames()
+    {
+        if ( mNumOfAllocatedFrames > 0 )
+        {
+            mQueue.Commit( mNumOfAllocatedFrames * sizeof( CanFrame ) ) ;
+        }
+        mWriteSpan = 0 ;
+        mNumOfWritableFrames = 0 ;
+        mNumOfAllocatedFrames = 0 ;
+        return ;
+    }
+
+    void
+    SlcanAdapter::Implementation::CommandResponse( const bool isOk )
+    {
+        mIsLastCommandOk = isOk ;
+        ++mNumOfCommandResponses ;
+        return ;
+    }
+
+    bool
+    SlcanAdapter::Implementation::SendCommand( const std::string& command )
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        const unsigned int num_of_responses = mNumOfCommandResponses ;
+        mSerialPort.Write( command + static_cast<char>( RECORD_TERMINATOR ) ) ;
+        const unsigned long long entry_time = MonotonicMicroseconds() ;
+        while ( num_of_responses == mNumOfCommandResponses )
+        {
+            if ( MonotonicMicroseconds() - entry_time > COMMAND_TIMEOUT_MICROSECONDS )
+            {
+                throw std::runtime_error( ERR_MSG_NO_RESPONSE + command ) ;
+            }
+            usleep( POLL_INTERVAL_MICROSECONDS ) ;
+        }
+        return mIsLastCommandOk ;
+    }
+
+    void
+    SlcanAdapter::Implementation::ExecuteCommand( const std::string& command )
+        throw( SerialPort::NotOpen,
+               std::runtime_error )
+    {
+        if ( ! this->SendCommand( command ) )
+        {
+            throw std::runtime_error( ERR_MSG_COMMAND_REFUSED + command ) ;
+        }
+        return ;
+    }
+
+    unsigned int
+    SlcanAdapter::Implementation::EncodeFrame( const CanFrame& frame,
+                                               unsigned char*  record )
+    {
+        const bool is_extended = ( 0 != ( frame.mFlags & CanFrame::EXTENDED_ID ) ) ;
+        const bool is_remote = ( 0 != ( frame.mFlags & CanFrame::REMOTE ) ) ;
+        unsigned int size = 0 ;
+        if ( is_remote )
+        {
+            record[ size++ ] = is_extended ? 'R' : 'r' ;
+        }
+        else
+        {
+            record[ size++ ] = is_extended ? 'T' : 't' ;
+        }
+        const unsigned int num_of_id_digits = is_extended ?
+                                              EXTENDED_ID_DIGITS : STANDARD_ID_DIGITS ;
+        for( unsigned int i=num_of_id_digits; i>0; --i )
+        {
+            record[ size++ ] = UPPER_CASE_DIGITS[ ( frame.mId >> ( 4 * ( i - 1 ) ) ) & 0x0F ] ;
+        }
+        record[ size++ ] = UPPER_CASE_DIGITS[ frame.mLength ] ;
+        if ( ! is_remote )
+        {
+            AsciiHex::Encode( frame.mData,
+                              frame.mLength,
+                              record + size ) ;
+            size += 2 * frame.mLength ;
+        }
+        record[ size++ ] = RECORD_TERMINATOR ;
+        return size ;
+    }
+
+} // namespace LibSerial
@@ -0,0 +1,265 @@
+/******************************************************************************
+ *   @file SlcanAdapter.h                                                     *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _SlcanAdapter_h_
+#define _SlcanAdapter_h_
+
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief A classic CAN frame with the time at which it was received.
+     *        Frames have a fixed size of 32 bytes, so that a ring buffer
+     *        of frames never splits a frame at its wrap-around.
+     */
+    struct CanFrame
+    {
+        /**
+         * @brief Bits of mFlags.
+         */
+        enum Flags
+        {
+            EXTENDED_ID       = 0x01, //!< mId is a 29-bit identifier.
+            REMOTE            = 0x02, //!< Remote transmission request.
+            ADAPTER_TIMESTAMP = 0x04  //!< mAdapterTimestamp is valid.
+        } ;
+
+        unsigned long long mTimestamp ;        //!< CLOCK_MONOTONIC time of reception in microseconds.
+        unsigned int       mId ;               //!< 11-bit or 29-bit identifier.
+        unsigned short     mAdapterTimestamp ; //!< Adapter time in milliseconds, 0 to 59999.
+        unsigned char      mLength ;           //!< Number of data bytes, 0 to 8.
+        unsigned char      mFlags ;            //!< Combination of Flags.
+        unsigned char      mData[8] ;          //!< The data bytes.
+        unsigned char      mReserved[8] ;      //!< Pads the frame to 32 bytes.
+    } ;
+
+    /**
+     * @brief A driver for serial-CAN adapters that speak the SLCAN
+     *        (Lawicel) ASCII protocol.
+     *
+     *        The adapter attaches itself as the receive handler of its
+     *        serial port. Received text is parsed in the SIGIO handler a
+     *        block at a time: the hexadecimal digits of the whole block
+     *        are converted with AsciiHex::NibbleValues(), and the frames
+     *        are then assembled directly into a lock-free queue of
+     *        CanFrame structures, without allocating memory or building
+     *        strings. The application takes frames from the queue in
+     *        batches with ReadFrames(). All frames of a block share the
+     *        timestamp taken when the block was received; adapters with
+     *        timestamps enabled also provide their own millisecond
+     *        timestamp for each frame.
+     *
+     *        WriteFrames() encodes a batch of frames into a single write
+     *        to the serial port. The "z" and "Z" acknowledgements of the
+     *        adapter are only counted.
+     *
+     *        The serial port must be signal driven, which is the default.
+     *        Commands and writes must not be issued concurrently from
+     *        several threads.
+     */
+    class SlcanAdapter : public SerialPortReceiveHandler
+    {
+    public:
+        /**
+         * @brief The standard bit rates of the "S" command.
+         */
+        enum BitRate
+        {
+            BIT_RATE_10K,
+            BIT_RATE_20K,
+            BIT_RATE_50K,
+            BIT_RATE_100K,
+            BIT_RATE_125K,
+            BIT_RATE_250K,
+            BIT_RATE_500K,
+            BIT_RATE_800K,
+            BIT_RATE_1M
+        } ;
+
+        /**
+         * @brief Counters describing the activity of the adapter.
+         */
+        struct Statistics
+        {
+            unsigned long mNumOfReceivedFrames ;    //!< Frames placed in the queue.
+            unsigned long mNumOfTransmittedFrames ; //!< Frames written to the port.
+            unsigned long mNumOfTransmitAcks ;      //!< "z" and "Z" acknowledgements.
+            unsigned long mNumOfErrorResponses ;    //!< BEL responses to commands or frames.
+            unsigned long mNumOfMalformedRecords ;  //!< Records that could not be parsed.
+            unsigned long mNumOfOverruns ;          //!< Frames dropped because the queue was full.
+        } ;
+
+        /**
+         * @brief Constructs an adapter on serialPort and attaches it as
+         *        the receive handler of the port. The port may be opened
+         *        before or after the adapter is constructed.
+         * @param serialPort The serial port of the adapter.
+         * @param queueCapacity The minimum number of received frames
+         *        that can be queued.
+         * @throw std::invalid_argument This exception is thrown if
+         *        queueCapacity is zero or too large.
+         * @throw std::bad_alloc This exception is thrown if the queue
+         *        cannot be allocated.
+         */
+        explicit
+        SlcanAdapter( SerialPort&        serialPort,
+                      const unsigned int queueCapacity = 4096 )
+            throw( std::invalid_argument,
+                   std::bad_alloc ) ;
+
+        /**
+         * @brief Destructor. Detaches the adapter from the serial port
+         *        without closing the CAN channel.
+         */
+        ~SlcanAdapter() ;
+
+        /**
+         * @brief Sets the bit rate and opens the CAN channel. A channel
+         *        left open by a previous session is closed first.
+         * @param bitRate The bit rate of the CAN bus.
+         * @param isListenOnly Set to true to open the channel in listen
+         *        only mode, in which the adapter neither acknowledges nor
+         *        transmits frames.
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::runtime_error This exception is thrown if the
+         *        adapter refuses a command or does not answer it.
+         */
+        void
+        Open( const BitRate bitRate,
+              const bool    isListenOnly = false )
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Closes the CAN channel. Frames already in the queue can
+         *        still be read.
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::runtime_error This exception is thrown if the
+         *        adapter refuses the command or does not answer it.
+         */
+        void
+        Close()
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Enables or disables the millisecond timestamps of the
+         *        adapter. This must be called while the CAN channel is
+         *        closed. Many adapters store the setting permanently.
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::runtime_error This exception is thrown if the
+         *        adapter refuses the command or does not answer it.
+         */
+        void
+        SetAdapterTimestamps( const bool isEnabled )
+            throw( SerialPort::NotOpen,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Moves received frames out of the queue, waiting for the
+         *        first one if the queue is empty.
+         * @param frames Receives the frames.
+         * @param maxNumOfFrames The maximum number of frames to read.
+         * @param msTimeout The maximum time to wait for a frame in
+         *        milliseconds, or 0 to wait forever.
+         * @return Returns the number of frames read, which is at least
+         *         one unless maxNumOfFrames is zero.
+         * @throw SerialPort::ReadTimeout This exception is thrown if no
+         *        frame is received within msTimeout milliseconds.
+         */
+        unsigned int
+        ReadFrames( CanFrame*          frames,
+                    const unsigned int maxNumOfFrames,
+                    const unsigned int msTimeout = 0 )
+            throw( SerialPort::ReadTimeout ) ;
+
+        /**
+         * @brief Gets the number of frames waiting in the queue.
+         */
+        unsigned int
+        GetNumOfQueuedFrames() const ;
+
+        /**
+         * @brief Transmits frames. The records of all frames are encoded
+         *        into one buffer and written to the serial port with as
+         *        few writes as possible. mTimestamp, mAdapterTimestamp
+         *        and the ADAPTER_TIMESTAMP flag are ignored.
+         * @throw SerialPort::NotOpen This exception is thrown if the serial
+         *        port is not open.
+         * @throw std::invalid_argument This exception is thrown if a frame
+         *        has an identifier or length out of range. No frames are
+         *        written in that case.
+         * @throw std::runtime_error This exception is thrown if the write
+         *        fails.
+         */
+        void
+        WriteFrames( const CanFrame*    frames,
+                     const unsigned int numOfFrames )
+            throw( SerialPort::NotOpen,
+                   std::invalid_argument,
+                   std::runtime_error ) ;
+
+        /**
+         * @brief Gets a copy of the current statistics of the adapter.
+         */
+        Statistics
+        GetStatistics() const ;
+
+        /**
+         * @brief Parses data received by the serial port. This is called
+         *        from the SIGIO handler of the port.
+         */
+        void
+        HandleReceivedData( const unsigned char* dataBuffer,
+                            const unsigned int   bufferSize ) ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        SlcanAdapter( const SlcanAdapter& otherAdapter ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        SlcanAdapter& operator=( const SlcanAdapter& otherAdapter ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _SlcanAdapter_h_
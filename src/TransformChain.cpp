@@ -0,0 +1,358 @@
+/******************************************************************************
+ *   @file TransformChain.cpp                                                 *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "TransformChain.h"
+#include "TransformKernels.h"
+
+#include <atomic>
+#include <limits>
+#include <vector>
+
+namespace
+{
+    const std::string ERR_MSG_EMPTY_KEY         = "The XOR key must not be empty." ;
+    const std::string ERR_MSG_BUFFER_TOO_SMALL  = "The buffer is too small for the transformed data." ;
+    const std::string ERR_MSG_CHAIN_ATTACHED    = "A transform chain cannot be changed while it is attached to a serial port." ;
+    const std::string ERR_MSG_ALREADY_ATTACHED  = "A transform chain can only be attached to one direction of one serial port." ;
+
+    namespace Kernels = LibSerial::TransformKernels ;
+
+    enum TransformType
+    {
+        STRIP_PARITY,
+        CR_LF_TO_LF,
+        LF_TO_CR_LF,
+        REVERSE_BITS,
+        XOR_MASK
+    } ;
+
+    /*
+     * A transform and the state it carries from one chunk of data to
+     * the next.
+     */
+    struct Transform
+    {
+        TransformType              mType ;
+        Kernels::ParityCheck       mParityCheck ;
+        std::vector<unsigned char> mKeyStream ;
+        unsigned int               mKeySize ;
+        unsigned int               mKeyPosition ;
+        bool                       mIsAfterCr ;
+    } ;
+
+    Transform
+    MakeTransform( const TransformType type )
+    {
+        Transform transform ;
+        transform.mType        = type ;
+        transform.mParityCheck = Kernels::NO_PARITY_CHECK ;
+        transform.mKeySize     = 0 ;
+        transform.mKeyPosition = 0 ;
+        transform.mIsAfterCr   = false ;
+        return transform ;
+    }
+}
+
+namespace LibSerial
+{
+    class TransformChain::Implementation
+    {
+    public:
+        Implementation() :
+            mTransforms(),
+            mNumOfParityErrors(0),
+            mIsAttached(false)
+        {
+            /* empty */
+        }
+
+        /*
+         * Throw if the chain is attached to a serial port.
+         */
+        void
+        CheckNotAttached() const
+            throw( std::logic_error )
+        {
+            if ( mIsAttached )
+            {
+                throw std::logic_error( ERR_MSG_CHAIN_ATTACHED ) ;
+            }
+        }
+
+        std::vector<Transform>     mTransforms ;
+        std::atomic<unsigned long> mNumOfParityErrors ;
+        std::atomic<bool>          mIsAttached ;
+
+    private:
+        Implementation( const Implementation& ) ;
+        Implementation& operator=( const Implementation& ) ;
+    } ;
+
+    TransformChain::TransformChain() :
+        mImpl( new Implementation() )
+    {
+        /* empty */
+    }
+
+    TransformChain::~TransformChain()
+    {
+        delete mImpl ;
+    }
+
+    void
+    TransformChain::AddStripParity( const SerialPort::Parity parity )
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        Transform transform = MakeTransform( STRIP_PARITY ) ;
+        if ( SerialPort::PARITY_EVEN == parity )
+        {
+            transform.mParityCheck = Kernels::EVEN_PARITY_CHECK ;
+        }
+        else if ( SerialPort::PARITY_ODD == parity )
+        {
+            transform.mParityCheck = Kernels::ODD_PARITY_CHECK ;
+        }
+        mImpl->mTransforms.push_back( transform ) ;
+        return ;
+    }
+
+    void
+    TransformChain::AddCrLfToLf()
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        mImpl->mTransforms.push_back( MakeTransform( CR_LF_TO_LF ) ) ;
+        return ;
+    }
+
+    void
+    TransformChain::AddLfToCrLf()
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        mImpl->mTransforms.push_back( MakeTransform( LF_TO_CR_LF ) ) ;
+        return ;
+    }
+
+    void
+    TransformChain::AddReverseBits()
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        mImpl->mTransforms.push_back( MakeTransform( REVERSE_BITS ) ) ;
+        return ;
+    }
+
+    void
+    TransformChain::AddXorMask( const unsigned char* key,
+                                const unsigned int   keySize )
+        throw( std::invalid_argument,
+               std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        if ( ( NULL == key ) ||
+             ( 0 == keySize ) )
+        {
+            throw std::invalid_argument( ERR_MSG_EMPTY_KEY ) ;
+        }
+        //
+        // Repeat the key so that the 16 key bytes the vector kernel needs
+        // are contiguous wherever in the key it starts.
+        //
+        Transform transform = MakeTransform( XOR_MASK ) ;
+        transform.mKeySize = keySize ;
+        transform.mKeyStream.resize( keySize + 16 ) ;
+        for( unsigned int i = 0 ; i < transform.mKeyStream.size() ; ++i )
+        {
+            transform.mKeyStream[i] = key[ i % keySize ] ;
+        }
+        mImpl->mTransforms.push_back( transform ) ;
+        return ;
+    }
+
+    void
+    TransformChain::Clear()
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        mImpl->mTransforms.clear() ;
+        return ;
+    }
+
+    bool
+    TransformChain::IsAttached() const
+    {
+        return mImpl->mIsAttached ;
+    }
+
+    unsigned int
+    TransformChain::GetNumOfTransforms() const
+    {
+        return mImpl->mTransforms.size() ;
+    }
+
+    bool
+    TransformChain::IsExpanding() const
+    {
+        for( unsigned int i = 0 ; i < mImpl->mTransforms.size() ; ++i )
+        {
+            if ( LF_TO_CR_LF == mImpl->mTransforms[i].mType )
+            {
+                return true ;
+            }
+        }
+        return false ;
+    }
+
+    unsigned int
+    TransformChain::GetMaxOutputSize( const unsigned int size ) const
+    {
+        //
+        // Each LF to CR LF translation at most doubles the data.
+        //
+        unsigned int max_size = size ;
+        for( unsigned int i = 0 ; i < mImpl->mTransforms.size() ; ++i )
+        {
+            if ( LF_TO_CR_LF != mImpl->mTransforms[i].mType )
+            {
+                continue ;
+            }
+            if ( max_size > std::numeric_limits<unsigned int>::max() / 2 )
+            {
+                return std::numeric_limits<unsigned int>::max() ;
+            }
+            max_size *= 2 ;
+        }
+        return max_size ;
+    }
+
+    unsigned int
+    TransformChain::Apply( unsigned char*     data,
+                           const unsigned int size,
+                           const unsigned int capacity )
+        throw( std::invalid_argument )
+    {
+        if ( ( capacity < size ) ||
+             ( this->IsExpanding() && ( capacity < this->GetMaxOutputSize( size ) ) ) )
+        {
+            throw std::invalid_argument( ERR_MSG_BUFFER_TOO_SMALL ) ;
+        }
+        return this->ApplyTransforms( data,
+                                      size ) ;
+    }
+
+    void
+    TransformChain::Attach()
+        throw( std::logic_error )
+    {
+        //
+        // The state of the transforms belongs to one stream, so a
+        // second port or direction would race on it.
+        //
+        if ( mImpl->mIsAttached.exchange( true ) )
+        {
+            throw std::logic_error( ERR_MSG_ALREADY_ATTACHED ) ;
+        }
+        return ;
+    }
+
+    void
+    TransformChain::Detach()
+    {
+        mImpl->mIsAttached = false ;
+        return ;
+    }
+
+    unsigned int
+    TransformChain::ApplyTransforms( unsigned char*     data,
+                                     const unsigned int size )
+    {
+        unsigned int data_size = size ;
+        for( unsigned int i = 0 ; i < mImpl->mTransforms.size() ; ++i )
+        {
+            Transform& transform = mImpl->mTransforms[i] ;
+            switch( transform.mType )
+            {
+            case STRIP_PARITY:
+                {
+                    const unsigned int num_of_errors =
+                        Kernels::StripParity( data,
+                                              data_size,
+                                              transform.mParityCheck ) ;
+                    if ( num_of_errors > 0 )
+                    {
+                        mImpl->mNumOfParityErrors += num_of_errors ;
+                    }
+                }
+                break ;
+            case CR_LF_TO_LF:
+                data_size = Kernels::CrLfToLf( data,
+                                               data_size,
+                                               transform.mIsAfterCr ) ;
+                break ;
+            case LF_TO_CR_LF:
+                data_size = Kernels::LfToCrLf( data,
+                                               data_size,
+                                               transform.mIsAfterCr ) ;
+                break ;
+            case REVERSE_BITS:
+                Kernels::ReverseBits( data,
+                                      data_size ) ;
+                break ;
+            case XOR_MASK:
+                Kernels::XorMask( data,
+                                  data_size,
+                                  &transform.mKeyStream[0],
+                                  transform.mKeySize,
+                                  transform.mKeyPosition ) ;
+                break ;
+            }
+        }
+        return data_size ;
+    }
+
+    void
+    TransformChain::Reset()
+        throw( std::logic_error )
+    {
+        mImpl->CheckNotAttached() ;
+        this->ResetTransforms() ;
+        return ;
+    }
+
+    void
+    TransformChain::ResetTransforms()
+    {
+        for( unsigned int i = 0 ; i < mImpl->mTransforms.size() ; ++i )
+        {
+            mImpl->mTransforms[i].mKeyPosition = 0 ;
+            mImpl->mTransforms[i].mIsAfterCr   = false ;
+        }
+        return ;
+    }
+
+    unsigned long
+    TransformChain::GetNumOfParityErrors() const
+    {
+        return mImpl->mNumOfParityErrors.load() ;
+    }
+
+} // namespace LibSerial
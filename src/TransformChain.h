@@ -0,0 +1,256 @@
+/******************************************************************************
+ *   @file TransformChain.h                                                   *
+ *   @copyright                                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _TransformChain_h_
+#define _TransformChain_h_
+
+#include <ExceptionSpecification.h>
+#include <SerialPort.h>
+
+namespace LibSerial
+{
+    /**
+     * @brief An ordered list of byte transforms applied in place to a
+     *        stream of serial data, such as the conversions that legacy
+     *        devices and line codes require: stripping and checking the
+     *        parity bit of 7-bit data, translating line endings,
+     *        reversing the bit order of LSB-first devices and XOR
+     *        scrambling.
+     *
+     *        A chain attached to a serial port with
+     *        SerialPort::SetReceiveTransform() runs once on each chunk of
+     *        data read by the SIGIO handler, in the buffer it was read
+     *        into, before the data reaches the receive handler or input
+     *        buffer. A chain attached with SerialPort::SetTransmitTransform()
+     *        runs on the port's transmit buffer just before each write.
+     *
+     *        The transforms use SSE2 and SSSE3 when the processor
+     *        supports them. Transforms that depend on earlier data, such
+     *        as the position in the XOR key or a CR at the end of the
+     *        previous chunk, keep their state between calls to Apply(),
+     *        so a stream gives the same result however it is split into
+     *        chunks. Each direction of each port therefore needs a chain
+     *        of its own, and a chain can only be attached once at a time.
+     *
+     *        A chain is frozen while it is attached to a serial port:
+     *        the Add...() methods, Clear() and Reset() throw
+     *        std::logic_error until it is detached again, so neither the
+     *        transforms nor their state change while the SIGIO handler
+     *        or a writing thread applies them.
+     */
+    class TransformChain
+    {
+    public:
+        /**
+         * @brief Constructs an empty chain, which leaves data unchanged.
+         */
+        TransformChain() ;
+
+        /**
+         * @brief Destructor.
+         */
+        ~TransformChain() ;
+
+        /**
+         * @brief Appends a transform that clears bit 7 of each byte, as
+         *        needed for 7-bit data read with 8 data bits and parity
+         *        generation disabled on the port. If parity is
+         *        SerialPort::PARITY_EVEN or SerialPort::PARITY_ODD, bit 7
+         *        is first checked against the parity of bits 0 to 6 and
+         *        mismatches are counted (see GetNumOfParityErrors()).
+         */
+        void
+        AddStripParity( const SerialPort::Parity parity = SerialPort::PARITY_NONE )
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Appends a transform that replaces CR LF pairs and lone
+         *        CRs with a single LF. The data may become shorter.
+         */
+        void
+        AddCrLfToLf()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Appends a transform that inserts a CR before each LF
+         *        that is not already preceded by one. The data may become
+         *        up to twice as long, so this transform can only be used
+         *        for transmitted data.
+         */
+        void
+        AddLfToCrLf()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Appends a transform that reverses the order of the bits
+         *        in each byte.
+         */
+        void
+        AddReverseBits()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Appends a transform that XORs the data with a repeating
+         *        key, starting at the first byte of the key.
+         * @throw std::invalid_argument This exception is thrown if the
+         *        key is empty.
+         */
+        void
+        AddXorMask( const unsigned char* key,
+                    const unsigned int   keySize )
+            LIBSERIAL_THROW( std::invalid_argument,
+                             std::logic_error ) ;
+
+        /**
+         * @brief Removes all transforms from the chain.
+         */
+        void
+        Clear()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Determines if the chain is attached to a serial port and
+         *        therefore cannot be changed.
+         */
+        bool
+        IsAttached() const ;
+
+        /**
+         * @brief Gets the number of transforms in the chain.
+         */
+        unsigned int
+        GetNumOfTransforms() const ;
+
+        /**
+         * @brief Determines if the chain may make data longer.
+         */
+        bool
+        IsExpanding() const ;
+
+        /**
+         * @brief Gets the buffer size Apply() needs for size bytes of
+         *        data.
+         */
+        unsigned int
+        GetMaxOutputSize( const unsigned int size ) const ;
+
+        /**
+         * @brief Applies all transforms, in the order they were added, to
+         *        the data in place.
+         * @param data The data to transform.
+         * @param size The number of bytes of data.
+         * @param capacity The size of the buffer that holds data.
+         * @throw std::invalid_argument This exception is thrown if
+         *        capacity is smaller than GetMaxOutputSize( size ).
+         * @return Returns the number of bytes of transformed data.
+         */
+        unsigned int
+        Apply( unsigned char*     data,
+               const unsigned int size,
+               const unsigned int capacity )
+            LIBSERIAL_THROW( std::invalid_argument ) ;
+
+        /**
+         * @brief Forgets the state carried over from earlier data, so
+         *        that the next call to Apply() starts a new stream. The
+         *        parity error count is not reset. A port resets the
+         *        chains attached to it whenever it is opened.
+         * @throw std::logic_error This exception is thrown if the chain
+         *        is attached to a serial port.
+         */
+        void
+        Reset()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Gets the number of bytes with a parity error found so
+         *        far. May be called while another thread applies the
+         *        chain.
+         */
+        unsigned long
+        GetNumOfParityErrors() const ;
+
+    private:
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        copy constructor private. This method is never defined.
+         */
+        TransformChain( const TransformChain& otherChain ) ;
+
+        /**
+         * @brief Prevents copying of objects of this class by declaring the
+         *        assignment operator private. This method is never defined.
+         */
+        TransformChain& operator=( const TransformChain& otherChain ) ;
+
+        /**
+         * @brief SerialPort freezes the chains it applies, applies them
+         *        without the checks of Apply() and resets them when it is
+         *        opened.
+         */
+        friend class ::SerialPort ;
+
+        /**
+         * @brief Freezes the chain while it is attached to a port.
+         * @throw std::logic_error This exception is thrown if the chain
+         *        is already attached, to the same or another port.
+         */
+        void
+        Attach()
+            LIBSERIAL_THROW( std::logic_error ) ;
+
+        /**
+         * @brief Undoes Attach().
+         */
+        void
+        Detach() ;
+
+        /**
+         * @brief Resets the state of the transforms without the check of
+         *        Reset(), for the port the chain is attached to.
+         */
+        void
+        ResetTransforms() ;
+
+        /**
+         * @brief Applies all transforms in place. The caller guarantees
+         *        that the buffer can hold GetMaxOutputSize( size ) bytes.
+         *        Never throws, so it can run in the SIGIO handler.
+         * @return Returns the number of bytes of transformed data.
+         */
+        unsigned int
+        ApplyTransforms( unsigned char*     data,
+                         const unsigned int size ) ;
+
+        /**
+         * @brief Forward declaration of the implementation class following
+         *        the PImpl idiom.
+         */
+        class Implementation ;
+
+        /**
+         * @brief Pointer to implementation class instance.
+         */
+        Implementation* mImpl ;
+    } ;
+
+} // namespace LibSerial
+
+#endif // #ifndef _TransformChain_h_
@@ -0,0 +1,426 @@
+/******************************************************************************
+ *   @file TransformKernels.cpp                                               *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include "TransformKernels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+//
+// The library is built for the baseline instruction set, which includes
+// SSE2 on x86-64. Only the functions below use the SSSE3 byte shuffle,
+// and they are only called after IsSsse3Supported() checked the
+// processor at run time.
+//
+#define HAS_SSSE3_KERNELS
+#define SSSE3_TARGET __attribute__(( target( "ssse3" ) ))
+
+#endif // defined(__x86_64__) || defined(__i386__)
+
+namespace
+{
+    using LibSerial::TransformKernels::ParityCheck ;
+    using LibSerial::TransformKernels::EVEN_PARITY_CHECK ;
+
+    const unsigned int VECTOR_SIZE = 16 ;
+
+    const unsigned char CR = '\r' ;
+    const unsigned char LF = '\n' ;
+
+    /*
+     * The bits of each 4-bit value in reverse order.
+     */
+    const unsigned char REVERSED_NIBBLES[ VECTOR_SIZE ] =
+    {
+        0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+        0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+    } ;
+
+    /*
+     * One if the 4-bit value has an odd number of bits set.
+     */
+    const unsigned char NIBBLE_PARITY[ VECTOR_SIZE ] =
+    {
+        0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0
+    } ;
+
+    inline
+    bool
+    HasParityError( const unsigned char dataByte,
+                    const ParityCheck   parityCheck )
+    {
+        const bool is_odd = ( 0 != __builtin_parity( dataByte ) ) ;
+        return ( EVEN_PARITY_CHECK == parityCheck ) ? is_odd : ! is_odd ;
+    }
+
+    inline
+    unsigned char
+    ReverseByte( const unsigned char dataByte )
+    {
+        return ( REVERSED_NIBBLES[ dataByte & 0x0F ] << 4 ) |
+               REVERSED_NIBBLES[ dataByte >> 4 ] ;
+    }
+
+    unsigned int
+    StripParityPortable( unsigned char*     data,
+                         const unsigned int size,
+                         const ParityCheck  parityCheck )
+    {
+        unsigned int num_of_errors = 0 ;
+        for( unsigned int i = 0 ; i < size ; ++i )
+        {
+            num_of_errors += HasParityError( data[i], parityCheck ) ? 1 : 0 ;
+            data[i] &= 0x7F ;
+        }
+        return num_of_errors ;
+    }
+
+#ifdef HAS_SSSE3_KERNELS
+
+    /*
+     * Looks up 4-bit values in a 16 entry table, one per byte.
+     */
+    SSSE3_TARGET inline
+    __m128i
+    LookUpNibbles( const __m128i table,
+                   const __m128i nibbles )
+    {
+        return _mm_shuffle_epi8( table, nibbles ) ;
+    }
+
+    SSSE3_TARGET
+    unsigned int
+    StripParitySsse3( unsigned char*     data,
+                      const unsigned int size,
+                      const ParityCheck  parityCheck )
+    {
+        const __m128i low_nibbles = _mm_set1_epi8( 0x0F ) ;
+        const __m128i data_bits = _mm_set1_epi8( 0x7F ) ;
+        const __m128i parity_table =
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( NIBBLE_PARITY ) ) ;
+        //
+        // With even parity a byte with an odd number of bits set is in
+        // error, with odd parity one with an even number.
+        //
+        const __m128i error_parity =
+            _mm_set1_epi8( EVEN_PARITY_CHECK == parityCheck ? 1 : 0 ) ;
+
+        unsigned int num_of_errors = 0 ;
+        unsigned int i = 0 ;
+        for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+        {
+            __m128i* block = reinterpret_cast<__m128i*>( data + i ) ;
+            const __m128i bytes = _mm_loadu_si128( block ) ;
+            //
+            // Fold the high nibble of each byte onto the low nibble, which
+            // keeps the parity, and look up the parity of the result.
+            //
+            const __m128i folded =
+                _mm_and_si128( _mm_xor_si128( bytes, _mm_srli_epi16( bytes, 4 ) ),
+                               low_nibbles ) ;
+            const __m128i parity = LookUpNibbles( parity_table, folded ) ;
+            const int error_mask =
+                _mm_movemask_epi8( _mm_cmpeq_epi8( parity, error_parity ) ) ;
+            num_of_errors += __builtin_popcount( error_mask ) ;
+            _mm_storeu_si128( block,
+                              _mm_and_si128( bytes, data_bits ) ) ;
+        }
+        return num_of_errors + StripParityPortable( data + i,
+                                                    size - i,
+                                                    parityCheck ) ;
+    }
+
+    SSSE3_TARGET
+    void
+    ReverseBitsSsse3( unsigned char*     data,
+                      const unsigned int size )
+    {
+        const __m128i low_nibbles = _mm_set1_epi8( 0x0F ) ;
+        const __m128i reversed_low =
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( REVERSED_NIBBLES ) ) ;
+        //
+        // The table entries fit in four bits, so shifting the 16-bit
+        // lanes moves each entry to the high nibble of its own byte.
+        //
+        const __m128i reversed_high = _mm_slli_epi16( reversed_low, 4 ) ;
+
+        unsigned int i = 0 ;
+        for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+        {
+            __m128i* block = reinterpret_cast<__m128i*>( data + i ) ;
+            const __m128i bytes = _mm_loadu_si128( block ) ;
+            const __m128i low = _mm_and_si128( bytes, low_nibbles ) ;
+            const __m128i high = _mm_and_si128( _mm_srli_epi16( bytes, 4 ),
+                                                low_nibbles ) ;
+            _mm_storeu_si128( block,
+                              _mm_or_si128( LookUpNibbles( reversed_high, low ),
+                                            LookUpNibbles( reversed_low, high ) ) ) ;
+        }
+        for( ; i < size ; ++i )
+        {
+            data[i] = ReverseByte( data[i] ) ;
+        }
+        return ;
+    }
+
+#endif // #ifdef HAS_SSSE3_KERNELS
+}
+
+namespace LibSerial
+{
+    namespace TransformKernels
+    {
+        bool
+        IsSsse3Supported()
+        {
+#ifdef HAS_SSSE3_KERNELS
+            return __builtin_cpu_supports( "ssse3" ) ;
+#else
+            return false ;
+#endif
+        }
+
+        unsigned int
+        StripParity( unsigned char*     data,
+                     const unsigned int size,
+                     const ParityCheck  parityCheck )
+        {
+            if ( NO_PARITY_CHECK != parityCheck )
+            {
+#ifdef HAS_SSSE3_KERNELS
+                if ( IsSsse3Supported() )
+                {
+                    return StripParitySsse3( data,
+                                             size,
+                                             parityCheck ) ;
+                }
+#endif
+                return StripParityPortable( data,
+                                            size,
+                                            parityCheck ) ;
+            }
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            const __m128i data_bits = _mm_set1_epi8( 0x7F ) ;
+            for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+            {
+                __m128i* block = reinterpret_cast<__m128i*>( data + i ) ;
+                _mm_storeu_si128( block,
+                                  _mm_and_si128( _mm_loadu_si128( block ),
+                                                 data_bits ) ) ;
+            }
+#endif
+            for( ; i < size ; ++i )
+            {
+                data[i] &= 0x7F ;
+            }
+            return 0 ;
+        }
+
+        void
+        ReverseBits( unsigned char*     data,
+                     const unsigned int size )
+        {
+#ifdef HAS_SSSE3_KERNELS
+            if ( IsSsse3Supported() )
+            {
+                ReverseBitsSsse3( data,
+                                  size ) ;
+                return ;
+            }
+#endif
+            for( unsigned int i = 0 ; i < size ; ++i )
+            {
+                data[i] = ReverseByte( data[i] ) ;
+            }
+            return ;
+        }
+
+        void
+        XorMask( unsigned char*       data,
+                 const unsigned int   size,
+                 const unsigned char* keyStream,
+                 const unsigned int   keySize,
+                 unsigned int&        keyPosition )
+        {
+            unsigned int position = keyPosition ;
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+            {
+                __m128i* block = reinterpret_cast<__m128i*>( data + i ) ;
+                const __m128i key =
+                    _mm_loadu_si128( reinterpret_cast<const __m128i*>( keyStream + position ) ) ;
+                _mm_storeu_si128( block,
+                                  _mm_xor_si128( _mm_loadu_si128( block ),
+                                                 key ) ) ;
+                position = ( position + VECTOR_SIZE ) % keySize ;
+            }
+#endif
+            for( ; i < size ; ++i )
+            {
+                data[i] ^= keyStream[ position ] ;
+                if ( ++position == keySize )
+                {
+                    position = 0 ;
+                }
+            }
+            keyPosition = position ;
+            return ;
+        }
+
+        unsigned int
+        CrLfToLf( unsigned char*     data,
+                  const unsigned int size,
+                  bool&              isAfterCr )
+        {
+            bool is_after_cr = isAfterCr ;
+            unsigned int output_size = 0 ;
+            unsigned int i = 0 ;
+            while( i < size )
+            {
+#ifdef __SSE2__
+                //
+                // Blocks without a CR are moved as a whole, unless they
+                // may start with the LF of a CR LF pair. The output never
+                // overtakes the input, so the store only overwrites bytes
+                // that have already been loaded.
+                //
+                if ( ( i + VECTOR_SIZE <= size ) &&
+                     ( ! is_after_cr ) )
+                {
+                    const __m128i bytes =
+                        _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) ) ;
+                    const int cr_mask =
+                        _mm_movemask_epi8( _mm_cmpeq_epi8( bytes,
+                                                           _mm_set1_epi8( CR ) ) ) ;
+                    if ( 0 == cr_mask )
+                    {
+                        _mm_storeu_si128( reinterpret_cast<__m128i*>( data + output_size ),
+                                          bytes ) ;
+                        output_size += VECTOR_SIZE ;
+                        i += VECTOR_SIZE ;
+                        continue ;
+                    }
+                }
+#endif
+                const unsigned int block_end = std::min( i + VECTOR_SIZE, size ) ;
+                for( ; i < block_end ; ++i )
+                {
+                    const unsigned char data_byte = data[i] ;
+                    if ( CR == data_byte )
+                    {
+                        data[ output_size++ ] = LF ;
+                        is_after_cr = true ;
+                        continue ;
+                    }
+                    if ( ( LF != data_byte ) ||
+                         ( ! is_after_cr ) )
+                    {
+                        data[ output_size++ ] = data_byte ;
+                    }
+                    is_after_cr = false ;
+                }
+            }
+            isAfterCr = is_after_cr ;
+            return output_size ;
+        }
+
+        unsigned int
+        CountLoneLf( const unsigned char* data,
+                     const unsigned int   size,
+                     const bool           isAfterCr )
+        {
+            bool is_after_cr = isAfterCr ;
+            unsigned int num_of_lone_lf = 0 ;
+            unsigned int i = 0 ;
+#ifdef __SSE2__
+            for( ; i + VECTOR_SIZE <= size ; i += VECTOR_SIZE )
+            {
+                const __m128i bytes =
+                    _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) ) ;
+                const unsigned int lf_mask =
+                    _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( LF ) ) ) ;
+                const unsigned int cr_mask =
+                    _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( CR ) ) ) ;
+                //
+                // Bit n is set if byte n follows a CR.
+                //
+                const unsigned int after_cr_mask =
+                    ( cr_mask << 1 ) | ( is_after_cr ? 1 : 0 ) ;
+                num_of_lone_lf += __builtin_popcount( lf_mask & ~after_cr_mask ) ;
+                is_after_cr = ( 0 != ( cr_mask & 0x8000 ) ) ;
+            }
+#endif
+            for( ; i < size ; ++i )
+            {
+                if ( ( LF == data[i] ) &&
+                     ( ! is_after_cr ) )
+                {
+                    ++num_of_lone_lf ;
+                }
+                is_after_cr = ( CR == data[i] ) ;
+            }
+            return num_of_lone_lf ;
+        }
+
+        unsigned int
+        LfToCrLf( unsigned char*     data,
+                  const unsigned int size,
+                  bool&              isAfterCr )
+        {
+            if ( 0 == size )
+            {
+                return 0 ;
+            }
+            const unsigned int output_size =
+                size + CountLoneLf( data, size, isAfterCr ) ;
+            const bool is_last_cr = ( CR == data[ size - 1 ] ) ;
+            //
+            // Move the data towards the end of the buffer, starting with
+            // the last byte. Once all CRs are inserted, the rest of the
+            // data is already in place.
+            //
+            unsigned int input_end = size ;
+            unsigned int output_end = output_size ;
+            while( output_end > input_end )
+            {
+                const unsigned char data_byte = data[ --input_end ] ;
+                data[ --output_end ] = data_byte ;
+                if ( LF != data_byte )
+                {
+                    continue ;
+                }
+                const bool is_after_cr = ( input_end > 0 ) ?
+                    ( CR == data[ input_end - 1 ] ) : isAfterCr ;
+                if ( ! is_after_cr )
+                {
+                    data[ --output_end ] = CR ;
+                }
+            }
+            isAfterCr = is_last_cr ;
+            return output_size ;
+        }
+
+    } // namespace TransformKernels
+
+} // namespace LibSerial
@@ -0,0 +1,120 @@
+/******************************************************************************
+ *   @file TransformKernels.h                                                 *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by     *
+ *   the Free Software Foundation; either version 2 of the License, or        *
+ *   (at your option) any later version.                                      *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU General Public License        *
+ *   along with this program; if not, write to the                            *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _TransformKernels_h_
+#define _TransformKernels_h_
+
+namespace LibSerial
+{
+    /**
+     * @brief The byte transforms behind TransformChain. All functions
+     *        work in place and never allocate memory, so they may be
+     *        called from the SIGIO handler. Each function picks the
+     *        widest vector instructions the processor supports at run
+     *        time and falls back to portable code otherwise.
+     */
+    namespace TransformKernels
+    {
+        /**
+         * @brief The parity expected in bit 7 of each byte.
+         */
+        enum ParityCheck
+        {
+            NO_PARITY_CHECK,
+            EVEN_PARITY_CHECK,
+            ODD_PARITY_CHECK
+        } ;
+
+        /**
+         * @brief Determines if the processor has the SSSE3 byte shuffle
+         *        used by the table lookup kernels.
+         */
+        bool
+        IsSsse3Supported() ;
+
+        /**
+         * @brief Clears bit 7 of each byte after checking it against the
+         *        parity of bits 0 to 6.
+         * @return Returns the number of bytes with a parity error.
+         */
+        unsigned int
+        StripParity( unsigned char*     data,
+                     const unsigned int size,
+                     const ParityCheck  parityCheck ) ;
+
+        /**
+         * @brief Reverses the order of the bits in each byte, converting
+         *        between LSB-first and MSB-first bit order.
+         */
+        void
+        ReverseBits( unsigned char*     data,
+                     const unsigned int size ) ;
+
+        /**
+         * @brief XORs the data with a repeating key.
+         * @param keyStream The key repeated to at least keySize + 16
+         *        bytes, so that 16 bytes of key starting at any position
+         *        are contiguous.
+         * @param keySize The length of the key.
+         * @param keyPosition The position in the key of the first byte.
+         *        Receives the position of the byte following the data.
+         */
+        void
+        XorMask( unsigned char*       data,
+                 const unsigned int   size,
+                 const unsigned char* keyStream,
+                 const unsigned int   keySize,
+                 unsigned int&        keyPosition ) ;
+
+        /**
+         * @brief Replaces CR LF pairs and lone CRs with LF.
+         * @param isAfterCr Set if the byte before the data was a CR.
+         *        Receives the same for the last byte of the data.
+         * @return Returns the new size of the data.
+         */
+        unsigned int
+        CrLfToLf( unsigned char*     data,
+                  const unsigned int size,
+                  bool&              isAfterCr ) ;
+
+        /**
+         * @brief Counts the LFs not preceded by a CR.
+         */
+        unsigned int
+        CountLoneLf( const unsigned char* data,
+                     const unsigned int   size,
+                     const bool           isAfterCr ) ;
+
+        /**
+         * @brief Inserts a CR before each LF not preceded by one. The
+         *        buffer must have room for size + CountLoneLf() bytes.
+         * @param isAfterCr Set if the byte before the data was a CR.
+         *        Receives the same for the last byte of the data.
+         * @return Returns the new size of the data.
+         */
+        unsigned int
+        LfToCrLf( unsigned char*     data,
+                  const unsigned int size,
+                  bool&              isAfterCr ) ;
+
+    } // namespace TransformKernels
+
+} // namespace LibSerial
+
+#endif // #ifndef _TransformKernels_h_
@@ -0,0 +1,404 @@
+/******************************************************************************
+ *   @file AeadChannelTest.cpp                                                *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                    *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <AeadChannel.h>
+#include <AeadCiphers.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    std::vector<unsigned char> fromHex(const std::string& hex)
+    {
+        std::vector<unsigned char> bytes;
+        for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        {
+            bytes.push_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+        }
+        return bytes;
+    }
+
+    std::vector<AeadChannel::Algorithm> supportedAlgorithms()
+    {
+        std::vector<AeadChannel::Algorithm> algorithms;
+        if (AeadChannel::IsAesGcmAccelerated())
+        {
+            algorithms.push_back(AeadChannel::AES_256_GCM);
+        }
+        algorithms.push_back(AeadChannel::CHACHA20_POLY1305);
+        return algorithms;
+    }
+
+    const char* algorithmName(AeadChannel::Algorithm algorithm)
+    {
+        return AeadChannel::AES_256_GCM == algorithm ? "AES-256-GCM" : "ChaCha20-Poly1305";
+    }
+
+    /**
+     * @brief Passes the salt of each end to the other, as a handshake
+     *        would when the link comes up.
+     */
+    void exchangeSalts(AeadChannel& first, AeadChannel& second)
+    {
+        unsigned char salt[AeadChannel::SALT_SIZE];
+        first.GetLocalSalt(salt);
+        second.SetRemoteSalt(salt);
+        second.GetLocalSalt(salt);
+        first.SetRemoteSalt(salt);
+    }
+
+    /**
+     * @brief Seals a copy of the payload into a new frame.
+     */
+    std::vector<unsigned char> sealPayload(AeadChannel& sender, const std::string& payload)
+    {
+        std::vector<unsigned char> frame(payload.size() + AeadChannel::OVERHEAD);
+        std::copy(payload.begin(), payload.end(), frame.begin() + AeadChannel::HEADER_SIZE);
+        sender.Seal(frame.data(), payload.size());
+        return frame;
+    }
+}
+
+class AeadChannelTest
+    : public ::testing::Test
+{
+protected:
+    AeadChannelTest()
+        : key(AeadChannel::KEY_SIZE)
+    {
+        for (size_t i = 0; i < key.size(); i++)
+        {
+            key[i] = 0x40 + i;
+        }
+    }
+
+    std::vector<unsigned char> key;
+};
+
+TEST_F(AeadChannelTest, testAesGcmKnownAnswer)
+{
+    if (!AeadChannel::IsAesGcmAccelerated())
+    {
+        return;
+    }
+    // NIST GCM specification, test case 14.
+    const std::vector<unsigned char> zeroKey(Aead::KEY_SIZE, 0);
+    const std::vector<unsigned char> nonce(Aead::NONCE_SIZE, 0);
+    std::vector<unsigned char> data(16, 0);
+    unsigned char tag[Aead::TAG_SIZE];
+
+    Aead::AesGcmKey expandedKey;
+    Aead::AesGcmInit(expandedKey, zeroKey.data());
+    Aead::AesGcmSeal(expandedKey, nonce.data(), NULL, 0, data.data(), data.size(), tag);
+
+    ASSERT_EQ(fromHex("cea7403d4d606b6e074ec5d3baf39d18"), data);
+    ASSERT_EQ(fromHex("d0d1c8a799996bf0265b98b5d48ab919"),
+              std::vector<unsigned char>(tag, tag + sizeof(tag)));
+}
+
+TEST_F(AeadChannelTest, testChaCha20Poly1305KnownAnswer)
+{
+    // RFC 8439, section 2.8.2.
+    std::vector<unsigned char> rfcKey(Aead::KEY_SIZE);
+    for (size_t i = 0; i < rfcKey.size(); i++)
+    {
+        rfcKey[i] = 0x80 + i;
+    }
+    const std::vector<unsigned char> nonce = fromHex("070000004041424344454647");
+    const std::vector<unsigned char> additionalData = fromHex("50515253c0c1c2c3c4c5c6c7");
+    const std::string plainText = "Ladies and Gentlemen of the class of '99: If I could offer "
+                                  "you only one tip for the future, sunscreen would be it.";
+    std::vector<unsigned char> data(plainText.begin(), plainText.end());
+    unsigned char tag[Aead::TAG_SIZE];
+
+    uint32_t keyWords[8];
+    Aead::ChaCha20KeyWords(keyWords, rfcKey.data());
+    Aead::ChaCha20Poly1305Seal(keyWords, nonce.data(), additionalData.data(), additionalData.size(),
+                               data.data(), data.size(), tag);
+
+    ASSERT_EQ(fromHex("d31a8d34648e60db7b86afbc53ef7ec2"),
+              std::vector<unsigned char>(data.begin(), data.begin() + 16));
+    ASSERT_EQ(fromHex("1ae10b594f09e26a7e902ecbd0600691"),
+              std::vector<unsigned char>(tag, tag + sizeof(tag)));
+
+    ASSERT_TRUE(Aead::ChaCha20Poly1305Open(keyWords, nonce.data(), additionalData.data(),
+                                           additionalData.size(), data.data(), data.size(), tag));
+    ASSERT_EQ(plainText, std::string(data.begin(), data.end()));
+}
+
+TEST_F(AeadChannelTest, testRoundTrip)
+{
+    const std::vector<AeadChannel::Algorithm> algorithms = supportedAlgorithms();
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        AeadChannel sender(key.data(), 1, 2, algorithms[a]);
+        AeadChannel receiver(key.data(), 2, 1, algorithms[a]);
+        ASSERT_EQ(algorithms[a], sender.GetAlgorithm());
+        exchangeSalts(sender, receiver);
+
+        for (unsigned int payloadSize = 0; payloadSize < 300; payloadSize += 7)
+        {
+            std::vector<unsigned char> frame(payloadSize + AeadChannel::OVERHEAD);
+            for (unsigned int i = 0; i < payloadSize; i++)
+            {
+                frame[AeadChannel::HEADER_SIZE + i] = i * 13;
+            }
+            const std::vector<unsigned char> payload(frame.begin() + AeadChannel::HEADER_SIZE,
+                                                     frame.begin() + AeadChannel::HEADER_SIZE + payloadSize);
+
+            ASSERT_EQ(frame.size(), sender.Seal(frame.data(), payloadSize));
+            if (payloadSize >= 16)
+            {
+                ASSERT_NE(payload, std::vector<unsigned char>(frame.begin() + AeadChannel::HEADER_SIZE,
+                                                              frame.begin() + AeadChannel::HEADER_SIZE + payloadSize));
+            }
+            ASSERT_EQ(int(payloadSize), receiver.Open(frame.data(), frame.size()));
+            ASSERT_EQ(payload, std::vector<unsigned char>(frame.begin() + AeadChannel::HEADER_SIZE,
+                                                          frame.begin() + AeadChannel::HEADER_SIZE + payloadSize));
+        }
+        ASSERT_EQ(0UL, receiver.GetNumOfRejectedFrames());
+    }
+}
+
+TEST_F(AeadChannelTest, testRejectsForgedAndReplayedFrames)
+{
+    const std::vector<AeadChannel::Algorithm> algorithms = supportedAlgorithms();
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        AeadChannel sender(key.data(), 1, 2, algorithms[a]);
+        AeadChannel receiver(key.data(), 2, 1, algorithms[a]);
+        exchangeSalts(sender, receiver);
+
+        std::vector<unsigned char> first(32 + AeadChannel::OVERHEAD);
+        std::vector<unsigned char> second(32 + AeadChannel::OVERHEAD);
+        sender.Seal(first.data(), 32);
+        sender.Seal(second.data(), 32);
+        const std::vector<unsigned char> firstCopy = first;
+
+        // A flipped bit in the payload, the tag or the header.
+        const size_t positions[] = { AeadChannel::HEADER_SIZE + 5, first.size() - 1, 3 };
+        for (size_t i = 0; i < 3; i++)
+        {
+            std::vector<unsigned char> forged = first;
+            forged[positions[i]] ^= 0x01;
+            const std::vector<unsigned char> forgedCopy = forged;
+            ASSERT_EQ(-1, receiver.Open(forged.data(), forged.size()));
+            ASSERT_EQ(forgedCopy, forged);
+        }
+
+        // Frames sealed by this end cannot be reflected back to it.
+        std::vector<unsigned char> reflected = first;
+        ASSERT_EQ(-1, sender.Open(reflected.data(), reflected.size()));
+
+        // Frames may be lost, but never replayed.
+        ASSERT_EQ(32, receiver.Open(second.data(), second.size()));
+        first = firstCopy;
+        ASSERT_EQ(-1, receiver.Open(first.data(), first.size()));
+        ASSERT_EQ(-1, receiver.Open(first.data(), AeadChannel::OVERHEAD - 1));
+
+        ASSERT_EQ(5UL, receiver.GetNumOfRejectedFrames());
+    }
+}
+
+TEST_F(AeadChannelTest, testRestartedSenderUsesFreshNonces)
+{
+    const std::vector<AeadChannel::Algorithm> algorithms = supportedAlgorithms();
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        // Nothing can be sealed before the salts are exchanged.
+        AeadChannel receiver(key.data(), 2, 1, algorithms[a]);
+        std::unique_ptr<AeadChannel> sender(new AeadChannel(key.data(), 1, 2, algorithms[a]));
+        std::vector<unsigned char> frame(AeadChannel::OVERHEAD);
+        ASSERT_THROW(sender->Seal(frame.data(), 0), std::logic_error);
+
+        const std::string payloads[2] = { "first session payload", "other session payload" };
+        exchangeSalts(*sender, receiver);
+        const std::vector<unsigned char> first = sealPayload(*sender, payloads[0]);
+        std::vector<unsigned char> opened = first;
+        ASSERT_EQ(int(payloads[0].size()), receiver.Open(opened.data(), opened.size()));
+
+        // The sender restarts, and its frame counter starts at zero again.
+        // Even paired with the same receiver salt, its new salt gives it
+        // a new key.
+        unsigned char oldSalt[AeadChannel::SALT_SIZE];
+        unsigned char newSalt[AeadChannel::SALT_SIZE];
+        unsigned char receiverSalt[AeadChannel::SALT_SIZE];
+        sender->GetLocalSalt(oldSalt);
+        sender.reset(new AeadChannel(key.data(), 1, 2, algorithms[a]));
+        sender->GetLocalSalt(newSalt);
+        ASSERT_NE(0, memcmp(oldSalt, newSalt, sizeof(oldSalt)));
+        receiver.GetLocalSalt(receiverSalt);
+        sender->SetRemoteSalt(receiverSalt);
+
+        const std::vector<unsigned char> second = sealPayload(*sender, payloads[1]);
+        ASSERT_EQ(0, memcmp(first.data(), second.data(), AeadChannel::HEADER_SIZE));
+
+        // Reusing a nonce under the same key would make the XOR of the
+        // ciphertexts equal to the XOR of the plaintexts.
+        bool isKeyStreamReused = true;
+        for (size_t i = 0; i < payloads[0].size(); i++)
+        {
+            const unsigned char cipherXor = first[AeadChannel::HEADER_SIZE + i] ^
+                                            second[AeadChannel::HEADER_SIZE + i];
+            if (cipherXor != (payloads[0][i] ^ payloads[1][i]))
+            {
+                isKeyStreamReused = false;
+            }
+        }
+        ASSERT_FALSE(isKeyStreamReused);
+
+        // A channel serves one session: the receiver neither takes the
+        // new salt nor opens frames of the new session.
+        ASSERT_THROW(receiver.SetRemoteSalt(newSalt), std::logic_error);
+        opened = second;
+        ASSERT_EQ(-1, receiver.Open(opened.data(), opened.size()));
+    }
+}
+
+TEST_F(AeadChannelTest, testRejectsReplayedSession)
+{
+    const std::vector<AeadChannel::Algorithm> algorithms = supportedAlgorithms();
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        // An attacker records the salt of the sender and its frames.
+        AeadChannel sender(key.data(), 1, 2, algorithms[a]);
+        std::unique_ptr<AeadChannel> receiver(new AeadChannel(key.data(), 2, 1, algorithms[a]));
+        exchangeSalts(sender, *receiver);
+        unsigned char recordedSalt[AeadChannel::SALT_SIZE];
+        sender.GetLocalSalt(recordedSalt);
+        std::vector<std::vector<unsigned char> > recordedFrames;
+        for (int i = 0; i < 3; i++)
+        {
+            recordedFrames.push_back(sealPayload(sender, "session payload"));
+            std::vector<unsigned char> opened = recordedFrames.back();
+            ASSERT_LT(0, receiver->Open(opened.data(), opened.size()));
+        }
+
+        // Replaying the salt to the same receiver does not reopen its
+        // replay window.
+        ASSERT_THROW(receiver->SetRemoteSalt(recordedSalt), std::logic_error);
+        for (size_t i = 0; i < recordedFrames.size(); i++)
+        {
+            std::vector<unsigned char> replayed = recordedFrames[i];
+            ASSERT_EQ(-1, receiver->Open(replayed.data(), replayed.size()));
+        }
+
+        // A restarted receiver has a fresh salt, so the replayed session
+        // is sealed under a key it never derives.
+        receiver.reset(new AeadChannel(key.data(), 2, 1, algorithms[a]));
+        receiver->SetRemoteSalt(recordedSalt);
+        for (size_t i = 0; i < recordedFrames.size(); i++)
+        {
+            std::vector<unsigned char> replayed = recordedFrames[i];
+            ASSERT_EQ(-1, receiver->Open(replayed.data(), replayed.size()));
+        }
+        ASSERT_EQ(3UL, receiver->GetNumOfRejectedFrames());
+    }
+}
+
+TEST_F(AeadChannelTest, testInvalidArguments)
+{
+    ASSERT_THROW(AeadChannel(NULL, 1, 2, AeadChannel::CHACHA20_POLY1305), std::invalid_argument);
+    ASSERT_THROW(AeadChannel(key.data(), 1, 1, AeadChannel::CHACHA20_POLY1305), std::invalid_argument);
+    AeadChannel channel(key.data(), 1, 2, AeadChannel::CHACHA20_POLY1305);
+    ASSERT_THROW(channel.SetRemoteSalt(NULL), std::invalid_argument);
+}
+
+TEST_F(AeadChannelTest, testSealedFramesOverSerialPort)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    AeadChannel local(key.data(), 1, 2, AeadChannel::AUTOMATIC);
+    AeadChannel remote(key.data(), 2, 1, local.GetAlgorithm());
+    exchangeSalts(local, remote);
+
+    const std::string message = "Modbus over an encrypted radio link";
+    unsigned char frame[256];
+    memcpy(frame + AeadChannel::HEADER_SIZE, message.data(), message.size());
+    const unsigned int frameSize = local.Seal(frame, message.size());
+    serialPort.Write(frame, frameSize);
+
+    unsigned char received[256];
+    ASSERT_EQ(frameSize, pseudoTerminal.Read(received, frameSize));
+    ASSERT_EQ(int(message.size()), remote.Open(received, frameSize));
+    ASSERT_EQ(message, std::string(reinterpret_cast<char*>(received + AeadChannel::HEADER_SIZE),
+                                   message.size()));
+    serialPort.Close();
+}
+
+TEST_F(AeadChannelTest, testCpuCostPerByte)
+{
+    //
+    // Seal and open typical serial frame sizes and report the cost per
+    // payload byte, and the share of one core needed to keep up with a
+    // link running at line rate in both directions.
+    //
+    const unsigned int payloadSizes[] = { 16, 64, 250, 1024 };
+    const unsigned int lineRates[] = { 115200, 921600, 4000000 };
+    const std::vector<AeadChannel::Algorithm> algorithms = supportedAlgorithms();
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        AeadChannel sender(key.data(), 1, 2, algorithms[a]);
+        AeadChannel receiver(key.data(), 2, 1, algorithms[a]);
+        exchangeSalts(sender, receiver);
+        for (size_t s = 0; s < sizeof(payloadSizes) / sizeof(payloadSizes[0]); s++)
+        {
+            const unsigned int payloadSize = payloadSizes[s];
+            std::vector<unsigned char> frame(payloadSize + AeadChannel::OVERHEAD, 0x5A);
+            const unsigned int iterations = 4 * 1024 * 1024 / payloadSize;
+
+            const auto start = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < iterations; i++)
+            {
+                const unsigned int frameSize = sender.Seal(frame.data(), payloadSize);
+                ASSERT_EQ(int(payloadSize), receiver.Open(frame.data(), frameSize));
+            }
+            const auto stop = std::chrono::steady_clock::now();
+
+            const double nanosecondsPerByte =
+                std::chrono::duration<double, std::nano>(stop - start).count() /
+                (2.0 * iterations * payloadSize);
+            std::cout << algorithmName(algorithms[a]) << " " << payloadSize
+                      << " byte frames: " << nanosecondsPerByte << " ns/byte, CPU at line rate:";
+            for (size_t r = 0; r < sizeof(lineRates) / sizeof(lineRates[0]); r++)
+            {
+                // 10 bits per character with 8N1 framing, both directions.
+                const double bytesPerSecond = 2.0 * lineRates[r] / 10.0;
+                std::cout << " " << lineRates[r] << "bd="
+                          << 100.0 * nanosecondsPerByte * bytesPerSecond / 1e9 << "%";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+ *   @file AsioSerialPortCoroutineTest.cpp                                    *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+// Built as C++20 so that AsioSerialPort is exercised with use_awaitable.
+// The library itself stays gnu++11; see ExceptionSpecification.h.
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include <AsioSerialPort.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+TEST(AsioSerialPortCoroutineTest, testUseAwaitable)
+{
+    PseudoTerminal pseudoTerminal;
+    boost::asio::io_context ioContext;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.SetSignalDriven(false);
+    serialPort.Open(SerialPort::BAUD_115200);
+    AsioSerialPort asioPort(ioContext, serialPort);
+
+    std::string received;
+    std::size_t numOfBytesWritten = 0;
+    bool isDone = false;
+    boost::asio::co_spawn(ioContext,
+        [&]() -> boost::asio::awaitable<void>
+        {
+            numOfBytesWritten = co_await boost::asio::async_write(
+                asioPort, boost::asio::buffer("ping", 4), boost::asio::use_awaitable);
+            char buffer[4];
+            const std::size_t size = co_await boost::asio::async_read(
+                asioPort, boost::asio::buffer(buffer), boost::asio::use_awaitable);
+            received.assign(buffer, size);
+            isDone = true;
+        },
+        boost::asio::detached);
+
+    std::thread master([&]()
+    {
+        char buffer[4];
+        if (pseudoTerminal.Read(buffer, sizeof(buffer)) == sizeof(buffer) &&
+            std::string(buffer, sizeof(buffer)) == "ping")
+        {
+            pseudoTerminal.Write("pong", 4);
+        }
+    });
+    ioContext.run_for(std::chrono::seconds(2));
+    master.join();
+
+    ASSERT_TRUE(isDone);
+    ASSERT_EQ(4U, numOfBytesWritten);
+    ASSERT_EQ("pong", received);
+}
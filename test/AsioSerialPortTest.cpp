@@ -0,0 +1,461 @@
+/******************************************************************************
+ *   @file AsioSerialPortTest.cpp                                             *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/serial_port.hpp>
+#include <boost/asio/use_future.hpp>
+#include <boost/asio/write.hpp>
+
+#include <AsioSerialPort.h>
+#include <Modbus.h>
+#include <ModbusAsciiDecoder.h>
+#include <SerialPort.h>
+#include <TransformChain.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    class FrameCounter : public ModbusAsciiDecoder::FrameHandler
+    {
+    public:
+        FrameCounter() : numOfFrames(0) {}
+
+        void HandleFrame(const unsigned char*, const unsigned int)
+        {
+            numOfFrames++;
+        }
+
+        int numOfFrames;
+    };
+
+    /**
+     * @brief Echoes everything received on the master side until stopped.
+     */
+    class Echo
+    {
+    public:
+        explicit Echo(PseudoTerminal& pseudoTerminal)
+            : mPseudoTerminal(pseudoTerminal)
+            , mIsStopping(false)
+            , mThread(&Echo::run, this)
+        {
+        }
+
+        ~Echo()
+        {
+            mIsStopping = true;
+            mThread.join();
+        }
+
+    private:
+        void run()
+        {
+            unsigned char buffer[4096];
+            while (!mIsStopping)
+            {
+                pollfd poll_fd = { mPseudoTerminal.MasterFileDescriptor(), POLLIN, 0 };
+                if (poll(&poll_fd, 1, 10) <= 0)
+                {
+                    continue;
+                }
+                const ssize_t size = read(mPseudoTerminal.MasterFileDescriptor(), buffer, sizeof(buffer));
+                if (size > 0)
+                {
+                    mPseudoTerminal.Write(buffer, size);
+                }
+            }
+        }
+
+        PseudoTerminal&   mPseudoTerminal;
+        std::atomic<bool> mIsStopping;
+        std::thread       mThread;
+    };
+
+    /**
+     * @brief Times round trips of single bytes through an echo, using
+     *        only the AsyncReadStream and AsyncWriteStream operations so
+     *        that both adapters run the same code.
+     * @return Returns the median round trip in microseconds.
+     */
+    template <typename Stream>
+    double measureRoundTrip(boost::asio::io_context& ioContext, Stream& stream, int numOfRoundTrips)
+    {
+        std::vector<double> times;
+        for (int i = 0; i < numOfRoundTrips; i++)
+        {
+            unsigned char sent = i & 0xFF;
+            unsigned char received = 0;
+            const auto start = std::chrono::steady_clock::now();
+            boost::asio::async_write(stream, boost::asio::buffer(&sent, 1),
+                                     [](const boost::system::error_code&, std::size_t) {});
+            boost::asio::async_read(stream, boost::asio::buffer(&received, 1),
+                                    [](const boost::system::error_code&, std::size_t) {});
+            ioContext.restart();
+            ioContext.run();
+            times.push_back(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count());
+            if (received != sent)
+            {
+                return -1.0;
+            }
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    /**
+     * @brief Reads numOfBytes streamed by a writer thread on the master
+     *        side with a chain of async_read_some() calls.
+     * @return Returns the throughput in MB/s.
+     */
+    template <typename Stream>
+    double measureThroughput(boost::asio::io_context& ioContext, Stream& stream,
+                             PseudoTerminal& pseudoTerminal, size_t numOfBytes)
+    {
+        std::vector<unsigned char> buffer(65536);
+        size_t numOfBytesRead = 0;
+        std::function<void(const boost::system::error_code&, std::size_t)> handleRead;
+        handleRead = [&](const boost::system::error_code& error, std::size_t size)
+        {
+            numOfBytesRead += size;
+            if (!error && numOfBytesRead < numOfBytes)
+            {
+                stream.async_read_some(boost::asio::buffer(buffer), handleRead);
+            }
+        };
+        const auto start = std::chrono::steady_clock::now();
+        std::thread writer([&]()
+        {
+            std::vector<unsigned char> chunk(4096, 0x55);
+            for (size_t sent = 0; sent < numOfBytes; sent += chunk.size())
+            {
+                pseudoTerminal.Write(chunk.data(), std::min(chunk.size(), numOfBytes - sent));
+            }
+        });
+        stream.async_read_some(boost::asio::buffer(buffer), handleRead);
+        ioContext.restart();
+        ioContext.run();
+        writer.join();
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        return numOfBytesRead == numOfBytes ? numOfBytes / seconds / 1e6 : -1.0;
+    }
+}
+
+TEST(AsioSerialPortTest, testRequiresPortWithoutSignals)
+{
+    PseudoTerminal pseudoTerminal;
+    boost::asio::io_context ioContext;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    ASSERT_TRUE(serialPort.IsSignalDriven());
+    ASSERT_THROW(AsioSerialPort(ioContext, serialPort), SerialPort::NotOpen);
+
+    serialPort.Open(SerialPort::BAUD_115200);
+    ASSERT_THROW(AsioSerialPort(ioContext, serialPort), std::logic_error);
+    ASSERT_THROW(serialPort.ProcessReceivedData(), std::logic_error);
+    ASSERT_THROW(serialPort.SetSignalDriven(false), SerialPort::AlreadyOpen);
+    serialPort.Close();
+
+    serialPort.SetSignalDriven(false);
+    serialPort.Open(SerialPort::BAUD_115200);
+    ASSERT_FALSE(serialPort.IsSignalDriven());
+    ASSERT_GE(serialPort.GetFileDescriptor(), 0);
+    AsioSerialPort asioPort(ioContext, serialPort);
+    ASSERT_EQ(&serialPort, &asioPort.GetSerialPort());
+
+    // The configuration methods keep working on the adapted port.
+    asioPort.GetSerialPort().SetBaudRate(SerialPort::BAUD_9600);
+    ASSERT_EQ(SerialPort::BAUD_9600, serialPort.GetBaudRate());
+}
+
+TEST(AsioSerialPortTest, testCallbacks)
+{
+    PseudoTerminal pseudoTerminal;
+    boost::asio::io_context ioContext;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.SetSignalDriven(false);
+    serialPort.Open(SerialPort::BAUD_115200);
+    AsioSerialPort asioPort(ioContext, serialPort);
+
+    // Data that is already waiting completes the read right away, but
+    // never from within async_read_some().
+    pseudoTerminal.Write("hello", 5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    char buffer[16];
+    boost::system::error_code readError = boost::asio::error::fault;
+    std::size_t readSize = 0;
+    asioPort.async_read_some(boost::asio::buffer(buffer),
+                             [&](const boost::system::error_code& error, std::size_t size)
+                             {
+                                 readError = error;
+                                 readSize = size;
+                             });
+    ASSERT_EQ(0U, readSize);
+    ioContext.run();
+    ASSERT_FALSE(readError);
+    ASSERT_EQ("hello", std::string(buffer, readSize));
+
+    // Otherwise it waits for the data.
+    std::thread writer([&]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pseudoTerminal.Write("world", 5);
+    });
+    readSize = 0;
+    asioPort.async_read_some(boost::asio::buffer(buffer),
+                             [&](const boost::system::error_code& error, std::size_t size)
+                             {
+                                 readError = error;
+                                 readSize = size;
+                             });
+    ioContext.restart();
+    ioContext.run();
+    writer.join();
+    ASSERT_FALSE(readError);
+    ASSERT_EQ("world", std::string(buffer, readSize));
+
+    std::size_t writeSize = 0;
+    asioPort.async_write_some(boost::asio::buffer("ping", 4),
+                              [&](const boost::system::error_code&, std::size_t size)
+                              {
+                                  writeSize = size;
+                              });
+    ioContext.restart();
+    ioContext.run();
+    ASSERT_EQ(4U, writeSize);
+    ASSERT_EQ(4U, pseudoTerminal.Read(buffer, 4));
+    ASSERT_EQ("ping", std::string(buffer, 4));
+
+    // A cancelled read completes with operation_aborted.
+    asioPort.async_read_some(boost::asio::buffer(buffer),
+                             [&](const boost::system::error_code& error, std::size_t size)
+                             {
+                                 readError = error;
+                                 readSize = size;
+                             });
+    ioContext.restart();
+    ioContext.poll();
+    asioPort.cancel();
+    ioContext.run();
+    ASSERT_EQ(boost::asio::error::operation_aborted, readError);
+    ASSERT_EQ(0U, readSize);
+}
+
+TEST(AsioSerialPortTest, testHangup)
+{
+    // Closing the master side hangs up the port. Both kinds of read
+    // operation complete with an error instead of waiting for the
+    // descriptor, which stays readable, forever.
+    for (int isProcessing = 0; isProcessing < 2; isProcessing++)
+    {
+        PseudoTerminal pseudoTerminal;
+        boost::asio::io_context ioContext;
+        SerialPort serialPort(pseudoTerminal.SlaveName());
+        serialPort.SetSignalDriven(false);
+        serialPort.Open(SerialPort::BAUD_115200);
+        AsioSerialPort asioPort(ioContext, serialPort);
+
+        char buffer[16];
+        bool isComplete = false;
+        boost::system::error_code readError;
+        auto handler = [&](const boost::system::error_code& error, std::size_t)
+                       {
+                           isComplete = true;
+                           readError = error;
+                       };
+        if (isProcessing)
+        {
+            asioPort.async_process_received_data(handler);
+        }
+        else
+        {
+            asioPort.async_read_some(boost::asio::buffer(buffer), handler);
+        }
+        ioContext.poll();
+        ASSERT_FALSE(isComplete);
+
+        pseudoTerminal.HangUp();
+        ioContext.run_for(std::chrono::seconds(2));
+        ASSERT_TRUE(isComplete);
+        ASSERT_TRUE(bool(readError));
+        ASSERT_NE(boost::asio::error::operation_aborted, readError);
+        serialPort.Close();
+    }
+}
+
+TEST(AsioSerialPortTest, testFutures)
+{
+    PseudoTerminal pseudoTerminal;
+    boost::asio::io_context ioContext;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.SetSignalDriven(false);
+    serialPort.Open(SerialPort::BAUD_115200);
+    AsioSerialPort asioPort(ioContext, serialPort);
+
+    auto work = boost::asio::make_work_guard(ioContext);
+    std::thread runner([&]() { ioContext.run(); });
+
+    // The composed operations of Asio accept the adapter as a stream.
+    std::vector<unsigned char> message(10000);
+    for (size_t i = 0; i < message.size(); i++)
+    {
+        message[i] = i * 7;
+    }
+    std::future<std::size_t> written =
+        boost::asio::async_write(asioPort, boost::asio::buffer(message), boost::asio::use_future);
+    std::vector<unsigned char> received(message.size());
+    ASSERT_EQ(message.size(), pseudoTerminal.Read(received.data(), received.size()));
+    ASSERT_EQ(message.size(), written.get());
+    ASSERT_EQ(message, received);
+
+    std::future<std::size_t> read =
+        boost::asio::async_read(asioPort, boost::asio::buffer(received), boost::asio::use_future);
+    pseudoTerminal.Write(message.data(), message.size());
+    ASSERT_EQ(message.size(), read.get());
+    ASSERT_EQ(message, received);
+
+    work.reset();
+    runner.join();
+}
+
+TEST(AsioSerialPortTest, testTransformsAndReceiveHandler)
+{
+    PseudoTerminal pseudoTerminal;
+    boost::asio::io_context ioContext;
+    TransformChain receiveTransform;
+    receiveTransform.AddCrLfToLf();
+    TransformChain transmitTransform;
+    transmitTransform.AddLfToCrLf();
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.SetReceiveTransform(&receiveTransform);
+    serialPort.SetTransmitTransform(&transmitTransform);
+    serialPort.SetSignalDriven(false);
+    serialPort.Open(SerialPort::BAUD_115200);
+    AsioSerialPort asioPort(ioContext, serialPort);
+
+    pseudoTerminal.Write("a\r\nb", 4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    char buffer[16];
+    std::size_t readSize = 0;
+    asioPort.async_read_some(boost::asio::buffer(buffer),
+                             [&](const boost::system::error_code&, std::size_t size)
+                             {
+                                 readSize = size;
+                             });
+    ioContext.run();
+    ASSERT_EQ("a\nb", std::string(buffer, readSize));
+
+    std::size_t writeSize = 0;
+    asioPort.async_write_some(boost::asio::buffer("x\ny", 3),
+                              [&](const boost::system::error_code&, std::size_t size)
+                              {
+                                  writeSize = size;
+                              });
+    ioContext.restart();
+    ioContext.run();
+    ASSERT_EQ(3U, writeSize);
+    ASSERT_EQ(4U, pseudoTerminal.Read(buffer, 4));
+    ASSERT_EQ("x\r\ny", std::string(buffer, 4));
+
+    // Framing receive handlers stay attached to the port.
+    FrameCounter counter;
+    ModbusAsciiDecoder decoder(counter);
+    serialPort.SetReceiveHandler(&decoder);
+    unsigned char frame[Modbus::MAX_ASCII_FRAME_SIZE];
+    const unsigned char request[] = { 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03 };
+    const unsigned int frameSize = Modbus::EncodeAsciiFrame(request, sizeof(request), frame);
+    std::function<void(const boost::system::error_code&, std::size_t)> handleData;
+    handleData = [&](const boost::system::error_code& error, std::size_t)
+    {
+        if (!error && counter.numOfFrames < 3)
+        {
+            asioPort.async_process_received_data(handleData);
+        }
+    };
+    asioPort.async_process_received_data(handleData);
+    std::thread writer([&]()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            pseudoTerminal.Write(frame, frameSize);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+    ioContext.restart();
+    ioContext.run();
+    writer.join();
+    serialPort.SetReceiveHandler(0);
+    ASSERT_EQ(3, counter.numOfFrames);
+}
+
+TEST(AsioSerialPortTest, testBenchmarkAgainstAsioSerialPort)
+{
+    const int numOfRoundTrips = 200;
+    const size_t numOfBytes = 8 << 20;
+    double roundTrips[2];
+    double throughputs[2];
+    {
+        PseudoTerminal pseudoTerminal;
+        boost::asio::io_context ioContext;
+        SerialPort serialPort(pseudoTerminal.SlaveName());
+        serialPort.SetSignalDriven(false);
+        serialPort.Open(SerialPort::BAUD_115200);
+        AsioSerialPort asioPort(ioContext, serialPort);
+        {
+            Echo echo(pseudoTerminal);
+            roundTrips[0] = measureRoundTrip(ioContext, asioPort, numOfRoundTrips);
+        }
+        throughputs[0] = measureThroughput(ioContext, asioPort, pseudoTerminal, numOfBytes);
+    }
+    {
+        PseudoTerminal pseudoTerminal;
+        boost::asio::io_context ioContext;
+        boost::asio::serial_port serialPort(ioContext, pseudoTerminal.SlaveName());
+        serialPort.set_option(boost::asio::serial_port::baud_rate(115200));
+        {
+            Echo echo(pseudoTerminal);
+            roundTrips[1] = measureRoundTrip(ioContext, serialPort, numOfRoundTrips);
+        }
+        throughputs[1] = measureThroughput(ioContext, serialPort, pseudoTerminal, numOfBytes);
+    }
+    ASSERT_GT(roundTrips[0], 0.0);
+    ASSERT_GT(roundTrips[1], 0.0);
+    ASSERT_GT(throughputs[0], 0.0);
+    ASSERT_GT(throughputs[1], 0.0);
+    std::cout << "Median round trip: AsioSerialPort " << roundTrips[0]
+              << " us, asio::serial_port " << roundTrips[1] << " us" << std::endl;
+    std::cout << "Receive throughput: AsioSerialPort " << throughputs[0]
+              << " MB/s, asio::serial_port " << throughputs[1] << " MB/s" << std::endl;
+}
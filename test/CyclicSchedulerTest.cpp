@@ -0,0 +1,189 @@
+/******************************************************************************
+ *   @file CyclicSchedulerTest.cpp                                            *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <CyclicScheduler.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    const unsigned char* bytes(const char* text)
+    {
+        return reinterpret_cast<const unsigned char*>(text);
+    }
+
+    std::string readAll(PseudoTerminal& pseudoTerminal)
+    {
+        std::string received;
+        char buffer[4096];
+        size_t size = 0;
+        while ((size = pseudoTerminal.Read(buffer, sizeof(buffer), 50)) > 0)
+        {
+            received.append(buffer, size);
+        }
+        return received;
+    }
+
+    size_t countOf(const std::string& text, const std::string& pattern)
+    {
+        size_t count = 0;
+        for (size_t i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + 1))
+        {
+            count++;
+        }
+        return count;
+    }
+}
+
+class CyclicSchedulerTest
+    : public ::testing::Test
+{
+protected:
+    CyclicSchedulerTest()
+        : firstPort(firstTerminal.SlaveName())
+        , secondPort(secondTerminal.SlaveName())
+    {
+        firstPort.Open(SerialPort::BAUD_115200);
+        secondPort.Open(SerialPort::BAUD_115200);
+    }
+
+    PseudoTerminal firstTerminal;
+    PseudoTerminal secondTerminal;
+    SerialPort firstPort;
+    SerialPort secondPort;
+};
+
+TEST_F(CyclicSchedulerTest, testSendsMessagesAtTheirRates)
+{
+    CyclicScheduler scheduler;
+    const CyclicScheduler::MessageId fast = scheduler.AddMessage(firstPort, bytes("F;"), 2, 10000);
+    const CyclicScheduler::MessageId slow = scheduler.AddMessage(firstPort, bytes("S;"), 2, 50000, 5000);
+    const CyclicScheduler::MessageId other = scheduler.AddMessage(secondPort, bytes("O;"), 2, 20000);
+    ASSERT_EQ(3U, scheduler.GetNumOfMessages());
+
+    const auto start = std::chrono::steady_clock::now();
+    scheduler.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    scheduler.Stop();
+    const double elapsedMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const std::string first = readAll(firstTerminal);
+    const std::string second = readAll(secondTerminal);
+    ASSERT_EQ(scheduler.GetStatistics(fast).mNumOfTransmissions, countOf(first, "F;"));
+    ASSERT_EQ(scheduler.GetStatistics(slow).mNumOfTransmissions, countOf(first, "S;"));
+    ASSERT_EQ(scheduler.GetStatistics(other).mNumOfTransmissions, countOf(second, "O;"));
+
+    // Every period is accounted for, either sent or missed.
+    const CyclicScheduler::MessageId ids[] = { fast, slow, other };
+    const double periodsMs[] = { 10.0, 50.0, 20.0 };
+    const double phasesMs[] = { 0.0, 5.0, 0.0 };
+    for (size_t i = 0; i < 3; i++)
+    {
+        const CyclicScheduler::Statistics statistics = scheduler.GetStatistics(ids[i]);
+        ASSERT_NEAR((elapsedMs - phasesMs[i]) / periodsMs[i],
+                    statistics.mNumOfTransmissions + statistics.mNumOfMissedDeadlines, 2.0);
+        std::cout << "Message " << ids[i] << ": " << statistics.mNumOfTransmissions
+                  << " sent, " << statistics.mNumOfMissedDeadlines << " missed, lateness mean "
+                  << statistics.mMeanLatenessMicroseconds << "us max "
+                  << statistics.mMaxLatenessMicroseconds << "us, period jitter max "
+                  << statistics.mMaxPeriodJitterMicroseconds << "us" << std::endl;
+    }
+    ASSERT_EQ(0UL, scheduler.GetNumOfFailedWrites());
+}
+
+TEST_F(CyclicSchedulerTest, testBatchesMessagesDueTogether)
+{
+    CyclicScheduler scheduler;
+    scheduler.AddMessage(firstPort, bytes("A;"), 2, 20000);
+    scheduler.AddMessage(firstPort, bytes("B;"), 2, 20000);
+    scheduler.AddMessage(firstPort, bytes("C;"), 2, 20000, 1000);
+    scheduler.SetBatchWindow(2000);
+
+    scheduler.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.Stop();
+
+    // Every write carries all three messages in order of their due time.
+    const std::string received = readAll(firstTerminal);
+    const size_t numOfBatches = countOf(received, "A;B;C;");
+    ASSERT_GT(numOfBatches, 5U);
+    ASSERT_EQ(3 * numOfBatches * 2, received.size());
+    ASSERT_EQ(numOfBatches, scheduler.GetNumOfWrites());
+}
+
+TEST_F(CyclicSchedulerTest, testPayloadUpdates)
+{
+    CyclicScheduler scheduler;
+    const CyclicScheduler::MessageId status = scheduler.AddMessage(firstPort, bytes("[0000]"), 6, 5000);
+
+    scheduler.Start();
+    for (int i = 1; i <= 20; i++)
+    {
+        char payload[8];
+        snprintf(payload, sizeof(payload), "[%04d]", i);
+        scheduler.UpdatePayload(status, bytes(payload), 6);
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    scheduler.Stop();
+
+    // Every transmission carries a complete payload, and the values
+    // never go backwards.
+    const std::string received = readAll(firstTerminal);
+    ASSERT_EQ(0U, received.size() % 6);
+    int previous = -1;
+    for (size_t i = 0; i < received.size(); i += 6)
+    {
+        ASSERT_EQ('[', received[i]);
+        ASSERT_EQ(']', received[i + 5]);
+        const int value = std::stoi(received.substr(i + 1, 4));
+        ASSERT_GE(value, previous);
+        previous = value;
+    }
+    ASSERT_EQ(20, previous);
+
+    // Shorter payloads are allowed, longer ones are not.
+    scheduler.UpdatePayload(status, bytes("[ok]"), 4);
+    ASSERT_THROW(scheduler.UpdatePayload(status, bytes("[00000]"), 7), std::invalid_argument);
+}
+
+TEST_F(CyclicSchedulerTest, testInvalidArguments)
+{
+    CyclicScheduler scheduler;
+    ASSERT_THROW(scheduler.AddMessage(firstPort, bytes("x"), 0, 1000), std::invalid_argument);
+    ASSERT_THROW(scheduler.AddMessage(firstPort, bytes("x"), 1, 0), std::invalid_argument);
+    ASSERT_THROW(scheduler.UpdatePayload(0, bytes("x"), 1), std::out_of_range);
+    ASSERT_THROW(scheduler.GetStatistics(0), std::out_of_range);
+
+    scheduler.AddMessage(firstPort, bytes("x"), 1, 1000000);
+    scheduler.Start();
+    ASSERT_THROW(scheduler.AddMessage(firstPort, bytes("y"), 1, 1000), std::logic_error);
+    scheduler.Stop();
+}
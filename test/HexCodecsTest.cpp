@@ -0,0 +1,447 @@
+/******************************************************************************
+ *   @file HexCodecsTest.cpp                                                  *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <AsciiHex.h>
+#include <HexImage.h>
+#include <MappedFile.h>
+#include <Modbus.h>
+#include <ModbusAsciiDecoder.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    std::vector<unsigned char> makeRandomData(size_t size, unsigned int seed)
+    {
+        std::mt19937 generator(seed);
+        std::vector<unsigned char> data(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = generator() & 0xFF;
+        }
+        return data;
+    }
+
+    const unsigned char* bytes(const std::string& text)
+    {
+        return reinterpret_cast<const unsigned char*>(text.data());
+    }
+
+    /**
+     * @brief Feeds text to a receive handler in chunks of varying size.
+     */
+    void feedInChunks(SerialPortReceiveHandler& handler, const std::string& text, unsigned int seed)
+    {
+        std::mt19937 generator(seed);
+        size_t position = 0;
+        while (position < text.size())
+        {
+            const size_t size = std::min<size_t>(generator() % 40 + 1, text.size() - position);
+            handler.HandleReceivedData(bytes(text) + position, size);
+            position += size;
+        }
+    }
+
+    class FrameCollector : public ModbusAsciiDecoder::FrameHandler
+    {
+    public:
+        void HandleFrame(const unsigned char* frame, const unsigned int frameSize)
+        {
+            frames.push_back(std::vector<unsigned char>(frame, frame + frameSize));
+        }
+
+        std::vector<std::vector<unsigned char> > frames;
+    };
+
+    /**
+     * @brief Collects decoded data records into a sparse memory image.
+     */
+    class ImageCollector : public HexImageHandler
+    {
+    public:
+        ImageCollector()
+            : startAddress(0)
+            , numOfEnds(0)
+        {
+        }
+
+        void HandleData(const unsigned long address, const unsigned char* data, const unsigned int size)
+        {
+            for (unsigned int i = 0; i < size; i++)
+            {
+                memory[address + i] = data[i];
+            }
+        }
+
+        void HandleStartAddress(const unsigned long address)
+        {
+            startAddress = address;
+        }
+
+        void HandleEnd()
+        {
+            numOfEnds++;
+        }
+
+        bool contains(const std::vector<unsigned char>& image, unsigned long baseAddress) const
+        {
+            if (memory.size() != image.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < image.size(); i++)
+            {
+                std::map<unsigned long, unsigned char>::const_iterator it = memory.find(baseAddress + i);
+                if (it == memory.end() || it->second != image[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::map<unsigned long, unsigned char> memory;
+        unsigned long startAddress;
+        int numOfEnds;
+    };
+
+    std::string encodeAll(HexImageEncoder& encoder, unsigned int bufferSize)
+    {
+        std::string text;
+        std::vector<unsigned char> buffer(bufferSize);
+        unsigned int size = 0;
+        while ((size = encoder.Encode(buffer.data(), buffer.size())) > 0)
+        {
+            text.append(buffer.begin(), buffer.begin() + size);
+        }
+        return text;
+    }
+}
+
+TEST(HexCodecsTest, testAsciiHexRoundTrip)
+{
+    const std::vector<unsigned char> data = makeRandomData(300, 1);
+    for (unsigned int size = 0; size <= data.size(); size += (size < 70 ? 1 : 23))
+    {
+        std::vector<unsigned char> text(2 * size);
+        unsigned int expectedSum = 0;
+        for (unsigned int i = 0; i < size; i++)
+        {
+            char digits[3];
+            snprintf(digits, sizeof(digits), "%02X", data[i]);
+            text[2 * i] = digits[0];
+            text[2 * i + 1] = digits[1];
+            expectedSum += data[i];
+        }
+        std::vector<unsigned char> encoded(2 * size);
+        ASSERT_EQ(expectedSum, AsciiHex::Encode(data.data(), size, encoded.data()));
+        ASSERT_EQ(text, encoded);
+
+        // Lower case digits decode as well.
+        for (size_t i = 0; i < text.size(); i += 3)
+        {
+            text[i] = tolower(text[i]);
+        }
+        std::vector<unsigned char> decoded(size);
+        unsigned int sum = 0;
+        ASSERT_EQ(2 * size, AsciiHex::Decode(text.data(), text.size(), decoded.data(), sum));
+        ASSERT_EQ(expectedSum, sum);
+        ASSERT_TRUE(std::equal(decoded.begin(), decoded.end(), data.begin()));
+    }
+
+    // Decoding stops before the pair holding the first other character.
+    std::vector<unsigned char> text(200);
+    AsciiHex::Encode(data.data(), 100, text.data());
+    for (unsigned int stop = 0; stop < 100; stop++)
+    {
+        std::vector<unsigned char> damaged(text);
+        damaged[stop] = 'g';
+        std::vector<unsigned char> decoded(100);
+        unsigned int sum = 0;
+        ASSERT_EQ(stop & ~1U, AsciiHex::Decode(damaged.data(), damaged.size(), decoded.data(), sum));
+    }
+}
+
+TEST(HexCodecsTest, testNibbleValues)
+{
+    // Every character value, at every position of a vector.
+    std::vector<unsigned char> text(256 + 15);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        text[i] = i & 0xFF;
+    }
+    std::vector<unsigned char> values(text.size());
+    AsciiHex::NibbleValues(text.data(), text.size(), values.data());
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        const std::string digits = "0123456789abcdef";
+        const size_t value = digits.find(tolower(text[i]));
+        if (value == std::string::npos)
+        {
+            ASSERT_EQ(AsciiHex::INVALID_NIBBLE, values[i]) << i;
+        }
+        else
+        {
+            ASSERT_EQ(value, values[i]) << i;
+        }
+    }
+}
+
+TEST(HexCodecsTest, testModbusAsciiFrames)
+{
+    // Read three holding registers from slave 17, as in the Modbus
+    // over serial line specification.
+    const unsigned char request[] = { 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03 };
+    unsigned char text[Modbus::MAX_ASCII_FRAME_SIZE];
+    ASSERT_EQ(17U, Modbus::EncodeAsciiFrame(request, sizeof(request), text));
+    ASSERT_EQ(":1103006B00037E\r\n", std::string(text, text + 17));
+    ASSERT_EQ(0x7E, Modbus::Lrc(request, sizeof(request)));
+    ASSERT_THROW(Modbus::EncodeAsciiFrame(request, 1, text), std::invalid_argument);
+
+    std::string stream = "noise:";
+    std::vector<std::vector<unsigned char> > expected;
+    for (unsigned int i = 0; i < 30; i++)
+    {
+        std::vector<unsigned char> frame = makeRandomData(2 + i * 8, i);
+        const unsigned int size = Modbus::EncodeAsciiFrame(frame.data(), frame.size(), text);
+        stream.append(text, text + size);
+        expected.push_back(frame);
+    }
+    const unsigned int lastSize = Modbus::EncodeAsciiFrame(request, sizeof(request), text);
+    std::string badLrc(text, text + lastSize);
+    badLrc[lastSize - 3] = 'F';
+    stream += badLrc + ":1103006B0003\r\n" + ":1103006B00037\r\n" + ":11xx\r\n";
+    stream.append(text, text + lastSize);
+    expected.push_back(std::vector<unsigned char>(request, request + sizeof(request)));
+
+    for (unsigned int seed = 0; seed < 5; seed++)
+    {
+        FrameCollector collector;
+        ModbusAsciiDecoder decoder(collector);
+        feedInChunks(decoder, stream, seed);
+        ASSERT_EQ(expected, collector.frames);
+        ASSERT_EQ(expected.size(), decoder.GetNumOfFrames());
+        ASSERT_EQ(2UL, decoder.GetNumOfLrcErrors());
+        // The frame interrupted by the next colon, the odd number of
+        // digits and the invalid digits.
+        ASSERT_EQ(3UL, decoder.GetNumOfMalformedFrames());
+    }
+}
+
+TEST(HexCodecsTest, testKnownRecords)
+{
+    const std::string intelHex =
+        ":10010000214601360121470136007EFE09D2190140\r\n"
+        ":020000040800F2\r\n"
+        ":0400000300003800C1\r\n"
+        ":04000000DEADBEEFC4\r\n"
+        ":00000001FF\r\n";
+    ImageCollector intelImage;
+    HexImageDecoder intelDecoder(INTEL_HEX, intelImage);
+    feedInChunks(intelDecoder, intelHex, 1);
+    ASSERT_EQ(5UL, intelDecoder.GetNumOfRecords());
+    ASSERT_EQ(0UL, intelDecoder.GetNumOfChecksumErrors());
+    ASSERT_TRUE(intelDecoder.IsComplete());
+    ASSERT_EQ(20U, intelImage.memory.size());
+    ASSERT_EQ(0x21, intelImage.memory[0x100]);
+    ASSERT_EQ(0x01, intelImage.memory[0x10F]);
+    ASSERT_EQ(0xDE, intelImage.memory[0x08000000]);
+    ASSERT_EQ(0x3800U, intelImage.startAddress);
+    ASSERT_EQ(1, intelImage.numOfEnds);
+
+    const std::string sRecords =
+        "S00F000068656C6C6F202020202000003C\r\n"
+        "S11F00007C0802A6900100049421FFF07C6C1B787C8C23783C6000003863000026\r\n"
+        "S5030001FB\r\n"
+        "S9030000FC\r\n";
+    ImageCollector sImage;
+    HexImageDecoder sDecoder(S_RECORD, sImage);
+    feedInChunks(sDecoder, sRecords, 2);
+    ASSERT_EQ(4UL, sDecoder.GetNumOfRecords());
+    ASSERT_EQ(0UL, sDecoder.GetNumOfChecksumErrors());
+    ASSERT_EQ(0UL, sDecoder.GetNumOfMalformedRecords());
+    ASSERT_TRUE(sDecoder.IsComplete());
+    ASSERT_EQ(28U, sImage.memory.size());
+    ASSERT_EQ(0x7C, sImage.memory[0]);
+    ASSERT_EQ(0x00, sImage.memory[27]);
+
+    // Damaged records are counted and dropped.
+    sDecoder.Reset();
+    feedInChunks(sDecoder, "S1050000AABB00\r\nS5030002FA\r\nS4030000FC\r\nS9030000FB\r\n", 3);
+    ASSERT_EQ(2UL, sDecoder.GetNumOfChecksumErrors());
+    ASSERT_EQ(2UL, sDecoder.GetNumOfMalformedRecords());
+    ASSERT_FALSE(sDecoder.IsComplete());
+}
+
+TEST(HexCodecsTest, testImageRoundTrip)
+{
+    const std::vector<unsigned char> image = makeRandomData(200000, 3);
+    const unsigned long baseAddresses[] = { 0x0, 0x1000, 0x0800F123, 0x00FF8000 };
+    const HexImageFormat formats[] = { INTEL_HEX, S_RECORD };
+    for (size_t f = 0; f < 2; f++)
+    {
+        for (size_t b = 0; b < 4; b++)
+        {
+            HexImageEncoder encoder(formats[f], image.data(), image.size(), baseAddresses[b], 250 - 16 * b);
+            encoder.SetStartAddress(baseAddresses[b] + 4);
+            const std::string text = encodeAll(encoder, encoder.GetMaxRecordSize() + 100);
+            ASSERT_TRUE(encoder.IsComplete());
+
+            ImageCollector collector;
+            HexImageDecoder decoder(formats[f], collector);
+            feedInChunks(decoder, text, b);
+            ASSERT_EQ(0UL, decoder.GetNumOfChecksumErrors());
+            ASSERT_EQ(0UL, decoder.GetNumOfMalformedRecords());
+            ASSERT_TRUE(decoder.IsComplete());
+            ASSERT_TRUE(collector.contains(image, baseAddresses[b]));
+            ASSERT_EQ(baseAddresses[b] + 4, collector.startAddress);
+            ASSERT_EQ(1, collector.numOfEnds);
+
+            // Encoding again after a rewind gives the same records.
+            encoder.Rewind();
+            ASSERT_EQ(text, encodeAll(encoder, 4096));
+        }
+    }
+
+    // S-records use the shortest addresses that fit.
+    HexImageEncoder small(S_RECORD, image.data(), 16, 0x100, 16);
+    const std::string text = encodeAll(small, 256);
+    ASSERT_EQ("S0030000FC\r\nS113", text.substr(0, 16));
+    ASSERT_NE(std::string::npos, text.find("\r\nS5030001FB\r\nS9030000FC\r\n"));
+
+    ASSERT_THROW(HexImageEncoder(INTEL_HEX, image.data(), 16, 0, 0), std::invalid_argument);
+    ASSERT_THROW(HexImageEncoder(INTEL_HEX, image.data(), 16, 0, 256), std::invalid_argument);
+    ASSERT_THROW(HexImageEncoder(S_RECORD, image.data(), 16, 0xFFFFFF00, 251), std::invalid_argument);
+    ASSERT_THROW(HexImageEncoder(INTEL_HEX, image.data(), 16, 0xFFFFFFF8), std::invalid_argument);
+    unsigned char buffer[16];
+    ASSERT_THROW(small.Encode(buffer, sizeof(buffer)), std::invalid_argument);
+
+    // A start address that needs longer S-record addresses than records
+    // of the requested size leave room for is refused, and the encoder
+    // still writes valid records.
+    HexImageEncoder full(S_RECORD, image.data(), 1000, 0x100, 252);
+    ASSERT_THROW(full.SetStartAddress(0x01000000), std::invalid_argument);
+    ImageCollector collector;
+    HexImageDecoder decoder(S_RECORD, collector);
+    feedInChunks(decoder, encodeAll(full, full.GetMaxRecordSize()), 4);
+    ASSERT_EQ(0UL, decoder.GetNumOfChecksumErrors());
+    ASSERT_EQ(0UL, decoder.GetNumOfMalformedRecords());
+    ASSERT_TRUE(decoder.IsComplete());
+    ASSERT_TRUE(collector.contains(std::vector<unsigned char>(image.begin(), image.begin() + 1000), 0x100));
+    ASSERT_EQ(0UL, collector.startAddress);
+}
+
+TEST(HexCodecsTest, testStreamsMappedFileThroughSerialPort)
+{
+    // A firmware image in a file is encoded straight from the mapping
+    // and decoded by a receive handler on the other end of the line.
+    char fileName[] = "/tmp/HexCodecsTestXXXXXX";
+    const int fileDescriptor = mkstemp(fileName);
+    ASSERT_GE(fileDescriptor, 0);
+    const std::vector<unsigned char> image = makeRandomData(100000, 4);
+    ASSERT_EQ(static_cast<ssize_t>(image.size()), write(fileDescriptor, image.data(), image.size()));
+    close(fileDescriptor);
+
+    {
+        MappedFile file(fileName);
+        ASSERT_EQ(image.size(), file.GetSize());
+        HexImageEncoder encoder(INTEL_HEX, file.GetData(), file.GetSize(), 0x20000000);
+
+        PseudoTerminal pseudoTerminal;
+        SerialPort serialPort(pseudoTerminal.SlaveName());
+        serialPort.Open(SerialPort::BAUD_115200);
+        ImageCollector collector;
+        HexImageDecoder decoder(INTEL_HEX, collector);
+        serialPort.SetReceiveHandler(&decoder);
+
+        std::vector<unsigned char> buffer(4096);
+        unsigned int size = 0;
+        while ((size = encoder.Encode(buffer.data(), buffer.size())) > 0)
+        {
+            pseudoTerminal.Write(buffer.data(), size);
+        }
+        for (int i = 0; i < 200 && !decoder.IsComplete(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        serialPort.SetReceiveHandler(0);
+        ASSERT_TRUE(decoder.IsComplete());
+        ASSERT_EQ(0UL, decoder.GetNumOfChecksumErrors());
+        ASSERT_TRUE(collector.contains(image, 0x20000000));
+    }
+    unlink(fileName);
+
+    ASSERT_THROW(MappedFile("/nonexistent/image.bin"), std::runtime_error);
+}
+
+TEST(HexCodecsTest, testThroughput)
+{
+    const std::vector<unsigned char> image = makeRandomData(4 << 20, 5);
+    HexImageEncoder encoder(INTEL_HEX, image.data(), image.size(), 0, 255);
+    std::vector<unsigned char> buffer(1 << 16);
+
+    auto start = std::chrono::steady_clock::now();
+    std::string text;
+    unsigned int size = 0;
+    while ((size = encoder.Encode(buffer.data(), buffer.size())) > 0)
+    {
+        text.append(buffer.begin(), buffer.begin() + size);
+    }
+    const double encodeSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    class CountingHandler : public HexImageHandler
+    {
+    public:
+        CountingHandler() : numOfBytes(0) {}
+        void HandleData(const unsigned long, const unsigned char*, const unsigned int size)
+        {
+            numOfBytes += size;
+        }
+        unsigned long numOfBytes;
+    } counter;
+    HexImageDecoder decoder(INTEL_HEX, counter);
+    start = std::chrono::steady_clock::now();
+    for (size_t position = 0; position < text.size(); position += 1024)
+    {
+        decoder.HandleReceivedData(bytes(text) + position, std::min<size_t>(1024, text.size() - position));
+    }
+    const double decodeSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_TRUE(decoder.IsComplete());
+    ASSERT_EQ(image.size(), counter.numOfBytes);
+    std::cout << "Intel HEX encode: " << text.size() / encodeSeconds / 1e6 << " MB/s of text, decode: "
+              << text.size() / decodeSeconds / 1e6 << " MB/s of text" << std::endl;
+}
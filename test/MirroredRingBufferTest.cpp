@@ -0,0 +1,210 @@
+/******************************************************************************
+ *   @file MirroredRingBufferTest.cpp                                         *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include <MirroredRingBuffer.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    std::vector<unsigned char> makePattern(size_t size, unsigned int seed)
+    {
+        std::vector<unsigned char> pattern(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            pattern[i] = (i * 7 + seed) & 0xFF;
+        }
+        return pattern;
+    }
+}
+
+TEST(MirroredRingBufferTest, testCapacityIsRoundedUp)
+{
+    MirroredRingBuffer ring(5000);
+    ASSERT_GE(ring.GetCapacity(), 5000U);
+    ASSERT_EQ(0U, ring.GetCapacity() & (ring.GetCapacity() - 1));
+    ASSERT_EQ(0U, ring.GetSize());
+    ASSERT_EQ(ring.GetCapacity(), ring.GetFreeSpace());
+
+    ASSERT_THROW(MirroredRingBuffer(0), std::invalid_argument);
+}
+
+TEST(MirroredRingBufferTest, testWrappedDataIsContiguous)
+{
+    MirroredRingBuffer ring(4096);
+    if (!ring.IsMirrored())
+    {
+        return;
+    }
+    const unsigned int capacity = ring.GetCapacity();
+
+    // Move the read position close to the end of the storage.
+    const std::vector<unsigned char> filler(capacity - 100, 0);
+    ASSERT_EQ(filler.size(), ring.Write(filler.data(), filler.size()));
+    ring.Consume(filler.size());
+
+    const std::vector<unsigned char> data = makePattern(1000, 3);
+    ASSERT_EQ(data.size(), ring.Write(data.data(), data.size()));
+
+    unsigned int spanSize = 0;
+    const unsigned char* span = ring.GetReadSpan(spanSize);
+    ASSERT_EQ(data.size(), spanSize);
+    ASSERT_EQ(0, memcmp(data.data(), span, spanSize));
+
+    // The second mapping shows the same memory.
+    unsigned int writeSpanSize = 0;
+    unsigned char* writeSpan = ring.GetWriteSpan(writeSpanSize);
+    ASSERT_EQ(capacity - data.size(), writeSpanSize);
+    writeSpan[0] = 0xA5;
+    ASSERT_EQ(0xA5, writeSpan[capacity]);
+
+    ASSERT_THROW(ring.Consume(spanSize + 1), std::out_of_range);
+    ASSERT_THROW(ring.Commit(writeSpanSize + 1), std::out_of_range);
+}
+
+TEST(MirroredRingBufferTest, testFallbackSplitsAtWrap)
+{
+    MirroredRingBuffer ring(4096, false);
+    ASSERT_FALSE(ring.IsMirrored());
+    const unsigned int capacity = ring.GetCapacity();
+
+    const std::vector<unsigned char> filler(capacity - 100, 0);
+    ring.Write(filler.data(), filler.size());
+    ring.Consume(filler.size());
+
+    const std::vector<unsigned char> data = makePattern(1000, 5);
+    ASSERT_EQ(data.size(), ring.Write(data.data(), data.size()));
+
+    unsigned int spanSize = 0;
+    const unsigned char* span = ring.GetReadSpan(spanSize);
+    ASSERT_EQ(100U, spanSize);
+    ASSERT_EQ(0, memcmp(data.data(), span, spanSize));
+    ring.Consume(spanSize);
+    span = ring.GetReadSpan(spanSize);
+    ASSERT_EQ(900U, spanSize);
+    ASSERT_EQ(0, memcmp(data.data() + 100, span, spanSize));
+
+    // Write() stops when the buffer is full.
+    ring.Consume(spanSize);
+    const std::vector<unsigned char> tooMuch(capacity + 10, 1);
+    ASSERT_EQ(capacity, ring.Write(tooMuch.data(), tooMuch.size()));
+    ASSERT_EQ(0U, ring.GetFreeSpace());
+}
+
+TEST(MirroredRingBufferTest, testConcurrentProducerAndConsumer)
+{
+    MirroredRingBuffer ring(4096);
+    const std::vector<unsigned char> data = makePattern(1 << 20, 11);
+
+    std::thread producer([&ring, &data]()
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            written += ring.Write(data.data() + written,
+                                  std::min<size_t>(data.size() - written, 777));
+        }
+    });
+
+    std::vector<unsigned char> received;
+    while (received.size() < data.size())
+    {
+        unsigned int spanSize = 0;
+        const unsigned char* span = ring.GetReadSpan(spanSize);
+        received.insert(received.end(), span, span + spanSize);
+        ring.Consume(spanSize);
+    }
+    producer.join();
+    ASSERT_EQ(data, received);
+}
+
+TEST(MirroredRingBufferTest, testSerialPortReceiveRing)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.SetReceiveBufferCapacity(4096);
+    serialPort.Open(SerialPort::BAUD_115200);
+    ASSERT_THROW(serialPort.SetReceiveBufferCapacity(0), SerialPort::AlreadyOpen);
+
+    //
+    // Stream several times the capacity through the ring, consuming it
+    // in uneven steps so that the data keeps crossing the wrap-around.
+    //
+    const std::vector<unsigned char> data = makePattern(64 * 1024, 17);
+    std::vector<unsigned char> received;
+    size_t written = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (received.size() < data.size() &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        if (written < data.size())
+        {
+            const size_t chunk = std::min<size_t>(data.size() - written, 1500);
+            pseudoTerminal.Write(data.data() + written, chunk);
+            written += chunk;
+        }
+        // Drain the chunk before writing the next so that the ring never
+        // overflows.
+        while (received.size() < written)
+        {
+            unsigned int size = 0;
+            const unsigned char* receivedData = serialPort.GetReceivedData(size);
+            if (0 == size)
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (serialPort.IsReceiveBufferMirrored())
+            {
+                ASSERT_EQ(0, memcmp(data.data() + received.size(), receivedData, size));
+            }
+            const unsigned int step = std::min(size, 333U);
+            received.insert(received.end(), receivedData, receivedData + step);
+            serialPort.ConsumeReceivedData(step);
+        }
+    }
+    ASSERT_EQ(data, received);
+
+    // The byte-oriented methods read from the ring as well.
+    pseudoTerminal.Write("ok\n", 3);
+    ASSERT_EQ("ok\n", serialPort.ReadLine(1000));
+    ASSERT_FALSE(serialPort.IsDataAvailable());
+    serialPort.Close();
+
+    ASSERT_THROW(serialPort.ConsumeReceivedData(0), SerialPort::NotOpen);
+    serialPort.SetReceiveBufferCapacity(0);
+    serialPort.Open(SerialPort::BAUD_115200);
+    unsigned int size = 0;
+    ASSERT_THROW(serialPort.GetReceivedData(size), std::logic_error);
+    serialPort.Close();
+}
@@ -0,0 +1,400 @@
+/******************************************************************************
+ *   @file ModbusGatewayTest.cpp                                              *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                    *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <Modbus.h>
+#include <ModbusGateway.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+class ModbusGatewayTest
+    : public ::testing::Test
+{
+public:
+    ModbusGatewayTest()
+        : serialPort(pseudoTerminal.SlaveName()),
+          gateway(serialPort, 0, "127.0.0.1"),
+          slaveRunning(false),
+          slaveDelayMilliseconds(0),
+          slaveThread(),
+          slaveMutex(),
+          slaveRequests()
+    {
+    }
+
+protected:
+
+    //
+    // The simulated slave never answers requests for this unit.
+    //
+    static const unsigned char silentUnit = 99;
+
+    PseudoTerminal           pseudoTerminal;
+    SerialPort               serialPort;
+    ModbusGateway            gateway;
+    std::atomic<bool>        slaveRunning;
+    std::atomic<int>         slaveDelayMilliseconds;
+    std::thread              slaveThread;
+    std::mutex               slaveMutex;
+    std::vector<std::vector<unsigned char> > slaveRequests;
+
+    virtual void SetUp()
+    {
+        serialPort.Open(SerialPort::BAUD_115200);
+        slaveRunning = true;
+        slaveThread = std::thread(&ModbusGatewayTest::simulateSlaves, this);
+        gateway.SetResponseTimeout(100);
+        gateway.Start();
+    }
+
+    virtual void TearDown()
+    {
+        gateway.Stop();
+        slaveRunning = false;
+        slaveThread.join();
+        serialPort.Close();
+    }
+
+    /**
+     * @brief Answers requests on the master side of the pseudo terminal.
+     *        Holding register n holds 0x100 + n and writes are echoed.
+     */
+    void simulateSlaves()
+    {
+        while (slaveRunning)
+        {
+            std::vector<unsigned char> frame(2);
+            if (pseudoTerminal.Read(frame.data(), 2, 20) != 2)
+            {
+                continue;
+            }
+            const unsigned char functionCode = frame[1];
+            size_t remaining = 6;
+            if (Modbus::WRITE_MULTIPLE_COILS == functionCode ||
+                Modbus::WRITE_MULTIPLE_REGISTERS == functionCode)
+            {
+                frame.resize(7);
+                pseudoTerminal.Read(&frame[2], 5);
+                remaining = frame[6] + 2;
+            }
+            const size_t offset = frame.size();
+            frame.resize(offset + remaining);
+            pseudoTerminal.Read(&frame[offset], remaining);
+            {
+                std::lock_guard<std::mutex> lock(slaveMutex);
+                slaveRequests.push_back(frame);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(slaveDelayMilliseconds));
+            if (silentUnit == frame[0] || Modbus::BROADCAST_ADDRESS == frame[0])
+            {
+                continue;
+            }
+            std::vector<unsigned char> response(frame.begin(), frame.begin() + 2);
+            if (Modbus::READ_HOLDING_REGISTERS == functionCode)
+            {
+                const unsigned int start    = frame[2] << 8 | frame[3];
+                const unsigned int quantity = frame[4] << 8 | frame[5];
+                response.push_back(2 * quantity);
+                for (unsigned int i = 0; i < quantity; i++)
+                {
+                    response.push_back((0x100 + start + i) >> 8);
+                    response.push_back((0x100 + start + i) & 0xFF);
+                }
+            }
+            else
+            {
+                response.insert(response.end(), frame.begin() + 2, frame.begin() + 6);
+            }
+            const unsigned short crc = Modbus::Crc16(response.data(), response.size());
+            response.push_back(crc & 0xFF);
+            response.push_back(crc >> 8);
+            pseudoTerminal.Write(response.data(), response.size());
+        }
+    }
+
+    size_t numberOfSlaveRequests()
+    {
+        std::lock_guard<std::mutex> lock(slaveMutex);
+        return slaveRequests.size();
+    }
+
+    int connectClient()
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_port = htons(gateway.GetTcpPort());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void sendRequest(int fd, unsigned short transactionId, unsigned char unit,
+                     const std::vector<unsigned char>& pdu)
+    {
+        std::vector<unsigned char> frame = {
+            static_cast<unsigned char>(transactionId >> 8),
+            static_cast<unsigned char>(transactionId & 0xFF),
+            0, 0,
+            static_cast<unsigned char>((pdu.size() + 1) >> 8),
+            static_cast<unsigned char>((pdu.size() + 1) & 0xFF),
+            unit };
+        frame.insert(frame.end(), pdu.begin(), pdu.end());
+        ASSERT_EQ(ssize_t(frame.size()), send(fd, frame.data(), frame.size(), 0));
+    }
+
+    /**
+     * @brief Receives a response and returns its PDU after checking the
+     *        MBAP header.
+     */
+    std::vector<unsigned char> receiveResponse(int fd, unsigned short transactionId)
+    {
+        std::vector<unsigned char> frame;
+        unsigned char buffer[260];
+        while (frame.size() < 7 ||
+               frame.size() < 6U + (frame[4] << 8 | frame[5]))
+        {
+            pollfd poll_fd = { fd, POLLIN, 0 };
+            const int ready = poll(&poll_fd, 1, 2000);
+            if (ready < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            if (ready <= 0)
+            {
+                return std::vector<unsigned char>();
+            }
+            const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                return std::vector<unsigned char>();
+            }
+            frame.insert(frame.end(), buffer, buffer + received);
+        }
+        EXPECT_EQ(transactionId, frame[0] << 8 | frame[1]);
+        return std::vector<unsigned char>(frame.begin() + 7, frame.end());
+    }
+
+    std::vector<unsigned char> readHoldingRegisters(int fd, unsigned short transactionId,
+                                                    unsigned short start, unsigned short quantity)
+    {
+        sendRequest(fd, transactionId, 1, { 0x03, 0x00, static_cast<unsigned char>(start),
+                                            0x00, static_cast<unsigned char>(quantity) });
+        return receiveResponse(fd, transactionId);
+    }
+
+    std::vector<unsigned char> expectedRegisters(unsigned short start, unsigned short quantity)
+    {
+        std::vector<unsigned char> pdu = { 0x03, static_cast<unsigned char>(2 * quantity) };
+        for (unsigned int i = 0; i < quantity; i++)
+        {
+            pdu.push_back((0x100 + start + i) >> 8);
+            pdu.push_back((0x100 + start + i) & 0xFF);
+        }
+        return pdu;
+    }
+};
+
+TEST_F(ModbusGatewayTest, testForwardsReadsAndWrites)
+{
+    const int client = connectClient();
+    ASSERT_LE(0, client);
+
+    ASSERT_EQ(expectedRegisters(4, 3), readHoldingRegisters(client, 1, 4, 3));
+
+    sendRequest(client, 2, 1, { 0x06, 0x00, 0x07, 0x12, 0x34 });
+    ASSERT_EQ(std::vector<unsigned char>({ 0x06, 0x00, 0x07, 0x12, 0x34 }),
+              receiveResponse(client, 2));
+
+    ASSERT_EQ(2U, numberOfSlaveRequests());
+    close(client);
+}
+
+TEST_F(ModbusGatewayTest, testCoalescesOverlappingReads)
+{
+    std::vector<int> clients;
+    for (int i = 0; i < 4; i++)
+    {
+        clients.push_back(connectClient());
+        ASSERT_LE(0, clients.back());
+    }
+
+    //
+    // Keep the bus busy with a first read while three overlapping or
+    // identical reads from other clients queue up behind it.
+    //
+    slaveDelayMilliseconds = 50;
+    sendRequest(clients[0], 1, 1, { 0x03, 0x00, 0x00, 0x00, 0x0A });
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    sendRequest(clients[1], 2, 1, { 0x03, 0x00, 0x05, 0x00, 0x0A });
+    sendRequest(clients[2], 3, 1, { 0x03, 0x00, 0x0A, 0x00, 0x0A });
+    sendRequest(clients[3], 4, 1, { 0x03, 0x00, 0x05, 0x00, 0x0A });
+
+    ASSERT_EQ(expectedRegisters(0, 10), receiveResponse(clients[0], 1));
+    ASSERT_EQ(expectedRegisters(5, 10), receiveResponse(clients[1], 2));
+    ASSERT_EQ(expectedRegisters(10, 10), receiveResponse(clients[2], 3));
+    ASSERT_EQ(expectedRegisters(5, 10), receiveResponse(clients[3], 4));
+
+    const ModbusGateway::Statistics statistics = gateway.GetStatistics();
+    ASSERT_EQ(2UL, statistics.mNumOfBusTransactions);
+    ASSERT_EQ(2UL, statistics.mNumOfCoalescedRequests);
+    std::cout << "Modbus gateway bus utilisation: "
+              << gateway.GetBusUtilisation() << std::endl;
+
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        close(clients[i]);
+    }
+}
+
+TEST_F(ModbusGatewayTest, testCacheAndInvalidation)
+{
+    gateway.SetCacheFreshness(1000);
+    const int client = connectClient();
+    ASSERT_LE(0, client);
+
+    ASSERT_EQ(expectedRegisters(0, 8), readHoldingRegisters(client, 1, 0, 8));
+    ASSERT_EQ(expectedRegisters(2, 4), readHoldingRegisters(client, 2, 2, 4));
+    ASSERT_EQ(1U, numberOfSlaveRequests());
+
+    //
+    // A write to one of the cached registers forces the next read back
+    // onto the bus.
+    //
+    sendRequest(client, 3, 1, { 0x06, 0x00, 0x03, 0x00, 0x00 });
+    receiveResponse(client, 3);
+    ASSERT_EQ(expectedRegisters(2, 4), readHoldingRegisters(client, 4, 2, 4));
+    ASSERT_EQ(3U, numberOfSlaveRequests());
+
+    ASSERT_EQ(1UL, gateway.GetStatistics().mNumOfCacheHits);
+    std::cout << "Modbus gateway cache hit rate: "
+              << gateway.GetCacheHitRate() << std::endl;
+    close(client);
+}
+
+TEST_F(ModbusGatewayTest, testWritesOvertakeReads)
+{
+    gateway.SetWritePriority(2, 1);
+    std::vector<int> clients;
+    for (int i = 0; i < 4; i++)
+    {
+        clients.push_back(connectClient());
+        ASSERT_LE(0, clients.back());
+    }
+
+    slaveDelayMilliseconds = 50;
+    sendRequest(clients[0], 1, 1, { 0x03, 0x00, 0x00, 0x00, 0x01 });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    sendRequest(clients[1], 2, 1, { 0x03, 0x00, 0x20, 0x00, 0x01 });
+    sendRequest(clients[2], 3, 1, { 0x06, 0x00, 0x01, 0x00, 0x01 });
+    sendRequest(clients[3], 4, 2, { 0x06, 0x00, 0x02, 0x00, 0x02 });
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_FALSE(receiveResponse(clients[i], 1 + i).empty());
+        close(clients[i]);
+    }
+
+    //
+    // The prioritised write to unit 2 goes first, then the other write,
+    // and only then the read that was queued before them.
+    //
+    std::lock_guard<std::mutex> lock(slaveMutex);
+    ASSERT_EQ(4U, slaveRequests.size());
+    ASSERT_EQ(0x03, slaveRequests[0][1]);
+    ASSERT_EQ(2, slaveRequests[1][0]);
+    ASSERT_EQ(1, slaveRequests[2][0]);
+    ASSERT_EQ(0x06, slaveRequests[2][1]);
+    ASSERT_EQ(0x03, slaveRequests[3][1]);
+}
+
+TEST_F(ModbusGatewayTest, testExceptions)
+{
+    const int client = connectClient();
+    ASSERT_LE(0, client);
+
+    sendRequest(client, 1, silentUnit, { 0x03, 0x00, 0x00, 0x00, 0x01 });
+    ASSERT_EQ(std::vector<unsigned char>({ 0x83, Modbus::GATEWAY_TARGET_NO_RESPONSE }),
+              receiveResponse(client, 1));
+
+    sendRequest(client, 2, 1, { 0x2B, 0x0E, 0x01, 0x00 });
+    ASSERT_EQ(std::vector<unsigned char>({ 0xAB, Modbus::ILLEGAL_FUNCTION }),
+              receiveResponse(client, 2));
+
+    sendRequest(client, 3, 1, { 0x03, 0x00, 0x00, 0x00, 0x7E });
+    ASSERT_EQ(std::vector<unsigned char>({ 0x83, Modbus::ILLEGAL_DATA_VALUE }),
+              receiveResponse(client, 3));
+
+    ASSERT_EQ(1UL, gateway.GetStatistics().mNumOfBusTimeouts);
+    close(client);
+}
+
+TEST_F(ModbusGatewayTest, testClientResetMidPipeline)
+{
+    //
+    // Requests the gateway rejects straight away, pipelined in a single
+    // segment. The client resets the connection before the gateway gets
+    // to them, so the first exception cannot be sent and closes the
+    // connection while the rest of the pipeline is still being parsed.
+    //
+    for (int attempt = 0; attempt < 20; attempt++)
+    {
+        const int client = connectClient();
+        ASSERT_LE(0, client);
+        std::vector<unsigned char> pipeline;
+        for (unsigned short i = 0; i < 32; i++)
+        {
+            const unsigned char frame[] = { static_cast<unsigned char>(i >> 8),
+                                            static_cast<unsigned char>(i & 0xFF),
+                                            0, 0, 0, 6, 1,
+                                            0x03, 0x00, 0x00, 0x00, 0x7E };
+            pipeline.insert(pipeline.end(), frame, frame + sizeof(frame));
+        }
+        ASSERT_EQ(ssize_t(pipeline.size()), send(client, pipeline.data(), pipeline.size(), 0));
+        const linger reset = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        close(client);
+    }
+
+    const int client = connectClient();
+    ASSERT_LE(0, client);
+    ASSERT_EQ(expectedRegisters(0, 2), readHoldingRegisters(client, 1, 0, 2));
+    close(client);
+}
@@ -0,0 +1,184 @@
+/******************************************************************************
+ *   @file ModbusRtuSlaveTest.cpp                                             *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                    *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <vector>
+
+#include <Modbus.h>
+#include <ModbusRegisterMap.h>
+#include <ModbusRtuSlave.h>
+#include <SerialPort.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+class ModbusRtuSlaveTest
+    : public ::testing::Test
+{
+public:
+    ModbusRtuSlaveTest()
+        : serialPort(pseudoTerminal.SlaveName()),
+          registerMap(16, 16, 64, 64),
+          slave(serialPort, registerMap, slaveAddress)
+    {
+    }
+
+protected:
+
+    static const unsigned char slaveAddress = 17;
+
+    PseudoTerminal    pseudoTerminal;
+    SerialPort        serialPort;
+    ModbusRegisterMap registerMap;
+    ModbusRtuSlave    slave;
+
+    virtual void SetUp()
+    {
+        serialPort.Open(SerialPort::BAUD_115200);
+        slave.Start();
+    }
+
+    virtual void TearDown()
+    {
+        slave.Stop();
+        serialPort.Close();
+    }
+
+    std::vector<unsigned char> makeFrame(std::vector<unsigned char> pdu, unsigned char address = slaveAddress)
+    {
+        pdu.insert(pdu.begin(), address);
+        const unsigned short crc = Modbus::Crc16(pdu.data(), pdu.size());
+        pdu.push_back(crc & 0xFF);
+        pdu.push_back(crc >> 8);
+        return pdu;
+    }
+
+    std::vector<unsigned char> transact(const std::vector<unsigned char>& request, size_t responseSize)
+    {
+        pseudoTerminal.Write(request.data(), request.size());
+        std::vector<unsigned char> response(responseSize);
+        response.resize(pseudoTerminal.Read(response.data(), responseSize));
+        return response;
+    }
+};
+
+TEST_F(ModbusRtuSlaveTest, testCrc16)
+{
+    // Reference frame from the Modbus over serial line specification.
+    const unsigned char frame[] = { 0x02, 0x07 };
+    ASSERT_EQ(0x1241, Modbus::Crc16(frame, sizeof(frame)));
+}
+
+TEST_F(ModbusRtuSlaveTest, testReadHoldingRegisters)
+{
+    registerMap.BeginUpdate();
+    registerMap.SetValue(ModbusRegisterMap::HOLDING_REGISTERS, 10, 0x1234);
+    registerMap.SetValue(ModbusRegisterMap::HOLDING_REGISTERS, 11, 0xABCD);
+    registerMap.EndUpdate();
+
+    const std::vector<unsigned char> response =
+        transact(makeFrame({ 0x03, 0x00, 0x0A, 0x00, 0x02 }), 9);
+
+    ASSERT_EQ(makeFrame({ 0x03, 0x04, 0x12, 0x34, 0xAB, 0xCD }), response);
+}
+
+TEST_F(ModbusRtuSlaveTest, testReadCoils)
+{
+    registerMap.SetValue(ModbusRegisterMap::COILS, 0, 1);
+    registerMap.SetValue(ModbusRegisterMap::COILS, 2, 1);
+    registerMap.SetValue(ModbusRegisterMap::COILS, 9, 1);
+
+    const std::vector<unsigned char> response =
+        transact(makeFrame({ 0x01, 0x00, 0x00, 0x00, 0x0A }), 7);
+
+    ASSERT_EQ(makeFrame({ 0x01, 0x02, 0x05, 0x02 }), response);
+}
+
+TEST_F(ModbusRtuSlaveTest, testWriteMultipleRegisters)
+{
+    const std::vector<unsigned char> response =
+        transact(makeFrame({ 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02 }), 8);
+
+    ASSERT_EQ(makeFrame({ 0x10, 0x00, 0x01, 0x00, 0x02 }), response);
+    ASSERT_EQ(0x000A, registerMap.GetValue(ModbusRegisterMap::HOLDING_REGISTERS, 1));
+    ASSERT_EQ(0x0102, registerMap.GetValue(ModbusRegisterMap::HOLDING_REGISTERS, 2));
+    ASSERT_EQ(1UL, registerMap.GetMasterWriteCount());
+}
+
+TEST_F(ModbusRtuSlaveTest, testIllegalDataAddress)
+{
+    const std::vector<unsigned char> response =
+        transact(makeFrame({ 0x04, 0x00, 0x3F, 0x00, 0x02 }), 5);
+
+    ASSERT_EQ(makeFrame({ 0x84, 0x02 }), response);
+}
+
+TEST_F(ModbusRtuSlaveTest, testFiltersOtherAddressesAndBadCrc)
+{
+    std::vector<unsigned char> badCrc = makeFrame({ 0x03, 0x00, 0x00, 0x00, 0x01 });
+    badCrc.back() ^= 0xFF;
+
+    std::vector<unsigned char> unused(8);
+    transact(makeFrame({ 0x03, 0x00, 0x00, 0x00, 0x01 }, slaveAddress + 1), 0);
+    ASSERT_EQ(0U, pseudoTerminal.Read(unused.data(), unused.size(), 50));
+    transact(badCrc, 0);
+    ASSERT_EQ(0U, pseudoTerminal.Read(unused.data(), unused.size(), 50));
+
+    const ModbusRtuSlave::Statistics statistics = slave.GetStatistics();
+    ASSERT_EQ(1UL, statistics.mNumOfIgnoredFrames);
+    ASSERT_EQ(1UL, statistics.mNumOfCrcErrors);
+    ASSERT_EQ(0UL, statistics.mNumOfResponses);
+}
+
+TEST_F(ModbusRtuSlaveTest, testRequestToResponseTurnaround)
+{
+    const size_t numberOfRequests = 1000;
+    const std::vector<unsigned char> request = makeFrame({ 0x04, 0x00, 0x00, 0x00, 0x10 });
+    const size_t responseSize = 5 + 2 * 16;
+
+    std::vector<double> turnaroundMicroseconds;
+    turnaroundMicroseconds.reserve(numberOfRequests);
+
+    for (size_t i = 0; i < numberOfRequests; i++)
+    {
+        registerMap.SetValue(ModbusRegisterMap::INPUT_REGISTERS, 0, i);
+
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<unsigned char> response = transact(request, responseSize);
+        const auto stop = std::chrono::steady_clock::now();
+
+        ASSERT_EQ(responseSize, response.size());
+        ASSERT_EQ(i & 0xFFFF, size_t(response[3] << 8 | response[4]));
+        turnaroundMicroseconds.push_back(
+            std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+
+    std::sort(turnaroundMicroseconds.begin(), turnaroundMicroseconds.end());
+    std::cout << "Modbus RTU slave turnaround on PTY (us): p50="
+              << turnaroundMicroseconds[numberOfRequests / 2]
+              << " p99=" << turnaroundMicroseconds[numberOfRequests * 99 / 100]
+              << " max=" << turnaroundMicroseconds.back() << std::endl;
+
+    ASSERT_EQ(numberOfRequests, slave.GetStatistics().mNumOfResponses);
+}
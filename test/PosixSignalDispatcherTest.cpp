@@ -0,0 +1,445 @@
+/******************************************************************************
+ *   @file PosixSignalDispatcherTest.cpp                                      *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <PosixSignalDispatcher.h>
+#include <PosixSignalHandler.h>
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+
+#include "PseudoTerminal.h"
+
+namespace
+{
+    std::string trace;
+
+    /**
+     * @brief Pretends to receive data, logging its name for every turn.
+     */
+    class FakeHandler : public PosixSignalHandler
+    {
+    public:
+        FakeHandler(char name, int available)
+            : name(name)
+            , available(available)
+            , pending(0)
+            , onTurn(0)
+        {
+        }
+
+        void HandlePosixSignal(int)
+        {
+        }
+
+        bool ServicePosixSignal(int, unsigned int byteBudget, bool isNewWakeup)
+        {
+            trace += name;
+            if (isNewWakeup)
+            {
+                pending = available;
+                available = 0;
+            }
+            const int size = (byteBudget > 0) ? std::min<int>(pending, byteBudget) : pending;
+            pending -= size;
+            if (0 != onTurn)
+            {
+                onTurn();
+            }
+            return pending > 0;
+        }
+
+        char name;
+        int available;
+        int pending;
+        void (*onTurn)();
+    };
+
+    /**
+     * @brief Only implements HandlePosixSignal().
+     */
+    class LegacyHandler : public PosixSignalHandler
+    {
+    public:
+        void HandlePosixSignal(int)
+        {
+            trace += 'L';
+        }
+    };
+
+    /**
+     * @brief Tracks how many threads run the handler at the same time.
+     */
+    class ConcurrencyHandler : public PosixSignalHandler
+    {
+    public:
+        ConcurrencyHandler()
+            : numOfRequests(0)
+            , numOfRequestsSeen(0)
+            , numOfCalls(0)
+            , numOfRunning(0)
+            , maxNumOfRunning(0)
+        {
+        }
+
+        void HandlePosixSignal(int)
+        {
+            const int running = ++numOfRunning;
+            if (running > maxNumOfRunning)
+            {
+                maxNumOfRunning = running;
+            }
+            numOfRequestsSeen = numOfRequests.load();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            numOfCalls++;
+            numOfRunning--;
+        }
+
+        std::atomic<int> numOfRequests;
+        std::atomic<int> numOfRequestsSeen;
+        std::atomic<int> numOfCalls;
+        std::atomic<int> numOfRunning;
+        std::atomic<int> maxNumOfRunning;
+    };
+
+    FakeHandler* interlock = 0;
+
+    void raiseInterlock()
+    {
+        // New work for the high class while the low class is busy.
+        if (std::count(trace.begin(), trace.end(), 'A') == 1)
+        {
+            interlock->available = 1;
+        }
+    }
+
+    /**
+     * @brief Records when the byte of a latency probe arrives.
+     */
+    class ProbeHandler : public SerialPortReceiveHandler
+    {
+    public:
+        ProbeHandler() : numOfProbes(0), arrivalTime(0) {}
+
+        void HandleReceivedData(const unsigned char*, const unsigned int)
+        {
+            arrivalTime.store(std::chrono::steady_clock::now().time_since_epoch().count());
+            numOfProbes.fetch_add(1);
+        }
+
+        std::atomic<int>       numOfProbes;
+        std::atomic<long long> arrivalTime;
+    };
+
+    /**
+     * @brief A bulk logging port that spends some time on every byte.
+     */
+    class BulkHandler : public SerialPortReceiveHandler
+    {
+    public:
+        BulkHandler() : numOfBytes(0), hash(0) {}
+
+        void HandleReceivedData(const unsigned char* data, const unsigned int size)
+        {
+            unsigned int value = hash;
+            for (unsigned int i = 0; i < size; i++)
+            {
+                for (int k = 0; k < 16; k++)
+                {
+                    value = value * 31 + data[i];
+                }
+            }
+            hash = value;
+            numOfBytes += size;
+        }
+
+        std::atomic<unsigned long> numOfBytes;
+        volatile unsigned int      hash;
+    };
+
+    /**
+     * @brief Blocks SIGIO in the calling thread for its lifetime.
+     */
+    class SigioBlocker
+    {
+    public:
+        SigioBlocker()
+        {
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGIO);
+            pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+        }
+
+        ~SigioBlocker()
+        {
+            pthread_sigmask(SIG_SETMASK, &oldSignals, 0);
+        }
+
+        sigset_t signals;
+
+    private:
+        sigset_t oldSignals;
+    };
+
+    struct LatencyResult
+    {
+        double median;
+        double p99;
+        double max;
+        int    numOfLost;
+        double bulkThroughput;
+    };
+
+    /**
+     * @brief Times single bytes sent to a probe port while three bulk
+     *        ports are flooded.
+     */
+    LatencyResult measureProbeLatency(bool isPrioritised)
+    {
+        const int numOfBulkPorts = 3;
+        const int numOfProbes = 200;
+        PseudoTerminal probeTerminal;
+        SerialPort probePort(probeTerminal.SlaveName());
+        std::vector<std::unique_ptr<PseudoTerminal> > bulkTerminals;
+        std::vector<std::unique_ptr<SerialPort> > bulkPorts;
+        std::vector<std::unique_ptr<BulkHandler> > bulkHandlers;
+        for (int i = 0; i < numOfBulkPorts; i++)
+        {
+            bulkTerminals.emplace_back(new PseudoTerminal());
+            bulkPorts.emplace_back(new SerialPort(bulkTerminals.back()->SlaveName()));
+            bulkHandlers.emplace_back(new BulkHandler());
+            if (isPrioritised)
+            {
+                bulkPorts.back()->SetServiceClass(0, 256);
+            }
+            bulkPorts.back()->SetReceiveHandler(bulkHandlers.back().get());
+            bulkPorts.back()->Open(SerialPort::BAUD_115200);
+        }
+        if (isPrioritised)
+        {
+            probePort.SetServiceClass(1);
+        }
+        ProbeHandler probeHandler;
+        probePort.SetReceiveHandler(&probeHandler);
+        probePort.Open(SerialPort::BAUD_115200);
+
+        // Leave receive processing to the writers. A probing thread that
+        // took SIGIO itself would time its own dispatch work instead of
+        // the dispatcher, and would send the probes late while a bulk
+        // port keeps it busy.
+        SigioBlocker blocker;
+        const sigset_t signals = blocker.signals;
+        std::atomic<bool> isStopping(false);
+        std::vector<std::thread> writers;
+        for (int i = 0; i < numOfBulkPorts; i++)
+        {
+            PseudoTerminal* terminal = bulkTerminals[i].get();
+            writers.emplace_back([terminal, &isStopping, signals]()
+            {
+                pthread_sigmask(SIG_UNBLOCK, &signals, 0);
+                std::vector<unsigned char> chunk(4096, 0xA5);
+                while (!isStopping)
+                {
+                    terminal->Write(chunk.data(), chunk.size());
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        LatencyResult result = LatencyResult();
+        std::vector<double> latencies;
+        unsigned long bulkBytes = 0;
+        for (int i = 0; i < numOfBulkPorts; i++)
+        {
+            bulkBytes += bulkHandlers[i]->numOfBytes;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numOfProbes; i++)
+        {
+            const int expected = probeHandler.numOfProbes + 1;
+            const unsigned char probe = 0x42;
+            const auto sent = std::chrono::steady_clock::now();
+            probeTerminal.Write(&probe, 1);
+            while (probeHandler.numOfProbes < expected &&
+                   std::chrono::steady_clock::now() - sent < std::chrono::milliseconds(200))
+            {
+                std::this_thread::yield();
+            }
+            if (probeHandler.numOfProbes < expected)
+            {
+                result.numOfLost++;
+                continue;
+            }
+            const std::chrono::steady_clock::time_point arrival(
+                std::chrono::steady_clock::duration(probeHandler.arrivalTime.load()));
+            latencies.push_back(std::chrono::duration<double, std::micro>(arrival - sent).count());
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        unsigned long bulkBytesAfter = 0;
+        for (int i = 0; i < numOfBulkPorts; i++)
+        {
+            bulkBytesAfter += bulkHandlers[i]->numOfBytes;
+        }
+        result.bulkThroughput = (bulkBytesAfter - bulkBytes) / seconds / 1e6;
+
+        isStopping = true;
+        for (size_t i = 0; i < writers.size(); i++)
+        {
+            writers[i].join();
+        }
+        probePort.Close();
+        for (int i = 0; i < numOfBulkPorts; i++)
+        {
+            bulkPorts[i]->Close();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        if (!latencies.empty())
+        {
+            result.median = latencies[latencies.size() / 2];
+            result.p99 = latencies[latencies.size() * 99 / 100];
+            result.max = latencies.back();
+        }
+        return result;
+    }
+}
+
+TEST(PosixSignalDispatcherTest, testServiceClassesAndBudgets)
+{
+    FakeHandler high('H', 1);
+    FakeHandler middle('M', 25);
+    FakeHandler lowA('A', 20);
+    FakeHandler lowB('B', 5);
+    LegacyHandler legacy;
+    PosixSignalDispatcher& dispatcher = PosixSignalDispatcher::Instance();
+    dispatcher.AttachHandler(SIGIO, lowA, 0, 10);
+    dispatcher.AttachHandler(SIGIO, high, 2);
+    dispatcher.AttachHandler(SIGIO, legacy);
+    dispatcher.AttachHandler(SIGIO, middle, 1, 10);
+    dispatcher.AttachHandler(SIGIO, lowB, 0, 10);
+
+    // The high class runs first and is checked again after every round
+    // of a lower class that leaves work behind. The handler without
+    // ServicePosixSignal() runs once per wakeup like a handler without
+    // a budget.
+    trace.clear();
+    raise(SIGIO);
+    ASSERT_EQ("HMHMHMHALBHMHA", trace);
+
+    // New work for the high class is serviced before the low class
+    // continues.
+    interlock = &high;
+    lowA.onTurn = raiseInterlock;
+    lowA.available = 20;
+    trace.clear();
+    raise(SIGIO);
+    ASSERT_EQ("HMHALBHMHA", trace);
+    ASSERT_EQ(0, high.pending);
+    ASSERT_EQ(0, high.available);
+
+    dispatcher.DetachHandler(SIGIO, high);
+    dispatcher.DetachHandler(SIGIO, middle);
+    dispatcher.DetachHandler(SIGIO, lowA);
+    dispatcher.DetachHandler(SIGIO, lowB);
+    dispatcher.DetachHandler(SIGIO, legacy);
+}
+
+TEST(PosixSignalDispatcherTest, testConcurrentSignalsAreSerialised)
+{
+    ConcurrencyHandler handler;
+    PosixSignalDispatcher& dispatcher = PosixSignalDispatcher::Instance();
+    dispatcher.AttachHandler(SIGIO, handler);
+
+    // Every thread raises SIGIO in itself. The handler never runs on two
+    // threads at once, and a signal that arrives during a dispatch on
+    // another thread is covered by a later pass of that dispatch.
+    const int numOfThreads = 4;
+    const int numOfSignals = 200;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numOfThreads; i++)
+    {
+        threads.emplace_back([&handler]()
+        {
+            for (int k = 0; k < numOfSignals; k++)
+            {
+                handler.numOfRequests++;
+                raise(SIGIO);
+            }
+        });
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    dispatcher.DetachHandler(SIGIO, handler);
+
+    ASSERT_EQ(1, handler.maxNumOfRunning);
+    ASSERT_EQ(numOfThreads * numOfSignals, handler.numOfRequestsSeen);
+    ASSERT_LE(handler.numOfCalls, numOfThreads * numOfSignals);
+}
+
+TEST(PosixSignalDispatcherTest, testSerialPortServiceClass)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    ASSERT_EQ(0U, serialPort.GetServiceClass());
+    ASSERT_EQ(0U, serialPort.GetReceiveBudget());
+    serialPort.SetServiceClass(0, 4);
+    ASSERT_EQ(4U, serialPort.GetReceiveBudget());
+    serialPort.Open(SerialPort::BAUD_115200);
+    ASSERT_THROW(serialPort.SetServiceClass(1), SerialPort::AlreadyOpen);
+
+    // Reading in slices of four bytes delivers all data in order.
+    const std::string message = "The quick brown fox jumps over the lazy dog";
+    pseudoTerminal.Write(message.data(), message.size());
+    SerialPort::DataBuffer received;
+    serialPort.Read(received, message.size(), 1000);
+    ASSERT_EQ(message, std::string(received.begin(), received.end()));
+}
+
+TEST(PosixSignalDispatcherTest, testBenchmarkHighClassLatencyUnderBulkLoad)
+{
+    //
+    // Wall clock timings depend on the load of the machine, so they are
+    // only reported. The order in which the classes are serviced is
+    // checked by testServiceClassesAndBudgets.
+    //
+    const LatencyResult flat = measureProbeLatency(false);
+    const LatencyResult prioritised = measureProbeLatency(true);
+    std::cout << "Probe latency with three saturated bulk ports (median/p99/max us):" << std::endl
+              << "  single class:   " << flat.median << " / " << flat.p99 << " / " << flat.max
+              << ", " << flat.numOfLost << " late, bulk "
+              << flat.bulkThroughput << " MB/s" << std::endl
+              << "  priority class: " << prioritised.median << " / " << prioritised.p99 << " / "
+              << prioritised.max << ", " << prioritised.numOfLost << " late, bulk "
+              << prioritised.bulkThroughput << " MB/s" << std::endl;
+}
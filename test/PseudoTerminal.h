@@ -0,0 +1,157 @@
+/******************************************************************************
+ *   @file PseudoTerminal.h                                                   *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                    *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#ifndef _PseudoTerminal_h_
+#define _PseudoTerminal_h_
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief A pseudo terminal pair used to test serial port code without
+ *        hardware. The slave side is opened through libserial using
+ *        SlaveName() while the test drives the master side directly.
+ */
+class PseudoTerminal
+{
+public:
+    PseudoTerminal()
+        : mMasterFileDescriptor(posix_openpt(O_RDWR | O_NOCTTY))
+    {
+        if ( mMasterFileDescriptor < 0 ||
+             grantpt(mMasterFileDescriptor) < 0 ||
+             unlockpt(mMasterFileDescriptor) < 0 )
+        {
+            throw std::runtime_error("Cannot create pseudo terminal.") ;
+        }
+        mSlaveName = ptsname(mMasterFileDescriptor) ;
+        //
+        // Keep the line discipline of the master side out of the way.
+        //
+        termios settings ;
+        tcgetattr(mMasterFileDescriptor, &settings) ;
+        cfmakeraw(&settings) ;
+        tcsetattr(mMasterFileDescriptor, TCSANOW, &settings) ;
+    }
+
+    ~PseudoTerminal()
+    {
+        if ( mMasterFileDescriptor >= 0 )
+        {
+            close(mMasterFileDescriptor) ;
+        }
+    }
+
+    /**
+     * @brief Closes the master side, which hangs up the slave side as
+     *        unplugging a serial adapter would.
+     */
+    void HangUp()
+    {
+        close(mMasterFileDescriptor) ;
+        mMasterFileDescriptor = -1 ;
+    }
+
+    const std::string& SlaveName() const
+    {
+        return mSlaveName ;
+    }
+
+    int MasterFileDescriptor() const
+    {
+        return mMasterFileDescriptor ;
+    }
+
+    /**
+     * @brief Writes all bytes to the master side.
+     */
+    void Write(const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data) ;
+        while (size > 0)
+        {
+            const ssize_t written = write(mMasterFileDescriptor, bytes, size) ;
+            if (written < 0)
+            {
+                if (EINTR == errno || EAGAIN == errno)
+                {
+                    continue ;
+                }
+                throw std::runtime_error("Cannot write to pseudo terminal.") ;
+            }
+            bytes += written ;
+            size -= written ;
+        }
+    }
+
+    /**
+     * @brief Reads exactly size bytes from the master side unless
+     *        msTimeout milliseconds elapse first.
+     * @return Returns the number of bytes read.
+     */
+    size_t Read(void* data, size_t size, int msTimeout = 1000)
+    {
+        unsigned char* bytes = static_cast<unsigned char*>(data) ;
+        size_t num_read = 0 ;
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(msTimeout) ;
+        while (num_read < size)
+        {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count() ;
+            if (remaining < 0)
+            {
+                break ;
+            }
+            pollfd poll_fd = { mMasterFileDescriptor, POLLIN, 0 } ;
+            const int ready = poll(&poll_fd, 1, remaining) ;
+            if (ready < 0 && EINTR == errno)
+            {
+                continue ;
+            }
+            if (ready <= 0)
+            {
+                break ;
+            }
+            const ssize_t result = read(mMasterFileDescriptor, bytes + num_read, size - num_read) ;
+            if (result > 0)
+            {
+                num_read += result ;
+            }
+        }
+        return num_read ;
+    }
+
+private:
+    PseudoTerminal(const PseudoTerminal&) ;
+    PseudoTerminal& operator=(const PseudoTerminal&) ;
+
+    int         mMasterFileDescriptor ;
+    std::string mSlaveName ;
+} ;
+
+#endif // #ifndef _PseudoTerminal_h_
@@ -0,0 +1,215 @@
+/******************************************************************************
+ *   @file SerialPortSelfTestTest.cpp                                         *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <thread>
+
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+
+#include "PseudoTerminal.h"
+
+namespace
+{
+    /**
+     * @brief Echoes everything written to the serial port back from the
+     *        master side of a pseudo terminal, like a loopback plug.
+     *        Every corruptionInterval-th byte is inverted if the interval
+     *        is not zero.
+     */
+    class EchoPeer
+    {
+    public:
+        EchoPeer(PseudoTerminal& pseudoTerminal, unsigned int corruptionInterval = 0)
+            : mPseudoTerminal(pseudoTerminal)
+            , mCorruptionInterval(corruptionInterval)
+            , mIsStopRequested(false)
+            , mThread(&EchoPeer::run, this)
+        {
+        }
+
+        ~EchoPeer()
+        {
+            mIsStopRequested = true;
+            mThread.join();
+        }
+
+    private:
+        void run()
+        {
+            unsigned long position = 0;
+            unsigned char buffer[4096];
+            while (!mIsStopRequested)
+            {
+                pollfd pollFd = { mPseudoTerminal.MasterFileDescriptor(), POLLIN, 0 };
+                if (poll(&pollFd, 1, 10) <= 0)
+                {
+                    continue;
+                }
+                const ssize_t size = read(mPseudoTerminal.MasterFileDescriptor(), buffer, sizeof(buffer));
+                for (ssize_t i = 0; i < size; i++, position++)
+                {
+                    if (mCorruptionInterval > 0 && position % mCorruptionInterval == 0)
+                    {
+                        buffer[i] = ~buffer[i];
+                    }
+                }
+                if (size > 0)
+                {
+                    mPseudoTerminal.Write(buffer, size);
+                }
+            }
+        }
+
+        PseudoTerminal& mPseudoTerminal;
+        const unsigned int mCorruptionInterval;
+        std::atomic<bool> mIsStopRequested;
+        std::thread mThread;
+    };
+
+    class CountingHandler : public SerialPortReceiveHandler
+    {
+    public:
+        void HandleReceivedData(const unsigned char*, const unsigned int)
+        {
+        }
+    };
+
+    void printReport(const SerialPort::SelfTestReport& report)
+    {
+        for (size_t i = 0; i < report.mResults.size(); i++)
+        {
+            const SerialPort::SelfTestResult& result = report.mResults[i];
+            std::cout << "rate " << result.mBaudRate << " payload " << result.mPayloadSize
+                      << ": latency min " << result.mMinLatencyMicroseconds
+                      << "us p50 " << result.mMedianLatencyMicroseconds
+                      << "us p90 " << result.mP90LatencyMicroseconds
+                      << "us p99 " << result.mP99LatencyMicroseconds
+                      << "us max " << result.mMaxLatencyMicroseconds
+                      << "us, throughput " << result.mThroughput << " B/s ("
+                      << 100.0 * result.mLineUtilisation << "% of line), "
+                      << (result.mIsErrorFree ? "error free" : "ERRORS") << std::endl;
+        }
+    }
+}
+
+class SerialPortSelfTestTest
+    : public ::testing::Test
+{
+protected:
+    SerialPortSelfTestTest()
+        : serialPort(pseudoTerminal.SlaveName())
+    {
+        serialPort.Open(SerialPort::BAUD_57600);
+        settings.mNumOfProbes = 10;
+        settings.mMsThroughputDuration = 100;
+    }
+
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort;
+    SerialPort::SelfTestSettings settings;
+};
+
+TEST_F(SerialPortSelfTestTest, testLoopbackSweep)
+{
+    EchoPeer peer(pseudoTerminal);
+    CountingHandler userHandler;
+    serialPort.SetReceiveHandler(&userHandler);
+
+    settings.mBaudRates.push_back(SerialPort::BAUD_9600);
+    settings.mBaudRates.push_back(SerialPort::BAUD_115200);
+    settings.mPayloadSizes.clear();
+    settings.mPayloadSizes.push_back(1);
+    settings.mPayloadSizes.push_back(64);
+    const SerialPort::SelfTestReport report = serialPort.SelfTest(settings);
+    printReport(report);
+
+    ASSERT_EQ(4U, report.mResults.size());
+    ASSERT_EQ(SerialPort::BAUD_9600, report.mResults[0].mBaudRate);
+    ASSERT_EQ(64U, report.mResults[1].mPayloadSize);
+    ASSERT_EQ(SerialPort::BAUD_115200, report.mResults[3].mBaudRate);
+    for (size_t i = 0; i < report.mResults.size(); i++)
+    {
+        const SerialPort::SelfTestResult& result = report.mResults[i];
+        ASSERT_TRUE(result.mIsErrorFree);
+        ASSERT_EQ(0U, result.mNumOfLostProbes);
+        ASSERT_EQ(result.mNumOfBytesSent, result.mNumOfBytesReceived);
+        ASSERT_GT(result.mMinLatencyMicroseconds, 0.0);
+        ASSERT_LE(result.mMinLatencyMicroseconds, result.mMedianLatencyMicroseconds);
+        ASSERT_LE(result.mMedianLatencyMicroseconds, result.mP90LatencyMicroseconds);
+        ASSERT_LE(result.mP90LatencyMicroseconds, result.mP99LatencyMicroseconds);
+        ASSERT_LE(result.mP99LatencyMicroseconds, result.mMaxLatencyMicroseconds);
+        ASSERT_GT(result.mThroughput, 0.0);
+    }
+
+    // Pseudo terminals do not count overruns.
+    ASSERT_FALSE(report.mIsOverrunCountAvailable);
+    ASSERT_EQ(-1, report.mResults[0].mNumOfOverruns);
+    ASSERT_FALSE(report.mHasOverrunOnset);
+    ASSERT_GT(report.mMaxErrorFreeThroughput, 0.0);
+
+    // The port is left as it was.
+    ASSERT_EQ(SerialPort::BAUD_57600, serialPort.GetBaudRate());
+    ASSERT_EQ(&userHandler, serialPort.GetReceiveHandler());
+    serialPort.SetReceiveHandler(0);
+}
+
+TEST_F(SerialPortSelfTestTest, testDetectsCorruption)
+{
+    EchoPeer peer(pseudoTerminal, 100);
+    const SerialPort::SelfTestReport report = serialPort.SelfTest(settings);
+
+    ASSERT_EQ(settings.mPayloadSizes.size(), report.mResults.size());
+    unsigned long numOfCorruptBytes = 0;
+    for (size_t i = 0; i < report.mResults.size(); i++)
+    {
+        numOfCorruptBytes += report.mResults[i].mNumOfCorruptBytes;
+    }
+    ASSERT_GT(numOfCorruptBytes, 0UL);
+    ASSERT_FALSE(report.mResults.back().mIsErrorFree);
+}
+
+TEST_F(SerialPortSelfTestTest, testSilentPeer)
+{
+    settings.mNumOfProbes = 3;
+    settings.mMsProbeTimeout = 20;
+    settings.mMsThroughputDuration = 20;
+    settings.mPayloadSizes.resize(1);
+    const SerialPort::SelfTestReport report = serialPort.SelfTest(settings);
+
+    ASSERT_EQ(1U, report.mResults.size());
+    ASSERT_EQ(3U, report.mResults[0].mNumOfLostProbes);
+    ASSERT_FALSE(report.mResults[0].mIsErrorFree);
+    ASSERT_EQ(0UL, report.mResults[0].mNumOfBytesReceived);
+    ASSERT_EQ(0.0, report.mMaxErrorFreeThroughput);
+}
+
+TEST_F(SerialPortSelfTestTest, testInvalidSettings)
+{
+    settings.mPayloadSizes.clear();
+    ASSERT_THROW(serialPort.SelfTest(settings), std::invalid_argument);
+    settings.mPayloadSizes.push_back(0);
+    ASSERT_THROW(serialPort.SelfTest(settings), std::invalid_argument);
+
+    serialPort.Close();
+    ASSERT_THROW(serialPort.SelfTest(), SerialPort::NotOpen);
+}
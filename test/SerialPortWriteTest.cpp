@@ -0,0 +1,196 @@
+/******************************************************************************
+ *   @file SerialPortWriteTest.cpp                                            *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+
+#include "PseudoTerminal.h"
+
+namespace
+{
+    std::vector<unsigned char> makePattern(size_t size)
+    {
+        std::vector<unsigned char> data(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = (i * 131) >> 3;
+        }
+        return data;
+    }
+
+    /**
+     * @brief Answers every received chunk with a reply far larger than
+     *        the output queue, as a receive handler writing from the
+     *        SIGIO handler might.
+     */
+    class FloodingHandler : public SerialPortReceiveHandler
+    {
+    public:
+        explicit FloodingHandler(SerialPort& serialPort)
+            : serialPort(serialPort)
+            , reply(1 << 20, 0x55)
+            , numOfWriteErrors(0)
+        {
+        }
+
+        void HandleReceivedData(const unsigned char*, const unsigned int)
+        {
+            try
+            {
+                serialPort.Write(reply.data(), reply.size());
+            }
+            catch (const std::runtime_error&)
+            {
+                numOfWriteErrors++;
+            }
+        }
+
+        SerialPort&                serialPort;
+        std::vector<unsigned char> reply;
+        std::atomic<int>           numOfWriteErrors;
+    };
+
+    class CountingHandler : public SerialPortReceiveHandler
+    {
+    public:
+        CountingHandler() : numOfBytes(0) {}
+
+        void HandleReceivedData(const unsigned char*, const unsigned int size)
+        {
+            numOfBytes += size;
+        }
+
+        std::atomic<unsigned int> numOfBytes;
+    };
+}
+
+TEST(SerialPortWriteTest, testLargeWriteToSlowReader)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    // The output queue fills up many times over, so most write() calls
+    // take only part of the data.
+    const std::vector<unsigned char> data = makePattern(1 << 20);
+    std::vector<unsigned char> received(data.size());
+    std::thread reader([&]()
+    {
+        size_t numOfBytes = 0;
+        while (numOfBytes < received.size())
+        {
+            const size_t size = pseudoTerminal.Read(&received[numOfBytes],
+                                                    std::min<size_t>(997, received.size() - numOfBytes));
+            if (0 == size)
+            {
+                break;
+            }
+            numOfBytes += size;
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    });
+    serialPort.Write(data.data(), data.size());
+    reader.join();
+    ASSERT_EQ(data, received);
+    serialPort.Close();
+}
+
+TEST(SerialPortWriteTest, testStalledOutputWaitsForReader)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    // Nobody reads the master side for longer than the stall timeout of
+    // receive handlers. A write from the application waits, as a
+    // blocking write would, until the line drains.
+    const std::vector<unsigned char> data = makePattern(1 << 20);
+    std::vector<unsigned char> received(data.size());
+    std::thread reader([&]()
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+        pseudoTerminal.Read(received.data(), received.size());
+    });
+    const auto start = std::chrono::steady_clock::now();
+    serialPort.Write(data.data(), data.size());
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    reader.join();
+    ASSERT_EQ(data, received);
+    serialPort.Close();
+}
+
+TEST(SerialPortWriteTest, testHangupDuringWriteThrows)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    const std::vector<unsigned char> data = makePattern(1 << 20);
+    std::thread hangup([&]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        pseudoTerminal.HangUp();
+    });
+    ASSERT_THROW(serialPort.Write(data.data(), data.size()), std::runtime_error);
+    hangup.join();
+    serialPort.Close();
+}
+
+TEST(SerialPortWriteTest, testStalledPortDoesNotSilenceOthers)
+{
+    PseudoTerminal stalledTerminal;
+    SerialPort stalledPort(stalledTerminal.SlaveName());
+    FloodingHandler floodingHandler(stalledPort);
+    stalledPort.SetReceiveHandler(&floodingHandler);
+    stalledPort.Open(SerialPort::BAUD_115200);
+
+    PseudoTerminal otherTerminal;
+    SerialPort otherPort(otherTerminal.SlaveName());
+    CountingHandler countingHandler;
+    otherPort.SetReceiveHandler(&countingHandler);
+    otherPort.Open(SerialPort::BAUD_115200);
+
+    // The reply of the stalled port blocks SIGIO dispatch until the
+    // write gives up after the stall timeout of receive handlers. Data received by the other port meanwhile is
+    // delivered afterwards.
+    const unsigned char request = 0x01;
+    stalledTerminal.Write(&request, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const unsigned char data[] = { 'p', 'i', 'n', 'g' };
+    otherTerminal.Write(data, sizeof(data));
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (countingHandler.numOfBytes < sizeof(data) &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(sizeof(data), countingHandler.numOfBytes);
+    ASSERT_EQ(1, floodingHandler.numOfWriteErrors);
+    stalledPort.Close();
+    otherPort.Close();
+}
@@ -0,0 +1,460 @@
+/******************************************************************************
+ *   @file SlcanAdapterTest.cpp                                               *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU General Public License for more details.                             *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <SerialPort.h>
+#include <SlcanAdapter.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    /**
+     * @brief Plays the part of an SLCAN adapter on the master side of a
+     *        pseudo terminal. Commands are answered as a Lawicel adapter
+     *        would, and transmitted frames are recorded.
+     */
+    class SlcanSimulator
+    {
+    public:
+        SlcanSimulator()
+            : isOpen(false)
+            , isListenOnly(false)
+            , bitRate(-1)
+            , hasTimestamps(false)
+            , isStopping(false)
+            , thread(&SlcanSimulator::run, this)
+        {
+        }
+
+        ~SlcanSimulator()
+        {
+            isStopping = true;
+            thread.join();
+        }
+
+        const std::string& SlaveName() const
+        {
+            return terminal.SlaveName();
+        }
+
+        /**
+         * @brief Sends records as if they were received from the bus.
+         */
+        void Emit(const std::string& records)
+        {
+            terminal.Write(records.data(), records.size());
+        }
+
+        std::vector<std::string> TransmittedRecords()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return transmitted;
+        }
+
+        std::atomic<bool> isOpen;
+        std::atomic<bool> isListenOnly;
+        std::atomic<int>  bitRate;
+        std::atomic<bool> hasTimestamps;
+
+    private:
+        void run()
+        {
+            std::string line;
+            while (!isStopping)
+            {
+                pollfd pollFd = { terminal.MasterFileDescriptor(), POLLIN, 0 };
+                if (poll(&pollFd, 1, 10) <= 0)
+                {
+                    continue;
+                }
+                char buffer[4096];
+                const ssize_t size = read(terminal.MasterFileDescriptor(), buffer, sizeof(buffer));
+                std::string responses;
+                for (ssize_t i = 0; i < size; i++)
+                {
+                    if ('\r' != buffer[i])
+                    {
+                        line += buffer[i];
+                        continue;
+                    }
+                    responses += execute(line);
+                    line.clear();
+                }
+                if (!responses.empty())
+                {
+                    Emit(responses);
+                }
+            }
+        }
+
+        std::string execute(const std::string& command)
+        {
+            const std::string ok = "\r";
+            const std::string error = "\a";
+            const char type = command.empty() ? ' ' : command[0];
+            switch (type)
+            {
+            case 'S':
+                if (isOpen || command.size() != 2 || command[1] < '0' || command[1] > '8')
+                {
+                    return error;
+                }
+                bitRate = command[1] - '0';
+                return ok;
+            case 'O':
+            case 'L':
+                if (isOpen || bitRate < 0)
+                {
+                    return error;
+                }
+                isOpen = true;
+                isListenOnly = ('L' == type);
+                return ok;
+            case 'C':
+                if (!isOpen)
+                {
+                    return error;
+                }
+                isOpen = false;
+                return ok;
+            case 'Z':
+                if (isOpen)
+                {
+                    return error;
+                }
+                hasTimestamps = ('1' == command[1]);
+                return ok;
+            case 't':
+            case 'T':
+            case 'r':
+            case 'R':
+                if (!isOpen || isListenOnly)
+                {
+                    return error;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    transmitted.push_back(command);
+                }
+                return ('t' == type || 'r' == type) ? "z\r" : "Z\r";
+            default:
+                return error;
+            }
+        }
+
+        PseudoTerminal           terminal;
+        std::atomic<bool>        isStopping;
+        std::mutex               mutex;
+        std::vector<std::string> transmitted;
+        std::thread              thread;
+    };
+
+    CanFrame makeFrame(unsigned int id, unsigned char flags, const std::string& data)
+    {
+        CanFrame frame = CanFrame();
+        frame.mId = id;
+        frame.mFlags = flags;
+        frame.mLength = data.size();
+        memcpy(frame.mData, data.data(), data.size());
+        return frame;
+    }
+
+    /**
+     * @brief The record of a random frame with eight data bytes, as an
+     *        adapter sends it at full bus load.
+     */
+    std::string makeRandomRecord(std::mt19937& generator)
+    {
+        char record[32];
+        if (generator() & 1)
+        {
+            snprintf(record, sizeof(record), "T%08X8%08X%08X\r",
+                     static_cast<unsigned int>(generator() & 0x1FFFFFFF),
+                     static_cast<unsigned int>(generator()),
+                     static_cast<unsigned int>(generator()));
+        }
+        else
+        {
+            snprintf(record, sizeof(record), "t%03X8%08X%08X\r",
+                     static_cast<unsigned int>(generator() & 0x7FF),
+                     static_cast<unsigned int>(generator()),
+                     static_cast<unsigned int>(generator()));
+        }
+        return record;
+    }
+
+    /**
+     * @brief Parses a record the straightforward way, as received
+     *        through SerialPort::ReadLine().
+     */
+    bool parseLine(const std::string& line, CanFrame& frame)
+    {
+        if (line.size() < 6 || (line[0] != 't' && line[0] != 'T'))
+        {
+            return false;
+        }
+        const size_t idDigits = ('T' == line[0]) ? 8 : 3;
+        frame = CanFrame();
+        frame.mId = strtoul(line.substr(1, idDigits).c_str(), 0, 16);
+        frame.mLength = line[1 + idDigits] - '0';
+        for (unsigned int i = 0; i < frame.mLength; i++)
+        {
+            frame.mData[i] = strtoul(line.substr(2 + idDigits + 2 * i, 2).c_str(), 0, 16);
+        }
+        return true;
+    }
+}
+
+TEST(SlcanAdapterTest, testOpenAndClose)
+{
+    SlcanSimulator simulator;
+    SerialPort serialPort(simulator.SlaveName());
+    SlcanAdapter adapter(serialPort);
+    ASSERT_THROW(adapter.Open(SlcanAdapter::BIT_RATE_500K), SerialPort::NotOpen);
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    adapter.Open(SlcanAdapter::BIT_RATE_500K);
+    ASSERT_TRUE(simulator.isOpen);
+    ASSERT_FALSE(simulator.isListenOnly);
+    ASSERT_EQ(6, simulator.bitRate);
+
+    // The bit rate can be changed by opening again.
+    adapter.Open(SlcanAdapter::BIT_RATE_1M, true);
+    ASSERT_TRUE(simulator.isListenOnly);
+    ASSERT_EQ(8, simulator.bitRate);
+    ASSERT_THROW(adapter.SetAdapterTimestamps(true), std::runtime_error);
+
+    adapter.Close();
+    ASSERT_FALSE(simulator.isOpen);
+    ASSERT_THROW(adapter.Close(), std::runtime_error);
+    adapter.SetAdapterTimestamps(true);
+    ASSERT_TRUE(simulator.hasTimestamps);
+    ASSERT_EQ(3UL, adapter.GetStatistics().mNumOfErrorResponses);
+}
+
+TEST(SlcanAdapterTest, testReceiveFrames)
+{
+    SlcanSimulator simulator;
+    SerialPort serialPort(simulator.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+    SlcanAdapter adapter(serialPort);
+    CanFrame frames[16];
+    ASSERT_THROW(adapter.ReadFrames(frames, 16, 20), SerialPort::ReadTimeout);
+
+    // Malformed records are dropped up to their terminator without
+    // losing the records around them.
+    const std::string records =
+        "t1232ABCD\r"
+        "T1ABCDEF08DEADbeef01020304\r"
+        "x123\r"
+        "r7FF0\r"
+        "t8001\r"
+        "t12G0\r"
+        "R000000014\r"
+        "t0000EA60\r"
+        "t1002AB\r"
+        "t0011F11234\r";
+    // Byte by byte, so that every record is split.
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        simulator.Emit(records.substr(i, 1));
+    }
+
+    unsigned int numOfFrames = 0;
+    while (numOfFrames < 6)
+    {
+        numOfFrames += adapter.ReadFrames(frames + numOfFrames, 16 - numOfFrames, 1000);
+    }
+    ASSERT_EQ(0U, adapter.GetNumOfQueuedFrames());
+
+    ASSERT_EQ(0x123U, frames[0].mId);
+    ASSERT_EQ(0, frames[0].mFlags);
+    ASSERT_EQ(2, frames[0].mLength);
+    ASSERT_EQ(0xAB, frames[0].mData[0]);
+    ASSERT_EQ(0xCD, frames[0].mData[1]);
+    ASSERT_GT(frames[0].mTimestamp, 0ULL);
+
+    ASSERT_EQ(0x1ABCDEF0U, frames[1].mId);
+    ASSERT_EQ(CanFrame::EXTENDED_ID, frames[1].mFlags);
+    ASSERT_EQ(8, frames[1].mLength);
+    const unsigned char data[] = { 0xDE, 0xAD, 0xBE, 0xEF, 1, 2, 3, 4 };
+    ASSERT_EQ(0, memcmp(data, frames[1].mData, 8));
+
+    ASSERT_EQ(0x7FFU, frames[2].mId);
+    ASSERT_EQ(CanFrame::REMOTE, frames[2].mFlags);
+    ASSERT_EQ(0, frames[2].mLength);
+
+    ASSERT_EQ(1U, frames[3].mId);
+    ASSERT_EQ(CanFrame::EXTENDED_ID | CanFrame::REMOTE, frames[3].mFlags);
+    ASSERT_EQ(4, frames[3].mLength);
+
+    // Adapter timestamps.
+    ASSERT_EQ(0U, frames[4].mId);
+    ASSERT_EQ(CanFrame::ADAPTER_TIMESTAMP, frames[4].mFlags);
+    ASSERT_EQ(0, frames[4].mLength);
+    ASSERT_EQ(60000, frames[4].mAdapterTimestamp);
+
+    ASSERT_EQ(1U, frames[5].mId);
+    ASSERT_EQ(CanFrame::ADAPTER_TIMESTAMP, frames[5].mFlags);
+    ASSERT_EQ(1, frames[5].mLength);
+    ASSERT_EQ(0xF1, frames[5].mData[0]);
+    ASSERT_EQ(0x1234, frames[5].mAdapterTimestamp);
+
+    const SlcanAdapter::Statistics statistics = adapter.GetStatistics();
+    ASSERT_EQ(6UL, statistics.mNumOfReceivedFrames);
+    ASSERT_EQ(4UL, statistics.mNumOfMalformedRecords);
+    ASSERT_EQ(0UL, statistics.mNumOfOverruns);
+}
+
+TEST(SlcanAdapterTest, testWriteFrames)
+{
+    SlcanSimulator simulator;
+    SerialPort serialPort(simulator.SlaveName());
+    serialPort.Open(SerialPort::BAUD_115200);
+    SlcanAdapter adapter(serialPort);
+    adapter.Open(SlcanAdapter::BIT_RATE_250K);
+
+    std::vector<CanFrame> frames;
+    frames.push_back(makeFrame(0x123, 0, "\xAB\xCD"));
+    frames.push_back(makeFrame(0x1ABCDEF0, CanFrame::EXTENDED_ID, std::string("\xDE\xAD\x00\x01", 4)));
+    frames.push_back(makeFrame(0x7FF, CanFrame::REMOTE, ""));
+    frames.back().mLength = 3;
+    frames.push_back(makeFrame(0x1, CanFrame::EXTENDED_ID | CanFrame::REMOTE, ""));
+    // More frames than fit into one write.
+    for (unsigned int i = 0; i < 300; i++)
+    {
+        frames.push_back(makeFrame(i, 0, "01234567"));
+    }
+    adapter.WriteFrames(frames.data(), frames.size());
+
+    std::vector<std::string> records;
+    for (int i = 0; i < 200 && records.size() < frames.size(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        records = simulator.TransmittedRecords();
+    }
+    ASSERT_EQ(frames.size(), records.size());
+    ASSERT_EQ("t1232ABCD", records[0]);
+    ASSERT_EQ("T1ABCDEF04DEAD0001", records[1]);
+    ASSERT_EQ("r7FF3", records[2]);
+    ASSERT_EQ("R000000010", records[3]);
+    ASSERT_EQ("t12B83031323334353637", records[4 + 299]);
+    for (int i = 0; i < 200 && adapter.GetStatistics().mNumOfTransmitAcks < frames.size(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ASSERT_EQ(frames.size(), adapter.GetStatistics().mNumOfTransmittedFrames);
+    ASSERT_EQ(frames.size(), adapter.GetStatistics().mNumOfTransmitAcks);
+
+    // Invalid frames are refused before anything is written.
+    CanFrame invalid[] = { makeFrame(1, 0, ""), makeFrame(0x800, 0, "") };
+    ASSERT_THROW(adapter.WriteFrames(invalid, 2), std::invalid_argument);
+    invalid[1] = makeFrame(0x20000000, CanFrame::EXTENDED_ID, "");
+    ASSERT_THROW(adapter.WriteFrames(invalid, 2), std::invalid_argument);
+    invalid[1] = makeFrame(1, 0, "");
+    invalid[1].mLength = 9;
+    ASSERT_THROW(adapter.WriteFrames(invalid, 2), std::invalid_argument);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(frames.size(), simulator.TransmittedRecords().size());
+}
+
+TEST(SlcanAdapterTest, testReceiveThroughput)
+{
+    // Full bus load at 1 Mbit/s is about 8000 frames per second. The
+    // simulator sends as fast as the pseudo terminal allows.
+    const unsigned int numOfFrames = 100000;
+    std::mt19937 generator(1);
+    std::string records;
+    for (unsigned int i = 0; i < numOfFrames; i++)
+    {
+        records += makeRandomRecord(generator);
+    }
+
+    // Batched parsing into the frame queue.
+    double adapterSeconds = 0;
+    {
+        SlcanSimulator simulator;
+        SerialPort serialPort(simulator.SlaveName());
+        serialPort.Open(SerialPort::BAUD_115200);
+        SlcanAdapter adapter(serialPort, numOfFrames);
+        std::vector<CanFrame> frames(256);
+        unsigned int numOfReceivedFrames = 0;
+        unsigned long long idSum = 0;
+        const auto start = std::chrono::steady_clock::now();
+        std::thread sender([&]() { simulator.Emit(records); });
+        while (numOfReceivedFrames < numOfFrames)
+        {
+            const unsigned int count = adapter.ReadFrames(frames.data(), frames.size(), 5000);
+            for (unsigned int i = 0; i < count; i++)
+            {
+                idSum += frames[i].mId;
+            }
+            numOfReceivedFrames += count;
+        }
+        adapterSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sender.join();
+        ASSERT_EQ(numOfFrames, numOfReceivedFrames);
+        ASSERT_EQ(0UL, adapter.GetStatistics().mNumOfMalformedRecords);
+        ASSERT_EQ(0UL, adapter.GetStatistics().mNumOfOverruns);
+        ASSERT_GT(idSum, 0ULL);
+    }
+
+    // One ReadLine() string per record.
+    double lineSeconds = 0;
+    {
+        SlcanSimulator simulator;
+        SerialPort serialPort(simulator.SlaveName());
+        serialPort.Open(SerialPort::BAUD_115200);
+        unsigned int numOfReceivedFrames = 0;
+        const auto start = std::chrono::steady_clock::now();
+        std::thread sender([&]() { simulator.Emit(records); });
+        while (numOfReceivedFrames < numOfFrames)
+        {
+            CanFrame frame;
+            if (parseLine(serialPort.ReadLine(5000, '\r'), frame))
+            {
+                numOfReceivedFrames++;
+            }
+        }
+        lineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sender.join();
+    }
+
+    std::cout << "SLCAN receive of " << numOfFrames << " frames:" << std::endl
+              << "  SlcanAdapter: " << numOfFrames / adapterSeconds << " frames/s" << std::endl
+              << "  ReadLine:     " << numOfFrames / lineSeconds << " frames/s" << std::endl;
+}
@@ -0,0 +1,455 @@
+/******************************************************************************
+ *   @file TransformChainTest.cpp                                             *
+ *   @copyright (C) 2016 LibSerial Development Team                           *
+ *                                                                            *
+ *   This program is free software; you can redistribute it and/or modify     *
+ *   it under the terms of the GNU Lessser General Public License as          *
+ *   published by the Free Software Foundation; either version 2 of the       *
+ *   License, or (at your option) any later version.                          *
+ *                                                                            *
+ *   This program is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ *   GNU Lesser General Public License for more details.                      *
+ *                                                                            *
+ *   You should have received a copy of the GNU Lesser General Public         *
+ *   License along with this program; if not, write to the                   *
+ *   Free Software Foundation, Inc.,                                          *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.                *
+ *****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <pthread.h>
+#include <random>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SerialPort.h>
+#include <SerialPortReceiveHandler.h>
+#include <TransformChain.h>
+
+#include "PseudoTerminal.h"
+
+using namespace LibSerial;
+
+namespace
+{
+    std::vector<unsigned char> makeRandomData(size_t size, unsigned int seed)
+    {
+        std::mt19937 generator(seed);
+        std::vector<unsigned char> data(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = generator() & 0xFF;
+        }
+        return data;
+    }
+
+    std::vector<unsigned char> bytes(const std::string& text)
+    {
+        return std::vector<unsigned char>(text.begin(), text.end());
+    }
+
+    std::string text(const std::vector<unsigned char>& data)
+    {
+        return std::string(data.begin(), data.end());
+    }
+
+    unsigned char reverseReference(unsigned char value)
+    {
+        unsigned char reversed = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            reversed |= ((value >> bit) & 1) << (7 - bit);
+        }
+        return reversed;
+    }
+
+    /**
+     * @brief Applies the chain to the data in chunks of varying size, as
+     *        the SIGIO handler would.
+     */
+    std::vector<unsigned char> applyInChunks(TransformChain& chain,
+                                             const std::vector<unsigned char>& data,
+                                             unsigned int seed)
+    {
+        std::mt19937 generator(seed);
+        std::vector<unsigned char> output;
+        size_t position = 0;
+        while (position < data.size())
+        {
+            const size_t size = std::min<size_t>(generator() % 70 + 1, data.size() - position);
+            std::vector<unsigned char> chunk(chain.GetMaxOutputSize(size));
+            std::copy(data.begin() + position, data.begin() + position + size, chunk.begin());
+            const unsigned int outputSize = chain.Apply(chunk.data(), size, chunk.size());
+            output.insert(output.end(), chunk.begin(), chunk.begin() + outputSize);
+            position += size;
+        }
+        return output;
+    }
+
+    /**
+     * @brief Echoes received data from the SIGIO handler.
+     */
+    class EchoHandler : public SerialPortReceiveHandler
+    {
+    public:
+        explicit EchoHandler(SerialPort& serialPort)
+            : serialPort(serialPort)
+            , numOfBytes(0)
+        {
+        }
+
+        void HandleReceivedData(const unsigned char* data, const unsigned int size)
+        {
+            serialPort.Write(data, size);
+            numOfBytes += size;
+        }
+
+        SerialPort&                serialPort;
+        std::atomic<unsigned long> numOfBytes;
+    };
+}
+
+TEST(TransformChainTest, testStripParity)
+{
+    const std::vector<unsigned char> data = makeRandomData(1000, 1);
+    unsigned long numOfEvenErrors = 0;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        numOfEvenErrors += __builtin_parity(data[i]);
+    }
+
+    // Every length is checked so that both the vector and the scalar
+    // code paths are used.
+    for (unsigned int size = 0; size <= 100; size++)
+    {
+        TransformChain even;
+        even.AddStripParity(SerialPort::PARITY_EVEN);
+        TransformChain odd;
+        odd.AddStripParity(SerialPort::PARITY_ODD);
+        std::vector<unsigned char> evenData(data.begin(), data.begin() + size);
+        std::vector<unsigned char> oddData(evenData);
+        ASSERT_EQ(size, even.Apply(evenData.data(), size, size));
+        ASSERT_EQ(size, odd.Apply(oddData.data(), size, size));
+
+        unsigned long expectedErrors = 0;
+        for (unsigned int i = 0; i < size; i++)
+        {
+            ASSERT_EQ(data[i] & 0x7F, evenData[i]);
+            ASSERT_EQ(data[i] & 0x7F, oddData[i]);
+            expectedErrors += __builtin_parity(data[i]);
+        }
+        ASSERT_EQ(expectedErrors, even.GetNumOfParityErrors());
+        ASSERT_EQ(size - expectedErrors, odd.GetNumOfParityErrors());
+    }
+
+    TransformChain chain;
+    chain.AddStripParity();
+    std::vector<unsigned char> stripped(data);
+    chain.Apply(stripped.data(), stripped.size(), stripped.size());
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        ASSERT_EQ(data[i] & 0x7F, stripped[i]);
+    }
+    ASSERT_EQ(0UL, chain.GetNumOfParityErrors());
+    ASSERT_GT(numOfEvenErrors, 0UL);
+}
+
+TEST(TransformChainTest, testReverseBits)
+{
+    const std::vector<unsigned char> data = makeRandomData(259, 2);
+    TransformChain chain;
+    chain.AddReverseBits();
+    std::vector<unsigned char> reversed(data);
+    chain.Apply(reversed.data(), reversed.size(), reversed.size());
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        ASSERT_EQ(reverseReference(data[i]), reversed[i]);
+    }
+
+    // Reversing twice restores the data.
+    chain.Apply(reversed.data(), reversed.size(), reversed.size());
+    ASSERT_EQ(data, reversed);
+}
+
+TEST(TransformChainTest, testXorMaskAcrossChunks)
+{
+    const std::vector<unsigned char> data = makeRandomData(1000, 3);
+    const unsigned int keySizes[] = { 1, 3, 7, 16, 17, 100 };
+    for (size_t k = 0; k < sizeof(keySizes) / sizeof(keySizes[0]); k++)
+    {
+        const std::vector<unsigned char> key = makeRandomData(keySizes[k], 4);
+        TransformChain chain;
+        chain.AddXorMask(key.data(), key.size());
+        const std::vector<unsigned char> masked = applyInChunks(chain, data, k);
+
+        ASSERT_EQ(data.size(), masked.size());
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            ASSERT_EQ(data[i] ^ key[i % key.size()], masked[i]);
+        }
+
+        // After a reset the key starts over, so masking again restores
+        // the data.
+        chain.Reset();
+        ASSERT_EQ(data, applyInChunks(chain, masked, k + 1));
+    }
+    TransformChain chain;
+    ASSERT_THROW(chain.AddXorMask(data.data(), 0), std::invalid_argument);
+}
+
+TEST(TransformChainTest, testLineEndings)
+{
+    std::string input;
+    for (int i = 0; i < 40; i++)
+    {
+        input += "line " + std::to_string(i) + (i % 3 == 0 ? "\r\n" : (i % 3 == 1 ? "\r" : "\n"));
+    }
+    input += "\r\n\r\n\n\r\r";
+
+    TransformChain receive;
+    receive.AddCrLfToLf();
+    ASSERT_FALSE(receive.IsExpanding());
+    std::string expected;
+    for (int i = 0; i < 40; i++)
+    {
+        expected += "line " + std::to_string(i) + "\n";
+    }
+    expected += "\n\n\n\n\n";
+    // A CR at the end of one chunk and the LF at the start of the next
+    // still form a single line ending.
+    for (unsigned int seed = 0; seed < 20; seed++)
+    {
+        receive.Reset();
+        ASSERT_EQ(expected, text(applyInChunks(receive, bytes(input), seed)));
+    }
+
+    TransformChain transmit;
+    transmit.AddLfToCrLf();
+    ASSERT_TRUE(transmit.IsExpanding());
+    ASSERT_EQ(20U, transmit.GetMaxOutputSize(10));
+    expected.clear();
+    for (int i = 0; i < 40; i++)
+    {
+        expected += "line " + std::to_string(i) + (i % 3 == 1 ? "\r" : "\r\n");
+    }
+    expected += "\r\n\r\n\r\n\r\r";
+    for (unsigned int seed = 0; seed < 20; seed++)
+    {
+        transmit.Reset();
+        ASSERT_EQ(expected, text(applyInChunks(transmit, bytes(input), seed)));
+    }
+
+    std::vector<unsigned char> buffer = bytes("\n\n\n\n");
+    ASSERT_THROW(transmit.Apply(buffer.data(), 4, 7), std::invalid_argument);
+    buffer.resize(8);
+    transmit.Reset();
+    ASSERT_EQ(8U, transmit.Apply(buffer.data(), 4, 8));
+    ASSERT_EQ("\r\n\r\n\r\n\r\n", text(buffer));
+}
+
+TEST(TransformChainTest, testSerialPortTransforms)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+
+    // 7-bit data with even parity in bit 7 and CR LF line endings.
+    TransformChain receive;
+    receive.AddStripParity(SerialPort::PARITY_EVEN);
+    receive.AddCrLfToLf();
+    const unsigned char key[] = { 0x5A, 0xA5, 0x3C };
+    TransformChain transmit;
+    transmit.AddLfToCrLf();
+    transmit.AddXorMask(key, sizeof(key));
+
+    TransformChain expanding;
+    expanding.AddLfToCrLf();
+    ASSERT_THROW(serialPort.SetReceiveTransform(&expanding), std::invalid_argument);
+    serialPort.SetReceiveTransform(&receive);
+    serialPort.SetTransmitTransform(&transmit);
+    serialPort.Open(SerialPort::BAUD_115200);
+    ASSERT_THROW(serialPort.SetReceiveTransform(0), SerialPort::AlreadyOpen);
+    ASSERT_THROW(serialPort.SetTransmitTransform(0), SerialPort::AlreadyOpen);
+
+    std::string line = "HELLO\r\nWORLD\r\n";
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        if (__builtin_parity(static_cast<unsigned char>(line[i])))
+        {
+            line[i] |= 0x80;
+        }
+    }
+    line[1] ^= 0x80;
+    pseudoTerminal.Write(line.data(), line.size());
+    ASSERT_EQ("HELLO\n", serialPort.ReadLine(1000));
+    ASSERT_EQ("WORLD\n", serialPort.ReadLine(1000));
+    ASSERT_EQ(1UL, receive.GetNumOfParityErrors());
+
+    // The caller's buffer is left unchanged.
+    const SerialPort::DataBuffer message = { 'o', 'k', '\n' };
+    serialPort.Write(message);
+    serialPort.Write(message);
+    ASSERT_EQ('o', message[0]);
+    unsigned char received[8];
+    ASSERT_EQ(8U, pseudoTerminal.Read(received, 8));
+    const std::string expected = "ok\r\nok\r\n";
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(static_cast<unsigned char>(expected[i]) ^ key[i % sizeof(key)], received[i]);
+    }
+    serialPort.Close();
+}
+
+TEST(TransformChainTest, testAttachedChainIsFrozen)
+{
+    TransformChain receive;
+    receive.AddStripParity();
+    TransformChain transmit;
+    {
+        PseudoTerminal pseudoTerminal;
+        SerialPort serialPort(pseudoTerminal.SlaveName());
+        serialPort.SetReceiveTransform(&receive);
+        serialPort.SetTransmitTransform(&transmit);
+        ASSERT_TRUE(receive.IsAttached());
+        ASSERT_TRUE(transmit.IsAttached());
+
+        // An attached receive chain cannot become expanding or change
+        // under the SIGIO handler.
+        ASSERT_THROW(receive.AddLfToCrLf(), std::logic_error);
+        ASSERT_THROW(receive.Clear(), std::logic_error);
+        ASSERT_THROW(transmit.AddReverseBits(), std::logic_error);
+        ASSERT_THROW(receive.Reset(), std::logic_error);
+        ASSERT_EQ(1U, receive.GetNumOfTransforms());
+
+        // A chain carries the state of one stream, so it cannot serve
+        // both directions or a second port. Setting the same chain again
+        // changes nothing.
+        PseudoTerminal otherTerminal;
+        SerialPort otherPort(otherTerminal.SlaveName());
+        ASSERT_THROW(serialPort.SetTransmitTransform(&receive), std::logic_error);
+        ASSERT_THROW(otherPort.SetReceiveTransform(&receive), std::logic_error);
+        ASSERT_THROW(otherPort.SetTransmitTransform(&transmit), std::logic_error);
+        ASSERT_EQ(0, otherPort.GetReceiveTransform());
+        serialPort.SetReceiveTransform(&receive);
+        ASSERT_TRUE(receive.IsAttached());
+
+        // Detaching a chain unfreezes it.
+        serialPort.SetTransmitTransform(0);
+        ASSERT_FALSE(transmit.IsAttached());
+        transmit.AddReverseBits();
+
+        serialPort.Open(SerialPort::BAUD_115200);
+        const std::string line = "DATA\n";
+        pseudoTerminal.Write(line.data(), line.size());
+        ASSERT_EQ(line, serialPort.ReadLine(1000));
+        serialPort.Close();
+    }
+
+    // Destroying the port detaches the chain.
+    ASSERT_FALSE(receive.IsAttached());
+    receive.Reset();
+    receive.Clear();
+}
+
+TEST(TransformChainTest, testTransmitTransformFromReceiveHandler)
+{
+    PseudoTerminal pseudoTerminal;
+    SerialPort serialPort(pseudoTerminal.SlaveName());
+    TransformChain transmit;
+    transmit.AddReverseBits();
+    serialPort.SetTransmitTransform(&transmit);
+    EchoHandler echo(serialPort);
+    serialPort.SetReceiveHandler(&echo);
+    serialPort.Open(SerialPort::BAUD_115200);
+
+    // Writes larger than a transform chunk come out whole.
+    const std::vector<unsigned char> data = makeRandomData(10000, 7);
+    serialPort.Write(data.data(), data.size());
+    std::vector<unsigned char> received(data.size());
+    ASSERT_EQ(data.size(), pseudoTerminal.Read(received.data(), received.size()));
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        ASSERT_EQ(reverseReference(data[i]), received[i]);
+    }
+
+    // Only this thread takes SIGIO, so the echo keeps interrupting the
+    // writes below while they transform data.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGIO);
+    pthread_sigmask(SIG_BLOCK, &signals, 0);
+    std::atomic<bool> isStopping(false);
+    std::thread feeder([&]()
+    {
+        const unsigned char byte = 0x11;
+        while (!isStopping)
+        {
+            pseudoTerminal.Write(&byte, 1);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    std::thread drainer([&]()
+    {
+        unsigned char buffer[4096];
+        while (!isStopping)
+        {
+            pseudoTerminal.Read(buffer, sizeof(buffer), 10);
+        }
+    });
+    pthread_sigmask(SIG_UNBLOCK, &signals, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    while (echo.numOfBytes < 200 ||
+           std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200))
+    {
+        serialPort.Write(data.data(), data.size());
+    }
+    isStopping = true;
+    feeder.join();
+    drainer.join();
+    serialPort.Close();
+}
+
+TEST(TransformChainTest, testThroughput)
+{
+    const unsigned int size = 1 << 20;
+    const std::vector<unsigned char> data = makeRandomData(size, 5);
+    const unsigned char key[] = { 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<unsigned char> buffer(2 * size);
+
+    const char* names[] = { "strip parity", "CR LF to LF", "LF to CR LF", "reverse bits", "XOR mask" };
+    for (int transform = 0; transform < 5; transform++)
+    {
+        TransformChain chain;
+        switch (transform)
+        {
+        case 0: chain.AddStripParity(SerialPort::PARITY_ODD); break;
+        case 1: chain.AddCrLfToLf(); break;
+        case 2: chain.AddLfToCrLf(); break;
+        case 3: chain.AddReverseBits(); break;
+        case 4: chain.AddXorMask(key, sizeof(key)); break;
+        }
+        // Transform the data in chunks of the size the SIGIO handler
+        // reads.
+        const int repetitions = 20;
+        const auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++)
+        {
+            std::copy(data.begin(), data.end(), buffer.begin());
+            for (unsigned int i = 0; i < size; i += 1024)
+            {
+                chain.Apply(buffer.data() + i, 1024, chain.GetMaxOutputSize(1024));
+            }
+        }
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << names[transform] << ": "
+                  << repetitions * size / seconds / 1e6 << " MB/s" << std::endl;
+    }
+}